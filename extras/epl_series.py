@@ -0,0 +1,88 @@
+#!/usr/bin/env python
+#
+# precision and cost of the truncated angular series of the `epl` lenses
+#
+# usage: epl_series.py [PREC]
+#
+# For a grid of axis ratios q and slopes t, the angular part of the deflection
+# is computed with the number of terms that `objects/epl.cl` chooses for the
+# given relative precision PREC (default: the value of EPL_PREC), with the
+# fixed ten terms that were used before, and with a reference series of high
+# order. The table lists the number of terms and the maximum error relative to
+# the leading term for both truncations. The cost of a deflection is dominated
+# by the series, so that the number of terms is a good measure of speed.
+#
+
+import sys
+import cmath
+import math
+
+# must match EPL_TERMS and EPL_PREC in objects/epl.cl
+EPL_TERMS = 64
+EPL_PREC = 1e-7
+
+# number of terms of reference series
+REF_TERMS = 2000
+
+# number of polar angles per quadrant
+NPHI = 64
+
+
+def coefficients(q, t, prec, nmax):
+    '''coefficients of angular series, truncated as in objects/epl.cl'''
+    f = (1 - q)/(1 + q)
+    c = []
+    A = 1
+    while len(c) < nmax and A*f > prec*(1 - f):
+        n = len(c) + 1
+        c.append(-f*(2*n - 2 + t)/(2*n + 2 - t))
+        A *= abs(c[-1])
+    return c
+
+
+def series(c, phi):
+    '''sum angular series with given coefficients at polar angle phi'''
+    A = a = cmath.exp(1j*phi)
+    R = cmath.exp(2j*phi)
+    for ci in c:
+        A = ci*R*A
+        a += A
+    return a
+
+
+def main(argv):
+    if len(argv) > 2:
+        sys.exit('usage: epl_series.py [PREC]')
+
+    prec = float(argv[1]) if len(argv) > 1 else EPL_PREC
+
+    qs = [0.1, 0.2, 0.3, 0.4, 0.5, 0.6, 0.7, 0.8, 0.9, 0.95, 0.99, 1.0]
+    ts = [0.2, 0.6, 1.0, 1.4, 1.8]
+    phis = [0.5*math.pi*(i + 0.5)/NPHI for i in range(NPHI)]
+
+    print('%5s %5s %6s %10s %10s' % ('q', 't', 'terms', 'error', 'error(10)'))
+
+    total, total10 = 0, 0
+    for q in qs:
+        for t in ts:
+            ref = coefficients(q, t, 0, REF_TERMS)
+            ada = coefficients(q, t, prec, EPL_TERMS)
+            ten = coefficients(q, t, 0, 10)
+
+            err = err10 = 0
+            for phi in phis:
+                a = series(ref, phi)
+                err = max(err, abs(series(ada, phi) - a))
+                err10 = max(err10, abs(series(ten, phi) - a))
+
+            print('%5.2f %5.2f %6d %10.2e %10.2e' % (q, t, len(ada), err, err10))
+
+            total += len(ada)
+            total10 += len(ten)
+
+    n = len(qs)*len(ts)
+    print('mean number of terms: %.1f (fixed: %.1f)' % (total/float(n), total10/float(n)))
+
+
+if __name__ == '__main__':
+    main(sys.argv)
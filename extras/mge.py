@@ -0,0 +1,184 @@
+#!/usr/bin/env python
+#
+# create a Lensed source from a multi-Gaussian expansion of a radial profile
+#
+# usage: mge.py NAME FILE [RMIN RMAX]
+#
+# FILE contains two columns: the radius and the surface brightness at that
+# radius, with arbitrary normalisation. The profile is fitted with a fixed
+# number of concentric Gaussians, which are written as an object file
+# `objects/NAME.cl` that can be used like any other source. The integral of
+# the expansion over pixels is computed analytically, so that the object is
+# cheap when it is not lensed, e.g. to model the light of a lens galaxy.
+#
+# The optional RMIN and RMAX give the range of radii that is fitted, and
+# default to the range of radii in FILE.
+#
+# This script requires numpy and scipy.
+#
+
+import sys
+import os
+import math
+
+import numpy as np
+from scipy.optimize import nnls, least_squares
+
+# must match MGE_SIZE in kernel/mge.cl
+MGE_SIZE = 14
+
+TEMPLATE = '''\
+// multi-Gaussian expansion generated by extras/mge.py from {file}
+
+type = SOURCE;
+
+params
+{{
+    {{ "x",   POSITION_X }},
+    {{ "y",   POSITION_Y }},
+    {{ "r",   RADIUS     }},
+    {{ "mag", MAGNITUDE  }},
+    {{ "q",   AXIS_RATIO }},
+    {{ "pa",  POS_ANGLE  }}
+}};
+
+data
+{{
+    struct mge g;   // multi-Gaussian expansion
+}};
+
+#if MGE_SIZE != {size}
+#error "{name}: expansion size does not match, please regenerate object"
+#endif
+
+// luminosity fractions of Gaussians
+constant float mge_{name}_l[MGE_SIZE] = {{
+{lums}
+}};
+
+// standard deviations of Gaussians for unit radius
+constant float mge_{name}_s[MGE_SIZE] = {{
+{sigs}
+}};
+
+static float brightness(local data* this, float2 x)
+{{
+    return mge_eval(&this->g, x);
+}}
+
+static float integral(local data* this, float2 x0, float2 x1)
+{{
+    return mge_integral(&this->g, x0, x1);
+}}
+
+static void set(local data* this, float x, float y, float r, float mag, float q, float pa)
+{{
+    float c = cos(pa*DEG2RAD);
+    float s = sin(pa*DEG2RAD);
+    
+    // total luminosity
+    float l = exp(-0.4f*mag*LOG_10);
+    
+    // position and transformation matrix: rotate and scale
+    mge_init(&this->g, (float2)(x, y), (mat22)(q*c, q*s, -s, c)/sqrt(q));
+    
+    // scale Gaussians
+    for(int i = 0; i < MGE_SIZE; ++i)
+        mge_set(&this->g, i, l*mge_{name}_l[i], r*mge_{name}_s[i]);
+}}
+'''
+
+
+def usage():
+    sys.exit('usage: mge.py NAME FILE [RMIN RMAX]')
+
+
+def read_profile(filename):
+    '''read positive radii and profile values from file'''
+    prof = []
+    with open(filename) as f:
+        for line in f:
+            line = line.split('#')[0].split()
+            if len(line) < 2:
+                continue
+            r, v = float(line[0]), float(line[1])
+            if r > 0 and v > 0:
+                prof.append((r, v))
+    prof.sort()
+    if len(prof) < MGE_SIZE:
+        sys.exit('%s: need at least %d points with positive values' % (filename, MGE_SIZE))
+    return np.array(prof).T
+
+
+def main(argv):
+    if len(argv) not in (3, 5):
+        usage()
+
+    name, filename = argv[1:3]
+
+    # name is used as identifier in kernel code
+    if not name.replace('_', 'a').isalnum() or name[0].isdigit():
+        sys.exit('invalid object name: %s' % name)
+
+    # read profile and restrict to range
+    r, v = read_profile(filename)
+    if len(argv) == 5:
+        rmin, rmax = float(argv[3]), float(argv[4])
+    else:
+        rmin, rmax = r[0], r[-1]
+    if not 0 < rmin < rmax:
+        sys.exit('invalid range for expansion')
+    sel = (r >= rmin) & (r <= rmax)
+    r, v = r[sel], v[sel]
+
+    # logarithmically spaced widths that cover the range of radii
+    s = np.geomspace(0.5*rmin, rmax, MGE_SIZE)
+
+    # surface brightness at half-light radius, used as reference for errors
+    lum = np.concatenate([[0], np.cumsum(np.diff(r)*math.pi*(r[1:]*v[1:] + r[:-1]*v[:-1]))])
+    vref = np.interp(0.5*lum[-1], lum, v)
+
+    # fit luminosities of Gaussians with fixed widths, minimising the
+    # relative error down to a fraction of the reference value and the
+    # absolute error below
+    w = 1/(v + 1e-3*vref)
+    g = np.exp(-0.5*(r[:, None]/s)**2)/(2*math.pi*s**2)
+    l, _ = nnls(g*w[:, None], v*w, maxiter=100*MGE_SIZE*len(r))
+
+    # refine luminosities and widths together
+    def resid(p):
+        l, s = np.exp(p[:MGE_SIZE]), np.exp(p[MGE_SIZE:])
+        return (np.exp(-0.5*(r[:, None]/s)**2)/(2*math.pi*s**2)).dot(l)*w - v*w
+    p = np.concatenate([np.log(np.maximum(l, 1e-6*l.max())), np.log(s)])
+    lo = np.concatenate([np.full(MGE_SIZE, -np.inf), np.full(MGE_SIZE, math.log(0.1*rmin))])
+    hi = np.concatenate([np.full(MGE_SIZE, np.inf), np.full(MGE_SIZE, math.log(10*rmax))])
+    p = least_squares(resid, np.clip(p, lo, hi), bounds=(lo, hi), max_nfev=10000).x
+    l, s = np.exp(p[:MGE_SIZE]), np.exp(p[MGE_SIZE:])
+    g = np.exp(-0.5*(r[:, None]/s)**2)/(2*math.pi*s**2)
+
+    # report accuracy of fit
+    err = (np.abs(g.dot(l) - v)/np.maximum(v, 1e-2*vref)).max()
+    print('maximum relative error of expansion: %.2g' % err)
+
+    # normalise to unit luminosity
+    if not l.sum() > 0:
+        sys.exit('could not fit profile')
+    l /= l.sum()
+
+    lums = ',\n'.join('    %.8ef' % x for x in l)
+    sigs = ',\n'.join('    %.8ef' % x for x in s)
+
+    code = TEMPLATE.format(file=os.path.basename(filename), name=name,
+                           size=MGE_SIZE, lums=lums, sigs=sigs)
+
+    # write object to objects folder next to this script
+    objdir = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'objects')
+    objfile = os.path.join(objdir, name + '.cl')
+    with open(objfile, 'w') as f:
+        f.write(code)
+
+    print('created %s' % os.path.normpath(objfile))
+
+
+if __name__ == '__main__':
+    main(sys.argv)
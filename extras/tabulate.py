@@ -0,0 +1,236 @@
+#!/usr/bin/env python
+#
+# create a Lensed object from a tabulated radial profile
+#
+# usage: tabulate.py (lens|source) NAME FILE [RMIN RMAX]
+#
+# FILE contains two columns: the radius and the profile value at that radius.
+# For a lens, the profile is the deflection angle of a circular mass
+# distribution with unit scale radius. For a source, it is the surface
+# brightness with arbitrary normalisation. The profile is resampled in
+# log-log space onto the nodes of a table, which is written as an object file
+# `objects/NAME.cl` that can be used like any other object.
+#
+# The optional RMIN and RMAX give the range of the table, and default to the
+# range of radii in FILE. Below RMIN, the profile is constant. Beyond RMAX,
+# the profile is extrapolated as a power law.
+#
+
+import sys
+import os
+import math
+
+# must match TABLE_SIZE in kernel/table.cl
+TABLE_SIZE = 64
+
+LENS_TEMPLATE = '''\
+// tabulated lens generated by extras/tabulate.py from {file}
+
+type = LENS;
+
+params
+{{
+    {{ "x", POSITION_X              }},
+    {{ "y", POSITION_Y              }},
+    {{ "r", RADIUS                  }},
+    {{ "f", PARAMETER, POS_BOUND    }}
+}};
+
+data
+{{
+    float2 x;       // lens position
+    float lr;       // log of scale radius
+    struct table a; // log of deflection over radius
+}};
+
+#if TABLE_SIZE != {size}
+#error "{name}: table size does not match, please regenerate object"
+#endif
+
+// log of deflection over radius at log-radius nodes
+constant float table_{name}[TABLE_SIZE] = {{
+{values}
+}};
+
+static float2 deflection(local data* this, float2 x)
+{{
+    // central coordinates
+    x -= this->x;
+    
+    // deflection over radius from table of log-radius
+    return fm_exp(table_eval(&this->a, 0.5f*fm_log(dot(x, x)) - this->lr))*x;
+}}
+
+static void set(local data* this, float x, float y, float r, float f)
+{{
+    // lens position
+    this->x = (float2)(x, y);
+    
+    // log of scale radius
+    this->lr = log(r);
+    
+    // copy and scale table
+    table_init(&this->a, {lmin}f, {lmax}f);
+    for(int i = 0; i < TABLE_SIZE; ++i)
+        this->a.y[i] = table_{name}[i] + log(f);
+    
+    // derivatives for interpolation
+    table_slopes(&this->a);
+}}
+'''
+
+SOURCE_TEMPLATE = '''\
+// tabulated source generated by extras/tabulate.py from {file}
+
+type = SOURCE;
+
+params
+{{
+    {{ "x",   POSITION_X }},
+    {{ "y",   POSITION_Y }},
+    {{ "r",   RADIUS     }},
+    {{ "mag", MAGNITUDE  }},
+    {{ "q",   AXIS_RATIO }},
+    {{ "pa",  POS_ANGLE  }}
+}};
+
+data
+{{
+    float2 x;       // source position
+    mat22 t;        // coordinate transformation matrix
+    float lr;       // log of scale radius
+    struct table s; // log of surface brightness
+}};
+
+#if TABLE_SIZE != {size}
+#error "{name}: table size does not match, please regenerate object"
+#endif
+
+// log of surface brightness at log-radius nodes, for unit luminosity
+constant float table_{name}[TABLE_SIZE] = {{
+{values}
+}};
+
+static float brightness(local data* this, float2 x)
+{{
+    float2 y = mv22(this->t, x - this->x);
+    return fm_exp(table_eval(&this->s, 0.5f*fm_log(dot(y, y)) - this->lr));
+}}
+
+static void set(local data* this, float x, float y, float r, float mag, float q, float pa)
+{{
+    float c = cos(pa*DEG2RAD);
+    float s = sin(pa*DEG2RAD);
+    
+    // source position
+    this->x = (float2)(x, y);
+    
+    // transformation matrix: rotate and scale
+    this->t = (mat22)(q*c, q*s, -s, c)/sqrt(q);
+    
+    // log of scale radius
+    this->lr = log(r);
+    
+    // copy and normalise table
+    table_init(&this->s, {lmin}f, {lmax}f);
+    for(int i = 0; i < TABLE_SIZE; ++i)
+        this->s.y[i] = table_{name}[i] - 0.4f*mag*LOG_10 - 2*this->lr;
+    
+    // derivatives for interpolation
+    table_slopes(&this->s);
+}}
+'''
+
+
+def usage():
+    sys.exit('usage: tabulate.py (lens|source) NAME FILE [RMIN RMAX]')
+
+
+def read_profile(filename):
+    '''read positive radii and profile values from file'''
+    prof = []
+    with open(filename) as f:
+        for line in f:
+            line = line.split('#')[0].split()
+            if len(line) < 2:
+                continue
+            r, v = float(line[0]), float(line[1])
+            if r > 0 and v > 0:
+                prof.append((math.log(r), math.log(v)))
+    prof.sort()
+    if len(prof) < 2:
+        sys.exit('%s: need at least two points with positive values' % filename)
+    return prof
+
+
+def resample(prof, l):
+    '''linear interpolation in log-log space, extrapolating at the ends'''
+    i = 1
+    while i < len(prof) - 1 and prof[i][0] < l:
+        i += 1
+    (l0, v0), (l1, v1) = prof[i-1], prof[i]
+    return v0 + (v1 - v0)*(l - l0)/(l1 - l0)
+
+
+def main(argv):
+    if len(argv) not in (4, 6) or argv[1] not in ('lens', 'source'):
+        usage()
+
+    kind, name, filename = argv[1:4]
+
+    # name is used as identifier in kernel code
+    if not name.replace('_', 'a').isalnum() or name[0].isdigit():
+        sys.exit('invalid object name: %s' % name)
+
+    # read profile and get range of table
+    prof = read_profile(filename)
+    if len(argv) == 6:
+        lmin, lmax = math.log(float(argv[4])), math.log(float(argv[5]))
+    else:
+        lmin, lmax = prof[0][0], prof[-1][0]
+    if not lmin < lmax:
+        sys.exit('invalid range for table')
+
+    # nodes and log-values of table
+    h = (lmax - lmin)/(TABLE_SIZE - 1)
+    nodes = [lmin + i*h for i in range(TABLE_SIZE)]
+    table = [resample(prof, l) for l in nodes]
+
+    if kind == 'lens':
+        # deflection over radius
+        table = [v - l for l, v in zip(nodes, table)]
+        template = LENS_TEMPLATE
+    else:
+        # total luminosity: constant disc inside first node, trapezoidal rule
+        # between nodes, and power law beyond the last node
+        f = [math.exp(2*l + v) for l, v in zip(nodes, table)]
+        lum = 0.5*f[0] + 0.5*h*sum(a + b for a, b in zip(f[:-1], f[1:]))
+        slope = (table[-1] - table[-2])/h
+        if slope < -2:
+            lum -= f[-1]/(2 + slope)
+        else:
+            sys.stderr.write('warning: profile does not converge, '
+                             'luminosity truncated at RMAX\n')
+        lum *= 2*math.pi
+
+        # normalise to unit luminosity
+        table = [v - math.log(lum) for v in table]
+        template = SOURCE_TEMPLATE
+
+    values = ',\n'.join('    %.8ef' % v for v in table)
+
+    code = template.format(file=os.path.basename(filename), name=name,
+                           size=TABLE_SIZE, values=values,
+                           lmin='%.8e' % lmin, lmax='%.8e' % lmax)
+
+    # write object to objects folder next to this script
+    objdir = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'objects')
+    objfile = os.path.join(objdir, name + '.cl')
+    with open(objfile, 'w') as f:
+        f.write(code)
+
+    print('created %s' % os.path.normpath(objfile))
+
+
+if __name__ == '__main__':
+    main(sys.argv)
@@ -0,0 +1,224 @@
+//-----------
+// fast math
+//-----------
+
+// exact math functions are used by default
+#ifndef FAST_MATH
+#define FAST_MATH 0
+#endif
+
+// The following functions approximate the built-in math functions using
+// polynomials and bit manipulation only, without branches. The maximum errors
+// are for float arithmetic and given in units of the float epsilon (ulp).
+// Arguments are assumed to be finite, and results are not correct for
+// denormal numbers, which are flushed to zero in Lensed.
+
+// polynomial for 2^x on [-1/2, 1/2], relative error 7.7e-8 in exact arithmetic
+#define FAST_EXP2_C0 1.0000000711e+00f
+#define FAST_EXP2_C1 6.9314694907e-01f
+#define FAST_EXP2_C2 2.4022121576e-01f
+#define FAST_EXP2_C3 5.5507426754e-02f
+#define FAST_EXP2_C4 9.6754694002e-03f
+#define FAST_EXP2_C5 1.3266979930e-03f
+
+// odd polynomial for atan(x) on [0, tan(pi/8)], relative error 2.0e-8
+#define FAST_ATAN_C1  9.9999999151e-01f
+#define FAST_ATAN_C3 -3.3332895079e-01f
+#define FAST_ATAN_C5  1.9976697639e-01f
+#define FAST_ATAN_C7 -1.3870363929e-01f
+#define FAST_ATAN_C9  8.0356993512e-02f
+
+// constants for argument reduction
+#define FAST_LOG2E     1.4426950408889634074f
+#define FAST_LN2       0.6931471805599453094f
+#define FAST_SQRT2     1.4142135623730950488f
+#define FAST_TAN_PI_8  0.4142135623730950488f
+#define FAST_2_PI      0.6366197723675813431f
+#define FAST_LN2_HI    0.693145751953125f
+#define FAST_LN2_LO    1.428606765330187045e-06f
+#define FAST_PI_2      1.5707963267948966192f
+#define FAST_PI_2_A    1.5703125f
+#define FAST_PI_2_B    4.837512969970703125e-04f
+#define FAST_PI_2_C    7.549789954891882e-08f
+
+// base-2 exponential, max. error 3 ulp, arguments clamped to [-126, 126]
+static float fast_exp2(float x)
+{
+    // clamp to range of normal numbers
+    x = clamp(x, -126.0f, 126.0f);
+    
+    // split into integral and fractional part
+    float n = rint(x);
+    float f = x - n;
+    
+    // polynomial for fractional part
+    float p = FAST_EXP2_C5;
+    p = mad(p, f, FAST_EXP2_C4);
+    p = mad(p, f, FAST_EXP2_C3);
+    p = mad(p, f, FAST_EXP2_C2);
+    p = mad(p, f, FAST_EXP2_C1);
+    p = mad(p, f, FAST_EXP2_C0);
+    
+    // scale by integral part using the exponent bits
+    return p*as_float(((int)n + 127) << 23);
+}
+
+// base-2 logarithm for positive arguments, max. error 2 ulp or 2e-7 absolute
+static float fast_log2(float x)
+{
+    // split into exponent and mantissa in [1, 2)
+    int i = as_int(x);
+    float e = ((i >> 23) & 0xff) - 127;
+    float m = as_float((i & 0x007fffff) | 0x3f800000);
+    
+    // move mantissa to [sqrt(1/2), sqrt(2))
+    int b = m > FAST_SQRT2;
+    m = b ? 0.5f*m : m;
+    e = b ? e + 1 : e;
+    
+    // log(m) = 2 atanh(s) as a series in s = (m - 1)/(m + 1), |s| < 0.172
+    float s = (m - 1)/(m + 1);
+    float s2 = s*s;
+    float p = 1.0f/9;
+    p = mad(p, s2, 1.0f/7);
+    p = mad(p, s2, 1.0f/5);
+    p = mad(p, s2, 1.0f/3);
+    p = mad(p, s2, 1.0f);
+    
+    return mad(2*FAST_LOG2E*s, p, e);
+}
+
+// natural exponential, max. error 3 ulp, arguments clamped to [-87, 87]
+static float fast_exp(float x)
+{
+    // clamp to range of normal numbers
+    x = clamp(x, -87.0f, 87.0f);
+    
+    // reduce to [-ln(2)/2, ln(2)/2] in two steps to keep the low bits of x
+    float n = rint(FAST_LOG2E*x);
+    float r = mad(-n, FAST_LN2_HI, x);
+    r = mad(-n, FAST_LN2_LO, r);
+    
+    return fast_exp2(FAST_LOG2E*r)*as_float(((int)n + 127) << 23);
+}
+
+// natural logarithm, max. error 2 ulp or 2e-7 absolute
+static float fast_log(float x)
+{
+    return FAST_LN2*fast_log2(x);
+}
+
+// power for non-negative base, error of exp2 and log2 amplified by |y log2(x)|
+static float fast_powr(float x, float y)
+{
+    return fast_exp2(y*fast_log2(x));
+}
+
+// arc tangent, max. error 3 ulp
+static float fast_atan(float x)
+{
+    float a = fabs(x);
+    
+    // reduce to [0, 1] using atan(x) = pi/2 - atan(1/x)
+    int inv = a > 1;
+    a = inv ? 1/a : a;
+    
+    // reduce to [-tan(pi/8), tan(pi/8)] using atan(x) = pi/4 + atan((x-1)/(x+1))
+    int mid = a > FAST_TAN_PI_8;
+    a = mid ? (a - 1)/(a + 1) : a;
+    
+    // odd polynomial
+    float a2 = a*a;
+    float p = FAST_ATAN_C9;
+    p = mad(p, a2, FAST_ATAN_C7);
+    p = mad(p, a2, FAST_ATAN_C5);
+    p = mad(p, a2, FAST_ATAN_C3);
+    p = mad(p, a2, FAST_ATAN_C1);
+    p *= a;
+    
+    // undo reductions
+    p = mid ? p + 0.5f*FAST_PI_2 : p;
+    p = inv ? FAST_PI_2 - p : p;
+    
+    return copysign(p, x);
+}
+
+// arc tangent of y/x in the correct quadrant, max. error 4 ulp
+static float fast_atan2(float y, float x)
+{
+    // angle in the right half-plane
+    float a = fast_atan(y/x);
+    
+    // move to left half-plane if necessary, and zero at the origin
+    a = x < 0 ? a + copysign(2*FAST_PI_2, y) : a;
+    return (x == 0 && y == 0) ? 0 : a;
+}
+
+// inverse hyperbolic tangent for |x| < 1, max. error 6 ulp
+static float fast_atanh(float x)
+{
+    // series for small arguments, same as for logarithm
+    float x2 = x*x;
+    float p = 1.0f/9;
+    p = mad(p, x2, 1.0f/7);
+    p = mad(p, x2, 1.0f/5);
+    p = mad(p, x2, 1.0f/3);
+    p = mad(p, x2, 1.0f);
+    
+    // logarithm for large arguments
+    return fabs(x) < 0.17f ? x*p : 0.5f*fast_log((1 + x)/(1 - x));
+}
+
+// sine and cosine for |x| < 1e4, max. error 2 ulp or 2e-7 absolute
+static float fast_sincos(float x, float* c)
+{
+    // reduce to [-pi/4, pi/4] and get quadrant
+    float k = rint(FAST_2_PI*x);
+    float r = mad(-k, FAST_PI_2_A, x);
+    r = mad(-k, FAST_PI_2_B, r);
+    r = mad(-k, FAST_PI_2_C, r);
+    int q = (int)k & 3;
+    
+    // Taylor series for sine and cosine
+    float r2 = r*r;
+    float s = -1.0f/362880;
+    s = mad(s, r2, 1.0f/5040);
+    s = mad(s, r2, -1.0f/120);
+    s = mad(s, r2, 1.0f/6);
+    s = mad(-s, r2*r, r);
+    float t = 1.0f/3628800;
+    t = mad(t, r2, -1.0f/40320);
+    t = mad(t, r2, 1.0f/720);
+    t = mad(t, r2, -1.0f/24);
+    t = mad(t, r2, 0.5f);
+    t = mad(-t, r2, 1.0f);
+    
+    // rotate into quadrant
+    float sn = (q & 1) ? t : s;
+    float cs = (q & 1) ? s : t;
+    *c = ((q + 1) & 2) ? -cs : cs;
+    return (q & 2) ? -sn : sn;
+}
+
+// select exact or fast variants for objects
+#if FAST_MATH
+#define fm_exp      fast_exp
+#define fm_exp2     fast_exp2
+#define fm_log      fast_log
+#define fm_log2     fast_log2
+#define fm_powr     fast_powr
+#define fm_atan     fast_atan
+#define fm_atan2    fast_atan2
+#define fm_atanh    fast_atanh
+#define fm_sincos   fast_sincos
+#else
+#define fm_exp      exp
+#define fm_exp2     exp2
+#define fm_log      log
+#define fm_log2     log2
+#define fm_powr     powr
+#define fm_atan     atan
+#define fm_atan2    atan2
+#define fm_atanh    atanh
+#define fm_sincos   sincos
+#endif
@@ -0,0 +1,63 @@
+// interpolated deflection field is disabled by default
+#ifndef DEFLECTION_FIELD
+#define DEFLECTION_FIELD 0
+#endif
+
+// layout of the header of the deflection field buffer
+enum
+{
+    FIELD_ORIGIN = 0,
+    FIELD_SPACING,
+    FIELD_INVERSE,
+    FIELD_DIMS,
+    FIELD_HEAD
+};
+
+// weights of the Catmull-Rom spline for the four nodes around t
+static float4 catmull_rom(float t)
+{
+    float t2 = t*t;
+    float t3 = t2*t;
+    
+    return 0.5f*(float4)(-t3 + 2*t2 - t,
+                         3*t3 - 5*t2 + 2,
+                         -3*t3 + 4*t2 + t,
+                         t3 - t2);
+}
+
+// bicubic interpolation of the deflection field at position x
+static float2 deflection_field(global const float2* field, float2 x)
+{
+    // dimensions of the grid
+    int nx = field[FIELD_DIMS].x;
+    int ny = field[FIELD_DIMS].y;
+    
+    // position in units of grid spacing
+    float2 u = (x - field[FIELD_ORIGIN])*field[FIELD_INVERSE];
+    
+    // grid cell, leaving room for the stencil
+    int i = min(max((int)floor(u.x), 1), nx - 3);
+    int j = min(max((int)floor(u.y), 1), ny - 3);
+    
+    // position within cell
+    float2 t = u - (float2)(i, j);
+    
+    // interpolation weights along each axis
+    float4 wx = catmull_rom(t.x);
+    float4 wy = catmull_rom(t.y);
+    
+    // first node of the stencil, grid starts after header
+    global const float2* g = field + FIELD_HEAD + (j - 1)*nx + (i - 1);
+    
+    // interpolate rows, then columns
+    float2 a = 0;
+    a += wy.s0*(wx.s0*g[0] + wx.s1*g[1] + wx.s2*g[2] + wx.s3*g[3]);
+    g += nx;
+    a += wy.s1*(wx.s0*g[0] + wx.s1*g[1] + wx.s2*g[2] + wx.s3*g[3]);
+    g += nx;
+    a += wy.s2*(wx.s0*g[0] + wx.s1*g[1] + wx.s2*g[2] + wx.s3*g[3]);
+    g += nx;
+    a += wy.s3*(wx.s0*g[0] + wx.s1*g[1] + wx.s2*g[2] + wx.s3*g[3]);
+    
+    return a;
+}
@@ -5,31 +5,68 @@
 #define clampi(x, minval, maxval) min(max(x, minval), maxval)
 #endif
 
-// compute image
+// the image is a single band, unless several bands are stacked vertically,
+// each with margins of rows above and below
+#ifndef BANDS
+#define BANDS 1
+#endif
+#ifndef BAND_MARGIN
+#define BAND_MARGIN 0
+#endif
+
+// rows of a band, including its margins
+#define BAND_ROWS (IMAGE_HEIGHT/BANDS)
+
+// object data of the band of image row j, and the row within the band
+#if BANDS > 1
+#define band_data(data, dsiz, j) ((data) + ((j)/BAND_ROWS)*((dsiz)/BANDS))
+#define band_row(j) ((int)((j)%BAND_ROWS) - BAND_MARGIN)
+#else
+#define band_data(data, dsiz, j) (data)
+#define band_row(j) (j)
+#endif
+
+// compute image, with work items arranged in tiles of pixels, for the rows
+// from the global offset up to jend
 kernel void render(ulong dsiz, constant uint* gdata, local uint* ldata,
-                   float4 pcs, constant float2* qq, constant float2* ww,
-                   global float* value, global float* error)
+                   global const float2* field, float4 pcs,
+                   constant float2* qq, constant float2* ww,
+                   global float* value, global float* error, ulong jend)
 {
-    // get pixel index
-    size_t k = get_global_id(0);
+    // get pixel indices
+    size_t i = get_global_id(0);
+    size_t j = get_global_id(1);
+    
+    // flat local index and size of work group
+    size_t l = get_local_id(1)*get_local_size(0) + get_local_id(0);
+    size_t m = get_local_size(0)*get_local_size(1);
     
     // load data from global to local memory
-    for(size_t i = get_local_id(0); i < dsiz; i += get_local_size(0))
-        ldata[i] = gdata[i];
+    for(size_t n = l; n < dsiz; n += m)
+        ldata[n] = gdata[n];
     barrier(CLK_LOCAL_MEM_FENCE);
     
-    // compute pixel flux if pixel is in image
-    if(k < IMAGE_SIZE)
+    // compute pixel flux if pixel is in rows
+    if(i < IMAGE_WIDTH && j < jend)
     {
+        // index of pixel in row-major image
+        size_t k = j*IMAGE_WIDTH + i;
+        
+        // object data of band
+        local uint* bdata = band_data(ldata, dsiz, j);
+        
         // pixel position
-        float2 x = pcs.xy + pcs.zw*(float2)(k%IMAGE_WIDTH, k/IMAGE_WIDTH);
+        float2 x = pcs.xy + pcs.zw*(float2)(i, band_row(j));
         
         // value and error of quadrature
         float2 f = 0;
         
         // apply quadrature rule to computed surface brightness
         for(size_t n = 0; n < QUAD_POINTS; ++n)
-            f += ww[n]*compute(ldata, x + qq[n]);
+            f += ww[n]*compute(bdata, field, x + qq[n]);
+        
+        // add mean of profiles that are integrated exactly over pixel
+        f.s0 += integral(bdata, x - 0.5f*pcs.zw, x + 0.5f*pcs.zw)/(pcs.z*pcs.w);
         
         // done
         value[k] = f.s0;
@@ -37,6 +74,278 @@ kernel void render(ulong dsiz, constant uint* gdata, local uint* ldata,
     }
 }
 
+// compute image with each work item computing a run of RENDER_RUN adjacent
+// pixels in a row, where the inner loop over pixels can be vectorised by CPU
+// compilers
+kernel void render_run(ulong dsiz, constant uint* gdata, local uint* ldata,
+                       global const float2* field, float4 pcs,
+                       constant float2* qq, constant float2* ww,
+                       global float* value, global float* error, ulong jend)
+{
+    // get indices of first pixel of run
+    size_t i = get_global_id(0)*RENDER_RUN;
+    size_t j = get_global_id(1);
+    
+    // flat local index and size of work group
+    size_t l = get_local_id(1)*get_local_size(0) + get_local_id(0);
+    size_t m = get_local_size(0)*get_local_size(1);
+    
+    // load data from global to local memory
+    for(size_t n = l; n < dsiz; n += m)
+        ldata[n] = gdata[n];
+    barrier(CLK_LOCAL_MEM_FENCE);
+    
+    // compute pixel fluxes if run starts in rows
+    if(i < IMAGE_WIDTH && j < jend)
+    {
+        // object data of band
+        local uint* bdata = band_data(ldata, dsiz, j);
+        
+        // pixel positions, and value and error of quadrature
+        float2 x[RENDER_RUN];
+        float2 f[RENDER_RUN];
+        for(int p = 0; p < RENDER_RUN; ++p)
+        {
+            x[p] = pcs.xy + pcs.zw*(float2)(i + p, band_row(j));
+            f[p] = 0;
+        }
+        
+        // apply quadrature rule to all pixels of run at once
+        for(size_t n = 0; n < QUAD_POINTS; ++n)
+        {
+            float2 q = qq[n];
+            float2 w = ww[n];
+            for(int p = 0; p < RENDER_RUN; ++p)
+                f[p] += w*compute(bdata, field, x[p] + q);
+        }
+        
+        // store pixels of run that are in image
+        for(int p = 0; p < RENDER_RUN && i + p < IMAGE_WIDTH; ++p)
+        {
+            // add mean of profiles that are integrated exactly over pixel
+            f[p].s0 += integral(bdata, x[p] - 0.5f*pcs.zw, x[p] + 0.5f*pcs.zw)/(pcs.z*pcs.w);
+            
+            // done
+            value[j*IMAGE_WIDTH + i + p] = f[p].s0;
+            error[j*IMAGE_WIDTH + i + p] = f[p].s1;
+        }
+    }
+}
+
+// compute image with one work group per pixel and one work item per node,
+// the local size must be a power of two and one in the second dimension
+kernel void render_nodes(ulong dsiz, constant uint* gdata, local uint* ldata,
+                         global const float2* field, float4 pcs,
+                         constant float2* qq, constant float2* ww,
+                         global float* value, global float* error,
+                         local float2* lsum)
+{
+    // get pixel indices from group, and node index from work item; the row
+    // is the global index, which includes the offset, as groups are one high
+    size_t i = get_group_id(0);
+    size_t j = get_global_id(1);
+    size_t l = get_local_id(0);
+    size_t m = get_local_size(0);
+    
+    // index of pixel in row-major image
+    size_t k = j*IMAGE_WIDTH + i;
+    
+    // object data of band
+    local uint* bdata = band_data(ldata, dsiz, j);
+    
+    // load data from global to local memory
+    for(size_t n = l; n < dsiz; n += m)
+        ldata[n] = gdata[n];
+    barrier(CLK_LOCAL_MEM_FENCE);
+    
+    // pixel position
+    float2 x = pcs.xy + pcs.zw*(float2)(i, band_row(j));
+    
+    // value and error of quadrature for nodes of this work item
+    float2 f = 0;
+    for(size_t n = l; n < QUAD_POINTS; n += m)
+        f += ww[n]*compute(bdata, field, x + qq[n]);
+    
+    // sum over work items by pairwise reduction
+    lsum[l] = f;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for(size_t s = m/2; s > 0; s /= 2)
+    {
+        if(l < s)
+            lsum[l] += lsum[l + s];
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+    
+    // first work item writes pixel
+    if(l == 0)
+    {
+        f = lsum[0];
+        
+        // add mean of profiles that are integrated exactly over pixel
+        f.s0 += integral(bdata, x - 0.5f*pcs.zw, x + 0.5f*pcs.zw)/(pcs.z*pcs.w);
+        
+        // done
+        value[k] = f.s0;
+        error[k] = f.s1;
+    }
+}
+
+// compute image as the render kernel, with partial updates: rays are traced
+// and stored for every quadrature point unless the stage keeps the lenses,
+// and the light of sources is computed and stored unless the stage keeps the
+// sources, so that only the objects that changed are computed again
+kernel void render_partial(ulong dsiz, constant uint* gdata, local uint* ldata,
+                           global const float2* field, float4 pcs,
+                           constant float2* qq, constant float2* ww,
+                           global float* value, global float* error, ulong jend,
+                           global float2* rays, global float2* light, ulong stage)
+{
+    // get pixel indices
+    size_t i = get_global_id(0);
+    size_t j = get_global_id(1);
+    
+    // flat local index and size of work group
+    size_t l = get_local_id(1)*get_local_size(0) + get_local_id(0);
+    size_t m = get_local_size(0)*get_local_size(1);
+    
+    // load data from global to local memory
+    for(size_t n = l; n < dsiz; n += m)
+        ldata[n] = gdata[n];
+    barrier(CLK_LOCAL_MEM_FENCE);
+    
+    // compute pixel flux if pixel is in rows
+    if(i < IMAGE_WIDTH && j < jend)
+    {
+        // index of pixel in row-major image
+        size_t k = j*IMAGE_WIDTH + i;
+        
+        // object data of band
+        local uint* bdata = band_data(ldata, dsiz, j);
+        
+        // pixel position
+        float2 x = pcs.xy + pcs.zw*(float2)(i, band_row(j));
+        
+        // value and error of quadrature
+        float2 f;
+        
+        // light of sources, computed or cached
+        if(stage < PARTIAL_FOREGROUNDS)
+        {
+            f = 0;
+            for(size_t n = 0; n < QUAD_POINTS; ++n)
+                f += ww[n]*compute_sources(bdata, field, x + qq[n], rays + k*QUAD_POINTS + n, stage < PARTIAL_SOURCES);
+            f.s0 += integral_sources(bdata, x - 0.5f*pcs.zw, x + 0.5f*pcs.zw)/(pcs.z*pcs.w);
+            light[k] = f;
+        }
+        else
+        {
+            f = light[k];
+        }
+        
+        // add light of foregrounds
+        for(size_t n = 0; n < QUAD_POINTS; ++n)
+            f += ww[n]*compute_foregrounds(bdata, x + qq[n]);
+        f.s0 += integral_foregrounds(bdata, x - 0.5f*pcs.zw, x + 0.5f*pcs.zw)/(pcs.z*pcs.w);
+        
+        // done
+        value[k] = f.s0;
+        error[k] = f.s1;
+    }
+}
+
+#if DEFLECTION_FIELD
+// compute deflection of first lens plane on grid, with lenses in tables
+// culled and expanded for the nodes of each work group
+kernel void field_grid(ulong dsiz, constant uint* gdata, local uint* ldata,
+                       global float2* field, global const uint* lenses,
+                       float cull, float theta)
+{
+    // chunks of lenses in tables
+    local uint scratch[LENS_SCRATCH];
+    local uchar keep[LENS_CHUNK];
+    
+    // get node index
+    size_t k = get_global_id(0);
+    
+    // dimensions of the grid
+    size_t nx = field[FIELD_DIMS].x;
+    size_t ny = field[FIELD_DIMS].y;
+    
+    // first and last node of the work group
+    size_t k0 = k - get_local_id(0);
+    size_t k1 = min(k0 + get_local_size(0), nx*ny) - 1;
+    
+    // box that contains the nodes of the work group, with whole rows if the
+    // group spans more than one row
+    float2 x0 = field[FIELD_ORIGIN] + field[FIELD_SPACING]*(float2)(k1/nx > k0/nx ? 0 : k0%nx, k0/nx);
+    float2 x1 = field[FIELD_ORIGIN] + field[FIELD_SPACING]*(float2)(k1/nx > k0/nx ? nx - 1 : k1%nx, k1/nx);
+    
+    // node position
+    float2 x = field[FIELD_ORIGIN] + field[FIELD_SPACING]*(float2)(k%nx, k/nx);
+    
+    // deflection of lenses in tables, computed by the whole work group
+    float2 a = deflection_lenses(lenses, cull, theta, x0, x1, scratch, keep, x);
+    
+    // load data from global to local memory
+    for(size_t i = get_local_id(0); i < dsiz; i += get_local_size(0))
+        ldata[i] = gdata[i];
+    barrier(CLK_LOCAL_MEM_FENCE);
+    
+    // store deflection after header if node is in grid
+    if(k < nx*ny)
+        field[FIELD_HEAD + k] = a + deflection_plane(ldata, x);
+}
+
+// compare interpolated and direct deflection at test points
+kernel void field_check(ulong dsiz, constant uint* gdata, local uint* ldata,
+                        global const float2* field, global const uint* lenses,
+                        ulong npts, constant float2* points,
+                        global float* error)
+{
+    // chunks of lenses in tables
+    local uint scratch[LENS_SCRATCH];
+    local uchar keep[LENS_CHUNK];
+    
+    // get point index
+    size_t k = get_global_id(0);
+    
+    // test point, which is repeated for work items beyond the points
+    float2 x = points[min(k, (size_t)(npts - 1))];
+    
+    // deflection of lenses in tables, without culling or expansion
+    float2 a = deflection_lenses(lenses, 0, 0, x, x, scratch, keep, x);
+    
+    // load data from global to local memory
+    for(size_t i = get_local_id(0); i < dsiz; i += get_local_size(0))
+        ldata[i] = gdata[i];
+    barrier(CLK_LOCAL_MEM_FENCE);
+    
+    // absolute error of interpolation at point
+    if(k < npts)
+        error[k] = length(deflection_field(field, x) - a - deflection_plane(ldata, x));
+}
+
+// compare deflection of lenses in tables from multipole trees and from
+// direct summation at test points, with one work item per group
+kernel void multipole_check(global const uint* lenses, float theta,
+                            constant float2* points, global float* error)
+{
+    // chunks of lenses in tables
+    local uint scratch[LENS_SCRATCH];
+    local uchar keep[LENS_CHUNK];
+    
+    // get point index
+    size_t k = get_global_id(0);
+    
+    // deflection with and without expansion
+    float2 a = deflection_lenses(lenses, 0, theta, points[k], points[k], scratch, keep, points[k]);
+    float2 b = deflection_lenses(lenses, 0, 0, points[k], points[k], scratch, keep, points[k]);
+    
+    // absolute error of expansion at point
+    error[k] = length(a - b);
+}
+#endif
+
 // calculate log-likelihood of computed model
 kernel void loglike(global const float* image, global const float* weight,
                     global const float* model, global float* loglike)
@@ -52,6 +361,39 @@ kernel void loglike(global const float* image, global const float* weight,
     }
 }
 
+// compute chi^2 value for correlated noise: the residuals, in units of the
+// standard deviation of their pixels, are whitened before they are squared
+kernel void loglike_noise(global const float* image, global const float* weight,
+                          global const float* model, global float* loglike,
+                          global const float* white, ulong ww, ulong wh)
+{
+    // get pixel index
+    int k = get_global_id(0);
+    
+    // compute chi^2 value if pixel is in image
+    if(k < IMAGE_SIZE)
+    {
+        int x = k%IMAGE_WIDTH;
+        int y = k/IMAGE_WIDTH;
+        int rx = ww/2;
+        int ry = wh/2;
+        
+        // whitened residual, masked pixels and pixels outside the image do
+        // not contribute
+        float e = 0;
+        for(int j = max(y - ry, 0); j <= min(y + ry, IMAGE_HEIGHT-1); ++j)
+        {
+            for(int i = max(x - rx, 0); i <= min(x + rx, IMAGE_WIDTH-1); ++i)
+            {
+                int l = mad24(j, IMAGE_WIDTH, i);
+                e += white[mad24(j - y + ry, (int)ww, i - x + rx)]*sqrt(weight[l])*(model[l] - image[l]);
+            }
+        }
+        
+        loglike[k] = weight[k] > 0 ? e*e : 0;
+    }
+}
+
 // convolve input with PSF
 kernel void convolve(global float* input, constant float* psf,
                      local float* input2, local float* psf2,
@@ -74,8 +416,8 @@ kernel void convolve(global float* input, constant float* psf,
     int cw = PSF_WIDTH/2 + lw + PSF_WIDTH/2;
     int ch = PSF_HEIGHT/2 + lh + PSF_HEIGHT/2;
     int cs = cw*ch;
-    int cx = mad24((int)get_group_id(0), lw, -PSF_WIDTH/2);
-    int cy = mad24((int)get_group_id(1), lh, -PSF_HEIGHT/2);
+    int cx = gi - li - PSF_WIDTH/2;
+    int cy = gj - lj - PSF_HEIGHT/2;
     
     // fill cache
     for(i = mad24(lj, lw, li); i < cs; i += ls)
@@ -92,12 +434,666 @@ kernel void convolve(global float* input, constant float* psf,
         // convolved value for pixel 
         float x = 0;
         
+#if BANDS > 1
+        // a group can span two bands, so the PSF of the band of the pixel
+        // is read from constant memory
+        constant float* bpsf = psf + (gj/BAND_ROWS)*PSF_WIDTH*PSF_HEIGHT;
+        
+        // convolve
+        for(j = 0; j < PSF_HEIGHT; ++j)
+            for(i = 0; i < PSF_WIDTH; ++i)
+                x += bpsf[mad24(j, PSF_WIDTH, i)]*input2[mad24(lj + PSF_HEIGHT - j - 1, cw, li + PSF_WIDTH - i - 1)];
+#else
         // convolve
         for(j = 0; j < PSF_HEIGHT; ++j)
             for(i = 0; i < PSF_WIDTH; ++i)
                 x += psf2[mad24(j, PSF_WIDTH, i)]*input2[mad24(lj + PSF_HEIGHT - j - 1, cw, li + PSF_WIDTH - i - 1)];
+#endif
         
         // store convolved value
         output[mad24(gj, IMAGE_WIDTH, gi)] = x;
     }
 }
+
+// simulate objects on the blocks of a binned image, with a single point at
+// the centre of each block
+kernel void binned_render(ulong dsiz, constant uint* gdata, local uint* ldata,
+                          global const float2* field, float4 pcs, ulong bin,
+                          ulong bw, ulong bh, global float* model)
+{
+    // get block indices
+    size_t i = get_global_id(0);
+    size_t j = get_global_id(1);
+    
+    // flat local index and size of work group
+    size_t l = get_local_id(1)*get_local_size(0) + get_local_id(0);
+    size_t m = get_local_size(0)*get_local_size(1);
+    
+    // load data from global to local memory
+    for(size_t n = l; n < dsiz; n += m)
+        ldata[n] = gdata[n];
+    barrier(CLK_LOCAL_MEM_FENCE);
+    
+    // compute block flux if block is in binned image
+    if(i < bw && j < bh)
+    {
+        // number of pixels along the side of a block
+        float b = bin;
+        
+        // position of block centre, and size of block
+        float2 x = pcs.xy + pcs.zw*((float2)(i, j)*b + 0.5f*(b - 1));
+        float2 d = b*pcs.zw;
+        
+        // mean surface brightness of block from its centre, plus the mean of
+        // profiles that are integrated exactly over the block
+        float f = compute(ldata, field, x) + integral(ldata, x - 0.5f*d, x + 0.5f*d)/(d.x*d.y);
+        
+        // binned image is the sum over the pixels of the block
+        model[j*bw + i] = b*b*f;
+    }
+}
+
+// compare binned model, convolved with the binned PSF if given, with the
+// binned image
+kernel void binned_loglike(global const float* model, global const float* psf,
+                           ulong pw, ulong ph, ulong bw, ulong bh,
+                           global const float* image, global const float* weight,
+                           global float* loglike)
+{
+    // get block indices
+    int i = get_global_id(0);
+    int j = get_global_id(1);
+    
+    // size of binned image and half size of binned PSF, which has odd size
+    int w = bw;
+    int h = bh;
+    int hw = pw/2;
+    int hh = ph/2;
+    
+    // compute chi^2 value if block is in binned image
+    if(i < w && j < h)
+    {
+        // convolved value for block
+        float x = 0;
+        
+        // convolve with binned PSF if given, clamping at the edges
+        if(pw > 0)
+        {
+            for(int v = 0; v < 2*hh + 1; ++v)
+            {
+                int r = clampi(j + hh - v, 0, h - 1);
+                for(int u = 0; u < 2*hw + 1; ++u)
+                    x += psf[v*(2*hw + 1) + u]*model[r*w + clampi(i + hw - u, 0, w - 1)];
+            }
+        }
+        else
+        {
+            x = model[j*w + i];
+        }
+        
+        // chi^2 value of block
+        x -= image[j*w + i];
+        loglike[j*w + i] = weight[j*w + i]*x*x;
+    }
+}
+
+// compute the pixels of a list with the quadrature rule, which are the pixels
+// that represent the cells of a binned image
+kernel void render_cells(ulong dsiz, constant uint* gdata, local uint* ldata,
+                         global const float2* field, float4 pcs,
+                         constant float2* qq, constant float2* ww,
+                         ulong npix, global const uint* pixels,
+                         global float* value)
+{
+    // get list index
+    size_t n = get_global_id(0);
+    
+    // load data from global to local memory
+    for(size_t i = get_local_id(0); i < dsiz; i += get_local_size(0))
+        ldata[i] = gdata[i];
+    barrier(CLK_LOCAL_MEM_FENCE);
+    
+    // compute pixel flux if index is in list
+    if(n < npix)
+    {
+        // index of pixel in row-major image
+        size_t k = pixels[n];
+        
+        // pixel position
+        float2 x = pcs.xy + pcs.zw*(float2)(k%IMAGE_WIDTH, k/IMAGE_WIDTH);
+        
+        // value and error of quadrature
+        float2 f = 0;
+        
+        // apply quadrature rule to computed surface brightness
+        for(size_t q = 0; q < QUAD_POINTS; ++q)
+            f += ww[q]*compute(ldata, field, x + qq[q]);
+        
+        // add mean of profiles that are integrated exactly over pixel
+        f.s0 += integral(ldata, x - 0.5f*pcs.zw, x + 0.5f*pcs.zw)/(pcs.z*pcs.w);
+        
+        // done
+        value[k] = f.s0;
+    }
+}
+
+// copy the value of the representative pixel of each cell to its pixels
+kernel void fill_cells(global const uint* rep, global float* value)
+{
+    // get pixel index
+    size_t k = get_global_id(0);
+    
+    // representative pixels keep their value
+    if(k < IMAGE_SIZE && rep[k] != k)
+        value[k] = value[rep[k]];
+}
+
+// calculate chi^2 values of cells from the summed model of their pixels
+kernel void loglike_cells(ulong ncells, global const uint* start,
+                          global const uint* pixels, global const float* image,
+                          global const float* weight, global const float* model,
+                          global float* loglike)
+{
+    // get cell index
+    size_t c = get_global_id(0);
+    
+    // compute chi^2 value if cell exists
+    if(c < ncells)
+    {
+        float d = 0;
+        for(uint n = start[c]; n < start[c + 1]; ++n)
+            d += model[pixels[n]];
+        d -= image[c];
+        loglike[c] = weight[c]*d*d;
+    }
+}
+
+// turn models for linear amplitudes into the basis images and the data that
+// is not explained by them; the first model has all amplitudes at one, and
+// each following model has one of the amplitudes at two
+kernel void linear_basis(ulong nvec, global const float* image,
+                         global float* models)
+{
+    // get pixel index
+    size_t k = get_global_id(0);
+    
+    // compute basis if pixel is in image
+    if(k < IMAGE_SIZE)
+    {
+        // model with unit amplitudes
+        float r = models[k];
+        
+        // data minus model without any amplitudes
+        float d = image[k] - r;
+        
+        // basis image is the difference to the unit model
+        for(size_t j = 1; j < nvec; ++j)
+        {
+            float b = models[j*IMAGE_SIZE + k] - r;
+            models[j*IMAGE_SIZE + k] = b;
+            d += b;
+        }
+        
+        // data comes first
+        models[k] = d;
+    }
+}
+
+// weighted products of data and basis images, summed along image rows
+kernel void linear_gram(ulong nvec, global const float* models,
+                        global const float* weight, global float* gram)
+{
+    // get pair of vectors and row
+    size_t p = get_global_id(0);
+    size_t r = get_global_id(1);
+    
+    // vectors of pair
+    size_t a = p/nvec;
+    size_t b = p%nvec;
+    
+    // the product is symmetric, compute upper triangle
+    if(a <= b && a < nvec && r < IMAGE_HEIGHT)
+    {
+        float s = 0;
+        for(size_t i = 0; i < IMAGE_WIDTH; ++i)
+        {
+            size_t k = r*IMAGE_WIDTH + i;
+            s += weight[k]*models[a*IMAGE_SIZE + k]*models[b*IMAGE_SIZE + k];
+        }
+        gram[p*IMAGE_HEIGHT + r] = s;
+    }
+}
+
+// chi^2 values of the residuals of data and basis images for the given
+// amplitudes, summed along image rows
+kernel void linear_resid(ulong nvec, global const float* models,
+                         global const float* weight, constant float* fit,
+                         global float* resid)
+{
+    // get row
+    size_t r = get_global_id(0);
+    
+    if(r < IMAGE_HEIGHT)
+    {
+        float s = 0;
+        for(size_t i = 0; i < IMAGE_WIDTH; ++i)
+        {
+            size_t k = r*IMAGE_WIDTH + i;
+            
+            // residual is formed for each pixel before it is squared
+            float d = models[k];
+            for(size_t j = 1; j < nvec; ++j)
+                d -= fit[j-1]*models[j*IMAGE_SIZE + k];
+            
+            s += weight[k]*d*d;
+        }
+        resid[r] = s;
+    }
+}
+
+// trace the quadrature nodes of all pixels to the first source plane, and
+// find the cells of the grid of source pixels that contain them
+kernel void pixels_trace(ulong dsiz, constant uint* gdata, local uint* ldata,
+                         global const float2* field, float4 pcs,
+                         constant float2* qq, float4 grid, ulong n,
+                         global int* cell, global float2* frac,
+                         global int* count)
+{
+    // get pixel index
+    size_t k = get_global_id(0);
+    
+    // number of cells along each side of the grid
+    int nc = n - 1;
+    
+    // load data from global to local memory
+    for(size_t i = get_local_id(0); i < dsiz; i += get_local_size(0))
+        ldata[i] = gdata[i];
+    barrier(CLK_LOCAL_MEM_FENCE);
+    
+    // trace nodes if pixel is in image
+    if(k < IMAGE_SIZE)
+    {
+        // pixel position
+        float2 x = pcs.xy + pcs.zw*(float2)(k%IMAGE_WIDTH, k/IMAGE_WIDTH);
+        
+        for(size_t q = 0; q < QUAD_POINTS; ++q)
+        {
+            // index of node
+            size_t m = k*QUAD_POINTS + q;
+            
+            // ray position
+            float2 y = x + qq[q];
+            
+            // deflection of first lens plane
+#if DEFLECTION_FIELD
+            float2 a = deflection_field(field, y);
+#else
+            float2 a = deflection_plane(ldata, y);
+#endif
+            
+            // apply deflection to ray, if finite
+            y -= dot(a, a) < HUGE_VALF ? a : (float2)(1E10f, 1E10f);
+            
+            // position on grid in units of the spacing
+            y = (y - grid.xy)/grid.zw;
+            
+            // cell containing the node, if any, and position within cell
+            if(y.x >= 0 && y.y >= 0 && y.x < nc && y.y < nc)
+            {
+                int ci = y.x;
+                int cj = y.y;
+                cell[m] = cj*nc + ci;
+                frac[m] = y - (float2)(ci, cj);
+                atomic_inc(&count[cell[m]]);
+            }
+            else
+            {
+                cell[m] = -1;
+            }
+        }
+    }
+}
+
+// turn the number of nodes in each cell into the start of its list, and
+// reset the numbers for the next sample
+kernel void pixels_scan(ulong ncells, global int* count, global int* start,
+                        global int* fill, local int* tmp)
+{
+    size_t l = get_local_id(0);
+    size_t m = get_local_size(0);
+    
+    // a single work group, where every work item scans a run of cells
+    size_t run = (ncells + m - 1)/m;
+    size_t c0 = min(l*run, (size_t)ncells);
+    size_t c1 = min(c0 + run, (size_t)ncells);
+    
+    // count of nodes in the run of the work item
+    int s = 0;
+    for(size_t c = c0; c < c1; ++c)
+        s += count[c];
+    
+    // inclusive scan of the runs over work items
+    tmp[l] = s;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for(size_t h = 1; h < m; h *= 2)
+    {
+        int t = l >= h ? tmp[l - h] : 0;
+        barrier(CLK_LOCAL_MEM_FENCE);
+        tmp[l] += t;
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+    
+    // start of every cell of the run, whose count is reset
+    s = tmp[l] - s;
+    for(size_t c = c0; c < c1; ++c)
+    {
+        start[c] = s;
+        fill[c] = s;
+        s += count[c];
+        count[c] = 0;
+    }
+    
+    if(l == m - 1)
+        start[ncells] = tmp[l];
+}
+
+// list the nodes of each cell
+kernel void pixels_sort(global const int* cell, global int* fill,
+                        global int* nodes)
+{
+    // get node index
+    size_t m = get_global_id(0);
+    
+    // add node to list of its cell
+    if(m < IMAGE_SIZE*QUAD_POINTS && cell[m] >= 0)
+        nodes[atomic_inc(&fill[cell[m]])] = m;
+}
+
+// map source pixels to the image, by bilinear interpolation at the nodes
+kernel void pixels_map(ulong n, global const int* cell,
+                       global const float2* frac, constant float2* ww,
+                       global const float* src, global float* output)
+{
+    // get pixel index
+    size_t k = get_global_id(0);
+    
+    // number of cells along each side of the grid
+    int nc = n - 1;
+    
+    // apply quadrature rule to interpolated source
+    if(k < IMAGE_SIZE)
+    {
+        float f = 0;
+        
+        for(size_t q = 0; q < QUAD_POINTS; ++q)
+        {
+            size_t m = k*QUAD_POINTS + q;
+            int c = cell[m];
+            
+            if(c >= 0)
+            {
+                // lower left source pixel of cell
+                global const float* s = src + (c/nc)*n + c%nc;
+                
+                float2 u = frac[m];
+                
+                f += ww[q].s0*((1 - u.x)*(1 - u.y)*s[0] + u.x*(1 - u.y)*s[1]
+                             + (1 - u.x)*u.y*s[n] + u.x*u.y*s[n + 1]);
+            }
+        }
+        
+        output[k] = f;
+    }
+}
+
+// convolve with PSF, with zero outside the image, or apply the transpose of
+// the convolution to the weighted input
+kernel void pixels_convolve(ulong adjoint, global const float* input,
+                            constant float* psf, global const float* weight,
+                            global float* output)
+{
+    // get pixel indices
+    int gi = get_global_id(0);
+    int gj = get_global_id(1);
+    
+    // check if pixel is in image
+    if(gi < IMAGE_WIDTH && gj < IMAGE_HEIGHT)
+    {
+        float x = 0;
+        
+#if PSF
+        // PSF pixel that the convolve kernel centres on the output pixel
+        int cw = PSF_WIDTH - 1 - PSF_WIDTH/2;
+        int ch = PSF_HEIGHT - 1 - PSF_HEIGHT/2;
+        
+        for(int j = 0; j < PSF_HEIGHT; ++j)
+        {
+            for(int i = 0; i < PSF_WIDTH; ++i)
+            {
+                int u = adjoint ? gi - cw + i : gi + cw - i;
+                int v = adjoint ? gj - ch + j : gj + ch - j;
+                
+                if(u >= 0 && u < IMAGE_WIDTH && v >= 0 && v < IMAGE_HEIGHT)
+                {
+                    size_t k = v*IMAGE_WIDTH + u;
+                    x += psf[j*PSF_WIDTH + i]*(adjoint ? weight[k]*input[k] : input[k]);
+                }
+            }
+        }
+#else
+        {
+            size_t k = gj*IMAGE_WIDTH + gi;
+            x = adjoint ? weight[k]*input[k] : input[k];
+        }
+#endif
+        
+        output[gj*IMAGE_WIDTH + gi] = x;
+    }
+}
+
+// map the image back to the source pixels, which is the transpose of the
+// interpolation, and add the regularisation of the source; for the diagonal,
+// sum the weighted squares instead and invert
+kernel void pixels_gather(ulong n, global const int* start,
+                          global const int* nodes, global const float2* frac,
+                          constant float2* ww, global const float* input,
+                          global const float* weight, ulong diagonal,
+                          float lambda, global const float* src,
+                          global float* output)
+{
+    // get source pixel index
+    size_t p = get_global_id(0);
+    
+    // size of grid, and number of cells along each side
+    int ns = n;
+    int nc = n - 1;
+    
+    if(p < n*n)
+    {
+        // source pixel indices
+        int a = p%n;
+        int b = p/n;
+        
+        // number of neighbours on the grid
+        int deg = (a > 0) + (a < nc) + (b > 0) + (b < nc);
+        
+        float f = 0;
+        
+        // the four cells that have the source pixel as a corner
+        for(int cb = b - 1; cb <= b; ++cb)
+        {
+            for(int ca = a - 1; ca <= a; ++ca)
+            {
+                if(ca < 0 || cb < 0 || ca >= nc || cb >= nc)
+                    continue;
+                
+                int c = cb*nc + ca;
+                
+                for(int e = start[c]; e < start[c + 1]; ++e)
+                {
+                    int m = nodes[e];
+                    float2 u = frac[m];
+                    
+                    // interpolation weight of source pixel for node
+                    float w = ww[m%QUAD_POINTS].s0*(a > ca ? u.x : 1 - u.x)*(b > cb ? u.y : 1 - u.y);
+                    
+                    if(diagonal)
+                        f += weight[m/QUAD_POINTS]*w*w;
+                    else
+                        f += w*input[m/QUAD_POINTS];
+                }
+            }
+        }
+        
+        if(diagonal)
+        {
+            // inverse diagonal, without the PSF, for the preconditioner
+            f += lambda*deg;
+            output[p] = f > 0 ? 1/f : 0;
+        }
+        else
+        {
+            // regularisation by differences with the neighbours, if any
+            if(lambda != 0)
+            {
+                float r = deg*src[p];
+                if(a > 0)
+                    r -= src[p - 1];
+                if(a < nc)
+                    r -= src[p + 1];
+                if(b > 0)
+                    r -= src[p - ns];
+                if(b < nc)
+                    r -= src[p + ns];
+                f += lambda*r;
+            }
+            
+            output[p] = f;
+        }
+    }
+}
+
+// scalar product of two vectors, computed by a single work group whose size
+// is a power of two
+kernel void pixels_dot(ulong len, global const float* a,
+                       global const float* b, local float* tmp,
+                       global float* cg, ulong slot)
+{
+    size_t l = get_local_id(0);
+    size_t m = get_local_size(0);
+    
+    float s = 0;
+    for(size_t i = l; i < len; i += m)
+        s += a[i]*b[i];
+    
+    // sum over work items by pairwise reduction
+    tmp[l] = s;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for(size_t h = m/2; h > 0; h /= 2)
+    {
+        if(l < h)
+            tmp[l] += tmp[l + h];
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+    
+    if(l == 0)
+        cg[slot] = tmp[0];
+}
+
+// regularisation of the source, the sum of squared differences between
+// neighbours, computed by a single work group like the scalar product
+kernel void pixels_energy(ulong n, global const float* src, local float* tmp,
+                          global float* cg, ulong slot)
+{
+    size_t l = get_local_id(0);
+    size_t m = get_local_size(0);
+    
+    float s = 0;
+    for(size_t p = l; p < n*n; p += m)
+    {
+        if(p%n + 1 < n)
+            s += (src[p + 1] - src[p])*(src[p + 1] - src[p]);
+        if(p/n + 1 < n)
+            s += (src[p + n] - src[p])*(src[p + n] - src[p]);
+    }
+    
+    // sum over work items by pairwise reduction
+    tmp[l] = s;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for(size_t h = m/2; h > 0; h /= 2)
+    {
+        if(l < h)
+            tmp[l] += tmp[l + h];
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+    
+    if(l == 0)
+        cg[slot] = tmp[0];
+}
+
+// start conjugate gradients from an empty source
+kernel void pixels_init(ulong len, global const float* b,
+                        global const float* dinv, global float* x,
+                        global float* r, global float* z, global float* p)
+{
+    size_t i = get_global_id(0);
+    
+    if(i < len)
+    {
+        x[i] = 0;
+        r[i] = b[i];
+        z[i] = dinv[i]*b[i];
+        p[i] = z[i];
+    }
+}
+
+// step of conjugate gradients along the search direction, with the scalar
+// products taken from the given slots
+kernel void pixels_step(ulong len, global const float* cg, ulong rz, ulong pq,
+                        global const float* p, global const float* q,
+                        global const float* dinv, global float* x,
+                        global float* r, global float* z)
+{
+    size_t i = get_global_id(0);
+    
+    if(i < len)
+    {
+        float alpha = cg[pq] > 0 ? cg[rz]/cg[pq] : 0;
+        x[i] += alpha*p[i];
+        r[i] -= alpha*q[i];
+        z[i] = dinv[i]*r[i];
+    }
+}
+
+// new search direction of conjugate gradients
+kernel void pixels_direction(ulong len, global const float* cg, ulong rzold,
+                             ulong rznew, global const float* z,
+                             global float* p)
+{
+    size_t i = get_global_id(0);
+    
+    if(i < len)
+    {
+        float beta = cg[rzold] > 0 ? cg[rznew]/cg[rzold] : 0;
+        p[i] = z[i] + beta*p[i];
+    }
+}
+
+// data that is not explained by the model
+kernel void pixels_residual(global const float* image,
+                            global const float* model, global float* output)
+{
+    size_t k = get_global_id(0);
+    
+    if(k < IMAGE_SIZE)
+        output[k] = image[k] - model[k];
+}
+
+// add image of source to model
+kernel void pixels_add(global const float* input, global float* output)
+{
+    size_t k = get_global_id(0);
+    
+    if(k < IMAGE_SIZE)
+        output[k] += input[k];
+}
@@ -0,0 +1,101 @@
+//---------------------------
+// multi-Gaussian expansions
+//---------------------------
+
+// number of Gaussians in an expansion
+#define MGE_SIZE 14
+
+// nodes and weights of 4-point Gauss-Legendre rule
+#define GAUSS_GL_X0 0.86113631159405257522f
+#define GAUSS_GL_X1 0.33998104358485626480f
+#define GAUSS_GL_W0 0.34785484513745385737f
+#define GAUSS_GL_W1 0.65214515486254614263f
+
+// integral of exp(-k^2 (x + m y)^2 - b y^2) over the rectangle [x0, x1],
+// exact along x and, unless m is zero, with Gauss-Legendre rule along y
+static float gauss_integral(float2 x0, float2 x1, float k, float m, float b)
+{
+    // separable profile is integrated exactly
+    if(m == 0)
+    {
+        float sb = sqrt(b);
+        return 0.25f*PI/(k*sb)*(erf(k*x1.x) - erf(k*x0.x))*(erf(sb*x1.y) - erf(sb*x0.y));
+    }
+    
+    // midpoint and half-width along y
+    float c = 0.5f*(x1.y + x0.y);
+    float h = 0.5f*(x1.y - x0.y);
+    
+    // nodes of Gauss-Legendre rule along y
+    float4 y = c + h*(float4)(-GAUSS_GL_X0, -GAUSS_GL_X1, GAUSS_GL_X1, GAUSS_GL_X0);
+    
+    // exact integral along x at nodes, times marginal profile along y
+    float4 f = exp(-b*y*y)*(erf(k*(x1.x + m*y)) - erf(k*(x0.x + m*y)));
+    
+    // apply Gauss-Legendre rule along y
+    return 0.5f*sqrt(PI)/k*h*dot(f, (float4)(GAUSS_GL_W0, GAUSS_GL_W1, GAUSS_GL_W1, GAUSS_GL_W0));
+}
+
+// concentric Gaussians with common shape
+struct __attribute__ ((aligned (4))) mge
+{
+    float2 x;           // centre
+    mat22 t;            // transformation to circular coordinates
+    float d;            // determinant of transformation
+    float axx;          // shape of profile along x at fixed y
+    float m;            // shift of profile along x per unit y
+    float ryy;          // shape of marginal profile along y
+    float a[MGE_SIZE];  // amplitudes
+    float h[MGE_SIZE];  // coefficients of exponent
+};
+
+// set centre and transformation to circular coordinates
+static void mge_init(local struct mge* g, float2 x, mat22 t)
+{
+    g->x = x;
+    g->t = t;
+    g->d = fabs(t.s0*t.s3 - t.s1*t.s2);
+    
+    // quadratic form of transformation
+    float axx = t.s0*t.s0 + t.s2*t.s2;
+    float axy = t.s0*t.s1 + t.s2*t.s3;
+    
+    // split into profile along x at fixed y and marginal profile along y
+    g->axx = axx;
+    g->m = axy/axx;
+    g->ryy = g->d*g->d/axx;
+}
+
+// set Gaussian i with luminosity l and standard deviation s
+static void mge_set(local struct mge* g, int i, float l, float s)
+{
+    g->a[i] = 0.5f*l*g->d/(PI*s*s);
+    g->h[i] = 0.5f/(s*s);
+}
+
+// surface brightness of expansion at x
+static float mge_eval(local const struct mge* g, float2 x)
+{
+    float2 y = mv22(g->t, x - g->x);
+    float r2 = dot(y, y);
+    
+    float f = 0;
+    for(int i = 0; i < MGE_SIZE; ++i)
+        f += g->a[i]*fm_exp(-g->h[i]*r2);
+    
+    return f;
+}
+
+// integral of expansion over the rectangle [x0, x1]
+static float mge_integral(local const struct mge* g, float2 x0, float2 x1)
+{
+    // centered coordinates
+    x0 -= g->x;
+    x1 -= g->x;
+    
+    float f = 0;
+    for(int i = 0; i < MGE_SIZE; ++i)
+        f += g->a[i]*gauss_integral(x0, x1, sqrt(g->h[i]*g->axx), g->m, g->h[i]*g->ryy);
+    
+    return f;
+}
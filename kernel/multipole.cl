@@ -0,0 +1,254 @@
+// multipole trees are only used for the lens tables of the deflection field
+#if DEFLECTION_FIELD
+
+//------------
+// multipoles
+//------------
+
+// order of the multipole expansion of a node
+#define MULTIPOLE_ORDER 4
+
+// number of complex moments of orders j + k up to MULTIPOLE_ORDER
+#define MULTIPOLE_NMOM ((MULTIPOLE_ORDER + 1)*(MULTIPOLE_ORDER + 2)/2)
+
+// layout of a node of the multipole tree
+enum
+{
+    MULTIPOLE_CENTRE = 0,   // centre of mass
+    MULTIPOLE_RADIUS = 2,   // largest distance of a member from the centre
+    MULTIPOLE_COUNT = 3,    // number of members
+    MULTIPOLE_SLOPE = 4,    // slope s of the far field of the members
+    MULTIPOLE_MOMENTS = 5,  // complex moments of orders j + k
+    MULTIPOLE_NODE = 5 + 2*MULTIPOLE_NMOM
+};
+
+// index of the moment sum_i m_i d_i^j conj(d_i)^k
+#define MULTIPOLE_MOMENT(j, k) (((j) + (k))*((j) + (k) + 1)/2 + (k))
+
+// product of complex numbers
+static float2 multipole_mul(float2 a, float2 b)
+{
+    return (float2)(a.x*b.x - a.y*b.y, a.x*b.y + a.y*b.x);
+}
+
+// spread the lower 16 bits of v to the even bits
+static uint multipole_spread(uint v)
+{
+    v &= 0xFFFF;
+    v = (v | (v << 8)) & 0x00FF00FF;
+    v = (v | (v << 4)) & 0x0F0F0F0F;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+}
+
+// sort members along a Morton curve through their bounding box, using the
+// positions of their far fields; all work items of the group must take part,
+// with local memory for one box per work item
+static void multipole_sort(global const float4* mono, global uint* key,
+                           global uint* index, size_t n, local float4* box)
+{
+    size_t l = get_local_id(0);
+    size_t m = get_local_size(0);
+    
+    // bounding box of the members of work item
+    float2 lo = HUGE_VALF;
+    float2 hi = -HUGE_VALF;
+    for(size_t i = l; i < n; i += m)
+    {
+        lo = fmin(lo, mono[i].xy);
+        hi = fmax(hi, mono[i].xy);
+    }
+    box[l] = (float4)(lo, hi);
+    barrier(CLK_LOCAL_MEM_FENCE);
+    
+    // reduce boxes of work items, the group size is a power of two
+    for(size_t s = m/2; s > 0; s /= 2)
+    {
+        if(l < s)
+            box[l] = (float4)(fmin(box[l].xy, box[l+s].xy), fmax(box[l].zw, box[l+s].zw));
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+    lo = box[0].xy;
+    hi = box[0].zw;
+    
+    // keys of members from 16 bits of each coordinate
+    float2 sc = 65535/fmax(hi - lo, 1E-10f);
+    for(size_t i = l; i < n; i += m)
+    {
+        uint2 q = convert_uint2_sat((mono[i].xy - lo)*sc);
+        key[i] = multipole_spread(q.x) | (multipole_spread(q.y) << 1);
+        index[i] = i;
+    }
+    barrier(CLK_GLOBAL_MEM_FENCE);
+    
+    // bitonic sort over the next power of two, where every merge starts by
+    // comparing mirrored pairs so that all comparisons are ascending; pairs
+    // past the end hold keys that are larger than all others and never move
+    size_t p = 1;
+    while(p < n)
+        p *= 2;
+    for(size_t k = 2; k <= p; k *= 2)
+    {
+        for(size_t j = k/2; j > 0; j /= 2)
+        {
+            for(size_t t = l; t < p/2; t += m)
+            {
+                size_t a, b;
+                
+                if(j == k/2)
+                {
+                    a = (t/j)*k + t%j;
+                    b = (t/j)*k + k - 1 - t%j;
+                }
+                else
+                {
+                    a = (t/j)*2*j + t%j;
+                    b = a + j;
+                }
+                
+                if(b < n && key[a] > key[b])
+                {
+                    uint ka = key[a], ia = index[a];
+                    key[a] = key[b];
+                    index[a] = index[b];
+                    key[b] = ka;
+                    index[b] = ia;
+                }
+            }
+            barrier(CLK_GLOBAL_MEM_FENCE);
+        }
+    }
+}
+
+// set the nodes of the implicit binary tree over the sorted members: node j
+// has children 2j and 2j + 1, and the l leaves starting at node l hold runs
+// of c members; all work items of the group must take part, each setting
+// its own nodes
+static void multipole_tree(global float* node, global const float4* mono,
+                           global const uint* index, size_t n, size_t c,
+                           size_t l)
+{
+    for(size_t j = 1 + get_local_id(0); j < 2*l; j += get_local_size(0))
+    {
+        global float* nd = node + j*MULTIPOLE_NODE;
+        
+        // depth of node, and range of its members
+        uint d = 31 - clz((uint)j);
+        size_t s = l >> d;
+        size_t i0 = min((j - ((size_t)1 << d))*s*c, n);
+        size_t i1 = min((j - ((size_t)1 << d) + 1)*s*c, n);
+        
+        // total mass and centre of mass, or centroid if there is no mass
+        float m = 0;
+        float2 x = 0;
+        float2 y = 0;
+        for(size_t i = i0; i < i1; ++i)
+        {
+            float4 p = mono[index[i]];
+            m += p.z;
+            x += p.z*p.xy;
+            y += p.xy;
+        }
+        x = m != 0 ? x/m : y/max(i1 - i0, (size_t)1);
+        
+        vstore2(x, 0, nd + MULTIPOLE_CENTRE);
+        nd[MULTIPOLE_RADIUS] = 0;
+        nd[MULTIPOLE_COUNT] = i1 - i0;
+        nd[MULTIPOLE_SLOPE] = i1 > i0 ? mono[index[i0]].w : 0;
+        for(int k = 0; k < MULTIPOLE_NMOM; ++k)
+            vstore2((float2)(0, 0), k, nd + MULTIPOLE_MOMENTS);
+        
+        // radius and moments sum_i m_i d_i^j conj(d_i)^k of offsets d_i from
+        // the centre
+        for(size_t i = i0; i < i1; ++i)
+        {
+            float4 p = mono[index[i]];
+            float2 e = p.xy - x;
+            float2 dj = (float2)(p.z, 0);
+            
+            nd[MULTIPOLE_RADIUS] = fmax(nd[MULTIPOLE_RADIUS], length(e));
+            
+            for(int a = 0; a <= MULTIPOLE_ORDER; ++a)
+            {
+                float2 q = dj;
+                for(int b = 0; a + b <= MULTIPOLE_ORDER; ++b)
+                {
+                    int k = MULTIPOLE_MOMENT(a, b);
+                    vstore2(vload2(k, nd + MULTIPOLE_MOMENTS) + q, k, nd + MULTIPOLE_MOMENTS);
+                    q = multipole_mul(q, (float2)(e.x, -e.y));
+                }
+                dj = multipole_mul(dj, e);
+            }
+        }
+    }
+}
+
+// check if node is far from the box from x0 to x1 for the opening angle
+static int multipole_far(global const float* nd, float theta, float2 x0,
+                         float2 x1)
+{
+    // distance from centre of node to box
+    float2 c = vload2(0, nd + MULTIPOLE_CENTRE);
+    float2 d = fmax(fmax(x0 - c, c - x1), 0.0f);
+    
+    return nd[MULTIPOLE_RADIUS] < theta*length(d);
+}
+
+// deflection of node far from its members, whose far fields are
+// m (x - x0)/|x - x0|^(1+s); for offsets d of the members from the centre and
+// w of the point, the complex deflection a.x - i a.y of a member is
+// m conj(w)/|w|^(1+s) (1 - d/w)^(-(1+s)/2) (1 - conj(d/w))^((1-s)/2), and the
+// binomial series of the two factors are summed with the moments of the node
+static float2 multipole_eval(global const float* nd, float2 x)
+{
+    // slope of far field, and exponents of the binomial series
+    float s = nd[MULTIPOLE_SLOPE];
+    float p = 0.5f*(1 + s);
+    float q = 0.5f*(1 - s);
+    
+    // complex offset from centre, and its inverse
+    float2 w = x - vload2(0, nd + MULTIPOLE_CENTRE);
+    float2 u = (float2)(w.x, -w.y)/dot(w, w);
+    
+    // double series in 1/w and 1/conj(w)
+    float2 t = 0;
+    float2 uj = (float2)(1, 0);
+    float aj = 1;
+    for(int j = 0; j <= MULTIPOLE_ORDER; ++j)
+    {
+        float2 r = 0;
+        float2 uk = uj;
+        float ck = aj;
+        for(int k = 0; j + k <= MULTIPOLE_ORDER && ck != 0; ++k)
+        {
+            r += ck*multipole_mul(vload2(MULTIPOLE_MOMENT(j, k), nd + MULTIPOLE_MOMENTS), uk);
+            uk = multipole_mul(uk, (float2)(u.x, -u.y));
+            ck *= (k - q)/(k + 1);
+        }
+        t += r;
+        uj = multipole_mul(uj, u);
+        aj *= (p + j)/(j + 1);
+    }
+    
+    // prefactor conj(w)/|w|^(1+s)
+    t = multipole_mul(t, (float2)(w.x, -w.y))*pow(dot(w, w), -p);
+    
+    return (float2)(t.x, -t.y);
+}
+
+// next node in a depth-first walk, descending into the children of node j
+// or moving on to the next sibling of node j or of its nearest ancestor;
+// zero when the walk is done
+static size_t multipole_next(size_t j, size_t down)
+{
+    if(down)
+        return 2*j;
+    
+    while(j & 1)
+        j >>= 1;
+    
+    return j ? j + 1 : 0;
+}
+
+#endif
@@ -0,0 +1,326 @@
+//----------------------------------------------------------------------------
+// kernel/native.h
+//----------------------------------------------------------------------------
+//
+// Compatibility header for compiling the kernel and object code as C++ for
+// the native backend. Lensed rewrites the few constructs that are not valid
+// C++ (vector literals, swizzles, casts to void pointers of an address space)
+// before the code is compiled, see `src/native.c`. Everything else is provided here:
+// vector types, address space qualifiers, built-in functions and work item
+// indices. The entry points for the native backend are defined at the end.
+//
+
+#include <cmath>
+#include <cfloat>
+#include <cstddef>
+#include <cstring>
+#include <cstdlib>
+
+using std::acos; using std::acosh; using std::asin; using std::atan;
+using std::atan2; using std::atanh; using std::cbrt; using std::ceil;
+using std::copysign; using std::cos; using std::cosh; using std::erf;
+using std::erfc; using std::exp; using std::exp2; using std::expm1;
+using std::fabs; using std::floor; using std::fmax; using std::fmin;
+using std::fmod; using std::hypot; using std::isfinite; using std::ldexp;
+using std::lgamma; using std::log; using std::log10; using std::log1p;
+using std::log2; using std::pow; using std::rint; using std::round;
+using std::sin; using std::sinh; using std::sqrt; using std::tan;
+using std::tanh; using std::tgamma; using std::trunc;
+
+// scalar types
+typedef unsigned char  uchar;
+typedef unsigned short ushort;
+typedef unsigned int   uint;
+typedef unsigned long  ulong;
+
+// math constants
+#define M_E_F        2.718281828f
+#define M_LOG2E_F    1.442695041f
+#define M_LOG10E_F   0.434294482f
+#define M_LN2_F      0.693147181f
+#define M_LN10_F     2.302585093f
+#define M_PI_F       3.141592654f
+#define M_PI_2_F     1.570796327f
+#define M_PI_4_F     0.785398163f
+#define M_1_PI_F     0.318309886f
+#define M_2_PI_F     0.636619772f
+#define M_2_SQRTPI_F 1.128379167f
+#define M_SQRT2_F    1.414213562f
+#define M_SQRT1_2_F  0.707106781f
+#define MAXFLOAT     FLT_MAX
+
+// vector types, with the swizzles used by the kernel code as functions
+struct float2
+{
+    union {
+        struct { float x, y; };
+        struct { float s0, s1; };
+        float s[2];
+    };
+    
+    float2() = default;
+    float2(float v) : x(v), y(v) {}
+    float2(float a, float b) : x(a), y(b) {}
+};
+
+struct float4
+{
+    union {
+        struct { float x, y, z, w; };
+        struct { float s0, s1, s2, s3; };
+        float s[4];
+    };
+    
+    float4() = default;
+    float4(float v) : x(v), y(v), z(v), w(v) {}
+    float4(float a, float b, float c, float d) : x(a), y(b), z(c), w(d) {}
+    float4(float2 a, float2 b) : x(a.x), y(a.y), z(b.x), w(b.y) {}
+    
+    float2 xy() const { return float2(x, y); }
+    float2 zw() const { return float2(z, w); }
+    float2 lo() const { return float2(x, y); }
+    float2 hi() const { return float2(z, w); }
+};
+
+struct int2
+{
+    union {
+        struct { int x, y; };
+        struct { int s0, s1; };
+        int s[2];
+    };
+    
+    int2() = default;
+    int2(int v) : x(v), y(v) {}
+    int2(int a, int b) : x(a), y(b) {}
+};
+
+struct char16
+{
+    char s[16];
+};
+
+// element-wise arithmetic for vector types
+#define NATIVE_VECTOR_OPS(T, N) \
+    inline T operator+(T a, T b) { for(int i = 0; i < N; ++i) a.s[i] += b.s[i]; return a; } \
+    inline T operator-(T a, T b) { for(int i = 0; i < N; ++i) a.s[i] -= b.s[i]; return a; } \
+    inline T operator*(T a, T b) { for(int i = 0; i < N; ++i) a.s[i] *= b.s[i]; return a; } \
+    inline T operator/(T a, T b) { for(int i = 0; i < N; ++i) a.s[i] /= b.s[i]; return a; } \
+    inline T operator-(T a) { for(int i = 0; i < N; ++i) a.s[i] = -a.s[i]; return a; } \
+    inline T& operator+=(T& a, T b) { return a = a + b; } \
+    inline T& operator-=(T& a, T b) { return a = a - b; } \
+    inline T& operator*=(T& a, T b) { return a = a * b; } \
+    inline T& operator/=(T& a, T b) { return a = a / b; }
+
+NATIVE_VECTOR_OPS(float2, 2)
+NATIVE_VECTOR_OPS(float4, 4)
+NATIVE_VECTOR_OPS(int2, 2)
+
+// geometric functions
+inline float dot(float2 a, float2 b) { return a.x*b.x + a.y*b.y; }
+inline float dot(float4 a, float4 b) { return a.x*b.x + a.y*b.y + a.z*b.z + a.w*b.w; }
+inline float length(float2 a) { return std::sqrt(dot(a, a)); }
+inline float2 normalize(float2 a) { return a/length(a); }
+
+// math functions
+inline float mad(float a, float b, float c) { return a*b + c; }
+inline float2 mad(float2 a, float2 b, float2 c) { return a*b + c; }
+inline float powr(float x, float y) { return std::pow(x, y); }
+inline float pown(float x, int y) { return std::pow(x, y); }
+inline float rootn(float x, int y) { return std::pow(x, 1.0f/y); }
+inline float rsqrt(float x) { return 1/std::sqrt(x); }
+inline float exp10(float x) { return std::pow(10.0f, x); }
+inline float sincos(float x, float* c) { *c = std::cos(x); return std::sin(x); }
+inline float fract(float x, float* i) { *i = std::floor(x); return x - *i; }
+inline float2 fabs(float2 a) { return float2(std::fabs(a.x), std::fabs(a.y)); }
+inline float2 floor(float2 a) { return float2(std::floor(a.x), std::floor(a.y)); }
+inline float2 fmin(float2 a, float2 b) { return float2(std::fmin(a.x, b.x), std::fmin(a.y, b.y)); }
+inline float2 fmax(float2 a, float2 b) { return float2(std::fmax(a.x, b.x), std::fmax(a.y, b.y)); }
+inline float4 exp(float4 a) { return float4(std::exp(a.x), std::exp(a.y), std::exp(a.z), std::exp(a.w)); }
+inline float4 erf(float4 a) { return float4(std::erf(a.x), std::erf(a.y), std::erf(a.z), std::erf(a.w)); }
+
+// common and integer functions
+inline float clamp(float x, float a, float b) { return x < a ? a : (x > b ? b : x); }
+inline int clamp(int x, int a, int b) { return x < a ? a : (x > b ? b : x); }
+inline float mix(float a, float b, float t) { return a + (b - a)*t; }
+inline float sign(float x) { return x > 0 ? 1.0f : (x < 0 ? -1.0f : 0.0f); }
+inline float step(float e, float x) { return x < e ? 0.0f : 1.0f; }
+template<class T> inline T min(T a, T b) { return b < a ? b : a; }
+template<class T> inline T max(T a, T b) { return a < b ? b : a; }
+inline int mad24(int a, int b, int c) { return a*b + c; }
+inline int mul24(int a, int b) { return a*b; }
+
+// reinterpretation
+inline float as_float(int i) { float f; std::memcpy(&f, &i, sizeof(f)); return f; }
+inline float as_float(uint i) { float f; std::memcpy(&f, &i, sizeof(f)); return f; }
+inline int as_int(float f) { int i; std::memcpy(&i, &f, sizeof(i)); return i; }
+inline uint as_uint(float f) { uint i; std::memcpy(&i, &f, sizeof(i)); return i; }
+
+// atomic counter, as work items run on several threads
+inline int atomic_inc(volatile int* p) { return __atomic_fetch_add(p, 1, __ATOMIC_RELAXED); }
+
+// vector loads
+inline float2 vload2(size_t o, const float* p) { return float2(p[2*o], p[2*o+1]); }
+inline char16 vload16(size_t o, const char* p) { char16 c; std::memcpy(c.s, p + 16*o, 16); return c; }
+
+// pointer that converts to any other pointer, for casts of object data
+struct anyptr
+{
+    void* p;
+    template<class T> anyptr(T* q) : p((void*)q) {}
+    template<class T> operator T*() const { return (T*)p; }
+};
+
+// work item indices, one set per thread
+static thread_local size_t native_global_id[3];
+static thread_local size_t native_local_id[3];
+static thread_local size_t native_local_size[3] = { 1, 1, 1 };
+static thread_local size_t native_group_id[3];
+inline size_t get_global_id(int d) { return native_global_id[d]; }
+inline size_t get_local_id(int d) { return native_local_id[d]; }
+inline size_t get_local_size(int d) { return native_local_size[d]; }
+inline size_t get_group_id(int d) { return native_group_id[d]; }
+
+// work groups have a single work item, so there is nothing to synchronise
+#define CLK_LOCAL_MEM_FENCE  1
+#define CLK_GLOBAL_MEM_FENCE 2
+inline void barrier(int) {}
+
+// address spaces are all the same, and kernels are exported
+#define kernel   extern "C"
+#define global
+#define local
+#define constant const
+#define private
+#define __attribute__(x)
+
+// `this` is a keyword in C++, but used for object data in the kernel code
+#define this this_
+
+#if IMAGE_SIZE
+// functions provided by the main program
+static float compute(local uint* data, global const float2* field, float2 x);
+static float integral(local uint* data, float2 x0, float2 x1);
+kernel void set_params(ulong dsiz, global int* gdata, local int* ldata,
+                       constant float* params, global uint* lenses,
+                       ulong stage);
+
+// set parameters of objects
+extern "C" void native_set_params(size_t dsiz, uint* data, const float* params)
+{
+    // set_params works on a local copy of the data
+    int* ldata = (int*)std::malloc(dsiz*sizeof(int));
+    if(!ldata)
+        std::abort();
+    
+    // there are no lens tables without the deflection field, and no
+    // partial updates
+    set_params(dsiz, (int*)data, ldata, params, 0, 0);
+    
+    std::free(ldata);
+}
+
+// the image is a single band, unless several bands are stacked vertically,
+// each with margins of rows above and below, as in the render kernels
+#ifndef BANDS
+#define BANDS 1
+#endif
+#ifndef BAND_MARGIN
+#define BAND_MARGIN 0
+#endif
+
+// compute image, with the pixels of each row distributed over threads
+extern "C" void native_render(size_t dsiz, const uint* data, const float* pcs,
+                              const float* qq, const float* ww,
+                              float* value, float* error)
+{
+    // pixel coordinate system
+    float2 o = float2(pcs[0], pcs[1]);
+    float2 d = float2(pcs[2], pcs[3]);
+    
+    #pragma omp parallel
+    {
+        // private copy of object data for each thread
+        uint* ldata = (uint*)std::malloc(dsiz*sizeof(uint));
+        if(!ldata)
+            std::abort();
+        std::memcpy(ldata, data, dsiz*sizeof(uint));
+        
+        #pragma omp for schedule(dynamic)
+        for(int j = 0; j < IMAGE_HEIGHT; ++j)
+        {
+            // object data of band, and row within band
+            uint* bdata = ldata + (j/(IMAGE_HEIGHT/BANDS))*(dsiz/BANDS);
+            int r = j%(IMAGE_HEIGHT/BANDS) - BAND_MARGIN;
+            
+            for(int i = 0; i < IMAGE_WIDTH; ++i)
+            {
+                // pixel position
+                float2 x = o + d*float2(i, r);
+                
+                // value and error of quadrature
+                float2 f = 0;
+                for(size_t n = 0; n < QUAD_POINTS; ++n)
+                    f += vload2(n, ww)*compute(bdata, 0, x + vload2(n, qq));
+                
+                // add mean of profiles that are integrated exactly over pixel
+                f.s0 += integral(bdata, x - 0.5f*d, x + 0.5f*d)/(d.x*d.y);
+                
+                // done
+                value[j*IMAGE_WIDTH + i] = f.s0;
+                error[j*IMAGE_WIDTH + i] = f.s1;
+            }
+        }
+        
+        std::free(ldata);
+    }
+}
+
+// convolve image with PSF, clamping at the edges as the convolve kernel
+extern "C" void native_convolve(const float* input, const float* psf, float* output)
+{
+    #pragma omp parallel for
+    for(int gj = 0; gj < IMAGE_HEIGHT; ++gj)
+    {
+        // PSF of band
+        const float* bpsf = psf + (gj/(IMAGE_HEIGHT/BANDS))*PSF_WIDTH*PSF_HEIGHT;
+        
+        for(int gi = 0; gi < IMAGE_WIDTH; ++gi)
+        {
+            float x = 0;
+            
+            for(int j = 0; j < PSF_HEIGHT; ++j)
+            {
+                int r = clamp(gj - PSF_HEIGHT/2 + PSF_HEIGHT - 1 - j, 0, IMAGE_HEIGHT-1);
+                for(int i = 0; i < PSF_WIDTH; ++i)
+                    x += bpsf[j*PSF_WIDTH + i]*input[r*IMAGE_WIDTH + clamp(gi - PSF_WIDTH/2 + PSF_WIDTH - 1 - i, 0, IMAGE_WIDTH-1)];
+            }
+            
+            output[gj*IMAGE_WIDTH + gi] = x;
+        }
+    }
+}
+
+// calculate chi^2 values of model, and return their sum
+extern "C" double native_loglike(const float* image, const float* weight,
+                                 const float* model, float* loglike)
+{
+    double chi2 = 0;
+    
+    #pragma omp parallel for reduction(+:chi2)
+    for(int k = 0; k < IMAGE_SIZE; ++k)
+    {
+        float d = model[k] - image[k];
+        loglike[k] = weight[k]*d*d;
+        chi2 += loglike[k];
+    }
+    
+    return chi2;
+}
+#else
+// select work item for kernels of object program
+extern "C" void native_work_item(size_t i)
+{
+    native_global_id[0] = i;
+}
+#endif
@@ -6,6 +6,15 @@ enum
     FOREGROUND = 'F'
 };
 
+// stages of partial updates: lenses are kept from PARTIAL_SOURCES on, and
+// sources from PARTIAL_FOREGROUNDS on
+enum
+{
+    PARTIAL_ALL = 0,
+    PARTIAL_SOURCES,
+    PARTIAL_FOREGROUNDS
+};
+
 // parameter types
 enum
 {
@@ -15,7 +24,8 @@ enum
     RADIUS,
     MAGNITUDE,
     AXIS_RATIO,
-    POS_ANGLE
+    POS_ANGLE,
+    AMPLITUDE
 };
 
 // parameter bounds
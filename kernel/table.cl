@@ -0,0 +1,94 @@
+//--------
+// tables
+//--------
+
+// number of nodes in a table
+#define TABLE_SIZE 64
+
+// table of function values at equidistant nodes
+struct __attribute__ ((aligned (4))) table
+{
+    float x0;               // position of first node
+    float h;                // spacing of nodes
+    float y[TABLE_SIZE];    // function values
+    float m[TABLE_SIZE];    // derivatives
+};
+
+// set equidistant nodes between x0 and x1
+static void table_init(local struct table* t, float x0, float x1)
+{
+    t->x0 = x0;
+    t->h = (x1 - x0)/(TABLE_SIZE - 1);
+}
+
+// position of node i
+static float table_node(local const struct table* t, int i)
+{
+    return t->x0 + i*t->h;
+}
+
+// compute derivatives that keep monotone data monotone (Fritsch & Carlson 1980)
+static void table_slopes(local struct table* t)
+{
+    // secants at the boundaries
+    t->m[0] = (t->y[1] - t->y[0])/t->h;
+    t->m[TABLE_SIZE-1] = (t->y[TABLE_SIZE-1] - t->y[TABLE_SIZE-2])/t->h;
+    
+    // average of secants if monotone, else zero
+    for(int i = 1; i < TABLE_SIZE-1; ++i)
+    {
+        float d0 = (t->y[i] - t->y[i-1])/t->h;
+        float d1 = (t->y[i+1] - t->y[i])/t->h;
+        t->m[i] = d0*d1 > 0 ? 0.5f*(d0 + d1) : 0;
+    }
+    
+    // limit derivatives to prevent overshoot
+    for(int i = 0; i < TABLE_SIZE-1; ++i)
+    {
+        float d = (t->y[i+1] - t->y[i])/t->h;
+        
+        if(d == 0)
+        {
+            t->m[i] = 0;
+            t->m[i+1] = 0;
+        }
+        else
+        {
+            float a = t->m[i]/d;
+            float b = t->m[i+1]/d;
+            float s = a*a + b*b;
+            
+            if(s > 9)
+            {
+                s = 3*rsqrt(s);
+                t->m[i] = s*a*d;
+                t->m[i+1] = s*b*d;
+            }
+        }
+    }
+}
+
+// cubic Hermite interpolation of table at x, constant below the first node
+// and linearly extrapolated beyond the last node
+static float table_eval(local const struct table* t, float x)
+{
+    // position in units of node spacing
+    float u = fmax((x - t->x0)/t->h, 0.0f);
+    
+    // interval, and position within interval
+    int i = min((int)u, TABLE_SIZE-2);
+    float s = u - i;
+    
+    // extrapolate beyond last node
+    if(s > 1)
+        return t->y[TABLE_SIZE-1] + (s - 1)*t->h*t->m[TABLE_SIZE-1];
+    
+    // Hermite basis
+    float s1 = 1 - s;
+    float h00 = (1 + 2*s)*s1*s1;
+    float h10 = s*s1*s1;
+    float h01 = s*s*(3 - 2*s);
+    float h11 = -s*s*s1;
+    
+    return h00*t->y[i] + h01*t->y[i+1] + t->h*(h10*t->m[i] + h11*t->m[i+1]);
+}
@@ -0,0 +1,98 @@
+// core-Sersic profile source, with tabulated brightness
+// follows Graham et al. (2003), Trujillo et al. (2004)
+
+type = SOURCE;
+
+params
+{
+    { "x",   POSITION_X },
+    { "y",   POSITION_Y },
+    { "r",   RADIUS     },
+    { "mag", MAGNITUDE  },
+    { "n",   PARAMETER, POS_BOUND },
+    { "rb",  RADIUS     },
+    { "a",   PARAMETER, POS_BOUND },
+    { "g",   PARAMETER, { 0.f, 2.f } },
+    { "q",   AXIS_RATIO },
+    { "pa",  POS_ANGLE  }
+};
+
+data
+{
+    float2 x;       // source position
+    mat22 t;        // coordinate transformation matrix
+    float lr;       // log of effective radius
+    struct table s; // log of surface brightness
+};
+
+static float brightness(local data* this, float2 x)
+{
+    float2 y = mv22(this->t, x - this->x);
+    return fm_exp(table_eval(&this->s, 0.5f*fm_log(dot(y, y)) - this->lr));
+}
+
+static void set(local data* this, float x, float y, float r, float mag, float n, float rb, float a, float g, float q, float pa)
+{
+    // for approximations see MacArthur, Courteau, Holtzman (2003)
+    float b = n > 0.36f ? 2.0f*n - 1.0f/3 + 4.0f/(405*n) + 46.0f/(25515*(n*n)) + 131.0f/(1148175*(n*n*n)) - 2194697.0f/(30690717750*(n*n*n*n))
+                        : 0.01945f - 0.8902f*n + 10.95f*(n*n) - 19.67f*(n*n*n) + 13.43f*(n*n*n*n);
+    
+    float c = cos(pa*DEG2RAD);
+    float s = sin(pa*DEG2RAD);
+    
+    // log of break radius in units of effective radius
+    float lb = log(rb/r);
+    
+    // maximum of integrand and integral for normalisation
+    float fmx, sum;
+    
+    // source position
+    this->x = (float2)(x, y);
+    
+    // transformation matrix: rotate and scale
+    this->t = (mat22)(q*c, q*s, -s, c)/sqrt(q);
+    
+    // log of effective radius
+    this->lr = log(r);
+    
+    // tabulate in units of effective radius
+    table_init(&this->s, -8, 6);
+    
+    // unnormalised profile, and maximum of flux integrand
+    fmx = -HUGE_VALF;
+    for(int i = 0; i < TABLE_SIZE; ++i)
+    {
+        // log-radius of node
+        float l = table_node(&this->s, i);
+        
+        // inner power law, with log(1 + exp(z)) computed stably
+        float z = a*(lb - l);
+        float p = z > 20 ? z : log1p(exp(z));
+        
+        // outer Sersic part, with log(exp(a*l) + exp(a*lb)) computed stably
+        float w = fmax(a*l, a*lb) + log1p(exp(-fabs(a*(l - lb))));
+        
+        this->s.y[i] = g/a*p - b*exp(w/(a*n));
+        
+        fmx = fmax(fmx, 2*l + this->s.y[i]);
+    }
+    
+    // flux in the disc inside the first node, where profile is constant
+    sum = 0.5f*exp(2*table_node(&this->s, 0) + this->s.y[0] - fmx);
+    
+    // flux between nodes, using trapezoidal rule in log-radius
+    for(int i = 0; i < TABLE_SIZE-1; ++i)
+        sum += 0.5f*this->s.h*(exp(2*table_node(&this->s, i) + this->s.y[i] - fmx)
+                             + exp(2*table_node(&this->s, i+1) + this->s.y[i+1] - fmx));
+    
+    // derivatives for interpolation
+    table_slopes(&this->s);
+    
+    // flux beyond the last node, where profile is extrapolated
+    if(this->s.m[TABLE_SIZE-1] < -2)
+        sum -= exp(2*table_node(&this->s, TABLE_SIZE-1) + this->s.y[TABLE_SIZE-1] - fmx)/(2 + this->s.m[TABLE_SIZE-1]);
+    
+    // normalise to total luminosity, derivatives are unchanged
+    for(int i = 0; i < TABLE_SIZE; ++i)
+        this->s.y[i] += -0.4f*mag*LOG_10 - LOG_2PI - 2*this->lr - fmx - log(sum);
+}
@@ -26,7 +26,7 @@ data
 static float brightness(local data* this, float2 x)
 {
     // de Vaucouleurs profile for centered and rotated coordinate system
-    return this->norm*exp(-DEVAUC_B*sqrt(sqrt(length(mv22(this->t, x - this->x))/this->rs)));
+    return this->norm*fm_exp(-DEVAUC_B*sqrt(sqrt(length(mv22(this->t, x - this->x))/this->rs)));
 }
 
 static void set(local data* this, float x, float y, float r, float mag, float q, float pa)
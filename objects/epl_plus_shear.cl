@@ -1,5 +1,10 @@
 // elliptical power law profile lens (Tessore & Metcalf 2015)
 
+// maximum number of terms in angular series
+#define EPL_TERMS 64
+// relative precision of truncated angular series
+#define EPL_PREC 1e-7f
+
 type = LENS;
 
 params
@@ -21,8 +26,9 @@ data
     mat22 w;  // inverse rotation matrix
     mat22 g;  // shear matrix
     float t;  // slope
-    float f;  // second flattening of ellipse
     float n;  // normalisation
+    int k;    // number of terms in angular series
+    float c[EPL_TERMS]; // coefficients of angular series
 };
 
 static float2 deflection(local data* this, float2 x)
@@ -32,9 +38,6 @@ static float2 deflection(local data* this, float2 x)
     float c, s, c2, s2;
     mat22 R;
     
-    const float T = 2 - this->t;
-    const float f = this->f;
-    
     // translate to central coordinates
     float2 dx = x - this->x;
     
@@ -43,30 +46,22 @@ static float2 deflection(local data* this, float2 x)
     
     // elliptical radius and polar angle
     r = length(x);
-    phi = atan2(x.y, x.x);
+    phi = fm_atan2(x.y, x.x);
     
     // sines and cosines
-    s = sincos(phi, &c);
-    s2 = sincos(2*phi, &c2);
+    s = fm_sincos(phi, &c);
+    s2 = fm_sincos(2*phi, &c2);
     
     // rotation matrix
     R = (mat22)(c2, -s2, s2, c2);
     
-    // angular part of deflection, up to tenth order
-    a  = A = (float2)(c, s);
-    a += A = -f*(2* 1 - T)/(2* 1 + T)*mv22(R, A);
-    a += A = -f*(2* 2 - T)/(2* 2 + T)*mv22(R, A);
-    a += A = -f*(2* 3 - T)/(2* 3 + T)*mv22(R, A);
-    a += A = -f*(2* 4 - T)/(2* 4 + T)*mv22(R, A);
-    a += A = -f*(2* 5 - T)/(2* 5 + T)*mv22(R, A);
-    a += A = -f*(2* 6 - T)/(2* 6 + T)*mv22(R, A);
-    a += A = -f*(2* 7 - T)/(2* 7 + T)*mv22(R, A);
-    a += A = -f*(2* 8 - T)/(2* 8 + T)*mv22(R, A);
-    a += A = -f*(2* 9 - T)/(2* 9 + T)*mv22(R, A);
-    a += A = -f*(2*10 - T)/(2*10 + T)*mv22(R, A);
+    // angular part of deflection, truncated at precision
+    a = A = (float2)(c, s);
+    for(int i = 0; i < this->k; ++i)
+        a += A = this->c[i]*mv22(R, A);
     
     // radial part of deflection
-    a *= this->n*powr(r, 1-this->t);
+    a *= this->n*fm_powr(r, 1-this->t);
     
     // reverse coordinate rotation
     float2 y = mv22(this->w, a);
@@ -94,10 +89,23 @@ static void set(local data* this,
     this->t = t;
     
     // second flattening of ellipse with axis ratio q
-    this->f = (1 - q)/(1 + q);
+    float f = (1 - q)/(1 + q);
     
     // normalisation of deflection
     this->n = 2*r*sqrt(q)/(1 + q);
+    
+    // coefficients of angular series, which are bounded by f in magnitude;
+    // stop when the remainder of the series, which is bounded by |A| f/(1-f)
+    // for the last term A, is below the required precision
+    float A = 1;
+    this->k = 0;
+    while(this->k < EPL_TERMS && A*f > EPL_PREC*(1 - f))
+    {
+        int n = this->k + 1;
+        this->c[this->k] = -f*(2*n - 2 + t)/(2*n + 2 - t);
+        A *= fabs(this->c[this->k]);
+        this->k += 1;
+    }
 
     // shear matrix
     this->g = (mat22)(g1,g2,g2,-g1);
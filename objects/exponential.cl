@@ -21,7 +21,7 @@ data
 static float brightness(local data* this, float2 x)
 {
     // exponential profile for centered and rotated coordinate system
-    return this->norm*exp(-length(mv22(this->t, x - this->x))/this->rs);
+    return this->norm*fm_exp(-length(mv22(this->t, x - this->x))/this->rs);
 }
 
 static void set(local data* this, float x, float y, float rs, float mag, float q, float pa)
@@ -16,13 +16,21 @@ data
     mat22 t;    // coordinate transformation matrix
     float s2;   // variance
     float norm; // normalisation
+    float k;    // inverse width of profile along x at fixed y
+    float m;    // shift of profile along x per unit y
+    float b;    // inverse variance of marginal profile along y
 };
 
 static float brightness(local data* this, float2 x)
 {
     // Gaussian profile for centered and rotated coordinate system
     float2 y = mv22(this->t, x - this->x);
-    return this->norm*exp(-0.5f*dot(y, y)/this->s2);
+    return this->norm*fm_exp(-0.5f*dot(y, y)/this->s2);
+}
+
+static float integral(local data* this, float2 x0, float2 x1)
+{
+    return this->norm*gauss_integral(x0 - this->x, x1 - this->x, this->k, this->m, this->b);
 }
 
 static void set(local data* this, float x, float y, float sigma, float mag, float q, float pa)
@@ -38,4 +46,11 @@ static void set(local data* this, float x, float y, float sigma, float mag, floa
     
     this->s2 = sigma*sigma;
     this->norm = exp(-0.4f*mag*LOG_10)*0.5f/PI/this->s2/q;
+    
+    // profile along x for fixed y, and marginal profile along y
+    float axx = q*q*c*c + s*s;
+    float axy = (q*q - 1)*c*s;
+    this->k = sqrt(0.5f*axx/this->s2);
+    this->m = axy/axx;
+    this->b = 0.5f*q*q/this->s2/axx;
 }
@@ -0,0 +1,472 @@
+// Sersic profile as a multi-Gaussian expansion
+
+// rows of expansion table, equidistant in log(n)
+#define MGE_SERSIC_ROWS 33
+#define MGE_SERSIC_LOGN0 -0.6931471806f
+#define MGE_SERSIC_LOGN1 2.0794415417f
+
+type = SOURCE;
+
+params
+{
+    { "x",   POSITION_X },
+    { "y",   POSITION_Y },
+    { "r",   RADIUS     },
+    { "mag", MAGNITUDE  },
+    { "n",   PARAMETER, { 0.5f, 8.0f } },
+    { "q",   AXIS_RATIO },
+    { "pa",  POS_ANGLE  }
+};
+
+data
+{
+    struct mge g;   // multi-Gaussian expansion
+};
+
+#if MGE_SIZE != 14
+#error "mge_sersic: expansion size does not match table"
+#endif
+
+// log of luminosity fractions of Gaussians
+constant float mge_sersic_lum[MGE_SERSIC_ROWS][MGE_SIZE] = {
+    {
+        -2.198427e+01f, -1.866320e+01f, -1.600450e+01f, -1.372572e+01f,
+        -1.170397e+01f, -9.876090e+00f, -8.207351e+00f, -6.671616e+00f,
+        -5.220016e+00f, -3.739031e+00f, -2.187589e+00f, -9.434398e-01f,
+        -8.636407e-01f, -3.150561e+00f
+    },
+    {
+        -2.092761e+01f, -1.774049e+01f, -1.515119e+01f, -1.291557e+01f,
+        -1.092335e+01f, -9.116519e+00f, -7.463263e+00f, -5.943547e+00f,
+        -4.530873e+00f, -3.177438e+00f, -1.881568e+00f, -9.315294e-01f,
+        -1.032562e+00f, -3.174528e+00f
+    },
+    {
+        -1.987094e+01f, -1.681781e+01f, -1.429800e+01f, -1.210589e+01f,
+        -1.014412e+01f, -8.360547e+00f, -6.727358e+00f, -5.231554e+00f,
+        -3.867216e+00f, -2.635375e+00f, -1.594010e+00f, -9.801805e-01f,
+        -1.267020e+00f, -3.205307e+00f
+    },
+    {
+        -1.882784e+01f, -1.584476e+01f, -1.336053e+01f, -1.119082e+01f,
+        -9.246798e+00f, -7.482065e+00f, -5.875378e+00f, -4.424754e+00f,
+        -3.145454e+00f, -2.074778e+00f, -1.306423e+00f, -1.058687e+00f,
+        -1.718543e+00f, -3.969482e+00f
+    },
+    {
+        -1.795671e+01f, -1.504548e+01f, -1.259866e+01f, -1.045340e+01f,
+        -8.530378e+00f, -6.790297e+00f, -5.220323e+00f, -3.830907e+00f,
+        -2.655184e+00f, -1.749063e+00f, -1.207993e+00f, -1.216410e+00f,
+        -2.107982e+00f, -4.532318e+00f
+    },
+    {
+        -1.719029e+01f, -1.435116e+01f, -1.194328e+01f, -9.824847e+00f,
+        -7.926692e+00f, -6.217569e+00f, -4.693643e+00f, -3.376366e+00f,
+        -2.310068e+00f, -1.555974e+00f, -1.199235e+00f, -1.393829e+00f,
+        -2.436970e+00f, -4.955121e+00f
+    },
+    {
+        -1.649570e+01f, -1.372804e+01f, -1.136059e+01f, -9.271720e+00f,
+        -7.402782e+00f, -5.730902e+00f, -4.260666e+00f, -3.021575e+00f,
+        -2.062872e+00f, -1.443745e+00f, -1.236341e+00f, -1.569525e+00f,
+        -2.712736e+00f, -5.273099e+00f
+    },
+    {
+        -1.585393e+01f, -1.315667e+01f, -1.083124e+01f, -8.775058e+00f,
+        -6.939938e+00f, -5.311111e+00f, -3.900187e+00f, -2.741448e+00f,
+        -1.884496e+00f, -1.383157e+00f, -1.297191e+00f, -1.734833e+00f,
+        -2.942479e+00f, -5.509138e+00f
+    },
+    {
+        -1.525253e+01f, -1.262443e+01f, -1.034282e+01f, -8.322764e+00f,
+        -6.526115e+00f, -4.945430e+00f, -3.597535e+00f, -2.518623e+00f,
+        -1.755830e+00f, -1.356519e+00f, -1.369647e+00f, -1.886259e+00f,
+        -3.132491e+00f, -5.679358e+00f
+    },
+    {
+        -1.468291e+01f, -1.212285e+01f, -9.887106e+00f, -7.906844e+00f,
+        -6.153163e+00f, -4.624820e+00f, -3.342006e+00f, -2.340633e+00f,
+        -1.663859e+00f, -1.352586e+00f, -1.446662e+00f, -2.022601e+00f,
+        -3.288048e+00f, -5.795649e+00f
+    },
+    {
+        -1.413886e+01f, -1.164602e+01f, -9.458469e+00f, -7.521760e+00f,
+        -5.815212e+00f, -4.342472e+00f, -3.125435e+00f, -2.198240e+00f,
+        -1.599430e+00f, -1.363928e+00f, -1.524011e+00f, -2.143769e+00f,
+        -3.413588e+00f, -5.867155e+00f
+    },
+    {
+        -1.361576e+01f, -1.118974e+01f, -9.052939e+00f, -7.163521e+00f,
+        -5.507816e+00f, -4.093031e+00f, -2.941421e+00f, -2.084449e+00f,
+        -1.555941e+00f, -1.385498e+00f, -1.599133e+00f, -2.250232e+00f,
+        -3.512878e+00f, -5.901123e+00f
+    },
+    {
+        -1.311023e+01f, -1.075111e+01f, -8.667796e+00f, -6.829260e+00f,
+        -5.227558e+00f, -3.872241e+00f, -2.784920e+00f, -1.993920e+00f,
+        -1.528560e+00f, -1.413795e+00f, -1.670466e+00f, -2.342688e+00f,
+        -3.589054e+00f, -5.903284e+00f
+    },
+    {
+        -1.262046e+01f, -1.032910e+01f, -8.302257e+00f, -6.518017e+00f,
+        -4.972896e+00f, -3.677741e+00f, -2.652829e+00f, -1.923208e+00f,
+        -1.514042e+00f, -1.446290e+00f, -1.736510e+00f, -2.420718e+00f,
+        -3.642594e+00f, -5.874625e+00f
+    },
+    {
+        -1.214968e+01f, -9.929245e+00f, -7.963075e+00f, -6.236786e+00f,
+        -4.750218e+00f, -3.514661e+00f, -2.548616e+00f, -1.873901e+00f,
+        -1.511967e+00f, -1.480387e+00f, -1.792168e+00f, -2.475838e+00f,
+        -3.659375e+00f, -5.791010e+00f
+    },
+    {
+        -1.170463e+01f, -9.561670e+00f, -7.662130e+00f, -5.997858e+00f,
+        -4.571050e+00f, -3.392804e+00f, -2.479623e+00f, -1.850295e+00f,
+        -1.523045e+00f, -1.512671e+00f, -1.829273e+00f, -2.493892e+00f,
+        -3.615705e+00f, -5.611687e+00f
+    },
+    {
+        -1.128313e+01f, -9.223917e+00f, -7.396460e+00f, -5.797619e+00f,
+        -4.431150e+00f, -3.307549e+00f, -2.441294e+00f, -1.848437e+00f,
+        -1.544439e+00f, -1.541832e+00f, -1.848412e+00f, -2.478058e+00f,
+        -3.518686e+00f, -5.350210e+00f
+    },
+    {
+        -1.087914e+01f, -8.907745e+00f, -7.156070e+00f, -5.624864e+00f,
+        -4.318820e+00f, -3.247619e+00f, -2.423829e+00f, -1.861102e+00f,
+        -1.572547e+00f, -1.568829e+00f, -1.855958e+00f, -2.441564e+00f,
+        -3.392180e+00f, -5.048886e+00f
+    },
+    {
+        -1.048789e+01f, -8.606406e+00f, -6.932634e+00f, -5.470247e+00f,
+        -4.224404e+00f, -3.203872e+00f, -2.419488e+00f, -1.882830e+00f,
+        -1.605017e+00f, -1.595143e+00f, -1.857837e+00f, -2.395619e+00f,
+        -3.255068e+00f, -4.738801e+00f
+    },
+    {
+        -1.010626e+01f, -8.315247e+00f, -6.720228e+00f, -5.327019e+00f,
+        -4.140901e+00f, -3.169704e+00f, -2.422722e+00f, -1.909757e+00f,
+        -1.640245e+00f, -1.621956e+00f, -1.858430e+00f, -2.348160e+00f,
+        -3.119813e+00f, -4.438408e+00f
+    },
+    {
+        -9.732023e+00f, -8.030690e+00f, -6.514146e+00f, -5.189738e+00f,
+        -4.062625e+00f, -3.139718e+00f, -2.428950e+00f, -1.938614e+00f,
+        -1.676729e+00f, -1.649948e+00f, -1.860956e+00f, -2.305148e+00f,
+        -2.995343e+00f, -4.159661e+00f
+    },
+    {
+        -7.158435e+00f, -8.875721e+00f, -7.196959e+00f, -5.727248e+00f,
+        -4.472694e+00f, -3.437662e+00f, -2.627949e+00f, -2.050031e+00f,
+        -1.710403e+00f, -1.614730e+00f, -1.765604e+00f, -2.156815e+00f,
+        -2.781999e+00f, -3.811932e+00f
+    },
+    {
+        -6.498360e+00f, -8.548756e+00f, -6.961475e+00f, -5.570188e+00f,
+        -4.381872e+00f, -3.400545e+00f, -2.631191e+00f, -2.079262e+00f,
+        -1.750193e+00f, -1.648729e+00f, -1.776867e+00f, -2.127117e+00f,
+        -2.682761e+00f, -3.579222e+00f
+    },
+    {
+        -5.985550e+00f, -8.224728e+00f, -6.727547e+00f, -5.413735e+00f,
+        -4.290916e+00f, -3.362734e+00f, -2.633460e+00f, -2.107682e+00f,
+        -1.789948e+00f, -1.684236e+00f, -1.792037e+00f, -2.104904e+00f,
+        -2.597303e+00f, -3.370737e+00f
+    },
+    {
+        -5.541160e+00f, -7.907302e+00f, -6.497868e+00f, -5.259696e+00f,
+        -4.200897e+00f, -3.324740e+00f, -2.634873e+00f, -2.135151e+00f,
+        -1.829384e+00f, -1.720897e+00f, -1.810757e+00f, -2.089811e+00f,
+        -2.525014e+00f, -3.185373e+00f
+    },
+    {
+        -5.146084e+00f, -7.598028e+00f, -6.273584e+00f, -5.108820e+00f,
+        -4.112236e+00f, -3.286740e+00f, -2.635436e+00f, -2.161562e+00f,
+        -1.868306e+00f, -1.758445e+00f, -1.832688e+00f, -2.081374e+00f,
+        -2.465057e+00f, -3.021702e+00f
+    },
+    {
+        -4.791366e+00f, -7.298127e+00f, -6.055666e+00f, -4.961823e+00f,
+        -4.025426e+00f, -3.249045e+00f, -2.635316e+00f, -2.186956e+00f,
+        -1.906633e+00f, -1.796660e+00f, -1.857449e+00f, -2.078984e+00f,
+        -2.416368e+00f, -2.878015e+00f
+    },
+    {
+        -4.471177e+00f, -7.008625e+00f, -5.844964e+00f, -4.819371e+00f,
+        -3.940970e+00f, -3.212023e+00f, -2.634761e+00f, -2.211464e+00f,
+        -1.944361e+00f, -1.835375e+00f, -1.884673e+00f, -2.082001e+00f,
+        -2.377822e+00f, -2.752525e+00f
+    },
+    {
+        -4.181022e+00f, -6.730428e+00f, -5.642269e+00f, -4.682130e+00f,
+        -3.859412e+00f, -3.176103e+00f, -2.634089e+00f, -2.235281e+00f,
+        -1.981540e+00f, -1.874461e+00f, -1.914008e+00f, -2.089785e+00f,
+        -2.348308e+00f, -2.643481e+00f
+    },
+    {
+        -3.917187e+00f, -6.464278e+00f, -5.448246e+00f, -4.550677e+00f,
+        -3.781243e+00f, -3.141693e+00f, -2.633618e+00f, -2.258618e+00f,
+        -2.018247e+00f, -1.913825e+00f, -1.945147e+00f, -2.101751e+00f,
+        -2.326795e+00f, -2.549241e+00f
+    },
+    {
+        -3.676497e+00f, -6.210765e+00f, -5.263443e+00f, -4.425509e+00f,
+        -3.706905e+00f, -3.109175e+00f, -2.633657e+00f, -2.281692e+00f,
+        -2.054577e+00f, -1.953400e+00f, -1.977823e+00f, -2.117367e+00f,
+        -2.312346e+00f, -2.468293e+00f
+    },
+    {
+        -3.456214e+00f, -5.970295e+00f, -5.088248e+00f, -4.306992e+00f,
+        -3.636740e+00f, -3.078856e+00f, -2.634468e+00f, -2.304697e+00f,
+        -2.090625e+00f, -1.993148e+00f, -2.011815e+00f, -2.136177e+00f,
+        -2.304131e+00f, -2.399279e+00f
+    },
+    {
+        -3.253972e+00f, -5.743039e+00f, -4.922826e+00f, -4.195293e+00f,
+        -3.570917e+00f, -3.050912e+00f, -2.636222e+00f, -2.327779e+00f,
+        -2.126482e+00f, -2.033060e+00f, -2.046973e+00f, -2.157821e+00f,
+        -2.301453e+00f, -2.340992e+00f
+    }
+};
+
+// log of standard deviations of Gaussians for unit effective radius
+constant float mge_sersic_sig[MGE_SERSIC_ROWS][MGE_SIZE] = {
+    {
+        -5.073752e+00f, -4.164291e+00f, -3.449932e+00f, -2.844357e+00f,
+        -2.311253e+00f, -1.832615e+00f, -1.399619e+00f, -1.008017e+00f,
+        -6.500371e-01f, -3.105090e-01f, -1.721145e-01f, -1.576959e-01f,
+        -1.560842e-01f, -1.473339e-01f
+    },
+    {
+        -5.191703e+00f, -4.288309e+00f, -3.566325e+00f, -2.949483e+00f,
+        -2.405023e+00f, -1.917445e+00f, -1.481117e+00f, -1.097289e+00f,
+        -7.706835e-01f, -5.044747e-01f, -2.990590e-01f, -1.546253e-01f,
+        -6.172863e-02f, 1.254319e-03f
+    },
+    {
+        -5.309653e+00f, -4.412289e+00f, -3.682513e+00f, -3.053826e+00f,
+        -2.496327e+00f, -1.995501e+00f, -1.545824e+00f, -1.148057e+00f,
+        -8.062458e-01f, -5.229787e-01f, -2.962029e-01f, -1.207146e-01f,
+        1.214994e-02f, 1.168610e-01f
+    },
+    {
+        -5.348519e+00f, -4.439826e+00f, -3.693415e+00f, -3.047617e+00f,
+        -2.474209e+00f, -1.959700e+00f, -1.499382e+00f, -1.094395e+00f,
+        -7.481401e-01f, -4.611186e-01f, -2.278459e-01f, -3.918687e-02f,
+        1.150075e-01f, 2.477089e-01f
+    },
+    {
+        -5.388487e+00f, -4.471246e+00f, -3.710006e+00f, -3.048369e+00f,
+        -2.460077e+00f, -1.932741e+00f, -1.462306e+00f, -1.049849e+00f,
+        -6.975811e-01f, -4.038265e-01f, -1.606993e-01f, 4.291023e-02f,
+        2.178815e-01f, 3.771031e-01f
+    },
+    {
+        -5.427627e+00f, -4.504110e+00f, -3.729733e+00f, -3.053543e+00f,
+        -2.451412e+00f, -1.912051e+00f, -1.431834e+00f, -1.011385e+00f,
+        -6.514856e-01f, -3.486805e-01f, -9.370304e-02f, 1.256103e-01f,
+        3.209183e-01f, 5.059495e-01f
+    },
+    {
+        -5.464953e+00f, -4.537043e+00f, -3.751138e+00f, -3.061684e+00f,
+        -2.446753e+00f, -1.896084e+00f, -1.406245e+00f, -9.771433e-01f,
+        -6.081656e-01f, -2.945976e-01f, -2.650684e-02f, 2.088946e-01f,
+        4.242265e-01f, 6.347275e-01f
+    },
+    {
+        -5.500026e+00f, -4.569298e+00f, -3.773392e+00f, -3.071950e+00f,
+        -2.445219e+00f, -1.883849e+00f, -1.384399e+00f, -9.459447e-01f,
+        -5.666731e-01f, -2.410746e-01f, 4.099268e-02f, 2.927215e-01f,
+        5.278623e-01f, 7.636996e-01f
+    },
+    {
+        -5.532651e+00f, -4.600415e+00f, -3.795944e+00f, -3.083751e+00f,
+        -2.446157e+00f, -1.874584e+00f, -1.365442e+00f, -9.169802e-01f,
+        -5.264344e-01f, -1.878627e-01f, 1.088060e-01f, 3.770370e-01f,
+        6.318413e-01f, 8.930023e-01f
+    },
+    {
+        -5.562846e+00f, -4.630194e+00f, -3.818496e+00f, -3.096725e+00f,
+        -2.449122e+00f, -1.867745e+00f, -1.348774e+00f, -8.897201e-01f,
+        -4.871216e-01f, -1.348638e-01f, 1.768827e-01f, 4.617628e-01f,
+        7.361363e-01f, 1.022683e+00f
+    },
+    {
+        -5.590748e+00f, -4.658601e+00f, -3.840906e+00f, -3.110643e+00f,
+        -2.453788e+00f, -1.862915e+00f, -1.333954e+00f, -8.638092e-01f,
+        -4.485470e-01f, -8.205920e-02f, 2.451400e-01f, 5.468014e-01f,
+        8.406862e-01f, 1.152725e+00f
+    },
+    {
+        -5.616563e+00f, -4.685694e+00f, -3.863118e+00f, -3.125349e+00f,
+        -2.459898e+00f, -1.859763e+00f, -1.320650e+00f, -8.390064e-01f,
+        -4.106081e-01f, -2.947589e-02f, 3.134746e-01f, 6.320385e-01f,
+        9.454013e-01f, 1.283063e+00f
+    },
+    {
+        -5.640548e+00f, -4.711619e+00f, -3.885161e+00f, -3.140764e+00f,
+        -2.467276e+00f, -1.858057e+00f, -1.308647e+00f, -8.151769e-01f,
+        -3.732831e-01f, 2.280722e-02f, 3.817472e-01f, 7.173243e-01f,
+        1.050148e+00f, 1.413576e+00f
+    },
+    {
+        -5.663193e+00f, -4.736881e+00f, -3.907506e+00f, -3.157301e+00f,
+        -2.476284e+00f, -1.858142e+00f, -1.298321e+00f, -7.927707e-01f,
+        -3.371053e-01f, 7.418859e-02f, 4.493177e-01f, 8.020125e-01f,
+        1.154290e+00f, 1.543637e+00f
+    },
+    {
+        -5.686345e+00f, -4.764104e+00f, -3.933292e+00f, -3.178447e+00f,
+        -2.490642e+00f, -1.863902e+00f, -1.293682e+00f, -7.758823e-01f,
+        -3.062074e-01f, 1.205377e-01f, 5.120687e-01f, 8.819604e-01f,
+        1.253591e+00f, 1.668971e+00f
+    },
+    {
+        -5.712884e+00f, -4.797603e+00f, -3.967883e+00f, -3.210335e+00f,
+        -2.517050e+00f, -1.882464e+00f, -1.302168e+00f, -7.721651e-01f,
+        -2.883659e-01f, 1.540224e-01f, 5.621165e-01f, 9.491107e-01f,
+        1.339607e+00f, 1.780818e+00f
+    },
+    {
+        -5.742794e+00f, -4.837321e+00f, -4.011272e+00f, -3.253089e+00f,
+        -2.555850e+00f, -1.914464e+00f, -1.324774e+00f, -7.829971e-01f,
+        -2.853381e-01f, 1.725408e-01f, 5.970711e-01f, 1.000828e+00f,
+        1.409443e+00f, 1.876183e+00f
+    },
+    {
+        -5.774599e+00f, -4.880886e+00f, -4.060462e+00f, -3.303330e+00f,
+        -2.603494e+00f, -1.956371e+00f, -1.358127e+00f, -8.052641e-01f,
+        -2.943228e-01f, 1.785721e-01f, 6.191520e-01f, 1.039236e+00f,
+        1.465338e+00f, 1.957588e+00f
+    },
+    {
+        -5.807001e+00f, -4.926152e+00f, -4.112672e+00f, -3.357859e+00f,
+        -2.656556e+00f, -2.004691e+00f, -1.398789e+00f, -8.356722e-01f,
+        -3.122241e-01f, 1.749883e-01f, 6.310346e-01f, 1.066943e+00f,
+        1.510008e+00f, 2.027836e+00f
+    },
+    {
+        -5.839057e+00f, -4.971492e+00f, -4.165730e+00f, -3.414116e+00f,
+        -2.712235e+00f, -2.056504e+00f, -1.443817e+00f, -8.713209e-01f,
+        -3.362353e-01f, 1.644679e-01f, 6.352601e-01f, 1.086402e+00f,
+        1.545883e+00f, 2.089162e+00f
+    },
+    {
+        -5.869960e+00f, -5.015477e+00f, -4.217671e+00f, -3.469718e+00f,
+        -2.767848e+00f, -2.108927e+00f, -1.490204e+00f, -9.091423e-01f,
+        -3.632764e-01f, 1.500604e-01f, 6.348091e-01f, 1.100500e+00f,
+        1.575702e+00f, 2.143894e+00f
+    },
+    {
+        -7.082912e+00f, -5.687099e+00f, -4.797760e+00f, -3.968955e+00f,
+        -3.193693e+00f, -2.467639e+00f, -1.787115e+00f, -1.148852e+00f,
+        -5.498265e-01f, 1.296051e-02f, 5.432921e-01f, 1.049567e+00f,
+        1.559485e+00f, 2.164451e+00f
+    },
+    {
+        -7.107255e+00f, -5.722907e+00f, -4.846509e+00f, -4.025439e+00f,
+        -3.253461e+00f, -2.526876e+00f, -1.842496e+00f, -1.197464e+00f,
+        -5.891249e-01f, -1.485530e-02f, 5.286698e-01f, 1.049199e+00f,
+        1.574590e+00f, 2.203817e+00f
+    },
+    {
+        -7.119025e+00f, -5.754569e+00f, -4.890887e+00f, -4.077756e+00f,
+        -3.309544e+00f, -2.583107e+00f, -1.895699e+00f, -1.244836e+00f,
+        -6.282025e-01f, -4.350829e-02f, 5.121703e-01f, 1.046006e+00f,
+        1.585981e+00f, 2.238462e+00f
+    },
+    {
+        -7.125792e+00f, -5.783554e+00f, -4.932021e+00f, -4.126695e+00f,
+        -3.362432e+00f, -2.636557e+00f, -1.946715e+00f, -1.290757e+00f,
+        -6.666695e-01f, -7.245988e-02f, 4.944456e-01f, 1.040709e+00f,
+        1.594399e+00f, 2.269036e+00f
+    },
+    {
+        -7.129390e+00f, -5.810215e+00f, -4.970158e+00f, -4.172374e+00f,
+        -3.412105e+00f, -2.687077e+00f, -1.995275e+00f, -1.334846e+00f,
+        -7.040461e-01f, -1.011440e-01f, 4.761281e-01f, 1.033979e+00f,
+        1.600521e+00f, 2.296150e+00f
+    },
+    {
+        -7.130675e+00f, -5.834758e+00f, -5.005467e+00f, -4.214893e+00f,
+        -3.458579e+00f, -2.734595e+00f, -2.041219e+00f, -1.376856e+00f,
+        -7.400035e-01f, -1.291570e-01f, 4.576830e-01f, 1.026321e+00f,
+        1.604875e+00f, 2.320299e+00f
+    },
+    {
+        -7.130189e+00f, -5.857334e+00f, -5.038094e+00f, -4.254355e+00f,
+        -3.501903e+00f, -2.779093e+00f, -2.084459e+00f, -1.416632e+00f,
+        -7.743167e-01f, -1.562107e-01f, 4.394528e-01f, 1.018117e+00f,
+        1.607869e+00f, 2.341892e+00f
+    },
+    {
+        -7.128343e+00f, -5.878092e+00f, -5.068207e+00f, -4.290916e+00f,
+        -3.542195e+00f, -2.820643e+00f, -2.125010e+00f, -1.454126e+00f,
+        -8.068764e-01f, -1.821344e-01f, 4.216636e-01f, 1.009637e+00f,
+        1.609813e+00f, 2.361256e+00f
+    },
+    {
+        -7.125465e+00f, -5.897170e+00f, -5.095970e+00f, -4.324736e+00f,
+        -3.579592e+00f, -2.859343e+00f, -2.162927e+00f, -1.489342e+00f,
+        -8.376311e-01f, -2.068222e-01f, 4.044716e-01f, 1.001081e+00f,
+        1.610945e+00f, 2.378663e+00f
+    },
+    {
+        -7.121832e+00f, -5.914699e+00f, -5.121552e+00f, -4.355989e+00f,
+        -3.614256e+00f, -2.895329e+00f, -2.198304e+00f, -1.522329e+00f,
+        -8.665825e-01f, -2.302253e-01f, 3.879746e-01f, 9.925882e-01f,
+        1.611449e+00f, 2.394343e+00f
+    },
+    {
+        -7.117676e+00f, -5.930795e+00f, -5.145097e+00f, -4.384828e+00f,
+        -3.646329e+00f, -2.928718e+00f, -2.231231e+00f, -1.553139e+00f,
+        -8.937409e-01f, -2.523116e-01f, 3.722461e-01f, 9.842710e-01f,
+        1.611475e+00f, 2.408493e+00f
+    },
+    {
+        -7.113180e+00f, -5.945518e+00f, -5.166675e+00f, -4.411313e+00f,
+        -3.675851e+00f, -2.959529e+00f, -2.261697e+00f, -1.581736e+00f,
+        -9.190442e-01f, -2.729953e-01f, 3.573926e-01f, 9.762523e-01f,
+        1.611168e+00f, 2.421300e+00f
+    }
+};
+
+static float brightness(local data* this, float2 x)
+{
+    return mge_eval(&this->g, x);
+}
+
+static float integral(local data* this, float2 x0, float2 x1)
+{
+    return mge_integral(&this->g, x0, x1);
+}
+
+static void set(local data* this, float x, float y, float r, float mag, float n, float q, float pa)
+{
+    float c = cos(pa*DEG2RAD);
+    float s = sin(pa*DEG2RAD);
+    
+    // position in table, and position between rows
+    float u = (log(n) - MGE_SERSIC_LOGN0)/(MGE_SERSIC_LOGN1 - MGE_SERSIC_LOGN0)*(MGE_SERSIC_ROWS - 1);
+    int j = min(max((int)u, 0), MGE_SERSIC_ROWS - 2);
+    float t = u - j;
+    
+    // interpolated luminosity fractions and their sum
+    float l[MGE_SIZE];
+    float lsum = 0;
+    for(int i = 0; i < MGE_SIZE; ++i)
+    {
+        l[i] = exp(mix(mge_sersic_lum[j][i], mge_sersic_lum[j+1][i], t));
+        lsum += l[i];
+    }
+    
+    // total luminosity, shared by Gaussians
+    float ltot = exp(-0.4f*mag*LOG_10)/lsum;
+    
+    // position and transformation matrix: rotate and scale
+    mge_init(&this->g, (float2)(x, y), (mat22)(q*c, q*s, -s, c)/sqrt(q));
+    
+    // set Gaussians with interpolated widths
+    for(int i = 0; i < MGE_SIZE; ++i)
+        mge_set(&this->g, i, ltot*l[i], r*exp(mix(mge_sersic_sig[j][i], mge_sersic_sig[j+1][i], t)));
+}
@@ -0,0 +1,62 @@
+// Navarro-Frenk-White profile lens, with tabulated deflection
+// follows Bartelmann (1996), Wright & Brainerd (2000)
+
+type = LENS;
+
+params
+{
+    { "x",  POSITION_X              },
+    { "y",  POSITION_Y              },
+    { "rs", RADIUS                  },
+    { "ks", PARAMETER, POS_BOUND    }
+};
+
+data
+{
+    float2 x;       // lens position
+    float lrs;      // log of scale radius
+    struct table a; // log of deflection over radius
+};
+
+static float2 deflection(local data* this, float2 x)
+{
+    // central coordinates
+    x -= this->x;
+    
+    // deflection over radius from table of log-radius
+    return fm_exp(table_eval(&this->a, 0.5f*fm_log(dot(x, x)) - this->lrs))*x;
+}
+
+static void set(local data* this, float x, float y, float rs, float ks)
+{
+    // lens position
+    this->x = (float2)(x, y);
+    
+    // log of scale radius
+    this->lrs = log(rs);
+    
+    // tabulate in units of scale radius
+    table_init(&this->a, -7, 7);
+    
+    for(int i = 0; i < TABLE_SIZE; ++i)
+    {
+        // log-radius and radius of node
+        float l = table_node(&this->a, i);
+        float u = exp(l);
+        
+        // mass function, using series expansion close to centre
+        float h;
+        if(u < 0.05f)
+            h = 0.25f*u*u*(2*(M_LN2_F - l) - 1) + u*u*u*u*(0.375f*(M_LN2_F - l) - 0.21875f);
+        else if(u < 1)
+            h = log(0.5f*u) + acosh(1/u)/sqrt(1 - u*u);
+        else
+            h = log(0.5f*u) + acos(1/u)/sqrt(u*u - 1);
+        
+        // deflection over radius
+        this->a.y[i] = log(4*ks*h) - 2*l;
+    }
+    
+    // derivatives for interpolation
+    table_slopes(&this->a);
+}
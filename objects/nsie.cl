@@ -39,7 +39,7 @@ static float2 deflection(local data* this, float2 x)
     
     // NSIE deflection
     r = sqrt(this->q2*y.x*y.x + y.y*y.y);
-    y = this->d*(float2)(atan(y.x*this->e/(this->rc + r)), atanh(y.y*this->e/(this->rc*this->q2 + r)));
+    y = this->d*(float2)(fm_atan(y.x*this->e/(this->rc + r)), fm_atanh(y.y*this->e/(this->rc*this->q2 + r)));
     
     // reverse coordinate rotation
     return mv22(this->w, y);
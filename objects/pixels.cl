@@ -0,0 +1,26 @@
+type = SOURCE;
+
+params
+{
+    { "x",  POSITION_X  },
+    { "y",  POSITION_Y  },
+    { "r",  RADIUS      }
+};
+
+data
+{
+    float2 x;   // centre of grid
+    float r;    // half-width of grid
+};
+
+static float brightness(local data* this, float2 x)
+{
+    // the pixels are solved for after the rest of the model is rendered
+    return 0;
+}
+
+static void set(local data* this, float x, float y, float r)
+{
+    this->x = (float2)(x, y);
+    this->r = r;
+}
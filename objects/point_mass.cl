@@ -30,3 +30,9 @@ static void set(local data* this, float x, float y, float r)
     // Einstein radius squared
     this->r2 = r*r;
 }
+
+static float4 farfield(local data* this)
+{
+    // deflection is that of a point mass everywhere
+    return (float4)(this->x, this->r2, 1);
+}
@@ -23,7 +23,7 @@ data
 static float brightness(local data* this, float2 x)
 {
     float2 y = mv22(this->t, x - this->x);
-    return exp(this->log0 - exp(this->log1 + this->m*log(dot(y, y))));
+    return fm_exp(this->log0 - fm_exp(this->log1 + this->m*fm_log(dot(y, y))));
 }
 
 static void set(local data* this, float x, float y, float r, float mag, float n, float q, float a)
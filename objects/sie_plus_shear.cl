@@ -40,7 +40,7 @@ static float2 deflection(local data* this, float2 x)
     
     // SIE deflection
     r = this->e/sqrt(this->q2*y.x*y.x + y.y*y.y);
-    y = this->d*(float2)(atan(y.x*r), atanh(y.y*r));
+    y = this->d*(float2)(fm_atan(y.x*r), fm_atanh(y.y*r));
     
     // reverse coordinate rotation, apply shear
     return mv22(this->w, y) + mv22(this->g, x);
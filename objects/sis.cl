@@ -30,3 +30,9 @@ static void set(local data* this, float x, float y, float r)
     // Einstein radius
     this->r = r;
 }
+
+static float4 farfield(local data* this)
+{
+    // deflection is that of an isothermal sphere everywhere
+    return (float4)(this->x, this->r, 0);
+}
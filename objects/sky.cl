@@ -2,9 +2,9 @@ type = FOREGROUND;
 
 params
 {
-    { "bg" },
-    { "dx", PARAMETER, UNBOUNDED, -0.0f },
-    { "dy", PARAMETER, UNBOUNDED, -0.0f }
+    { "bg", AMPLITUDE },
+    { "dx", AMPLITUDE, UNBOUNDED, -0.0f },
+    { "dy", AMPLITUDE, UNBOUNDED, -0.0f }
 };
 
 data
@@ -18,6 +18,13 @@ static float foreground(local data* this, float2 x)
     return this->bg + dot(this->grad, x - (float2)(1, 1));
 }
 
+static float integral(local data* this, float2 x0, float2 x1)
+{
+    // plane is integrated exactly by its value at the centre
+    float2 d = x1 - x0;
+    return d.x*d.y*foreground(this, 0.5f*(x0 + x1));
+}
+
 static void set(local data* this, float bg, float dx, float dy)
 {
     this->bg = bg;
@@ -0,0 +1,208 @@
+#include <stdlib.h>
+#include <math.h>
+
+#include "opencl.h"
+#include "input.h"
+#include "profile.h"
+#include "lensed.h"
+#include "binned.h"
+#include "log.h"
+
+struct binned* binned_create(const struct lensed* lensed, cl_context context,
+                             cl_program program, size_t bin,
+                             const cl_float* psf, size_t psfw, size_t psfh,
+                             cl_float4 pcs, cl_ulong dsiz)
+{
+    struct shard* shard = lensed->shards;
+    struct binned* binned;
+    cl_int err;
+    cl_float* image;
+    cl_float* weight;
+    cl_float* bpsf;
+    cl_ulong pw, ph;
+    size_t size;
+    
+    binned = malloc(sizeof(struct binned));
+    if(!binned)
+        errori(NULL);
+    
+    // binned image covers all whole blocks of the image
+    binned->bin = bin;
+    binned->width = lensed->width/bin;
+    binned->height = lensed->height/bin;
+    size = binned->width*binned->height;
+    
+    verbose("    blocks: %zu x %zu of %zu pixels", (size_t)binned->width, (size_t)binned->height, bin);
+    
+    image = malloc(size*sizeof(cl_float));
+    weight = malloc(size*sizeof(cl_float));
+    if(!image || !weight)
+        errori(NULL);
+    
+    // binned image is the sum of the pixels in a block, and its weight the
+    // inverse of the summed variance, so that the chi^2 value of a block is a
+    // lower bound for the chi^2 value of its pixels; blocks with masked pixels
+    // are masked
+    binned->nblocks = 0;
+    for(size_t j = 0; j < binned->height; ++j)
+    {
+        for(size_t i = 0; i < binned->width; ++i)
+        {
+            double sum = 0, var = 0;
+            int mask = 0;
+            
+            for(size_t v = 0; v < bin; ++v)
+            {
+                for(size_t u = 0; u < bin; ++u)
+                {
+                    size_t k = (j*bin + v)*lensed->width + i*bin + u;
+                    
+                    sum += lensed->image[k];
+                    if(lensed->weight[k] > 0)
+                        var += 1/lensed->weight[k];
+                    else
+                        mask = 1;
+                }
+            }
+            
+            image[j*binned->width + i] = sum;
+            weight[j*binned->width + i] = mask ? 0 : 1/var;
+            
+            if(!mask)
+                binned->nblocks += 1;
+        }
+    }
+    
+    // binned PSF has odd size, with blocks around the pixel that the convolve
+    // kernel centres on the output pixel
+    pw = ph = 0;
+    bpsf = NULL;
+    if(psf)
+    {
+        long cw = psfw - 1 - psfw/2;
+        long ch = psfh - 1 - psfh/2;
+        long hw = floor((double)(psfw/2)/bin + 0.5);
+        long hh = floor((double)(psfh/2)/bin + 0.5);
+        
+        pw = 2*hw + 1;
+        ph = 2*hh + 1;
+        
+        bpsf = calloc(pw*ph, sizeof(cl_float));
+        if(!bpsf)
+            errori(NULL);
+        
+        for(long v = 0; v < psfh; ++v)
+        {
+            long bv = hh + floor((double)(v - ch)/bin + 0.5);
+            for(long u = 0; u < psfw; ++u)
+            {
+                long bu = hw + floor((double)(u - cw)/bin + 0.5);
+                bpsf[bv*pw + bu] += psf[v*psfw + u];
+            }
+        }
+        
+        verbose("    PSF: %zu x %zu", (size_t)pw, (size_t)ph);
+    }
+    
+    // buffers for binned data and model
+    binned->image_mem = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR | CL_MEM_HOST_NO_ACCESS, size*sizeof(cl_float), image, NULL);
+    binned->weight_mem = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR | CL_MEM_HOST_NO_ACCESS, size*sizeof(cl_float), weight, NULL);
+    binned->psf_mem = bpsf ? clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR | CL_MEM_HOST_NO_ACCESS, pw*ph*sizeof(cl_float), bpsf, NULL) : NULL;
+    binned->model_mem = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS, size*sizeof(cl_float), NULL, NULL);
+    binned->loglike_mem = clCreateBuffer(context, CL_MEM_WRITE_ONLY | CL_MEM_ALLOC_HOST_PTR | CL_MEM_HOST_READ_ONLY, size*sizeof(cl_float), NULL, NULL);
+    if(!binned->image_mem || !binned->weight_mem || (bpsf && !binned->psf_mem) || !binned->model_mem || !binned->loglike_mem)
+        error("failed to create binned image buffers");
+    
+    free(image);
+    free(weight);
+    free(bpsf);
+    
+    // kernels for model on blocks
+    binned->render = clCreateKernel(program, "binned_render", &err);
+    if(err != CL_SUCCESS)
+        error("failed to create binned render kernel");
+    
+    binned->loglike = clCreateKernel(program, "binned_loglike", &err);
+    if(err != CL_SUCCESS)
+        error("failed to create binned loglike kernel");
+    
+    // set kernel arguments, the model is computed from the object data of the
+    // first shard
+    err = 0;
+    err |= clSetKernelArg(binned->render, 0, sizeof(cl_ulong), &dsiz);
+    err |= clSetKernelArg(binned->render, 1, sizeof(cl_mem), &shard->object_mem);
+    err |= clSetKernelArg(binned->render, 2, dsiz*sizeof(cl_uint), NULL);
+    err |= clSetKernelArg(binned->render, 3, sizeof(cl_mem), lensed->field ? &lensed->field->mem : NULL);
+    err |= clSetKernelArg(binned->render, 4, sizeof(cl_float4), &pcs);
+    err |= clSetKernelArg(binned->render, 5, sizeof(cl_ulong), &binned->bin);
+    err |= clSetKernelArg(binned->render, 6, sizeof(cl_ulong), &binned->width);
+    err |= clSetKernelArg(binned->render, 7, sizeof(cl_ulong), &binned->height);
+    err |= clSetKernelArg(binned->render, 8, sizeof(cl_mem), &binned->model_mem);
+    err |= clSetKernelArg(binned->loglike, 0, sizeof(cl_mem), &binned->model_mem);
+    err |= clSetKernelArg(binned->loglike, 1, sizeof(cl_mem), binned->psf_mem ? &binned->psf_mem : NULL);
+    err |= clSetKernelArg(binned->loglike, 2, sizeof(cl_ulong), &pw);
+    err |= clSetKernelArg(binned->loglike, 3, sizeof(cl_ulong), &ph);
+    err |= clSetKernelArg(binned->loglike, 4, sizeof(cl_ulong), &binned->width);
+    err |= clSetKernelArg(binned->loglike, 5, sizeof(cl_ulong), &binned->height);
+    err |= clSetKernelArg(binned->loglike, 6, sizeof(cl_mem), &binned->image_mem);
+    err |= clSetKernelArg(binned->loglike, 7, sizeof(cl_mem), &binned->weight_mem);
+    err |= clSetKernelArg(binned->loglike, 8, sizeof(cl_mem), &binned->loglike_mem);
+    if(err != CL_SUCCESS)
+        error("failed to set binned image kernel arguments");
+    
+    // one work item per block, the binned image is small enough to let the
+    // implementation choose the work groups
+    binned->gws[0] = binned->width;
+    binned->gws[1] = binned->height;
+    
+    return binned;
+}
+
+double binned_chi2(const struct lensed* lensed, const struct binned* binned,
+                   cl_event* render_ev, cl_event* loglike_ev)
+{
+    struct shard* shard = lensed->shards;
+    
+    // number of blocks in binned image
+    size_t len = binned->width*binned->height;
+    
+    cl_int err;
+    cl_float* loglike;
+    double chi2 = 0;
+    
+    // simulate objects on blocks
+    err = clEnqueueNDRangeKernel(shard->queue, binned->render, 2, NULL, binned->gws, NULL, 0, NULL, render_ev);
+    if(err != CL_SUCCESS)
+        error("failed to run binned render kernel");
+    
+    // compare with binned image
+    err = clEnqueueNDRangeKernel(shard->queue, binned->loglike, 2, NULL, binned->gws, NULL, 0, NULL, loglike_ev);
+    if(err != CL_SUCCESS)
+        error("failed to run binned loglike kernel");
+    
+    // map chi^2 values from device
+    loglike = clEnqueueMapBuffer(shard->queue, binned->loglike_mem, CL_TRUE, CL_MAP_READ, 0, len*sizeof(cl_float), 0, NULL, NULL, &err);
+    if(err != CL_SUCCESS)
+        error("failed to map binned loglike buffer");
+    
+    // sum chi^2 values
+    for(size_t i = 0; i < len; ++i)
+        chi2 += loglike[i];
+    
+    clEnqueueUnmapMemObject(shard->queue, binned->loglike_mem, loglike, 0, NULL, NULL);
+    
+    return chi2;
+}
+
+void binned_free(struct binned* binned)
+{
+    clReleaseKernel(binned->render);
+    clReleaseKernel(binned->loglike);
+    clReleaseMemObject(binned->image_mem);
+    clReleaseMemObject(binned->weight_mem);
+    if(binned->psf_mem)
+        clReleaseMemObject(binned->psf_mem);
+    clReleaseMemObject(binned->model_mem);
+    clReleaseMemObject(binned->loglike_mem);
+    free(binned);
+}
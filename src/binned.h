@@ -0,0 +1,16 @@
+#pragma once
+
+// bin the image, weights and PSF into square blocks of pixels, and create the
+// kernels that compare a model on the blocks with the binned image
+struct binned* binned_create(const struct lensed* lensed, cl_context context,
+                             cl_program program, size_t bin,
+                             const cl_float* psf, size_t psfw, size_t psfh,
+                             cl_float4 pcs, cl_ulong dsiz);
+
+// compute the chi^2 value of the binned image for the parameters of the first
+// shard, which must be set
+double binned_chi2(const struct lensed* lensed, const struct binned* binned,
+                   cl_event* render_ev, cl_event* loglike_ev);
+
+// free binned image and its kernels
+void binned_free(struct binned* binned);
@@ -0,0 +1,310 @@
+// provide POSIX standard in strict C99 mode
+#define _XOPEN_SOURCE 700
+
+#include <stdlib.h>
+
+#include "broker.h"
+
+#ifdef LENSED_MPI
+
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "rank.h"
+#include "log.h"
+
+// number of times to yield before sleeping while waiting
+#define BROKER_SPINS 1000
+
+// time to sleep while waiting, in nanoseconds
+#define BROKER_SLEEP 20000
+
+// alignment of request slots, one cache line
+#define BROKER_ALIGN 64
+
+// states of a request slot
+enum { BROKER_IDLE, BROKER_PENDING, BROKER_DONE };
+
+// header of shared memory
+struct broker_shm
+{
+    // next position in ring, claimed by processes sending requests
+    unsigned tail;
+    
+    // number of processes that are done sending requests
+    unsigned done;
+};
+
+// entry of the ring of pending requests; the sequence number is even while the
+// entry is free for a lap of the ring, and odd while it holds a request
+struct broker_entry
+{
+    unsigned seq;
+    unsigned slot;
+};
+
+// request of a process in shared memory
+struct broker_slot
+{
+    unsigned state;
+    double loglike;
+    double params[];
+};
+
+struct broker
+{
+    // shared memory and its layout
+    void* mem;
+    struct broker_shm* shm;
+    struct broker_entry* ring;
+    char* slots;
+    size_t stride;
+    
+    // number of parameters
+    size_t npars;
+    
+    // number of entries in ring, a power of two
+    unsigned size;
+    
+    // rank of process and number of processes on node
+    int rank;
+    int nranks;
+    
+    // serving thread of first process
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    int stop;
+    unsigned head;
+    broker_eval eval;
+    void* data;
+};
+
+// request slot of process
+static struct broker_slot* broker_slot(struct broker* broker, unsigned rank)
+{
+    return (struct broker_slot*)(broker->slots + rank*broker->stride);
+}
+
+// wait a little while for shared memory to change
+static void broker_wait(unsigned* spins)
+{
+    if(++*spins < BROKER_SPINS)
+    {
+        sched_yield();
+    }
+    else
+    {
+        struct timespec ts = { 0, BROKER_SLEEP };
+        nanosleep(&ts, NULL);
+    }
+}
+
+// serve requests, collecting all pending requests into one batch
+static void* broker_serve(void* broker_)
+{
+    struct broker* broker = broker_;
+    
+    struct broker_slot** batch;
+    const double** params;
+    double* loglike;
+    unsigned spins = 0;
+    
+    batch = malloc(broker->nranks*sizeof(struct broker_slot*));
+    params = malloc(broker->nranks*sizeof(const double*));
+    loglike = malloc(broker->nranks*sizeof(double));
+    if(!batch || !params || !loglike)
+        errori(NULL);
+    
+    while(!__atomic_load_n(&broker->stop, __ATOMIC_ACQUIRE))
+    {
+        size_t n = 0;
+        
+        // take requests from ring until there are no more
+        while(n < broker->nranks)
+        {
+            struct broker_entry* entry = &broker->ring[broker->head & (broker->size - 1)];
+            unsigned lap = broker->head/broker->size;
+            
+            if(__atomic_load_n(&entry->seq, __ATOMIC_ACQUIRE) != 2*lap + 1)
+                break;
+            
+            batch[n] = broker_slot(broker, entry->slot);
+            params[n] = batch[n]->params;
+            n += 1;
+            
+            // free entry for next lap
+            __atomic_store_n(&entry->seq, 2*lap + 2, __ATOMIC_RELEASE);
+            broker->head += 1;
+        }
+        
+        if(n == 0)
+        {
+            broker_wait(&spins);
+            continue;
+        }
+        
+        spins = 0;
+        
+        // evaluate batch
+        pthread_mutex_lock(&broker->mutex);
+        broker->eval(broker->data, n, params, loglike);
+        pthread_mutex_unlock(&broker->mutex);
+        
+        // return results
+        for(size_t i = 0; i < n; ++i)
+        {
+            batch[i]->loglike = loglike[i];
+            __atomic_store_n(&batch[i]->state, BROKER_DONE, __ATOMIC_RELEASE);
+        }
+    }
+    
+    free(batch);
+    free(params);
+    free(loglike);
+    
+    return NULL;
+}
+
+struct broker* broker_create(size_t npars, broker_eval eval, void* data)
+{
+    size_t ring_off, slots_off;
+    
+    struct broker* broker = malloc(sizeof(struct broker));
+    if(!broker)
+        errori(NULL);
+    
+    broker->npars = npars;
+    broker->rank = rank_node();
+    broker->nranks = rank_node_size();
+    
+    // ring has room for a request of every process
+    broker->size = 1;
+    while(broker->size < broker->nranks)
+        broker->size *= 2;
+    
+    // layout of shared memory
+    ring_off = sizeof(struct broker_shm);
+    slots_off = ring_off + broker->size*sizeof(struct broker_entry);
+    slots_off = (slots_off + BROKER_ALIGN - 1)/BROKER_ALIGN*BROKER_ALIGN;
+    broker->stride = sizeof(struct broker_slot) + npars*sizeof(double);
+    broker->stride = (broker->stride + BROKER_ALIGN - 1)/BROKER_ALIGN*BROKER_ALIGN;
+    
+    // shared memory for all processes on node
+    broker->mem = rank_shared(slots_off + broker->nranks*broker->stride);
+    if(!broker->mem)
+        error("broker needs shared memory");
+    broker->shm = broker->mem;
+    broker->ring = (struct broker_entry*)((char*)broker->mem + ring_off);
+    broker->slots = (char*)broker->mem + slots_off;
+    
+    // first process serves requests
+    broker->stop = 0;
+    broker->head = 0;
+    broker->eval = eval;
+    broker->data = data;
+    if(broker->rank == 0)
+    {
+        pthread_mutex_init(&broker->mutex, NULL);
+        if(pthread_create(&broker->thread, NULL, broker_serve, broker) != 0)
+            error("failed to start broker");
+    }
+    
+    return broker;
+}
+
+double broker_request(struct broker* broker, const double* params)
+{
+    struct broker_slot* slot = broker_slot(broker, broker->rank);
+    struct broker_entry* entry;
+    unsigned pos, lap;
+    unsigned spins = 0;
+    double loglike;
+    
+    // write request
+    memcpy(slot->params, params, broker->npars*sizeof(double));
+    __atomic_store_n(&slot->state, BROKER_PENDING, __ATOMIC_RELAXED);
+    
+    // claim position in ring and wait for the entry to be free
+    pos = __atomic_fetch_add(&broker->shm->tail, 1, __ATOMIC_ACQ_REL);
+    lap = pos/broker->size;
+    entry = &broker->ring[pos & (broker->size - 1)];
+    while(__atomic_load_n(&entry->seq, __ATOMIC_ACQUIRE) != 2*lap)
+        broker_wait(&spins);
+    
+    // publish request
+    entry->slot = broker->rank;
+    __atomic_store_n(&entry->seq, 2*lap + 1, __ATOMIC_RELEASE);
+    
+    // wait for result
+    spins = 0;
+    while(__atomic_load_n(&slot->state, __ATOMIC_ACQUIRE) != BROKER_DONE)
+        broker_wait(&spins);
+    
+    loglike = slot->loglike;
+    
+    __atomic_store_n(&slot->state, BROKER_IDLE, __ATOMIC_RELAXED);
+    
+    return loglike;
+}
+
+void broker_lock(struct broker* broker)
+{
+    if(broker->rank == 0)
+        pthread_mutex_lock(&broker->mutex);
+}
+
+void broker_unlock(struct broker* broker)
+{
+    if(broker->rank == 0)
+        pthread_mutex_unlock(&broker->mutex);
+}
+
+void broker_free(struct broker* broker)
+{
+    // count this process as done
+    __atomic_fetch_add(&broker->shm->done, 1, __ATOMIC_ACQ_REL);
+    
+    // first process serves until all processes are done
+    if(broker->rank == 0)
+    {
+        unsigned spins = 0;
+        while(__atomic_load_n(&broker->shm->done, __ATOMIC_ACQUIRE) < broker->nranks)
+            broker_wait(&spins);
+        
+        __atomic_store_n(&broker->stop, 1, __ATOMIC_RELEASE);
+        pthread_join(broker->thread, NULL);
+        pthread_mutex_destroy(&broker->mutex);
+    }
+    
+    rank_shared_free(broker->mem);
+    
+    free(broker);
+}
+
+#else
+
+struct broker* broker_create(size_t npars, broker_eval eval, void* data)
+{
+    return NULL;
+}
+
+double broker_request(struct broker* broker, const double* params)
+{
+    return 0;
+}
+
+void broker_lock(struct broker* broker)
+{
+}
+
+void broker_unlock(struct broker* broker)
+{
+}
+
+void broker_free(struct broker* broker)
+{
+}
+
+#endif
@@ -0,0 +1,21 @@
+#pragma once
+
+// broker that evaluates the likelihoods of all processes on a node
+struct broker;
+
+// function that evaluates the log-likelihoods of a batch of parameters
+typedef void (*broker_eval)(void* data, size_t n, const double* params[], double loglike[]);
+
+// create broker for the processes on the node, which must all call this; the
+// first process serves the requests in a thread using the given function
+struct broker* broker_create(size_t npars, broker_eval eval, void* data);
+
+// send parameters to the broker and wait for their log-likelihood
+double broker_request(struct broker* broker, const double* params);
+
+// lock and unlock the broker for exclusive use of its device
+void broker_lock(struct broker* broker);
+void broker_unlock(struct broker* broker);
+
+// wait for all processes on the node to be done, then stop and free broker
+void broker_free(struct broker* broker);
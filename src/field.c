@@ -0,0 +1,188 @@
+#include <stdlib.h>
+#include <math.h>
+
+#include "opencl.h"
+#include "input.h"
+#include "profile.h"
+#include "lensed.h"
+#include "field.h"
+#include "log.h"
+
+void field_dims(const struct lensed* lensed, int level, size_t* nx, size_t* ny)
+{
+    // grid spacing for level
+    double hx = lensed->field->scale.s[0]*ldexp(1, -level);
+    double hy = lensed->field->scale.s[1]*ldexp(1, -level);
+    
+    // cover the image with one node before and two nodes after the bounds
+    *nx = ceil((lensed->field->bounds.s[2] - lensed->field->bounds.s[0])/hx) + 4;
+    *ny = ceil((lensed->field->bounds.s[3] - lensed->field->bounds.s[1])/hy) + 4;
+}
+
+void field_grid(struct lensed* lensed, int level)
+{
+    cl_int err;
+    size_t nx, ny, lws;
+    cl_float2 head[FIELD_HEAD];
+    
+    // grid spacing for level
+    double hx = lensed->field->scale.s[0]*ldexp(1, -level);
+    double hy = lensed->field->scale.s[1]*ldexp(1, -level);
+    
+    // grid dimensions for level
+    field_dims(lensed, level, &nx, &ny);
+    
+    // origin, one node before the lower bounds
+    head[0].s[0] = lensed->field->bounds.s[0] - hx;
+    head[0].s[1] = lensed->field->bounds.s[1] - hy;
+    
+    // spacing
+    head[1].s[0] = hx;
+    head[1].s[1] = hy;
+    
+    // inverse spacing
+    head[2].s[0] = 1/hx;
+    head[2].s[1] = 1/hy;
+    
+    // dimensions
+    head[3].s[0] = nx;
+    head[3].s[1] = ny;
+    
+    // write header to device
+    err = clEnqueueWriteBuffer(lensed->field->queue, lensed->field->mem, CL_TRUE, 0, sizeof(head), head, 0, NULL, NULL);
+    if(err != CL_SUCCESS)
+        error("failed to write deflection field header");
+    
+    // global work size must be padded to local work size
+    lws = lensed->field->grid_lws[0];
+    lensed->field->grid_gws[0] = nx*ny + (lws - (nx*ny)%lws)%lws;
+    
+    // store level
+    lensed->field->level = level;
+}
+
+// get maximum error of the deflection field at the test points
+static double field_error(struct lensed* lensed)
+{
+    cl_int err;
+    cl_float* error_map;
+    double max;
+    
+    // compare interpolated and direct deflection
+    err = clEnqueueNDRangeKernel(lensed->field->queue, lensed->field->check, 1, NULL, lensed->field->check_gws, lensed->field->check_lws, 0, NULL, NULL);
+    if(err != CL_SUCCESS)
+        error("failed to run deflection field check kernel");
+    
+    // map errors from device
+    error_map = clEnqueueMapBuffer(lensed->field->queue, lensed->field->error_mem, CL_TRUE, CL_MAP_READ, 0, FIELD_POINTS*sizeof(cl_float), 0, NULL, NULL, &err);
+    if(err != CL_SUCCESS)
+        error("failed to map deflection field error buffer");
+    
+    // find maximum error, invalid values count as failure
+    max = 0;
+    for(size_t i = 0; i < FIELD_POINTS; ++i)
+        if(!(error_map[i] <= max))
+            max = isnan(error_map[i]) ? HUGE_VAL : error_map[i];
+    
+    // unmap errors
+    clEnqueueUnmapMemObject(lensed->field->queue, lensed->field->error_mem, error_map, 0, NULL, NULL);
+    
+    return max;
+}
+
+// keep track of the maximum error of multipole trees at the test points
+static void field_multipole(struct lensed* lensed)
+{
+    cl_int err;
+    cl_float* error_map;
+    
+    // one work item per group, so that every point walks its own tree
+    size_t gws[1] = { FIELD_POINTS };
+    size_t lws[1] = { 1 };
+    
+    // compare multipole trees and direct summation
+    err = clEnqueueNDRangeKernel(lensed->field->queue, lensed->field->multipole, 1, NULL, gws, lws, 0, NULL, NULL);
+    if(err != CL_SUCCESS)
+        error("failed to run multipole check kernel");
+    
+    // map errors from device
+    error_map = clEnqueueMapBuffer(lensed->field->queue, lensed->field->error_mem, CL_TRUE, CL_MAP_READ, 0, FIELD_POINTS*sizeof(cl_float), 0, NULL, NULL, &err);
+    if(err != CL_SUCCESS)
+        error("failed to map multipole error buffer");
+    
+    // largest error so far, invalid values count as failure
+    for(size_t i = 0; i < FIELD_POINTS; ++i)
+        if(!(error_map[i] <= lensed->field->multipole_error))
+            lensed->field->multipole_error = isnan(error_map[i]) ? HUGE_VAL : error_map[i];
+    
+    // unmap errors
+    clEnqueueUnmapMemObject(lensed->field->queue, lensed->field->error_mem, error_map, 0, NULL, NULL);
+}
+
+void field_update(struct lensed* lensed, cl_event* event)
+{
+    cl_int err;
+    
+    // compute deflection on grid
+    err = clEnqueueNDRangeKernel(lensed->field->queue, lensed->field->grid, 1, NULL, lensed->field->grid_gws, lensed->field->grid_lws, 0, NULL, event);
+    if(err != CL_SUCCESS)
+        error("failed to run deflection field kernel");
+    
+    // periodically validate the field against direct evaluation
+    if(lensed->field->count++ % FIELD_CHECK != 0)
+        return;
+    
+    // check multipole trees if requested
+    if(lensed->field->multipole)
+        field_multipole(lensed);
+    
+    // refine grid until interpolation is accurate enough
+    while(field_error(lensed) > lensed->field->tol)
+    {
+        // cannot refine beyond maximum level
+        if(lensed->field->level == FIELD_LEVEL_MAX)
+        {
+            if(!lensed->field->warned)
+                warn("deflection field did not reach tolerance\n"
+                     "The interpolated deflection field is less accurate "
+                     "than the requested tolerance even on the finest grid. "
+                     "Consider increasing the \"field-tol\" option, or "
+                     "disabling the deflection field.");
+            lensed->field->warned = 1;
+            break;
+        }
+        
+        // set up finer grid
+        field_grid(lensed, lensed->field->level + 1);
+        
+        // compute deflection on new grid
+        err = clEnqueueNDRangeKernel(lensed->field->queue, lensed->field->grid, 1, NULL, lensed->field->grid_gws, lensed->field->grid_lws, 0, NULL, NULL);
+        if(err != CL_SUCCESS)
+            error("failed to run deflection field kernel");
+    }
+}
+
+// radical inverse of n in the given base
+static double radical_inverse(size_t n, size_t base)
+{
+    double x = 0;
+    double f = 1.0/base;
+    
+    for(; n > 0; n /= base, f /= base)
+        x += f*(n%base);
+    
+    return x;
+}
+
+void field_points(const struct lensed* lensed, size_t n, cl_float2 points[])
+{
+    // bounds of the field
+    const cl_float4 b = lensed->field->bounds;
+    
+    // Halton sequence in bases 2 and 3 covers the image evenly
+    for(size_t i = 0; i < n; ++i)
+    {
+        points[i].s[0] = b.s[0] + (b.s[2] - b.s[0])*radical_inverse(i + 1, 2);
+        points[i].s[1] = b.s[1] + (b.s[3] - b.s[1])*radical_inverse(i + 1, 3);
+    }
+}
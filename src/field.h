@@ -0,0 +1,26 @@
+#pragma once
+
+// number of header entries in the deflection field buffer
+#define FIELD_HEAD 4
+
+// range of refinement levels, grid spacing is 2^(-level) pixels
+#define FIELD_LEVEL_MIN -3
+#define FIELD_LEVEL_MAX 1
+
+// number of points for validation of the deflection field
+#define FIELD_POINTS 256
+
+// number of likelihood evaluations between validations
+#define FIELD_CHECK 100
+
+// get the grid dimensions for a given refinement level
+void field_dims(const struct lensed* lensed, int level, size_t* nx, size_t* ny);
+
+// generate quasi-random points covering the field for validation
+void field_points(const struct lensed* lensed, size_t n, cl_float2 points[]);
+
+// set up the grid of the deflection field for a given refinement level
+void field_grid(struct lensed* lensed, int level);
+
+// evaluate the deflection field, refining the grid if it is not accurate
+void field_update(struct lensed* lensed, cl_event* event);
@@ -4,6 +4,7 @@
 
 #include "input.h"
 #include "input/objects.h"
+#include "input/bands.h"
 #include "input/options.h"
 #include "input/ini.h"
 #include "prior.h"
@@ -121,6 +122,10 @@ input* read_input(int argc, char* argv[])
     inp->nobjs = 0;
     inp->objs = NULL;
     
+    // no additional bands
+    inp->nbands = 0;
+    inp->bands = NULL;
+    
     // set default options
     default_options(inp);
     
@@ -241,6 +246,11 @@ input* read_input(int argc, char* argv[])
             for(size_t j = 0; j < inp->objs[i].npars; ++j)
                 if(!inp->objs[i].pars[j].pri)
                     error("missing prior: %s (check [priors] section)", inp->objs[i].pars[j].id);
+        
+        // make sure that all bands have an image
+        for(size_t i = 0; i < inp->nbands; ++i)
+            if(!inp->bands[i].image)
+                error("band %s: missing image (check [bands] section)", inp->bands[i].name);
     }
     
     // everything is fine
@@ -261,6 +271,23 @@ void print_input(const input* inp)
             verbose("  %s = %s", option_name(i), value);
         }
         
+        if(inp->nbands)
+        {
+            verbose("bands");
+            for(size_t i = 0; i < inp->nbands; ++i)
+            {
+                const band* b = &inp->bands[i];
+                
+                write_path_or_real(value, &b->weight, sizeof(value));
+                
+                verbose("  %s", b->name);
+                verbose("    image = %s", b->image);
+                verbose("    weight = %s", value);
+                verbose("    mask = %s", b->mask ? b->mask : "none");
+                verbose("    psf = %s", b->psf ? b->psf : "none");
+            }
+        }
+        
         verbose("objects");
         for(size_t i = 0; i < inp->nobjs; ++i)
             verbose("  %s = %s", inp->objs[i].id, inp->objs[i].name);
@@ -292,16 +319,18 @@ void print_input(const input* inp)
                 prior_print(par->pri, buf, 255);
                 
                 // collect tags
-                snprintf(tag, 255, " [%s%s%s%s%s%s%s%s%s",
+                snprintf(tag, 255, " [%s%s%s%s%s%s%s%s%s%s%s",
                     par->type == PAR_POSITION_X ? "position x, " : "",
                     par->type == PAR_POSITION_Y ? "position y, " : "",
                     par->type == PAR_RADIUS     ? "radius, "     : "",
                     par->type == PAR_MAGNITUDE  ? "magnitude, "  : "",
                     par->type == PAR_AXIS_RATIO ? "axis ratio, " : "",
                     par->type == PAR_POS_ANGLE  ? "pos. angle, " : "",
+                    par->type == PAR_AMPLITUDE  ? "amplitude, "  : "",
                     par->bounded                ? "bounded, "    : "",
                     par->wrap                   ? "wrap, "       : "",
-                    par->ipp                    ? "IPP, "        : ""
+                    par->ipp                    ? "IPP, "        : "",
+                    par->linear                 ? "linear, "     : ""
                 );
                 
                 // check if tags were set
@@ -334,5 +363,9 @@ void free_input(input* inp)
         free_object(&inp->objs[i]);
     free(inp->objs);
     
+    for(size_t i = 0; i < inp->nbands; ++i)
+        free_band(&inp->bands[i]);
+    free(inp->bands);
+    
     free(inp);
 }
@@ -17,7 +17,8 @@ enum
     PAR_RADIUS,
     PAR_MAGNITUDE,
     PAR_AXIS_RATIO,
-    PAR_POS_ANGLE
+    PAR_POS_ANGLE,
+    PAR_AMPLITUDE
 };
 
 // option contains a path or a real
@@ -31,6 +32,8 @@ typedef struct
 {
     // lensed
     char* device;
+    int numa;
+    int broker;
     int output;
     char* root;
     int devices;
@@ -38,6 +41,25 @@ typedef struct
     int batch_header;
     int show_rules;
     char* rule;
+    double field_tol;
+    int fast_math;
+    int tiles;
+    int early_exit;
+    int screen;
+    int pyramid;
+    double pyramid_sigma;
+    double voronoi;
+    int linear;
+    int pixels_size;
+    double pixels_reg;
+    int pixels_iter;
+    int lens_table;
+    double lens_cull;
+    double multipole;
+    int multipole_check;
+    char* planes;
+    int partial;
+    double partial_mem;
     
     // data
     char* image;
@@ -45,6 +67,7 @@ typedef struct
     struct path_or_real* xweight;
     char* mask;
     char* psf;
+    char* noise;
     double offset;
     struct path_or_real* gain;
     double bscale;
@@ -101,11 +124,19 @@ typedef struct
     // flag for derived parameters
     int derived;
     
+    // flag for linear amplitudes, which are derived from the data
+    int linear;
+    
     // flag for default value
     int defval;
     
     // label, used for output
     const char* label;
+    
+    // band of a per-band copy, and index of the parameter it copies; the
+    // band is zero for parameters that are shared by all bands
+    size_t band;
+    size_t base;
 } param;
 
 // definition of objects
@@ -117,6 +148,19 @@ typedef struct
     // size of object data
     size_t size;
     
+    // flag for objects with pixel integral
+    int integral;
+    
+    // flag for lenses that are evaluated from a table
+    int table;
+    
+    // flag for objects with far field, and for lenses in multipole trees
+    int farfield;
+    int tree;
+    
+    // comoving distance of the plane of the object, or zero if not given
+    double distance;
+    
     // unique identifier of object
     const char* id;
     
@@ -128,6 +172,19 @@ typedef struct
     param* pars;
 } object;
 
+// additional band of data, fitted jointly with the image from the options
+typedef struct
+{
+    // name of band
+    const char* name;
+    
+    // data of band
+    char* image;
+    struct path_or_real* weight;
+    char* mask;
+    char* psf;
+} band;
+
 // all input settings
 typedef struct
 {
@@ -140,6 +197,10 @@ typedef struct
     // objects on the line of sight
     size_t nobjs;
     object* objs;
+    
+    // additional bands of data
+    size_t nbands;
+    band* bands;
 } input;
 
 input* read_input(int argc, char* argv[]);
@@ -0,0 +1,121 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../input.h"
+#include "bands.h"
+#include "options.h"
+#include "../log.h"
+
+void add_band(input* inp, const char* name)
+{
+    band* b;
+    
+    // add new band to list
+    inp->nbands += 1;
+    inp->bands = realloc(inp->bands, inp->nbands*sizeof(band));
+    if(!inp->bands)
+        errori("band %s", name);
+    
+    // realloc was successful, get new band
+    b = &inp->bands[inp->nbands-1];
+    
+    // copy name into band
+    b->name = malloc(strlen(name) + 1);
+    if(!b->name)
+        errori("band %s", name);
+    strcpy((char*)b->name, name);
+    
+    // no data yet
+    b->image = NULL;
+    b->weight = NULL;
+    b->mask = NULL;
+    b->psf = NULL;
+}
+
+size_t find_band(const input* inp, const char* name)
+{
+    // bands are numbered from one, zero is the image from the options
+    for(size_t i = 0; i < inp->nbands; ++i)
+        if(strcmp(name, inp->bands[i].name) == 0)
+            return i + 1;
+    return 0;
+}
+
+int set_band_data(band* b, const char* key, const char* value)
+{
+    // read data with the same rules as the corresponding options
+    if(strcmp(key, "image") == 0)
+    {
+        free_path(&b->image);
+        return read_path(&b->image, value);
+    }
+    if(strcmp(key, "weight") == 0)
+    {
+        free_path_or_real(&b->weight);
+        return read_path_or_real(&b->weight, value);
+    }
+    if(strcmp(key, "mask") == 0)
+    {
+        free_path(&b->mask);
+        return read_path(&b->mask, value);
+    }
+    if(strcmp(key, "psf") == 0)
+    {
+        free_path(&b->psf);
+        return read_path(&b->psf, value);
+    }
+    
+    // unknown key
+    return 1;
+}
+
+void free_band(band* b)
+{
+    free((char*)b->name);
+    free_path(&b->image);
+    free_path_or_real(&b->weight);
+    free_path(&b->mask);
+    free_path(&b->psf);
+}
+
+param* add_band_param(object* obj, size_t n, size_t b, const char* band)
+{
+    param* par;
+    char* name;
+    char* id;
+    
+    // add new parameter to object
+    obj->npars += 1;
+    obj->pars = realloc(obj->pars, obj->npars*sizeof(param));
+    if(!obj->pars)
+        errori("object %s", obj->id);
+    
+    // realloc was successful, get new parameter
+    par = &obj->pars[obj->npars-1];
+    
+    // name and id of copy carry the band
+    name = malloc(strlen(obj->pars[n].name) + 1 + strlen(band) + 1);
+    id = malloc(strlen(obj->pars[n].id) + 1 + strlen(band) + 1);
+    if(!name || !id)
+        errori(NULL);
+    sprintf(name, "%s.%s", obj->pars[n].name, band);
+    sprintf(id, "%s.%s", obj->pars[n].id, band);
+    
+    // copy parameter information, but not its prior
+    par->name   = name;
+    par->id     = id;
+    par->type   = obj->pars[n].type;
+    par->lower  = obj->pars[n].lower;
+    par->upper  = obj->pars[n].upper;
+    par->pri    = NULL;
+    par->wrap   = 0;
+    par->ipp    = 0;
+    par->linear = 0;
+    par->defval = 0;
+    par->label  = NULL;
+    par->band   = b;
+    par->base   = n;
+    
+    return par;
+}
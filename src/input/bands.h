@@ -0,0 +1,16 @@
+#pragma once
+
+// add a new band to input
+void add_band(input* inp, const char* name);
+
+// find band with given name and return its number, or zero if not found
+size_t find_band(const input* inp, const char* name);
+
+// set data of band, and return nonzero if the key or value is invalid
+int set_band_data(band* b, const char* key, const char* value);
+
+// free all memory allocated for band
+void free_band(band* b);
+
+// add a copy of the n'th parameter of object for the given band
+param* add_band_param(object* obj, size_t n, size_t b, const char* band);
@@ -4,6 +4,7 @@
 
 #include "../input.h"
 #include "objects.h"
+#include "bands.h"
 #include "options.h"
 #include "ini.h"
 #include "../log.h"
@@ -84,7 +85,8 @@ enum
     GRP_OPTIONS,
     GRP_OBJECTS,
     GRP_PRIORS,
-    GRP_LABELS
+    GRP_LABELS,
+    GRP_BANDS
 };
 
 // assign group id to group name
@@ -92,7 +94,8 @@ static const struct { const char* name; const int grp; } GROUPS[] = {
     { "options", GRP_OPTIONS },
     { "objects", GRP_OBJECTS },
     { "priors", GRP_PRIORS },
-    { "labels", GRP_LABELS }
+    { "labels", GRP_LABELS },
+    { "bands", GRP_BANDS }
 };
 
 // find group id by name
@@ -106,6 +109,46 @@ int findgrp(const char* name)
     return -1;
 }
 
+// create the copy of a parameter for a band, from a name <param>.<band>
+static param* band_param(input* inp, object* obj, const char* name,
+                         const char* ini, size_t line)
+{
+    char* buf;
+    char* sep;
+    param* base;
+    size_t b;
+    
+    // split name at the last separator
+    buf = malloc(strlen(name) + 1);
+    if(!buf)
+        errori(NULL);
+    strcpy(buf, name);
+    sep = strrchr(buf, *SEP);
+    if(!sep)
+    {
+        free(buf);
+        return NULL;
+    }
+    *sep = '\0';
+    
+    // find parameter and band, and fail if either is unknown
+    base = find_param(obj, buf);
+    b = find_band(inp, sep + 1);
+    if(!base || base->band || !b)
+    {
+        free(buf);
+        return NULL;
+    }
+    
+    // only parameters of the light can differ between bands
+    if(obj->type == OBJ_LENS)
+        errorf(ini, line, "object %s: lens parameter %s cannot be given for a band", obj->id, buf);
+    
+    free(buf);
+    
+    return add_band_param(obj, base - obj->pars, b, inp->bands[b-1].name);
+}
+
 void read_ini(const char* ini, input* inp)
 {
     const char* cwd;
@@ -227,10 +270,31 @@ void read_ini(const char* ini, input* inp)
             if(!obj)
                 errorf(ini, line, "unknown object: %s (check [objects] group)", name);
             par = find_param(obj, sub);
+            
+            // priors can create copies of parameters for bands
+            if(!par && grp == GRP_PRIORS)
+                par = band_param(inp, obj, sub, ini, line);
+            
             if(!par)
                 errorf(ini, line, "object %s: unknown parameter %s", name, sub);
         }
         
+        // bands are given as <band>.<data>
+        if(grp == GRP_BANDS)
+        {
+            sub = split(name, SEP);
+            if(!sub)
+                errorf(ini, line, "invalid band data (should be <band>.<data>)");
+            rtrim(name, WS);
+            ltrim(sub, WS);
+            if(!*name)
+                errorf(ini, line, "no band given (should be <band>.%s)", sub);
+            if(!*sub)
+                errorf(ini, line, "band %s: no data given (should be %s.<data>)", name, name);
+            if(strpbrk(name, WS))
+                errorf(ini, line, "band %s: invalid name", name);
+        }
+        
         // use name and value according to current group
         switch(grp)
         {
@@ -263,11 +327,20 @@ void read_ini(const char* ini, input* inp)
             
         case GRP_PRIORS:
             set_param_prior(par, value);
+            if(par->band && par->ipp)
+                errorf(ini, line, "%s: image plane priors cannot be given for a band", par->id);
             break;
             
         case GRP_LABELS:
             set_param_label(par, value);
             break;
+            
+        case GRP_BANDS:
+            if(!find_band(inp, name))
+                add_band(inp, name);
+            if(set_band_data(&inp->bands[find_band(inp, name)-1], sub, value))
+                errorf(ini, line, "band %s: invalid data: %s = %s (should be image, weight, mask or psf)", name, sub, value);
+            break;
         }
     }
     
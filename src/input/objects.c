@@ -8,14 +8,16 @@
 #include "../prior.h"
 #include "objects.h"
 #include "../kernel.h"
+#include "../native.h"
 #include "../log.h"
 
 static const char* WS = " \t\n\v\f\r";
 
-void add_object(input* inp, const char* id, const char* name)
+// get metadata and parameter information of object using OpenCL
+static void object_info(const char* id, const char* name, cl_int* type,
+                        cl_ulong* size, cl_ulong* npar, cl_char16** names,
+                        cl_int** types, cl_float2** bounds, cl_float** defvals)
 {
-    object* obj;
-    
     // OpenCL
     cl_int err;
     lensed_cl* lcl;
@@ -30,11 +32,8 @@ void add_object(input* inp, const char* id, const char* name)
     
     // object metadata
     cl_mem      meta_type_mem;
-    cl_int      meta_type;
     cl_mem      meta_size_mem;
-    cl_ulong    meta_size;
     cl_mem      meta_npar_mem;
-    cl_ulong    meta_npar;
     
     // parameter info kernel
     char*       param_kernam;
@@ -43,33 +42,12 @@ void add_object(input* inp, const char* id, const char* name)
     
     // parameter information
     cl_mem      param_names_mem;
-    cl_char16*  param_names;
     cl_mem      param_types_mem;
-    cl_int*     param_types;
     cl_mem      param_bounds_mem;
-    cl_float2*  param_bounds;
     cl_mem      param_defvals_mem;
-    cl_float*   param_defvals;
-    
-    // realloc space for one more object
-    inp->nobjs += 1;
-    inp->objs = realloc(inp->objs, inp->nobjs*sizeof(object));
-    if(!inp->objs)
-        errori("object %s", name);
-    
-    // realloc was successful, get new object
-    obj = &inp->objs[inp->nobjs-1];
-    
-    // allocate space and copy id and name into object
-    obj->id = malloc(strlen(id) + 1);
-    obj->name = malloc(strlen(name) + 1);
-    if(!obj->id || !obj->name)
-        errori("object %s", id);
-    strcpy((char*)obj->id, id);
-    strcpy((char*)obj->name, name);
     
     // set up host device
-    lcl = get_lensed_cl(NULL);
+    lcl = get_lensed_cl(NULL, 0, -1);
     queue = clCreateCommandQueue(lcl->context, lcl->device_id, 0, &err);
     if(err != CL_SUCCESS)
         error("object %s: failed to create command queue", id);
@@ -129,34 +107,22 @@ void add_object(input* inp, const char* id, const char* name)
         error("object %s: failed to run kernel for metadata", id);
     
     // get metadata from buffer
-    err |= clEnqueueReadBuffer(queue, meta_type_mem, CL_TRUE, 0, sizeof(cl_int),   &meta_type, 0, NULL, NULL);
-    err |= clEnqueueReadBuffer(queue, meta_size_mem, CL_TRUE, 0, sizeof(cl_ulong), &meta_size, 0, NULL, NULL);
-    err |= clEnqueueReadBuffer(queue, meta_npar_mem, CL_TRUE, 0, sizeof(cl_ulong), &meta_npar, 0, NULL, NULL);
+    err |= clEnqueueReadBuffer(queue, meta_type_mem, CL_TRUE, 0, sizeof(cl_int),   type, 0, NULL, NULL);
+    err |= clEnqueueReadBuffer(queue, meta_size_mem, CL_TRUE, 0, sizeof(cl_ulong), size, 0, NULL, NULL);
+    err |= clEnqueueReadBuffer(queue, meta_npar_mem, CL_TRUE, 0, sizeof(cl_ulong), npar, 0, NULL, NULL);
     if(err != CL_SUCCESS)
         error("object %s: failed to get metadata", id);
     
-    // convert size in sizeof(cl_char) to size in sizeof(cl_float), rounding up
-    meta_size = ((meta_size*sizeof(cl_char))/sizeof(cl_float)) + ((meta_size*sizeof(cl_char))%sizeof(cl_float) ? 1 : 0);
-    
-    // set metadata for object
-    obj->type  = meta_type;
-    obj->size  = meta_size;
-    obj->npars = meta_npar;
-    
-    // check metadata
-    if(obj->type != OBJ_LENS && obj->type != OBJ_SOURCE && obj->type != OBJ_FOREGROUND)
-        error("object %s: invalid type (should be LENS, SOURCE or FOREGROUND)", id);
-    
     // buffers for kernel parameters
-    param_names_mem   = clCreateBuffer(lcl->context, CL_MEM_WRITE_ONLY, obj->npars*sizeof(cl_char16), NULL, NULL);
-    param_types_mem   = clCreateBuffer(lcl->context, CL_MEM_WRITE_ONLY, obj->npars*sizeof(cl_int),    NULL, NULL);
-    param_bounds_mem  = clCreateBuffer(lcl->context, CL_MEM_WRITE_ONLY, obj->npars*sizeof(cl_float2), NULL, NULL);
-    param_defvals_mem = clCreateBuffer(lcl->context, CL_MEM_WRITE_ONLY, obj->npars*sizeof(cl_float),  NULL, NULL);
+    param_names_mem   = clCreateBuffer(lcl->context, CL_MEM_WRITE_ONLY, *npar*sizeof(cl_char16), NULL, NULL);
+    param_types_mem   = clCreateBuffer(lcl->context, CL_MEM_WRITE_ONLY, *npar*sizeof(cl_int),    NULL, NULL);
+    param_bounds_mem  = clCreateBuffer(lcl->context, CL_MEM_WRITE_ONLY, *npar*sizeof(cl_float2), NULL, NULL);
+    param_defvals_mem = clCreateBuffer(lcl->context, CL_MEM_WRITE_ONLY, *npar*sizeof(cl_float),  NULL, NULL);
     if(!param_names_mem || !param_types_mem || !param_bounds_mem || !param_defvals_mem)
         error("object %s: failed to create buffer for parameters", id);
     
     // the work size of the parameters kernel is the number of parameters
-    param_gws = meta_npar;
+    param_gws = *npar;
     
     // setup and run kernel to get parameters
     param_kernam = kernel_name("params_", name);
@@ -174,21 +140,110 @@ void add_object(input* inp, const char* id, const char* name)
         error("object %s: failed to run kernel for parameters", id);
     
     // arrays for kernel parameters
-    param_names   = malloc(obj->npars*sizeof(cl_char16));
-    param_types   = malloc(obj->npars*sizeof(cl_int));
-    param_bounds  = malloc(obj->npars*sizeof(cl_float2));
-    param_defvals = malloc(obj->npars*sizeof(cl_float));
-    if(!param_types || !param_names || !param_bounds || !param_defvals)
+    *names   = malloc(*npar*sizeof(cl_char16));
+    *types   = malloc(*npar*sizeof(cl_int));
+    *bounds  = malloc(*npar*sizeof(cl_float2));
+    *defvals = malloc(*npar*sizeof(cl_float));
+    if(!*types || !*names || !*bounds || !*defvals)
         errori("object %s", id);
     
     // get kernel parameters from buffer
-    err |= clEnqueueReadBuffer(queue, param_names_mem,   CL_TRUE, 0, obj->npars*sizeof(cl_char16), param_names,   0, NULL, NULL);
-    err |= clEnqueueReadBuffer(queue, param_types_mem,   CL_TRUE, 0, obj->npars*sizeof(cl_int),    param_types,   0, NULL, NULL);
-    err |= clEnqueueReadBuffer(queue, param_bounds_mem,  CL_TRUE, 0, obj->npars*sizeof(cl_float2), param_bounds,  0, NULL, NULL);
-    err |= clEnqueueReadBuffer(queue, param_defvals_mem, CL_TRUE, 0, obj->npars*sizeof(cl_float),  param_defvals, 0, NULL, NULL);
+    err |= clEnqueueReadBuffer(queue, param_names_mem,   CL_TRUE, 0, *npar*sizeof(cl_char16), *names,   0, NULL, NULL);
+    err |= clEnqueueReadBuffer(queue, param_types_mem,   CL_TRUE, 0, *npar*sizeof(cl_int),    *types,   0, NULL, NULL);
+    err |= clEnqueueReadBuffer(queue, param_bounds_mem,  CL_TRUE, 0, *npar*sizeof(cl_float2), *bounds,  0, NULL, NULL);
+    err |= clEnqueueReadBuffer(queue, param_defvals_mem, CL_TRUE, 0, *npar*sizeof(cl_float),  *defvals, 0, NULL, NULL);
     if(err != CL_SUCCESS)
         error("object %s: failed to get parameters", id);
     
+    // clean up
+    clFinish(queue);
+    
+    clReleaseMemObject(param_names_mem);
+    clReleaseMemObject(param_types_mem);
+    clReleaseMemObject(param_bounds_mem);
+    clReleaseMemObject(param_defvals_mem);
+    
+    free(param_kernam);
+    clReleaseKernel(param_kernel);
+    
+    free(meta_kernam);
+    clReleaseKernel(meta_kernel);
+    
+    clReleaseMemObject(meta_type_mem);
+    clReleaseMemObject(meta_size_mem);
+    clReleaseMemObject(meta_npar_mem);
+    
+    for(int i = 0; i < nkernels; ++i)
+        free((void*)kernels[i]);
+    clReleaseProgram(program);
+    clReleaseCommandQueue(queue);
+    free_lensed_cl(lcl);
+}
+
+void add_object(input* inp, const char* id, const char* name)
+{
+    object* obj;
+    
+    // object metadata
+    cl_int      meta_type;
+    cl_ulong    meta_size;
+    cl_ulong    meta_npar;
+    
+    // parameter information
+    cl_char16*  param_names;
+    cl_int*     param_types;
+    cl_float2*  param_bounds;
+    cl_float*   param_defvals;
+    
+    // realloc space for one more object
+    inp->nobjs += 1;
+    inp->objs = realloc(inp->objs, inp->nobjs*sizeof(object));
+    if(!inp->objs)
+        errori("object %s", name);
+    
+    // realloc was successful, get new object
+    obj = &inp->objs[inp->nobjs-1];
+    
+    // allocate space and copy id and name into object
+    obj->id = malloc(strlen(id) + 1);
+    obj->name = malloc(strlen(name) + 1);
+    if(!obj->id || !obj->name)
+        errori("object %s", id);
+    strcpy((char*)obj->id, id);
+    strcpy((char*)obj->name, name);
+    
+    // get object information from the native backend if selected, since
+    // there might be no OpenCL device at all, or else from the host device
+    if(native_device(inp->opts->device))
+        native_object(name, &meta_type, &meta_size, &meta_npar, &param_names, &param_types, &param_bounds, &param_defvals);
+    else
+        object_info(id, name, &meta_type, &meta_size, &meta_npar, &param_names, &param_types, &param_bounds, &param_defvals);
+    
+    // convert size in sizeof(cl_char) to size in sizeof(cl_float), rounding up
+    meta_size = ((meta_size*sizeof(cl_char))/sizeof(cl_float)) + ((meta_size*sizeof(cl_char))%sizeof(cl_float) ? 1 : 0);
+    
+    // set metadata for object
+    obj->type  = meta_type;
+    obj->size  = meta_size;
+    obj->npars = meta_npar;
+    
+    // check if object can be integrated over pixels
+    obj->integral = object_integral(name);
+    
+    // check if object provides its far field
+    obj->farfield = object_farfield(name);
+    
+    // lenses are only stored in tables once the program is built
+    obj->table = 0;
+    obj->tree = 0;
+    
+    // distances of planes are set together with the program
+    obj->distance = 0;
+    
+    // check metadata
+    if(obj->type != OBJ_LENS && obj->type != OBJ_SOURCE && obj->type != OBJ_FOREGROUND)
+        error("object %s: invalid type (should be LENS, SOURCE or FOREGROUND)", id);
+    
     // create array for params
     obj->pars = malloc(obj->npars*sizeof(param));
     if(!obj->pars)
@@ -234,35 +289,18 @@ void add_object(input* inp, const char* id, const char* name)
         obj->pars[i].pri    = pri;
         obj->pars[i].wrap   = 0;
         obj->pars[i].ipp    = 0;
+        obj->pars[i].linear = 0;
         obj->pars[i].defval = pri ? 1 : 0;
         obj->pars[i].label  = NULL;
+        obj->pars[i].band   = 0;
+        obj->pars[i].base   = 0;
     }
     
     // clean up
-    clFinish(queue);
-    
-    clReleaseMemObject(param_names_mem);
     free(param_names);
-    clReleaseMemObject(param_types_mem);
     free(param_types);
-    clReleaseMemObject(param_bounds_mem);
     free(param_bounds);
-    
-    free(param_kernam);
-    clReleaseKernel(param_kernel);
-    
-    free(meta_kernam);
-    clReleaseKernel(meta_kernel);
-    
-    clReleaseMemObject(meta_type_mem);
-    clReleaseMemObject(meta_size_mem);
-    clReleaseMemObject(meta_npar_mem);
-    
-    for(int i = 0; i < nkernels; ++i)
-        free((void*)kernels[i]);
-    clReleaseProgram(program);
-    clReleaseCommandQueue(queue);
-    free_lensed_cl(lcl);
+    free(param_defvals);
 }
 
 object* find_object(const input* inp, const char* id)
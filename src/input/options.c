@@ -67,6 +67,20 @@ struct option OPTIONS[] = {
         OPTION_OPTIONAL(string, "auto"),
         OPTION_FIELD(device)
     },
+    {
+        "numa",
+        "Split devices by NUMA node",
+        OPTION_OPTIONAL(bool, 0),
+        OPTION_FIELD(numa)
+    },
+#ifdef LENSED_MPI
+    {
+        "broker",
+        "Evaluate likelihoods of a node in one process",
+        OPTION_OPTIONAL(bool, 0),
+        OPTION_FIELD(broker)
+    },
+#endif
     {
         "output",
         "Output results",
@@ -127,12 +141,132 @@ struct option OPTIONS[] = {
         OPTION_OPTIONAL(path, NULL),
         OPTION_FIELD(psf)
     },
+    {
+        "noise",
+        "Correlation of pixel noise, FITS file",
+        OPTION_OPTIONAL(path, NULL),
+        OPTION_FIELD(noise)
+    },
     {
         "rule",
         "Rule for numerical integration",
         OPTION_OPTIONAL(string, "g3k7"),
         OPTION_FIELD(rule)
     },
+    {
+        "field-tol",
+        "Tolerance of interpolated deflection field",
+        OPTION_OPTIONAL(real, 0),
+        OPTION_FIELD(field_tol)
+    },
+    {
+        "fast-math",
+        "Use fast approximations of math functions",
+        OPTION_OPTIONAL(bool, 0),
+        OPTION_FIELD(fast_math)
+    },
+    {
+        "tiles",
+        "Render image in square tiles",
+        OPTION_OPTIONAL(bool, 1),
+        OPTION_FIELD(tiles)
+    },
+    {
+        "early-exit",
+        "Stop likelihood below lowest live point",
+        OPTION_OPTIONAL(bool, 0),
+        OPTION_FIELD(early_exit)
+    },
+    {
+        "screen",
+        "Block size of screening image",
+        OPTION_OPTIONAL(int, 0),
+        OPTION_FIELD(screen)
+    },
+    {
+        "pyramid",
+        "Number of binned levels before image",
+        OPTION_OPTIONAL(int, 0),
+        OPTION_FIELD(pyramid)
+    },
+    {
+        "pyramid-sigma",
+        "Least prior padding from binned levels in sigma",
+        OPTION_OPTIONAL(real, 5),
+        OPTION_FIELD(pyramid_sigma)
+    },
+    {
+        "voronoi",
+        "Target S/N of binned faint pixels",
+        OPTION_OPTIONAL(real, 0),
+        OPTION_FIELD(voronoi)
+    },
+    {
+        "linear",
+        "Marginalise linear amplitudes",
+        OPTION_OPTIONAL(bool, 0),
+        OPTION_FIELD(linear)
+    },
+    {
+        "pixels-size",
+        "Source pixels along each side",
+        OPTION_OPTIONAL(int, 32),
+        OPTION_FIELD(pixels_size)
+    },
+    {
+        "pixels-reg",
+        "Regularisation of pixelated source",
+        OPTION_OPTIONAL(real, 1),
+        OPTION_FIELD(pixels_reg)
+    },
+    {
+        "pixels-iter",
+        "Solver iterations per round for pixelated source",
+        OPTION_OPTIONAL(int, 50),
+        OPTION_FIELD(pixels_iter)
+    },
+    {
+        "lens-table",
+        "Lenses of one type that are stored in a table",
+        OPTION_OPTIONAL(int, 0),
+        OPTION_FIELD(lens_table)
+    },
+    {
+        "lens-cull",
+        "Deflection below which table lenses are culled",
+        OPTION_OPTIONAL(real, 0),
+        OPTION_FIELD(lens_cull)
+    },
+    {
+        "multipole",
+        "Opening angle of multipole trees for table lenses",
+        OPTION_OPTIONAL(real, 0),
+        OPTION_FIELD(multipole)
+    },
+    {
+        "multipole-check",
+        "Report error of multipole trees against direct sum",
+        OPTION_OPTIONAL(bool, 0),
+        OPTION_FIELD(multipole_check)
+    },
+    {
+        "planes",
+        "Comoving distances of lens and source planes",
+        OPTION_OPTIONAL(string, NULL),
+        OPTION_FIELD(planes)
+    },
+    {
+        "partial",
+        "Recompute only objects whose parameters changed",
+        OPTION_OPTIONAL(bool, 0),
+        OPTION_FIELD(partial)
+    },
+    {
+        "partial-mem",
+        "Largest ray cache for partial updates in MB",
+        OPTION_OPTIONAL(real, 0),
+        OPTION_FIELD(partial_mem)
+    },
 #ifdef LENSED_XPA
     {
         "ds9",
@@ -388,6 +522,31 @@ const char* options_cwd(const char* cwd)
     return old;
 }
 
+int read_path(char** out, const char* in)
+{
+    return option_read_path(out, in);
+}
+
+int read_path_or_real(struct path_or_real** out, const char* in)
+{
+    return option_read_path_or_real(out, in);
+}
+
+int write_path_or_real(char* out, struct path_or_real* const* in, size_t n)
+{
+    return option_write_path_or_real(out, in, n);
+}
+
+void free_path(char** p)
+{
+    option_free_path(p);
+}
+
+void free_path_or_real(struct path_or_real** p)
+{
+    option_free_path_or_real(p);
+}
+
 // wrappers for option reading and writing
 
 int option_read_string(void* out, const char* in)
@@ -44,3 +44,18 @@ int option_value(char* buf, size_t buf_size, const input* inp, size_t n);
 
 // set current working directory for option reading and return old cwd
 const char* options_cwd(const char* cwd);
+
+// read a path, relative to the current working directory for options
+int read_path(char** out, const char* in);
+
+// read a path or a real, with paths relative to the current working directory
+int read_path_or_real(struct path_or_real** out, const char* in);
+
+// write a path or a real to buffer
+int write_path_or_real(char* out, struct path_or_real* const* in, size_t n);
+
+// free a path read with read_path
+void free_path(char** p);
+
+// free a path or real read with read_path_or_real
+void free_path_or_real(struct path_or_real** p);
@@ -27,16 +27,32 @@ static const char FILEFOOT[] =
 // kernels that are needed for initialising programs
 static const char* INITKERNS[] = {
     "object",
-    "constants"
+    "constants",
+    "fastmath",
+    "table",
+    "mge"
 };
 static const size_t NINITKERNS = sizeof(INITKERNS)/sizeof(INITKERNS[0]);
 
+// kernels that are needed for computing images
+static const char* COMPKERNS[] = {
+    "field",
+    "multipole"
+};
+static const size_t NCOMPKERNS = sizeof(COMPKERNS)/sizeof(COMPKERNS[0]);
+
 // kernels that are needed for main program
 static const char* MAINKERNS[] = {
     "lensed"
 };
 static const size_t NMAINKERNS = sizeof(MAINKERNS)/sizeof(MAINKERNS[0]);
 
+// number of lenses in a chunk of a table, and leaf of a multipole tree
+static const size_t LENS_CHUNK = 16;
+
+// size of a node of a multipole tree, as in kernel/multipole.cl
+static const size_t MULTIPOLE_NODE = 35;
+
 // kernel to get meta-data for object
 static const char METAKERN[] = 
     "kernel void meta_<name>(global int*   type, global ulong* size,\n"
@@ -61,9 +77,98 @@ static const char PARSKERN[] =
     "}\n"
 ;
 
+// deflection of first lens plane
+static const char PLANHEAD[] =
+    "static float2 deflection_plane(local uint* data, float2 x)\n"
+    "{\n"
+    "    // initial deflection is zero\n"
+    "    float2 a = 0;\n"
+    "    \n"
+    "    // calculate deflection\n"
+;
+static const char PLANLENS[] =
+    "    a += deflection_%s((local void*)(data + %zu), x);\n"
+;
+static const char PLANFOOT[] =
+    "    \n"
+    "    // return total deflection\n"
+    "    return a;\n"
+    "}\n"
+    "\n"
+;
+
+// pixel integral of profiles with closed form, for all objects and for
+// sources and foregrounds alone
+static const char* INTGNAME[] = { "integral", "integral_sources", "integral_foregrounds" };
+static const int INTGTYPE[] = { 0, OBJ_SOURCE, OBJ_FOREGROUND };
+static const size_t NINTGPART = sizeof(INTGNAME)/sizeof(INTGNAME[0]);
+static const char INTGHEAD[] =
+    "static float %s(local uint* data, float2 x0, float2 x1)\n"
+    "{\n"
+    "    // initial integral is zero\n"
+    "    float f = 0;\n"
+    "    \n"
+    "    // integrate profiles over pixel\n"
+;
+static const char INTGOBJS[] =
+    "    f += integral_%s((local void*)(data + %zu), x0, x1);\n"
+;
+static const char INTGFOOT[] =
+    "    \n"
+    "    // return total integral\n"
+    "    return f;\n"
+    "}\n"
+    "\n"
+;
+
+// partial updates compute foregrounds, and sources with cached rays
+static const char FGNDHEAD[] =
+    "static float compute_foregrounds(local uint* data, float2 x)\n"
+    "{\n"
+    "    // initial surface brightness is zero\n"
+    "    float f = 0;\n"
+    "    \n"
+    "    // add foreground\n"
+;
+static const char COMPPHED[] =
+    "static float compute_sources(local uint* data, global const float2* field, float2 x,\n"
+    "                             global float2* rays, int trace)\n"
+    "{\n"
+    "    // ray position\n"
+    "    float2 y = x;\n"
+    "    \n"
+    "    // initial surface brightness is zero\n"
+    "    float f = 0;\n"
+;
+static const char COMPLPHD[] =
+    "    \n"
+    "    // lens plane, unless rays are cached\n"
+    "    if(trace)\n"
+    "    {\n"
+    "        // initial deflection is zero\n"
+    "        float2 a = 0;\n"
+    "        \n"
+    "        // calculate deflection\n"
+;
+static const char COMPRAYS[] =
+    "    \n"
+    "    // store traced ray, or load cached ray\n"
+    "    if(trace)\n"
+    "        rays[%zu*IMAGE_SIZE*QUAD_POINTS] = y;\n"
+    "    else\n"
+    "        y = rays[%zu*IMAGE_SIZE*QUAD_POINTS];\n"
+;
+static const char PARTFOOT[] =
+    "    \n"
+    "    // return total surface brightness\n"
+    "    return f;\n"
+    "}\n"
+    "\n"
+;
+
 // kernel to compute images
 static const char COMPHEAD[] =
-    "static float compute(local uint* data, float2 x)\n"
+    "static float compute(local uint* data, global const float2* field, float2 x)\n"
     "{\n"
     "    // ray position\n"
     "    float2 y = x;\n"
@@ -80,6 +185,13 @@ static const char COMPLHED[] =
     "        \n"
     "        // calculate deflection\n"
 ;
+static const char COMPPLAN[] =
+    "#if DEFLECTION_FIELD\n"
+    "        a += deflection_field(field, y);\n"
+    "#else\n"
+    "        a += deflection_plane(data, y);\n"
+    "#endif\n"
+;
 static const char COMPLENS[] =
     "        a += deflection_%s((local void*)(data + %zu), y);\n"
 ;
@@ -89,6 +201,20 @@ static const char COMPDEFL[] =
     "        y -= dot(a,a) < HUGE_VALF ? a : (float2)(1E10f, 1E10f);\n"
     "    }\n"
 ;
+static const char COMPDSTP[] =
+    "        \n"
+    "        // apply deflection to ray, if finite, and carry on its direction\n"
+    "        // from the previous plane\n"
+    "        a = (dot(a,a) < HUGE_VALF ? a : (float2)(1E10f, 1E10f)) - %.9ef*(y - z);\n"
+    "        z = y;\n"
+    "        y -= a;\n"
+    "    }\n"
+;
+static const char COMPPREV[] =
+    "    \n"
+    "    // ray position on previous plane\n"
+    "    float2 z = 0;\n"
+;
 static const char COMPSHED[] =
     "    \n"
     "    // calculate surface brightness\n"
@@ -113,7 +239,8 @@ static const char COMPFOOT[] =
 // kernel to set parameters
 static const char SETPHEAD[] =
     "kernel void set_params(ulong dsiz, global int* gdata, local int* ldata,\n"
-    "                       constant float* params)\n"
+    "                       constant float* params, global uint* lenses,\n"
+    "                       ulong stage)\n"
     "{\n"
     "    // image plane priors\n"
     "    float2 x;\n"
@@ -126,10 +253,27 @@ static const char SETPHEAD[] =
     "        ldata[i] = gdata[i];\n"
     "    \n"
 ;
+static const char SETPPREV[] =
+    "    // image plane priors on previous plane\n"
+    "    float2 z;\n"
+    "    \n"
+;
+static const char SETPSKIP[] =
+    "    if(stage < %s)\n"
+    "    {\n"
+;
+static const char SETPSEND[] =
+    "    }\n"
+;
 static const char SETPLEFT[] = "    set_%s((local void*)(ldata + %zu)";
 static const char SETPARGS[] = ", params[%zu]";
 static const char SETPIPPA[] = ", %s";
 static const char SETPRGHT[] = ");\n";
+static const char SETPTLFT[] = "    set_%s((local void*)(ldata + dsiz)";
+static const char SETPTCPY[] =
+    "    for(size_t i = 0; i < %zu; ++i)\n"
+    "        lenses[%zu + i] = ldata[dsiz + i];\n"
+;
 static const char SETPFOOT[] =
     "    \n"
     "    // store parameters to global memory\n"
@@ -141,13 +285,201 @@ static const char SETPFOOT[] =
 static const char SETPIPP_POSINIT[] =
     "    x = (float2)(params[%zu], params[%zu]);\n"
 ;
+static const char SETPIPP_POSPREV[] =
+    "    z = 0;\n"
+;
 static const char SETPIPP_POSLENS[] =
     "    a += deflection_%s((local void*)(ldata + %zu), x);\n"
 ;
+static const char SETPIPP_POSTABL[] =
+    "    a += deflection_lenses_item(lenses, (local uint*)(ldata + dsiz), x);\n"
+;
 static const char SETPIPP_POSDEFL[] =
     "    x -= dot(a, a) < HUGE_VALF ? a : (float2)(1E10f, 1E10f);\n"
     "    a = 0;\n"
 ;
+static const char SETPIPP_POSDSTP[] =
+    "    a = (dot(a, a) < HUGE_VALF ? a : (float2)(1E10f, 1E10f)) - %.9ef*(x - z);\n"
+    "    z = x;\n"
+    "    x -= a;\n"
+    "    a = 0;\n"
+;
+
+// lenses in tables, evaluated in chunks of members staged in local memory
+static const char TABLHEAD[] =
+    "#if DEFLECTION_FIELD\n"
+    "// number of members in a chunk, and size of the chunk\n"
+    "#define LENS_CHUNK %zu\n"
+    "#define LENS_SCRATCH (LENS_CHUNK*%zu)\n"
+    "\n"
+    "// members without a far field are culled when their largest deflection on\n"
+    "// a grid of 3x3 points in the box, times a safety factor, is below the\n"
+    "// tolerance; this assumes that the deflection varies smoothly over the box\n"
+    "#define LENS_SAMPLES 3\n"
+    "#define LENS_SAFETY 2\n"
+    "\n"
+    "// bound on the deflection m (x - x0)/|x - x0|^(1+s) of a far field f in\n"
+    "// the box from x0 to x1, which is m/d^s for the distance d of the box\n"
+    "static float lens_far(float4 f, float2 x0, float2 x1)\n"
+    "{\n"
+    "    float d = length(fmax(fmax(x0 - f.xy, f.xy - x1), 0.0f));\n"
+    "    return d > 0 ? f.z/pow(d, f.w) : (f.w > 0 ? HUGE_VALF : f.z);\n"
+    "}\n"
+    "\n"
+    "// deflection of lenses in tables, skipping the members whose deflection\n"
+    "// in the box from x0 to x1 is below the cull tolerance, and expanding\n"
+    "// the nodes of multipole trees that are far from the box for the opening\n"
+    "// angle theta; all work items of the group must take part\n"
+    "static float2 deflection_lenses(global const uint* lenses, float cull,\n"
+    "                                float theta, float2 x0, float2 x1,\n"
+    "                                local uint* scratch, local uchar* keep,\n"
+    "                                float2 x)\n"
+    "{\n"
+    "    // initial deflection is zero\n"
+    "    float2 a = 0;\n"
+;
+static const char TABLCHNK[] =
+    "    \n"
+    "    // lenses of type %s\n"
+    "    for(size_t c = 0; c < %zu; c += LENS_CHUNK)\n"
+    "    {\n"
+    "        // number of members in chunk\n"
+    "        size_t n = min((size_t)LENS_CHUNK, (size_t)(%zu - c));\n"
+;
+static const char TABLTREE[] =
+    "    \n"
+    "    // lenses of type %s, in a multipole tree\n"
+    "    for(size_t j = 1, down = 0; j > 0; j = multipole_next(j, down))\n"
+    "    {\n"
+    "        // node of tree\n"
+    "        global const float* nd = (global const float*)(lenses + %zu) + j*MULTIPOLE_NODE;\n"
+    "        \n"
+    "        // open near nodes, down to the leaves\n"
+    "        int opened = nd[MULTIPOLE_COUNT] > 0 && !multipole_far(nd, theta, x0, x1);\n"
+    "        down = opened && j < %zu;\n"
+    "        \n"
+    "        // expand far nodes that are not empty\n"
+    "        if(!opened && nd[MULTIPOLE_COUNT] > 0)\n"
+    "            a += multipole_eval(nd, x);\n"
+    "        \n"
+    "        // members of near leaves are computed directly\n"
+    "        if(!opened || down)\n"
+    "            continue;\n"
+    "        \n"
+    "        // first member of leaf, and number of members\n"
+    "        size_t c = (j - %zu)*LENS_CHUNK;\n"
+    "        size_t n = min((size_t)LENS_CHUNK, (size_t)(%zu - c));\n"
+;
+static const char TABLBODY[] =
+    "        \n"
+    "        // stage chunk in local memory\n"
+    "        barrier(CLK_LOCAL_MEM_FENCE);\n"
+    "        for(size_t i = get_local_id(0); i < n*%zu; i += get_local_size(0))\n"
+    "            scratch[i] = lenses[%zu + c*%zu + i];\n"
+    "        barrier(CLK_LOCAL_MEM_FENCE);\n"
+    "        \n"
+    "        // keep members whose sampled deflection can reach the tolerance\n"
+    "        for(size_t i = get_local_id(0); i < n; i += get_local_size(0))\n"
+    "        {\n"
+    "            float b = 0;\n"
+    "            for(int u = 0; u < LENS_SAMPLES && cull > 0; ++u)\n"
+    "                for(int v = 0; v < LENS_SAMPLES; ++v)\n"
+    "                    b = fmax(b, length(deflection_%s((local void*)(scratch + i*%zu), x0 + (float2)(u, v)*(x1 - x0)/(LENS_SAMPLES - 1))));\n"
+    "            keep[i] = !(cull > 0 && LENS_SAFETY*b < cull);\n"
+    "        }\n"
+    "        barrier(CLK_LOCAL_MEM_FENCE);\n"
+    "        \n"
+    "        // add deflection of members that are kept\n"
+    "        for(size_t i = 0; i < n; ++i)\n"
+    "            if(keep[i])\n"
+    "                a += deflection_%s((local void*)(scratch + i*%zu), x);\n"
+    "    }\n"
+;
+static const char TABLBFAR[] =
+    "        \n"
+    "        // stage chunk in local memory\n"
+    "        barrier(CLK_LOCAL_MEM_FENCE);\n"
+    "        for(size_t i = get_local_id(0); i < n*%zu; i += get_local_size(0))\n"
+    "            scratch[i] = lenses[%zu + c*%zu + i];\n"
+    "        barrier(CLK_LOCAL_MEM_FENCE);\n"
+    "        \n"
+    "        // keep members whose far field can reach the tolerance\n"
+    "        for(size_t i = get_local_id(0); i < n; i += get_local_size(0))\n"
+    "            keep[i] = !(cull > 0 && lens_far(farfield_%s((local void*)(scratch + i*%zu)), x0, x1) < cull);\n"
+    "        barrier(CLK_LOCAL_MEM_FENCE);\n"
+    "        \n"
+    "        // add deflection of members that are kept\n"
+    "        for(size_t i = 0; i < n; ++i)\n"
+    "            if(keep[i])\n"
+    "                a += deflection_%s((local void*)(scratch + i*%zu), x);\n"
+    "    }\n"
+;
+static const char TABLITEM[] =
+    "    \n"
+    "    // return total deflection\n"
+    "    return a;\n"
+    "}\n"
+    "\n"
+    "// deflection of lenses in tables for a single work item, staging one\n"
+    "// member at a time in local memory\n"
+    "static float2 deflection_lenses_item(global const uint* lenses,\n"
+    "                                     local uint* scratch, float2 x)\n"
+    "{\n"
+    "    // initial deflection is zero\n"
+    "    float2 a = 0;\n"
+;
+static const char TABLIMEM[] =
+    "    \n"
+    "    // lenses of type %s\n"
+    "    for(size_t i = 0; i < %zu; ++i)\n"
+    "    {\n"
+    "        for(size_t j = 0; j < %zu; ++j)\n"
+    "            scratch[j] = lenses[%zu + i*%zu + j];\n"
+    "        a += deflection_%s((local void*)scratch, x);\n"
+    "    }\n"
+;
+static const char TABLFOOT[] =
+    "    \n"
+    "    // return total deflection\n"
+    "    return a;\n"
+    "}\n"
+    "#endif\n"
+;
+
+// multipole trees of lens tables, built in parallel by a single work group
+static const char TREEHEAD[] =
+    "\n"
+    "#if DEFLECTION_FIELD\n"
+    "// build the multipole trees of lens tables from the lenses as they were\n"
+    "// set, with all work items of a single group taking part\n"
+    "kernel void lens_trees(global uint* lenses, local uint* scratch,\n"
+    "                       local float4* box)\n"
+    "{\n"
+    "    // work item and size of group\n"
+    "    size_t l = get_local_id(0);\n"
+    "    size_t m = get_local_size(0);\n"
+;
+static const char TREEBODY[] =
+    "    \n"
+    "    // multipole tree of lenses of type %s: far fields of the lenses,\n"
+    "    // lenses sorted along a Morton curve, and nodes\n"
+    "    for(size_t i = l; i < %zu; i += m)\n"
+    "    {\n"
+    "        for(size_t j = 0; j < %zu; ++j)\n"
+    "            scratch[l*%zu + j] = lenses[%zu + i*%zu + j];\n"
+    "        ((global float4*)(lenses + %zu))[i] = farfield_%s((local void*)(scratch + l*%zu));\n"
+    "    }\n"
+    "    barrier(CLK_GLOBAL_MEM_FENCE);\n"
+    "    multipole_sort((global const float4*)(lenses + %zu), lenses + %zu, lenses + %zu, %zu, box);\n"
+    "    for(size_t i = l; i < %zu; i += m)\n"
+    "        lenses[%zu + i] = lenses[%zu + lenses[%zu + i/%zu]*%zu + i%%%zu];\n"
+    "    multipole_tree((global float*)(lenses + %zu), (global const float4*)(lenses + %zu), lenses + %zu, %zu, LENS_CHUNK, %zu);\n"
+    "    barrier(CLK_GLOBAL_MEM_FENCE);\n"
+;
+static const char TREEFOOT[] =
+    "}\n"
+    "#endif\n"
+;
 
 // object kernel
 static const char OBJHEAD[] =
@@ -157,6 +489,8 @@ static const char OBJHEAD[] =
     "#define deflection deflection_%s\n"
     "#define brightness brightness_%s\n"
     "#define foreground foreground_%s\n"
+    "#define integral integral_%s\n"
+    "#define farfield farfield_%s\n"
     "#define set set_%s\n"
     "\n"
 ;
@@ -168,6 +502,8 @@ static const char OBJFOOT[] =
     "#undef deflection\n"
     "#undef brightness\n"
     "#undef foreground\n"
+    "#undef integral\n"
+    "#undef farfield\n"
     "#undef set\n"
 ;
 
@@ -232,6 +568,149 @@ static const char* str_replace(const char* str, const char* search, const char*
     return buf;
 }
 
+// check if object is integrated over pixels instead of the quadrature rule
+static int integrated(object objs[], size_t i)
+{
+    // object needs to provide an integral
+    if(!objs[i].integral)
+        return 0;
+    
+    // foregrounds are never lensed
+    if(objs[i].type == OBJ_FOREGROUND)
+        return 1;
+    
+    // sources are unlensed if no lens comes before them
+    if(objs[i].type == OBJ_SOURCE)
+    {
+        for(size_t j = 0; j < i; ++j)
+            if(objs[j].type == OBJ_LENS)
+                return 0;
+        return 1;
+    }
+    
+    // lenses cannot be integrated
+    return 0;
+}
+
+// size of object in the data block, where lenses in tables take no space
+static size_t block_size(object objs[], size_t i)
+{
+    return objs[i].table ? 0 : objs[i].size;
+}
+
+// index of the first member of the lens table of object
+static size_t table_first(object objs[], size_t i)
+{
+    for(size_t j = 0; j < i; ++j)
+        if(objs[j].table && strcmp(objs[j].name, objs[i].name) == 0)
+            return j;
+    return i;
+}
+
+// number of members in the lens table of object
+static size_t table_count(size_t nobjs, object objs[], size_t i)
+{
+    size_t n = 0;
+    for(size_t j = 0; j < nobjs; ++j)
+        if(objs[j].table && strcmp(objs[j].name, objs[i].name) == 0)
+            n += 1;
+    return n;
+}
+
+// offset of object in the buffer of lens tables, which holds the tables in
+// order of their first members
+static size_t table_offset(size_t nobjs, object objs[], size_t i)
+{
+    size_t t = 0;
+    size_t f = table_first(objs, i);
+    for(size_t j = 0; j < nobjs; ++j)
+    {
+        if(!objs[j].table)
+            continue;
+        
+        // earlier members of the same table, and all members of earlier tables
+        if(strcmp(objs[j].name, objs[i].name) == 0 ? j < i : table_first(objs, j) < f)
+            t += objs[j].size;
+    }
+    return t;
+}
+
+// round offset up to a multiple of four, for the alignment of vectors
+static size_t align4(size_t n)
+{
+    return (n + 3)/4*4;
+}
+
+// number of leaves of the multipole tree of a table, which is a power of two
+static size_t tree_leaves(size_t n)
+{
+    size_t l = 1;
+    while(l*LENS_CHUNK < n)
+        l *= 2;
+    return l;
+}
+
+// layout of a multipole tree for n lenses of size z starting at base: the
+// lenses as they are set, their far fields, sort keys and indices, and the
+// nodes; returns the end of the layout
+static size_t tree_region(size_t base, size_t n, size_t z, size_t* raw,
+                          size_t* mono, size_t* key, size_t* index,
+                          size_t* node)
+{
+    *raw = base;
+    *mono = align4(*raw + n*z);
+    *key = *mono + 4*n;
+    *index = *key + n;
+    *node = align4(*index + n);
+    return align4(*node + 2*tree_leaves(n)*MULTIPOLE_NODE);
+}
+
+// layout of the multipole tree of the lens table of object, after all tables
+// and the trees of earlier tables; returns the end of the layout
+static size_t tree_layout(size_t nobjs, object objs[], size_t i, size_t* raw,
+                          size_t* mono, size_t* key, size_t* index,
+                          size_t* node)
+{
+    size_t b = 0;
+    
+    // trees come after all tables
+    for(size_t j = 0; j < nobjs; ++j)
+        if(objs[j].table)
+            b += objs[j].size;
+    b = align4(b);
+    
+    // trees of tables in order of their first members
+    for(size_t j = 0; j < nobjs; ++j)
+    {
+        if(!objs[j].tree || table_first(objs, j) != j)
+            continue;
+        
+        b = tree_region(b, table_count(nobjs, objs, j), objs[j].size, raw, mono, key, index, node);
+        
+        if(j == table_first(objs, i))
+            break;
+    }
+    
+    return b;
+}
+
+// check if distances of planes are given
+static int plane_distances(size_t nobjs, object objs[])
+{
+    for(size_t i = 0; i < nobjs; ++i)
+        if(objs[i].distance > 0)
+            return 1;
+    return 0;
+}
+
+// extra step that carries the direction of a ray from the previous plane at
+// distance c0 through the current plane at c1 on to the next plane at c2, in
+// units of the step between the previous and current plane
+static double plane_step(double c0, double c1, double c2)
+{
+    return c0*(c2 - c1)/(c2*(c1 - c0));
+}
+
 static const char* compute_kernel(size_t nobjs, object objs[])
 {
     // object type currently processed
@@ -240,8 +719,17 @@ static const char* compute_kernel(size_t nobjs, object objs[])
     // trigger for changing lens planes
     int trigger;
     
+    // number of lens planes that were applied
+    size_t planes;
+    
+    // distances of previous and current lens plane
+    double c0, c1;
+    
+    // index of cached ray
+    size_t r;
+    
     // buffer for kernel
-    size_t buf_size;
+    size_t siz, len;
     char* buf;
     
     // current output position
@@ -253,159 +741,751 @@ static const char* compute_kernel(size_t nobjs, object objs[])
     // number of characters added
     int wri;
     
-    // calculate buffer size
-    d = 0;
-    type = trigger = 0;
-    buf_size = sizeof(FILEHEAD) + strlen("compute");
-    buf_size += sizeof(COMPHEAD);
-    for(size_t i = 0; i < nobjs; ++i)
+    // start empty and with 0 length to prevent writing
+    buf = NULL;
+    out = NULL;
+    siz = 0;
+    len = 0;
+    
+    // two-pass: calculate buffer size and allocate, then fill
+    for(int pass = 0; pass < 2; ++pass)
     {
-        if(objs[i].type != trigger && objs[i].type != OBJ_FOREGROUND)
+        // allocate buffer after first pass
+        if(pass > 0)
         {
-            if(trigger == OBJ_LENS)
-                buf_size += sizeof(COMPDEFL);
-            trigger = objs[i].type;
+            // allocate
+            buf = malloc(siz + 1);
+            if(!buf)
+                errori(NULL);
+            
+            // output tracks writing
+            out = buf;
+            
+            // maximum length is now huge
+            len = -1;
         }
-        if(objs[i].type != type)
+        
+        // write file header
+        wri = snprintf(out, len, FILEHEAD, "", "compute");
+        if(wri < 0)
+            errori(NULL);
+        if(pass > 0)
+            out += wri;
+        else
+            siz += wri;
+        
+        // write header of first lens plane
+        wri = snprintf(out, len, PLANHEAD);
+        if(wri < 0)
+            errori(NULL);
+        if(pass > 0)
+            out += wri;
+        else
+            siz += wri;
+        
+        // start at beginning of data block with invalid trigger
+        d = 0;
+        trigger = 0;
+        
+        // write lenses up to the first source behind them
+        for(size_t i = 0; i < nobjs; ++i)
         {
-            if(objs[i].type == OBJ_LENS)
-                buf_size += sizeof(COMPLHED);
-            else if(objs[i].type == OBJ_SOURCE)
-                buf_size += sizeof(COMPSHED);
-            else if(objs[i].type == OBJ_FOREGROUND)
-                buf_size += sizeof(COMPFHED);
-            type = objs[i].type;
+            // stop when triggering from lenses to sources
+            if(trigger == OBJ_LENS && objs[i].type == OBJ_SOURCE)
+                break;
+            
+            // write line for lens, unless it is in a table
+            if(objs[i].type == OBJ_LENS && !objs[i].table)
+            {
+                wri = snprintf(out, len, PLANLENS, objs[i].name, d);
+                if(wri < 0)
+                    errori(NULL);
+                if(pass > 0)
+                    out += wri;
+                else
+                    siz += wri;
+            }
+            
+            // new trigger
+            if(objs[i].type != OBJ_FOREGROUND)
+                trigger = objs[i].type;
+            
+            // advance data pointer
+            d += block_size(objs, i);
         }
-        if(type == OBJ_LENS)
-            buf_size += sizeof(COMPLENS);
-        else if(type == OBJ_SOURCE)
-            buf_size += sizeof(COMPSRCE);
-        else if(type == OBJ_FOREGROUND)
-            buf_size += sizeof(COMPFGND);
-        buf_size += strlen(objs[i].name);
-        buf_size += log10(1+d);
-        d += objs[i].size;
-    }
-    if(trigger == OBJ_LENS)
-        buf_size += sizeof(COMPDEFL);
-    buf_size += sizeof(COMPFOOT);
-    buf_size += sizeof(FILEFOOT);
-    
-    // allocate buffer
-    buf = malloc(buf_size);
-    if(!buf)
-        errori(NULL);
-    
-    // start at beginning of data block
-    d = 0;
-    
-    // start with invalid type
-    type = trigger = 0;
-    
-    // output tracks current writing position on buffer
-    out = buf;
-    
-    // write file header
-    wri = sprintf(out, FILEHEAD, "", "compute");
-    if(wri < 0)
-        errori(NULL);
-    out += wri;
-    
-    // write header
-    wri = sprintf(out, COMPHEAD);
-    if(wri < 0)
-        errori(NULL);
-    out += wri;
-    
-    // write body
-    for(size_t i = 0; i < nobjs; ++i)
-    {
-        // check if lens plane change is triggered
-        if(objs[i].type != trigger && objs[i].type != OBJ_FOREGROUND)
+        
+        // write footer of first lens plane
+        wri = snprintf(out, len, PLANFOOT);
+        if(wri < 0)
+            errori(NULL);
+        if(pass > 0)
+            out += wri;
+        else
+            siz += wri;
+        
+        // write pixel integral of all integrated objects, and of integrated
+        // sources and foregrounds alone
+        for(size_t part = 0; part < NINTGPART; ++part)
         {
-            // when triggering from lenses to sources, apply deflection
-            if(trigger == OBJ_LENS)
-            {
-                wri = sprintf(out, COMPDEFL);
+            // write header of pixel integral
+            wri = snprintf(out, len, INTGHEAD, INTGNAME[part]);
+            if(wri < 0)
+                errori(NULL);
+            if(pass > 0)
+                out += wri;
+            else
+                siz += wri;
+            
+            // start at beginning of data block
+            d = 0;
+            
+            // write integrated objects
+            for(size_t i = 0; i < nobjs; ++i)
+            {
+                if(integrated(objs, i) && (!INTGTYPE[part] || objs[i].type == INTGTYPE[part]))
+                {
+                    wri = snprintf(out, len, INTGOBJS, objs[i].name, d);
+                    if(wri < 0)
+                        errori(NULL);
+                    if(pass > 0)
+                        out += wri;
+                    else
+                        siz += wri;
+                }
+                
+                // advance data pointer
+                d += block_size(objs, i);
+            }
+            
+            // write footer of pixel integral
+            wri = snprintf(out, len, INTGFOOT);
+            if(wri < 0)
+                errori(NULL);
+            if(pass > 0)
+                out += wri;
+            else
+                siz += wri;
+        }
+        
+        // write header of foregrounds for partial updates
+        wri = snprintf(out, len, FGNDHEAD);
+        if(wri < 0)
+            errori(NULL);
+        if(pass > 0)
+            out += wri;
+        else
+            siz += wri;
+        
+        // start at beginning of data block
+        d = 0;
+        
+        // write foregrounds that are not integrated
+        for(size_t i = 0; i < nobjs; ++i)
+        {
+            if(objs[i].type == OBJ_FOREGROUND && !integrated(objs, i))
+            {
+                wri = snprintf(out, len, COMPFGND, objs[i].name, d);
+                if(wri < 0)
+                    errori(NULL);
+                if(pass > 0)
+                    out += wri;
+                else
+                    siz += wri;
+            }
+            
+            // advance data pointer
+            d += block_size(objs, i);
+        }
+        
+        // write footer of foregrounds
+        wri = snprintf(out, len, PARTFOOT);
+        if(wri < 0)
+            errori(NULL);
+        if(pass > 0)
+            out += wri;
+        else
+            siz += wri;
+        
+        // write kernel for sources with cached rays for partial updates,
+        // then the kernel for all objects
+        for(int all = 0; all < 2; ++all)
+        {
+            // write header
+            wri = snprintf(out, len, all ? COMPHEAD : COMPPHED);
+            if(wri < 0)
+                errori(NULL);
+            if(pass > 0)
+                out += wri;
+            else
+                siz += wri;
+            
+            // rays remember the previous plane if planes have distances
+            if(plane_distances(nobjs, objs))
+            {
+                wri = snprintf(out, len, COMPPREV);
+                if(wri < 0)
+                    errori(NULL);
+                if(pass > 0)
+                    out += wri;
+                else
+                    siz += wri;
+            }
+            
+            // start at beginning of data block
+            d = 0;
+            
+            // start with invalid type
+            type = trigger = 0;
+            
+            // no lens planes applied yet, and rays start at the observer
+            planes = 0;
+            c0 = c1 = 0;
+            
+            // no rays cached yet
+            r = 0;
+            
+            // write body
+            for(size_t i = 0; i < nobjs; ++i)
+            {
+                // check if lens plane change is triggered
+                if(objs[i].type != trigger && objs[i].type != OBJ_FOREGROUND)
+                {
+                    // when triggering from lenses to sources, apply deflection,
+                    // which reaches the sources after the step from the plane
+                    // before if planes have distances
+                    if(trigger == OBJ_LENS)
+                    {
+                        if(plane_distances(nobjs, objs))
+                            wri = snprintf(out, len, COMPDSTP, plane_step(c0, c1, objs[i].distance));
+                        else
+                            wri = snprintf(out, len, COMPDEFL);
+                        if(wri < 0)
+                            errori(NULL);
+                        if(pass > 0)
+                            out += wri;
+                        else
+                            siz += wri;
+                        
+                        // one more lens plane done
+                        planes += 1;
+                        c0 = c1;
+                    }
+                    
+                    // new trigger
+                    trigger = objs[i].type;
+                }
+                
+                // check if type of object changed
+                if(objs[i].type != type)
+                {
+                    // rays are cached before sources for partial updates
+                    if(!all && objs[i].type == OBJ_SOURCE)
+                    {
+                        wri = snprintf(out, len, COMPRAYS, r, r);
+                        if(wri < 0)
+                            errori(NULL);
+                        if(pass > 0)
+                            out += wri;
+                        else
+                            siz += wri;
+                        
+                        r += 1;
+                    }
+                    
+                    // write header, foregrounds are computed separately for
+                    // partial updates
+                    if(objs[i].type == OBJ_LENS)
+                        wri = snprintf(out, len, all ? COMPLHED : COMPLPHD);
+                    else if(objs[i].type == OBJ_SOURCE)
+                        wri = snprintf(out, len, COMPSHED);
+                    else if(objs[i].type == OBJ_FOREGROUND && all)
+                        wri = snprintf(out, len, COMPFHED);
+                    else
+                        wri = 0;
+                    if(wri < 0)
+                        errori(NULL);
+                    if(pass > 0)
+                        out += wri;
+                    else
+                        siz += wri;
+                    
+                    // first lens plane is computed all at once
+                    if(objs[i].type == OBJ_LENS && planes == 0)
+                    {
+                        wri = snprintf(out, len, COMPPLAN);
+                        if(wri < 0)
+                            errori(NULL);
+                        if(pass > 0)
+                            out += wri;
+                        else
+                            siz += wri;
+                    }
+                    
+                    // new type
+                    type = objs[i].type;
+                }
+                
+                // keep track of distance of lens plane
+                if(type == OBJ_LENS)
+                    c1 = objs[i].distance;
+                
+                // write line for current object, unless it is integrated
+                if(integrated(objs, i))
+                    wri = 0;
+                else if(type == OBJ_LENS && planes > 0)
+                    wri = snprintf(out, len, COMPLENS, objs[i].name, d);
+                else if(type == OBJ_SOURCE)
+                    wri = snprintf(out, len, COMPSRCE, objs[i].name, d);
+                else if(type == OBJ_FOREGROUND && all)
+                    wri = snprintf(out, len, COMPFGND, objs[i].name, d);
+                else
+                    wri = 0;
+                if(wri < 0)
+                    errori(NULL);
+                if(pass > 0)
+                    out += wri;
+                else
+                    siz += wri;
+                
+                // advance data pointer
+                d += block_size(objs, i);
+            }
+            
+            // apply deflection when finishing with lens
+            if(trigger == OBJ_LENS)
+            {
+                wri = snprintf(out, len, COMPDEFL);
+                if(wri < 0)
+                    errori(NULL);
+                if(pass > 0)
+                    out += wri;
+                else
+                    siz += wri;
+            }
+            
+            // write footer
+            wri = snprintf(out, len, all ? COMPFOOT : PARTFOOT);
+            if(wri < 0)
+                errori(NULL);
+            if(pass > 0)
+                out += wri;
+            else
+                siz += wri;
+        }
+        
+        // write file footer
+        wri = snprintf(out, len, FILEFOOT);
+        if(wri < 0)
+            errori(NULL);
+        if(pass > 0)
+            out += wri;
+        else
+            siz += wri;
+    }
+    
+    // this is our code
+    return buf;
+}
+
+static const char* set_params_kernel(size_t nobjs, object objs[], size_t nbands)
+{
+    // trigger for changing lens planes
+    int trigger;
+    
+    // index of object starting current plane
+    size_t plane;
+    
+    // buffer for kernel
+    size_t siz, len;
+    char* buf;
+    
+    // current output position
+    char* out;
+    
+    // number of characters added
+    int wri;
+    
+    // data offset
+    size_t d;
+    
+    // parameter offset
+    size_t p;
+    
+    // size of data for one band
+    size_t dband;
+    
+    // every band has its own copy of the object data
+    dband = 0;
+    for(size_t i = 0; i < nobjs; ++i)
+        dband += block_size(objs, i);
+    
+    // start empty and with 0 length to prevent writing
+    buf = NULL;
+    out = NULL;
+    siz = 0;
+    len = 0;
+    
+    // two-pass: calculate buffer size and allocate, then fill
+    for(int pass = 0; pass < 2; ++pass)
+    {
+        // allocate buffer after first pass
+        if(pass > 0)
+        {
+            // allocate
+            buf = malloc(siz + 1);
+            if(!buf)
+                errori(NULL);
+            
+            // output tracks writing
+            out = buf;
+            
+            // maximum length is now huge
+            len = -1;
+        }
+        
+        // write file header
+        wri = snprintf(out, len, FILEHEAD, "", "set_params");
+        if(wri < 0)
+            errori(NULL);
+        if(pass > 0)
+            out += wri;
+        else
+            siz += wri;
+        
+        // write header
+        wri = snprintf(out, len, SETPHEAD);
+        if(wri < 0)
+            errori(NULL);
+        if(pass > 0)
+            out += wri;
+        else
+            siz += wri;
+        
+        // image plane priors remember the previous plane if planes have
+        // distances
+        if(plane_distances(nobjs, objs))
+        {
+            wri = snprintf(out, len, SETPPREV);
+            if(wri < 0)
+                errori(NULL);
+            if(pass > 0)
+                out += wri;
+            else
+                siz += wri;
+        }
+        
+        // write body for each band, with copies of parameters for the band
+        // replacing the shared parameters
+        for(size_t b = 0; b < nbands; ++b)
+        {
+            // start with invalid trigger
+            trigger = 0;
+            
+            // keep track of where current plane starts
+            plane = 0;
+            
+            // start at beginning of data of band and parameters
+            p = 0;
+            d = b*dband;
+            
+            for(size_t i = 0; i < nobjs; ++i)
+            {
+                // check if lens plane change is triggered
+                if(objs[i].type != trigger && objs[i].type != OBJ_FOREGROUND)
+                {
+                    // when triggering from lenses to sources, change planes
+                    if(trigger == OBJ_LENS && objs[i].type == OBJ_SOURCE)
+                        plane = i;
+                    
+                    // new trigger
+                    trigger = objs[i].type;
+                }
+                
+                // lenses in tables are shared by all bands
+                if(objs[i].table && b > 0)
+                {
+                    p += objs[i].npars;
+                    continue;
+                }
+                
+                // lenses and sources are kept by partial updates
+                if(objs[i].type != OBJ_FOREGROUND)
+                {
+                    wri = snprintf(out, len, SETPSKIP, objs[i].type == OBJ_LENS ? "PARTIAL_SOURCES" : "PARTIAL_FOREGROUNDS");
+                    if(wri < 0)
+                        errori(NULL);
+                    if(pass > 0)
+                        out += wri;
+                    else
+                        siz += wri;
+                }
+                
+                // search for image plane priors in this object
+                for(size_t j = 0; j < objs[i].npars; ++j)
+                {
+                    if(objs[i].pars[j].ipp)
+                    {
+                        // image plane prior depends on parameter type
+                        switch(objs[i].pars[j].type)
+                        {
+                            // position: lens through all previous planes
+                            case PAR_POSITION_X:
+                            {
+                                // inner trigger for changing lens planes
+                                int trigger2 = 0;
+                                
+                                // inner data offset
+                                size_t d2 = 0;
+                                
+                                // lens tables were not applied yet
+                                int tables2 = 0;
+                                
+                                // inner distances of previous and current
+                                // lens plane
+                                double c0 = 0, c1 = 0;
+                                
+                                // initialise position IPP
+                                wri = snprintf(out, len, SETPIPP_POSINIT, p + j, p + j + 1);
+                                if(wri < 0)
+                                    errori(NULL);
+                                if(pass > 0)
+                                    out += wri;
+                                else
+                                    siz += wri;
+                                
+                                // start at the observer
+                                if(plane_distances(nobjs, objs))
+                                {
+                                    wri = snprintf(out, len, SETPIPP_POSPREV);
+                                    if(wri < 0)
+                                        errori(NULL);
+                                    if(pass > 0)
+                                        out += wri;
+                                    else
+                                        siz += wri;
+                                }
+                                
+                                // deflect IPP through previous planes
+                                for(size_t k = 0; k < plane; ++k)
+                                {
+                                    if(objs[k].type != trigger2 && objs[k].type != OBJ_FOREGROUND)
+                                    {
+                                        // deflect when triggering from lens
+                                        if(trigger2 == OBJ_LENS)
+                                        {
+                                            if(plane_distances(nobjs, objs))
+                                                wri = snprintf(out, len, SETPIPP_POSDSTP, plane_step(c0, c1, objs[k].distance));
+                                            else
+                                                wri = snprintf(out, len, SETPIPP_POSDEFL);
+                                            if(wri < 0)
+                                                errori(NULL);
+                                            if(pass > 0)
+                                                out += wri;
+                                            else
+                                                siz += wri;
+                                            
+                                            c0 = c1;
+                                        }
+                                        
+                                        // reset trigger
+                                        trigger2 = objs[k].type;
+                                    }
+                                    
+                                    // compute deflection for all lens tables
+                                    // at once, reading the members of trees
+                                    // as they were set, since the trees are
+                                    // only sorted after this kernel
+                                    if(objs[k].table && !tables2)
+                                    {
+                                        wri = snprintf(out, len, SETPIPP_POSTABL);
+                                        if(wri < 0)
+                                            errori(NULL);
+                                        if(pass > 0)
+                                            out += wri;
+                                        else
+                                            siz += wri;
+                                        
+                                        tables2 = 1;
+                                    }
+                                    
+                                    // keep track of distance of lens plane
+                                    if(objs[k].type == OBJ_LENS)
+                                        c1 = objs[k].distance;
+                                    
+                                    // compute deflection for lens
+                                    if(objs[k].type == OBJ_LENS && !objs[k].table)
+                                    {
+                                        wri = snprintf(out, len, SETPIPP_POSLENS, objs[k].name, d2);
+                                        if(wri < 0)
+                                            errori(NULL);
+                                        if(pass > 0)
+                                            out += wri;
+                                        else
+                                            siz += wri;
+                                    }
+                                    
+                                    // increase data offset
+                                    d2 += block_size(objs, k);
+                                }
+                                
+                                // apply final deflection when stopped with lens
+                                if(trigger2 == OBJ_LENS)
+                                {
+                                    if(plane_distances(nobjs, objs))
+                                        wri = snprintf(out, len, SETPIPP_POSDSTP, plane_step(c0, c1, objs[plane].distance));
+                                    else
+                                        wri = snprintf(out, len, SETPIPP_POSDEFL);
+                                    if(wri < 0)
+                                        errori(NULL);
+                                    if(pass > 0)
+                                        out += wri;
+                                    else
+                                        siz += wri;
+                                }
+                            }
+                            
+                            // handled together with X
+                            case PAR_POSITION_Y:
+                                break;
+                            
+                            // should not happen
+                            default:
+                                break;
+                        }
+                    }
+                }
+                
+                // write left side of line, lenses in tables are set in the
+                // scratch space after the data block
+                if(objs[i].table)
+                    wri = snprintf(out, len, SETPTLFT, objs[i].name);
+                else
+                    wri = snprintf(out, len, SETPLEFT, objs[i].name, d);
                 if(wri < 0)
                     errori(NULL);
-                out += wri;
+                if(pass > 0)
+                    out += wri;
+                else
+                    siz += wri;
+                
+                // write arguments, skipping copies of parameters for bands
+                for(size_t j = 0; j < objs[i].npars; ++j)
+                {
+                    if(objs[i].pars[j].band)
+                        continue;
+                    
+                    // special argument for image plane priors
+                    if(objs[i].pars[j].ipp)
+                    {
+                        const char* arg;
+                        
+                        switch(objs[i].pars[j].type)
+                        {
+                            case PAR_POSITION_X:    arg = "x.x";    break;
+                            case PAR_POSITION_Y:    arg = "x.y";    break;
+                            default:                arg = "0";      break;
+                        }
+                        
+                        wri = snprintf(out, len, SETPIPPA, arg);
+                        if(wri < 0)
+                            errori(NULL);
+                        if(pass > 0)
+                            out += wri;
+                        else
+                            siz += wri;
+                    }
+                    else
+                    {
+                        // parameter, or its copy for the band
+                        size_t k = j;
+                        for(size_t l = 0; b > 0 && l < objs[i].npars; ++l)
+                            if(objs[i].pars[l].band == b && objs[i].pars[l].base == j)
+                                k = l;
+                        
+                        wri = snprintf(out, len, SETPARGS, p + k);
+                        if(wri < 0)
+                            errori(NULL);
+                        if(pass > 0)
+                            out += wri;
+                        else
+                            siz += wri;
+                    }
+                }
+                
+                // write right side of line
+                wri = snprintf(out, len, SETPRGHT);
+                if(wri < 0)
+                    errori(NULL);
+                if(pass > 0)
+                    out += wri;
+                else
+                    siz += wri;
+                
+                // copy lens from scratch space to its table, or to the space
+                // of its tree where lenses are sorted
+                if(objs[i].table)
+                {
+                    size_t t = table_offset(nobjs, objs, i);
+                    
+                    if(objs[i].tree)
+                    {
+                        size_t raw, mono, key, index, node;
+                        tree_layout(nobjs, objs, i, &raw, &mono, &key, &index, &node);
+                        t += raw - table_offset(nobjs, objs, table_first(objs, i));
+                    }
+                    
+                    wri = snprintf(out, len, SETPTCPY, objs[i].size, t);
+                    if(wri < 0)
+                        errori(NULL);
+                    if(pass > 0)
+                        out += wri;
+                    else
+                        siz += wri;
+                }
+                
+                // end of object that is kept by partial updates
+                if(objs[i].type != OBJ_FOREGROUND)
+                {
+                    wri = snprintf(out, len, SETPSEND);
+                    if(wri < 0)
+                        errori(NULL);
+                    if(pass > 0)
+                        out += wri;
+                    else
+                        siz += wri;
+                }
+                
+                // increase offsets
+                d += block_size(objs, i);
+                p += objs[i].npars;
             }
-            
-            // new trigger
-            trigger = objs[i].type;
-        }
-        
-        // check if type of object changed
-        if(objs[i].type != type)
-        {
-            // write header
-            if(objs[i].type == OBJ_LENS)
-                wri = sprintf(out, COMPLHED);
-            else if(objs[i].type == OBJ_SOURCE)
-                wri = sprintf(out, COMPSHED);
-            else if(objs[i].type == OBJ_FOREGROUND)
-                wri = sprintf(out, COMPFHED);
-            else
-                wri = 0;
-            if(wri < 0)
-                errori(NULL);
-            out += wri;
-            
-            // new type
-            type = objs[i].type;
         }
         
-        // write line for current object
-        if(type == OBJ_LENS)
-            wri = sprintf(out, COMPLENS, objs[i].name, d);
-        else if(type == OBJ_SOURCE)
-            wri = sprintf(out, COMPSRCE, objs[i].name, d);
-        else if(type == OBJ_FOREGROUND)
-            wri = sprintf(out, COMPFGND, objs[i].name, d);
-        else
-            wri = 0;
+        // write footer
+        wri = snprintf(out, len, SETPFOOT);
         if(wri < 0)
             errori(NULL);
-        out += wri;
+        if(pass > 0)
+            out += wri;
+        else
+            siz += wri;
         
-        // advance data pointer
-        d += objs[i].size;
-    }
-    
-    // apply deflection when finishing with lens
-    if(trigger == OBJ_LENS)
-    {
-        wri = sprintf(out, COMPDEFL);
+        // write file footer
+        wri = snprintf(out, len, FILEFOOT);
         if(wri < 0)
             errori(NULL);
-        out += wri;
+        if(pass > 0)
+            out += wri;
+        else
+            siz += wri;
     }
     
-    // write footer
-    wri = sprintf(out, COMPFOOT);
-    if(wri < 0)
-        errori(NULL);
-    out += wri;
-    
-    // write file footer
-    wri = sprintf(out, FILEFOOT);
-    if(wri < 0)
-        errori(NULL);
-    out += wri;
-    
     // this is our code
     return buf;
 }
 
-static const char* set_params_kernel(size_t nobjs, object objs[])
+static const char* tables_kernel(size_t nobjs, object objs[])
 {
-    // trigger for changing lens planes
-    int trigger;
-    
-    // index of object starting current plane
-    size_t plane;
-    
     // buffer for kernel
     size_t siz, len;
     char* buf;
@@ -416,11 +1496,16 @@ static const char* set_params_kernel(size_t nobjs, object objs[])
     // number of characters added
     int wri;
     
-    // data offset
-    size_t d;
+    // largest lens in a table, for the size of chunks
+    size_t lmax;
     
-    // parameter offset
-    size_t p;
+    // number of multipole trees
+    size_t trees;
+    
+    lmax = 1;
+    for(size_t i = 0; i < nobjs; ++i)
+        if(objs[i].table && objs[i].size > lmax)
+            lmax = objs[i].size;
     
     // start empty and with 0 length to prevent writing
     buf = NULL;
@@ -446,17 +1531,8 @@ static const char* set_params_kernel(size_t nobjs, object objs[])
             len = -1;
         }
         
-        // start with invalid trigger
-        trigger = 0;
-        
-        // keep track of where current plane starts
-        plane = 0;
-        
-        // start at beginning of data and parameters
-        p = d = 0;
-        
         // write file header
-        wri = snprintf(out, len, FILEHEAD, "", "set_params");
+        wri = snprintf(out, len, FILEHEAD, "", "lens_tables");
         if(wri < 0)
             errori(NULL);
         if(pass > 0)
@@ -465,7 +1541,7 @@ static const char* set_params_kernel(size_t nobjs, object objs[])
             siz += wri;
         
         // write header
-        wri = snprintf(out, len, SETPHEAD);
+        wri = snprintf(out, len, TABLHEAD, LENS_CHUNK, lmax);
         if(wri < 0)
             errori(NULL);
         if(pass > 0)
@@ -473,167 +1549,85 @@ static const char* set_params_kernel(size_t nobjs, object objs[])
         else
             siz += wri;
         
-        // write body
+        // write chunked loop for each table
         for(size_t i = 0; i < nobjs; ++i)
         {
-            // check if lens plane change is triggered
-            if(objs[i].type != trigger && objs[i].type != OBJ_FOREGROUND)
+            if(!objs[i].table || table_first(objs, i) != i)
+                continue;
+            
+            size_t n = table_count(nobjs, objs, i);
+            size_t t = table_offset(nobjs, objs, i);
+            size_t z = objs[i].size;
+            
+            // walk multipole tree to its near leaves, or loop over chunks
+            if(objs[i].tree)
             {
-                // when triggering from lenses to sources, change planes
-                if(trigger == OBJ_LENS && objs[i].type == OBJ_SOURCE)
-                    plane = i;
-                
-                // new trigger
-                trigger = objs[i].type;
+                size_t l = tree_leaves(n);
+                size_t raw, mono, key, index, node;
+                tree_layout(nobjs, objs, i, &raw, &mono, &key, &index, &node);
+                wri = snprintf(out, len, TABLTREE, objs[i].name, node, l, l, n);
             }
-            
-            // search for image plane priors in this object
-            for(size_t j = 0; j < objs[i].npars; ++j)
+            else
             {
-                if(objs[i].pars[j].ipp)
-                {
-                    // image plane prior depends on parameter type
-                    switch(objs[i].pars[j].type)
-                    {
-                        // position: lens through all previous planes
-                        case PAR_POSITION_X:
-                        {
-                            // inner trigger for changing lens planes
-                            int trigger2 = 0;
-                            
-                            // inner data offset
-                            size_t d2 = 0;
-                            
-                            // initialise position IPP
-                            wri = snprintf(out, len, SETPIPP_POSINIT, p + j, p + j + 1);
-                            if(wri < 0)
-                                errori(NULL);
-                            if(pass > 0)
-                                out += wri;
-                            else
-                                siz += wri;
-                            
-                            // deflect IPP through previous planes
-                            for(size_t k = 0; k < plane; ++k)
-                            {
-                                if(objs[k].type != trigger2 && objs[k].type != OBJ_FOREGROUND)
-                                {
-                                    // deflect when triggering from lens
-                                    if(trigger2 == OBJ_LENS)
-                                    {
-                                        wri = snprintf(out, len, SETPIPP_POSDEFL);
-                                        if(wri < 0)
-                                            errori(NULL);
-                                        if(pass > 0)
-                                            out += wri;
-                                        else
-                                            siz += wri;
-                                    }
-                                    
-                                    // reset trigger
-                                    trigger2 = objs[k].type;
-                                }
-                                
-                                // compute deflection for lens
-                                if(objs[k].type == OBJ_LENS)
-                                {
-                                    wri = snprintf(out, len, SETPIPP_POSLENS, objs[k].name, d2);
-                                    if(wri < 0)
-                                        errori(NULL);
-                                    if(pass > 0)
-                                        out += wri;
-                                    else
-                                        siz += wri;
-                                }
-                                
-                                // increase data offset
-                                d2 += objs[k].size;
-                            }
-                            
-                            // apply final deflection when stopped with lens
-                            if(trigger2 == OBJ_LENS)
-                            {
-                                wri = snprintf(out, len, SETPIPP_POSDEFL);
-                                if(wri < 0)
-                                    errori(NULL);
-                                if(pass > 0)
-                                    out += wri;
-                                else
-                                    siz += wri;
-                            }
-                        }
-                        
-                        // handled together with X
-                        case PAR_POSITION_Y:
-                            break;
-                        
-                        // should not happen
-                        default:
-                            break;
-                    }
-                }
+                wri = snprintf(out, len, TABLCHNK, objs[i].name, n, n);
             }
+            if(wri < 0)
+                errori(NULL);
+            if(pass > 0)
+                out += wri;
+            else
+                siz += wri;
             
-            // write left side of line
-            wri = snprintf(out, len, SETPLEFT, objs[i].name, d);
+            // members of chunk or leaf
+            // with culling bounded by the far field, if there is one
+            wri = snprintf(out, len, objs[i].farfield ? TABLBFAR : TABLBODY, z, t, z, objs[i].name, z, objs[i].name, z);
             if(wri < 0)
                 errori(NULL);
             if(pass > 0)
                 out += wri;
             else
                 siz += wri;
+        }
+        
+        // write function for single work items
+        wri = snprintf(out, len, TABLITEM);
+        if(wri < 0)
+            errori(NULL);
+        if(pass > 0)
+            out += wri;
+        else
+            siz += wri;
+        
+        // write member loop for each table
+        for(size_t i = 0; i < nobjs; ++i)
+        {
+            if(!objs[i].table || table_first(objs, i) != i)
+                continue;
+            
+            size_t n = table_count(nobjs, objs, i);
+            size_t t = table_offset(nobjs, objs, i);
+            size_t z = objs[i].size;
             
-            // write arguments
-            for(size_t j = 0; j < objs[i].npars; ++j)
+            // lenses of trees are taken as they were set, since the trees
+            // are only built once the parameter kernel is done
+            if(objs[i].tree)
             {
-                // special argument for image plane priors
-                if(objs[i].pars[j].ipp)
-                {
-                    const char* arg;
-                    
-                    switch(objs[i].pars[j].type)
-                    {
-                        case PAR_POSITION_X:    arg = "x.x";    break;
-                        case PAR_POSITION_Y:    arg = "x.y";    break;
-                        default:                arg = "0";      break;
-                    }
-                    
-                    wri = snprintf(out, len, SETPIPPA, arg);
-                    if(wri < 0)
-                        errori(NULL);
-                    if(pass > 0)
-                        out += wri;
-                    else
-                        siz += wri;
-                }
-                else
-                {
-                    wri = snprintf(out, len, SETPARGS, p + j);
-                    if(wri < 0)
-                        errori(NULL);
-                    if(pass > 0)
-                        out += wri;
-                    else
-                        siz += wri;
-                }
+                size_t raw, mono, key, index, node;
+                tree_layout(nobjs, objs, i, &raw, &mono, &key, &index, &node);
+                t = raw;
             }
             
-            // write right side of line
-            wri = snprintf(out, len, SETPRGHT);
+            wri = snprintf(out, len, TABLIMEM, objs[i].name, n, z, t, z, objs[i].name);
             if(wri < 0)
                 errori(NULL);
             if(pass > 0)
                 out += wri;
             else
                 siz += wri;
-            
-            // increase offsets
-            d += objs[i].size;
-            p += objs[i].npars;
         }
         
         // write footer
-        wri = snprintf(out, len, SETPFOOT);
+        wri = snprintf(out, len, TABLFOOT);
         if(wri < 0)
             errori(NULL);
         if(pass > 0)
@@ -641,6 +1635,53 @@ static const char* set_params_kernel(size_t nobjs, object objs[])
         else
             siz += wri;
         
+        // write kernel that builds the multipole trees, if there are any
+        trees = 0;
+        for(size_t i = 0; i < nobjs; ++i)
+        {
+            size_t n, z, t, l;
+            size_t raw, mono, key, index, node;
+            
+            if(!objs[i].tree || table_first(objs, i) != i)
+                continue;
+            
+            n = table_count(nobjs, objs, i);
+            z = objs[i].size;
+            t = table_offset(nobjs, objs, i);
+            l = tree_leaves(n);
+            tree_layout(nobjs, objs, i, &raw, &mono, &key, &index, &node);
+            
+            if(!trees++)
+            {
+                wri = snprintf(out, len, TREEHEAD);
+                if(wri < 0)
+                    errori(NULL);
+                if(pass > 0)
+                    out += wri;
+                else
+                    siz += wri;
+            }
+            
+            wri = snprintf(out, len, TREEBODY, objs[i].name, n, z, z, raw, z, mono, objs[i].name, z, mono, key, index, n, n*z, t, raw, index, z, z, z, node, mono, index, n, l);
+            if(wri < 0)
+                errori(NULL);
+            if(pass > 0)
+                out += wri;
+            else
+                siz += wri;
+        }
+        
+        if(trees)
+        {
+            wri = snprintf(out, len, TREEFOOT);
+            if(wri < 0)
+                errori(NULL);
+            if(pass > 0)
+                out += wri;
+            else
+                siz += wri;
+        }
+        
         // write file footer
         wri = snprintf(out, len, FILEFOOT);
         if(wri < 0)
@@ -764,7 +1805,7 @@ static const char* load_object(const char* name)
     // calculate size of buffer
     buf_size = file_size
              + snprintf(NULL, 0, FILEHEAD, OBJECT_DIR, name)
-             + snprintf(NULL, 0, OBJHEAD, name, name, name, name, name, name, name)
+             + snprintf(NULL, 0, OBJHEAD, name, name, name, name, name, name, name, name, name)
              + snprintf(NULL, 0, OBJFOOT)
              + snprintf(NULL, 0, FILEFOOT);
     
@@ -783,7 +1824,7 @@ static const char* load_object(const char* name)
     out += wri;
     
     // write object header
-    wri = sprintf(out, OBJHEAD, name, name, name, name, name, name, name);
+    wri = sprintf(out, OBJHEAD, name, name, name, name, name, name, name, name, name);
     if(wri < 0)
         errori("object %s", name);
     out += wri;
@@ -835,7 +1876,81 @@ void object_program(const char* name, size_t* nkernels, const char*** kernels)
     *(k++) = str_replace(PARSKERN, "<name>", name);
 }
 
-void main_program(size_t nobjs, object objs[], size_t* nkernels, const char*** kernels)
+int object_integral(const char* name)
+{
+    // object code
+    const char* code;
+    
+    // flag for integral
+    int found;
+    
+    // load object
+    code = load_object(name);
+    
+    // look for the definition of the integral function
+    found = strstr(code, "float integral(") != NULL;
+    
+    // clean up
+    free((char*)code);
+    
+    // done
+    return found;
+}
+
+int object_farfield(const char* name)
+{
+    // object code
+    const char* code;
+    
+    // flag for far field
+    int found;
+    
+    // load object
+    code = load_object(name);
+    
+    // look for the definition of the far field function
+    found = strstr(code, "float4 farfield(") != NULL;
+    
+    // clean up
+    free((char*)code);
+    
+    // done
+    return found;
+}
+
+size_t lens_tables_size(size_t nobjs, object objs[])
+{
+    size_t end = 0;
+    
+    // size of all tables
+    for(size_t i = 0; i < nobjs; ++i)
+        if(objs[i].table)
+            end += objs[i].size;
+    
+    // trees come after the tables
+    for(size_t i = 0; i < nobjs; ++i)
+    {
+        size_t raw, mono, key, index, node;
+        if(objs[i].tree && table_first(objs, i) == i)
+            end = tree_layout(nobjs, objs, i, &raw, &mono, &key, &index, &node);
+    }
+    
+    return end;
+}
+
+size_t compute_rays(size_t nobjs, object objs[])
+{
+    size_t r = 0;
+    
+    // one ray for every header of sources in compute_sources
+    for(size_t i = 0; i < nobjs; ++i)
+        if(objs[i].type == OBJ_SOURCE && (i == 0 || objs[i-1].type != OBJ_SOURCE))
+            r += 1;
+    
+    return r;
+}
+
+void main_program(size_t nobjs, object objs[], size_t nbands, size_t* nkernels, const char*** kernels)
 {
     // create an array of unique object names
     size_t nuniq = 0;
@@ -851,7 +1966,7 @@ void main_program(size_t nobjs, object objs[], size_t* nkernels, const char*** k
     }
     
     // create kernel array
-    *nkernels = NINITKERNS + nuniq + 2 + NMAINKERNS;
+    *nkernels = NINITKERNS + nuniq + NCOMPKERNS + 3 + NMAINKERNS;
     *kernels = malloc((*nkernels)*sizeof(const char*));
     
     const char** k = *kernels;
@@ -864,11 +1979,18 @@ void main_program(size_t nobjs, object objs[], size_t* nkernels, const char*** k
     for(size_t i = 0; i < nuniq; ++i)
         *(k++) = load_object(uniq[i]);
     
+    // load kernels for computing images
+    for(size_t i = 0; i < NCOMPKERNS; ++i)
+        *(k++) = load_kernel(COMPKERNS[i]);
+    
     // load compute kernel
     *(k++) = compute_kernel(nobjs, objs);
     
+    // load kernel for lens tables
+    *(k++) = tables_kernel(nobjs, objs);
+    
     // load parameter setter kernel
-    *(k++) = set_params_kernel(nobjs, objs);
+    *(k++) = set_params_kernel(nobjs, objs, nbands);
     
     // load main kernels
     for(size_t i = 0; i < NMAINKERNS; ++i)
@@ -894,6 +2016,7 @@ const char* kernel_options(size_t width, size_t height, int psf, size_t psfw, si
     const char* psfw_opt = " -DPSF_WIDTH=%zu";
     const char* psfh_opt = " -DPSF_HEIGHT=%zu";
     const char* nq_opt = " -DQUAD_POINTS=%zu";
+    const char* run_opt = " -DRENDER_RUN=%d";
     
     // get number of options and their sizes
     opts_size = 0;
@@ -912,6 +2035,8 @@ const char* kernel_options(size_t width, size_t height, int psf, size_t psfw, si
     nopts += 1;
     opts_size += strlen(nq_opt) + log10(nq + 1) + 1;
     nopts += 1;
+    opts_size += strlen(run_opt) + log10(RENDER_RUN + 1) + 1;
+    nopts += 1;
     for(f = flags; *f; ++f)
     {
         opts_size += strlen(*f) + 1;
@@ -934,6 +2059,7 @@ const char* kernel_options(size_t width, size_t height, int psf, size_t psfw, si
     cur += sprintf(cur, psfw_opt, psfw);
     cur += sprintf(cur, psfh_opt, psfh);
     cur += sprintf(cur, nq_opt, nq);
+    cur += sprintf(cur, run_opt, RENDER_RUN);
     
     // add flags
     for(f = flags; *f; ++f)
@@ -3,8 +3,25 @@
 // program for getting object information
 void object_program(const char* name, size_t* nkernels, const char*** kernels);
 
-// main program to compute images
-void main_program(size_t nobjs, object objs[], size_t* nkernels, const char*** kernels);
+// check if object provides a pixel integral
+int object_integral(const char* name);
+
+// check if object provides the far field of its deflection
+int object_farfield(const char* name);
+
+// size of the buffer for lens tables and their multipole trees
+size_t lens_tables_size(size_t nobjs, object objs[]);
+
+// number of rays that are cached for each quadrature point by partial updates
+size_t compute_rays(size_t nobjs, object objs[]);
+
+// main program to compute images, with object data for each band
+void main_program(size_t nobjs, object objs[], size_t nbands,
+                  size_t* nkernels, const char*** kernels);
+
+// number of adjacent pixels per work item on CPU, which is passed to the
+// kernels as a build option
+#define RENDER_RUN 4
 
 // get options for building kernels
 const char* kernel_options(size_t width, size_t height,
@@ -22,6 +22,25 @@
 #include "path.h"
 #include "version.h"
 #include "ds9.h"
+#include "field.h"
+#include "native.h"
+#include "rank.h"
+#include "broker.h"
+#include "binned.h"
+#include "voronoi.h"
+#include "linear.h"
+#include "pixels.h"
+#include "noise.h"
+
+// minimum number of work groups per compute unit for one work item per pixel
+#define RENDER_MIN_GROUPS 4
+
+// maximum number of chunks of rows for early termination of the likelihood
+#define LOGLIKE_CHUNKS 8
+
+// margin of the screening chi^2 value for noise, in standard deviations of
+// the chi^2 distribution of the binned image
+#define SCREEN_SIGMAS 5
 
 // jump buffer to exit run
 static jmp_buf jmp;
@@ -43,12 +62,23 @@ int main(int argc, char* argv[])
     cl_float* psf;
     size_t psfw;
     size_t psfh;
+    cl_float* noise;
+    size_t noisew;
+    size_t noiseh;
     
     // quadrature rule
     cl_ulong nq;
     cl_float2* qq;
     cl_float2* ww;
     
+    // native backend instead of OpenCL
+    int native;
+    
+    // likelihoods of the node are evaluated by a broker, and this process
+    // is a client that sends its parameters to it
+    int broker;
+    int client;
+    
     // OpenCL error code
     cl_int err;
     
@@ -61,19 +91,18 @@ int main(int argc, char* argv[])
     cl_uint work_item_dims;
     size_t* work_item_sizes;
     cl_ulong local_mem_size;
+    cl_device_type device_type;
+    cl_uint compute_units;
     
-    // buffer for objects
+    // size of object data
     cl_ulong object_size;
-    cl_mem object_mem;
     
-    // buffers for quadrature rule
-    cl_mem qq_mem;
-    cl_mem ww_mem;
+    // size of lens tables, and of the largest lens in them
+    cl_ulong lenses_size;
+    cl_ulong lenses_item;
     
-    // buffers for data
-    cl_mem image_mem;
-    cl_mem weight_mem;
-    cl_mem psf_mem;
+    // pixel coordinate system for kernels
+    cl_float4 pcs4;
     
     // timer for duration
     time_t start, end;
@@ -87,6 +116,9 @@ int main(int argc, char* argv[])
      * initialisation *
      ******************/
     
+    // initialise MPI when running as part of a job
+    rank_init(&argc, &argv);
+    
     // initialise the path to Lensed
     init_lensed_path();
     
@@ -103,6 +135,10 @@ int main(int argc, char* argv[])
     // read input
     input* inp = read_input(argc, argv);
     
+    // only the first process of a job reports, all others give warnings
+    if(rank_world() > 0 && LOG_LEVEL < LOG_WARN)
+        log_level(LOG_WARN);
+    
     // parameter initialisation
     {
         // number of derived parameters
@@ -238,12 +274,25 @@ int main(int argc, char* argv[])
                     }
                 }
                 
+                // parameters with image plane priors are shared by all bands
+                if(par->band && obj->pars[par->base].ipp)
+                    error("%s: cannot give a band prior for a parameter "
+                          "with an image plane prior", par->id);
+                
                 // store parameter
                 lensed->pars[p] = par;
                 
                 // mark parameter as derived if it has a pseudo-prior
                 par->derived = prior_pseudo(par->pri);
                 
+                // linear amplitudes of sources and foregrounds are solved for
+                // instead of drawn, and reported as derived parameters
+                if(inp->opts->linear && !par->derived && obj->type != OBJ_LENS && (par->type == PAR_MAGNITUDE || par->type == PAR_AMPLITUDE))
+                {
+                    par->linear = 1;
+                    par->derived = 1;
+                }
+                
                 // collect derived parameters for end of list
                 if(par->derived)
                 {
@@ -333,6 +382,11 @@ int main(int argc, char* argv[])
             printf("\n");
         }
         
+        // native backend is always available
+        printf("device: %s\n", NATIVE_DEVICE);
+        printf("  compiler: %s\n", native_compiler());
+        printf("\n");
+        
         exit(0);
     }
     
@@ -564,6 +618,133 @@ int main(int argc, char* argv[])
         }
     }
     
+    // stack additional bands below the image, each with a margin of rows that
+    // keeps the PSF of one band from reaching into the next
+    lensed->nbands = 1 + inp->nbands;
+    lensed->margin = 0;
+    if(inp->nbands)
+    {
+        size_t w = lensed->width;
+        size_t h = lensed->height;
+        size_t m = psfh/2;
+        size_t rows = h + 2*m;
+        cl_float* image;
+        cl_float* weight;
+        
+        // stacked image and weights, margins have zero weight
+        image = calloc(lensed->nbands*rows*w, sizeof(cl_float));
+        weight = calloc(lensed->nbands*rows*w, sizeof(cl_float));
+        if(!image || !weight)
+            errori(NULL);
+        
+        // first band is the image from the options
+        memcpy(image + m*w, lensed->image, h*w*sizeof(cl_float));
+        memcpy(weight + m*w, lensed->weight, h*w*sizeof(cl_float));
+        free(lensed->image);
+        free(lensed->weight);
+        
+        // make room for the PSF of each band
+        if(psf)
+        {
+            psf = realloc(psf, lensed->nbands*psfw*psfh*sizeof(cl_float));
+            if(!psf)
+                errori(NULL);
+        }
+        
+        for(size_t b = 1; b < lensed->nbands; ++b)
+        {
+            const band* bnd = &inp->bands[b-1];
+            cl_float* bimg;
+            cl_float* bwht;
+            size_t bw, bh;
+            pcsdata bpcs;
+            
+            verbose("  band %s", bnd->name);
+            
+            // read image of band, which must cover the same pixels
+            read_image(bnd->image, &bw, &bh, &bimg);
+            read_pcs(bnd->image, &bpcs);
+            if(bw != w || bh != h)
+                error("band %s: image size %zu x %zu does not match image "
+                      "size %zu x %zu", bnd->name, bw, bh, w, h);
+            if(bpcs.rx != pcs->rx || bpcs.ry != pcs->ry || bpcs.sx != pcs->sx || bpcs.sy != pcs->sy)
+                error("band %s: pixel coordinate system does not match "
+                      "image", bnd->name);
+            
+            // apply scale to input pixels if given
+            if(inp->opts->bscale)
+                for(size_t i = 0; i < h*w; ++i)
+                    bimg[i] *= inp->opts->bscale;
+            
+            // read weight map of band, or make it from gain and offset
+            if(bnd->weight)
+            {
+                read_or_make_image(bnd->weight->file, bnd->weight->value, w, h, &bwht);
+            }
+            else if(inp->opts->gain)
+            {
+                cl_float* gain;
+                
+                read_or_make_image(inp->opts->gain->file, inp->opts->gain->value, w, h, &gain);
+                make_weight(bimg, gain, inp->opts->offset, w, h, &bwht);
+                free(gain);
+            }
+            else
+            {
+                error("band %s: missing weight (no gain given)", bnd->name);
+            }
+            
+            // apply mask of band if given
+            if(bnd->mask)
+            {
+                int* mask;
+                
+                read_mask(bnd->mask, bnd->image, pcs, w, h, &mask);
+                for(size_t i = 0; i < h*w; ++i)
+                    if(mask[i])
+                        bwht[i] = 0;
+                free(mask);
+            }
+            
+            // make sure weights are non-negative
+            for(size_t i = 0; i < h*w; ++i)
+                if(!(bwht[i] >= 0))
+                    error("band %s: negative values in weights", bnd->name);
+            
+            // PSF of band must match the PSF of the image
+            if(!psf != !bnd->psf)
+                error("band %s: %s", bnd->name, psf ? "missing PSF" : "no PSF was given for the image");
+            if(psf)
+            {
+                cl_float* bpsf;
+                size_t bpw, bph;
+                
+                read_psf(bnd->psf, &bpw, &bph, &bpsf);
+                if(bpw != psfw || bph != psfh)
+                    error("band %s: PSF size %zu x %zu does not match PSF "
+                          "size %zu x %zu", bnd->name, bpw, bph, psfw, psfh);
+                memcpy(psf + b*psfw*psfh, bpsf, psfw*psfh*sizeof(cl_float));
+                free(bpsf);
+            }
+            
+            // store band in stack
+            memcpy(image + (b*rows + m)*w, bimg, h*w*sizeof(cl_float));
+            memcpy(weight + (b*rows + m)*w, bwht, h*w*sizeof(cl_float));
+            free(bimg);
+            free(bwht);
+        }
+        
+        // the stack replaces the image
+        lensed->image = image;
+        lensed->weight = weight;
+        lensed->height = lensed->nbands*rows;
+        lensed->size = lensed->width*lensed->height;
+        lensed->margin = m;
+        
+        verbose("  bands: %zu", lensed->nbands);
+        verbose("  stacked size: %zu x %zu", lensed->width, lensed->height);
+    }
+    
     
     /***********
      * results *
@@ -601,8 +782,11 @@ int main(int argc, char* argv[])
     lensed->sigma = calloc(lensed->npars, sizeof(double));
     lensed->ml    = calloc(lensed->npars, sizeof(double));
     lensed->map   = calloc(lensed->npars, sizeof(double));
-    if(!lensed->mean || !lensed->sigma || !lensed->ml || !lensed->map)
+    lensed->lower = calloc(lensed->npars, sizeof(double));
+    lensed->upper = calloc(lensed->npars, sizeof(double));
+    if(!lensed->mean || !lensed->sigma || !lensed->ml || !lensed->map || !lensed->lower || !lensed->upper)
         errori(NULL);
+    lensed->logvol = 0;
     
     
     /*******************
@@ -648,13 +832,41 @@ int main(int argc, char* argv[])
     verbose("kernel");
     
     {
-        // get the OpenCL environment
-        lcl = get_lensed_cl(inp->opts->device);
+        // check if the native backend is selected
+        native = native_device(inp->opts->device);
+        lensed->native = NULL;
+        
+        // broker of the node evaluates likelihoods for all processes
+        broker = inp->opts->broker && rank_world_size() > 1;
+        if(broker && native)
+        {
+            warn("broker not available\n"
+                 "The native backend evaluates likelihoods in every "
+                 "process. The \"broker\" option will be ignored.");
+            broker = 0;
+        }
+        client = broker && rank_node() > 0;
+        
+        // get the OpenCL environment, with processes of a job assigned to
+        // the available devices in turn unless the broker uses all of them
+        lcl = (native || client) ? NULL : get_lensed_cl(inp->opts->device, inp->opts->numa, (rank_world_size() > 1 && !broker) ? rank_node() : -1);
+        
+        // output MPI job info
+        if(rank_world_size() > 1)
+            verbose("  processes: %d, %d on node", rank_world_size(), rank_node_size());
         
         // output device info
-        if(LOG_LEVEL <= LOG_VERBOSE)
+        if(native)
+        {
+            verbose("  device: %s", NATIVE_DEVICE);
+            verbose("    compiler: %s", native_compiler());
+        }
+        else if(client)
+        {
+            verbose("  device: broker");
+        }
+        else if(LOG_LEVEL <= LOG_VERBOSE)
         {
-            cl_device_type device_type;
             char device_name[128];
             char device_vendor[128];
             char device_version[128];
@@ -662,7 +874,6 @@ int main(int argc, char* argv[])
             char device_compiler[128];
 #endif
             char driver_version[128];
-            cl_uint compute_units;
             
             // query device name
             err = clGetDeviceInfo(lcl->device_id, CL_DEVICE_NAME, sizeof(device_name), device_name, NULL);
@@ -695,23 +906,327 @@ int main(int argc, char* argv[])
             verbose("    units: %u", err == CL_SUCCESS ? compute_units : 0);
         }
         
+        // output number of devices if there are more than one
+        if(lcl && lcl->ndevices > 1)
+            verbose("  devices: %u", lcl->ndevices);
+        
+        // profiling uses the OpenCL events of a single queue
+        if(inp->opts->profile && native)
+            warn("profiler not available\n"
+                 "The native backend does not support profiling. The "
+                 "\"profile\" option will be ignored.");
+        else if(inp->opts->profile && broker)
+            warn("profiler not available\n"
+                 "Profiling is not supported with a broker. The \"profile\" "
+                 "option will be ignored.");
+        else if(inp->opts->profile && lcl->ndevices > 1)
+            warn("profiler not available\n"
+                 "Profiling is not supported with more than one device. The "
+                 "\"profile\" option will be ignored.");
+        
+        // queue properties for shards
         queue_properties = 0;
-        if(inp->opts->profile)
+        if(inp->opts->profile && !native && !broker && lcl->ndevices == 1)
             queue_properties |= CL_QUEUE_PROFILING_ENABLE;
         
-        lensed->queue = clCreateCommandQueue(lcl->context, lcl->device_id, queue_properties, &err);
-        if(!lensed->queue || err != CL_SUCCESS)
-            error("failed to create command queue");
+        // interpolated deflection field if enabled and there is a lens
+        lensed->field = NULL;
+        if(inp->opts->field_tol > 0 && native)
+        {
+            warn("deflection field not available\n"
+                 "The native backend does not support the interpolated "
+                 "deflection field. The \"field-tol\" option will be "
+                 "ignored.");
+        }
+        else if(inp->opts->field_tol > 0 && broker)
+        {
+            warn("deflection field not available\n"
+                 "The interpolated deflection field is not supported with "
+                 "a broker. The \"field-tol\" option will be ignored.");
+        }
+        else if(inp->opts->field_tol > 0 && lcl->ndevices > 1)
+        {
+            warn("deflection field not available\n"
+                 "The interpolated deflection field is not supported with "
+                 "more than one device. The \"field-tol\" option will be "
+                 "ignored.");
+        }
+        else if(inp->opts->field_tol > 0)
+        {
+            size_t i;
+            
+            // try to locate lens
+            for(i = 0; i < inp->nobjs; ++i)
+                if(inp->objs[i].type == OBJ_LENS)
+                    break;
+            
+            // create deflection field only if there is a lens
+            if(i < inp->nobjs)
+            {
+                lensed->field = malloc(sizeof(*lensed->field));
+                if(!lensed->field)
+                    errori(NULL);
+                
+                lensed->field->tol = inp->opts->field_tol;
+                lensed->field->cull = inp->opts->lens_cull;
+                lensed->field->theta = inp->opts->multipole;
+                lensed->field->multipole = NULL;
+                lensed->field->multipole_error = 0;
+                lensed->field->warned = 0;
+                lensed->field->count = 0;
+            }
+            else
+            {
+                warn("deflection field without lens\n"
+                     "The \"field-tol\" option was given, but there is no "
+                     "lens to compute the deflection field for. The option "
+                     "will be ignored.");
+            }
+        }
+        
+        // partial updates need the object of every parameter
+        lensed->partial = NULL;
+        if(inp->opts->partial && native)
+        {
+            warn("partial updates not available\n"
+                 "The native backend does not support partial updates. The "
+                 "\"partial\" option will be ignored.");
+        }
+        else if(inp->opts->partial)
+        {
+            // the cached rays of all quadrature points must fit into a
+            // single buffer on every device
+            size_t nrays = compute_rays(inp->nobjs, inp->objs);
+            cl_ulong rays_size = (nrays ? nrays : 1)*lensed->size*nq*sizeof(cl_float2);
+            cl_ulong max_alloc = rays_size;
+            
+            for(cl_uint i = 0; lcl && i < lcl->ndevices; ++i)
+            {
+                cl_ulong m;
+                err = clGetDeviceInfo(lcl->device_ids[i], CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(m), &m, NULL);
+                if(err != CL_SUCCESS)
+                    error("failed to get maximum memory allocation size");
+                if(m < max_alloc)
+                    max_alloc = m;
+            }
+            
+            // the ray cache can be limited further
+            if(inp->opts->partial_mem > 0 && inp->opts->partial_mem*1048576 < max_alloc)
+                max_alloc = inp->opts->partial_mem*1048576;
+            
+            if(max_alloc < rays_size)
+            {
+                warn("partial updates not available\n"
+                     "The cache of rays for partial updates needs %.0f MB, "
+                     "but at most %.0f MB can be allocated. The "
+                     "\"partial\" option will be ignored.",
+                     rays_size/1048576., max_alloc/1048576.);
+            }
+            else
+            {
+                lensed->partial = malloc(lensed->npars*sizeof(int));
+                if(!lensed->partial)
+                    errori(NULL);
+                
+                for(size_t i = 0; i < lensed->npars; ++i)
+                    for(size_t j = 0, p = 0; j < inp->nobjs; p += inp->objs[j].npars, ++j)
+                        if(lensed->pmap[i] >= p && lensed->pmap[i] < p + inp->objs[j].npars)
+                            lensed->partial[i] = inp->objs[j].type;
+            }
+        }
+        
+        // lenses of a type that occurs often enough on the first lens plane
+        // are evaluated from a table as part of the deflection field
+        if(inp->opts->lens_table > 0 && !lensed->field)
+        {
+            warn("lens tables not available\n"
+                 "Lens tables are computed as part of the interpolated "
+                 "deflection field, which is not used. The \"lens-table\" "
+                 "option will be ignored.");
+        }
+        else if(inp->opts->lens_table > 0)
+        {
+            // end of first lens plane
+            size_t end;
+            int trigger = 0;
+            for(end = 0; end < inp->nobjs; ++end)
+            {
+                if(trigger == OBJ_LENS && inp->objs[end].type == OBJ_SOURCE)
+                    break;
+                if(inp->objs[end].type != OBJ_FOREGROUND)
+                    trigger = inp->objs[end].type;
+            }
+            
+            // count lenses of the same type on the first plane
+            for(size_t i = 0; i < end; ++i)
+            {
+                size_t n = 0;
+                
+                if(inp->objs[i].type != OBJ_LENS)
+                    continue;
+                
+                for(size_t j = 0; j < end; ++j)
+                    if(inp->objs[j].type == OBJ_LENS && strcmp(inp->objs[j].name, inp->objs[i].name) == 0)
+                        n += 1;
+                
+                inp->objs[i].table = (n >= inp->opts->lens_table);
+            }
+        }
+        
+        // tolerance for culling needs lens tables
+        if(inp->opts->lens_cull > 0 && !(lensed->field && inp->opts->lens_table > 0))
+            warn("culling of lenses not available\n"
+                 "Only lenses in tables can be culled, but no lens tables "
+                 "are used. The \"lens-cull\" option will be ignored.");
+        
+        // lenses in tables that provide their far field are grouped into
+        // multipole trees
+        if(inp->opts->multipole > 0)
+        {
+            int trees = 0;
+            
+            for(size_t i = 0; i < inp->nobjs; ++i)
+            {
+                inp->objs[i].tree = inp->objs[i].table && inp->objs[i].farfield;
+                trees |= inp->objs[i].tree;
+            }
+            
+            if(!trees)
+                warn("multipole trees not available\n"
+                     "Only lenses in tables whose objects provide a far "
+                     "field can be grouped into multipole trees, and there "
+                     "are none. The \"multipole\" option will be ignored.");
+            
+            if(!trees && inp->opts->multipole_check)
+                warn("multipole check not available\n"
+                     "There are no multipole trees to check. The "
+                     "\"multipole-check\" option will be ignored.");
+        }
+        else if(inp->opts->multipole_check)
+        {
+            warn("multipole check not available\n"
+                 "The \"multipole-check\" option needs the \"multipole\" "
+                 "option. It will be ignored.");
+        }
+        
+        // comoving distances of planes: lenses up to the first source
+        // behind them are on one plane, and sources behind them are on the
+        // next plane, together with the lenses that follow
+        if(inp->opts->planes)
+        {
+            const char* str = inp->opts->planes;
+            char* end;
+            size_t ndist = 0;
+            double* dist;
+            size_t nplanes = 1;
+            int trigger = 0;
+            
+            // count distances separated by whitespace
+            for(;; str = end)
+            {
+                strtod(str, &end);
+                if(end == str)
+                    break;
+                ndist += 1;
+            }
+            
+            // room for the distances, and for the read that ends the list
+            dist = malloc((ndist + 1)*sizeof(double));
+            if(!dist)
+                errori(NULL);
+            
+            // read distances
+            str = inp->opts->planes;
+            ndist = 0;
+            while(1)
+            {
+                dist[ndist] = strtod(str, &end);
+                if(end == str)
+                    break;
+                if(!(dist[ndist] > (ndist > 0 ? dist[ndist-1] : 0)))
+                    error("planes: distances must be positive and increasing");
+                ndist += 1;
+                str = end;
+            }
+            str += strspn(str, " \t");
+            if(*str)
+                error("planes: invalid distance \"%s\"", str);
+            
+            // assign plane distances to objects
+            for(size_t i = 0; i < inp->nobjs; ++i)
+            {
+                if(trigger == OBJ_LENS && inp->objs[i].type == OBJ_SOURCE)
+                    nplanes += 1;
+                if(inp->objs[i].type != OBJ_FOREGROUND)
+                    trigger = inp->objs[i].type;
+                if(nplanes <= ndist)
+                    inp->objs[i].distance = dist[nplanes-1];
+            }
+            
+            if(ndist != nplanes)
+                error("planes: %zu distances given for %zu planes", ndist, nplanes);
+            
+            // distances only matter for rays through several lens planes
+            if(nplanes < 3)
+            {
+                warn("plane distances have no effect\n"
+                     "Distances only change the ray tracing if there is "
+                     "more than one lens plane. The \"planes\" option will "
+                     "be ignored.");
+                
+                for(size_t i = 0; i < inp->nobjs; ++i)
+                    inp->objs[i].distance = 0;
+            }
+            else
+            {
+                verbose("  planes");
+                for(size_t i = 0; i < nplanes; ++i)
+                    verbose("    plane %zu: distance %g", i, dist[i]);
+            }
+            
+            free(dist);
+        }
+        
+        // collect size of lens tables, and of the largest lens in them
+        lenses_size = lens_tables_size(inp->nobjs, inp->objs);
+        lenses_item = 0;
+        for(size_t i = 0; i < inp->nobjs; ++i)
+            if(inp->objs[i].table && inp->objs[i].size > lenses_item)
+                lenses_item = inp->objs[i].size;
+        
+        // output lens tables
+        if(lenses_size > 0)
+        {
+            verbose("  lens tables");
+            for(size_t i = 0; i < inp->nobjs; ++i)
+            {
+                size_t n = 0;
+                int first = inp->objs[i].table;
+                
+                for(size_t j = 0; j < inp->nobjs; ++j)
+                {
+                    if(inp->objs[j].table && strcmp(inp->objs[j].name, inp->objs[i].name) == 0)
+                    {
+                        if(j < i)
+                            first = 0;
+                        n += 1;
+                    }
+                }
+                
+                if(first)
+                    verbose("    %s: %zu lenses%s", inp->objs[i].name, n, inp->objs[i].tree ? " in multipole tree" : "");
+            }
+        }
         
         // load program
         size_t nkernels;
         const char** kernels;
         
         verbose("  load program");
-        main_program(inp->nobjs, inp->objs, &nkernels, &kernels);
+        main_program(inp->nobjs, inp->objs, lensed->nbands, &nkernels, &kernels);
         
         // output program
-        if(inp->opts->output)
+        if(inp->opts->output && rank_world() == 0)
         {
             FILE* file;
             char* name;
@@ -734,37 +1249,117 @@ int main(int argc, char* argv[])
             free(name);
         }
         
-        // create program
-        verbose("  create program");
-        program = clCreateProgramWithSource(lcl->context, nkernels, kernels, NULL, &err);
-        if(err != CL_SUCCESS)
-            error("failed to create program");
-        
         // flags for building, zero-terminated
-        const char* build_flags[] = {
-            "-cl-denorms-are-zero",
-            "-cl-fast-relaxed-math",
-            NULL
-        };
+        const char* build_flags[6];
+        size_t nflags = 0;
+        char bands_flag[64];
+        build_flags[nflags++] = "-cl-denorms-are-zero";
+        build_flags[nflags++] = "-cl-fast-relaxed-math";
+        if(lensed->field)
+            build_flags[nflags++] = "-DDEFLECTION_FIELD=1";
+        if(inp->opts->fast_math)
+            build_flags[nflags++] = "-DFAST_MATH=1";
+        if(lensed->nbands > 1)
+        {
+            sprintf(bands_flag, "-DBANDS=%zu -DBAND_MARGIN=%zu", lensed->nbands, lensed->margin);
+            build_flags[nflags++] = bands_flag;
+        }
+        build_flags[nflags] = NULL;
         
         // make build options string
         const char* build_options = kernel_options(lensed->width, lensed->height, !!psf, psfw, psfh, nq, build_flags);
         
-        // and build program
-        verbose("  build program");
-        err = clBuildProgram(program, 1, &lcl->device_id, build_options, NULL, NULL);
-// build log is reported in the notifications on Apple's implementation
-#ifndef __APPLE__
-        if(LOG_LEVEL <= LOG_VERBOSE)
+        if(native)
         {
-            char log[4096];
-            clGetProgramBuildInfo(program, lcl->device_id, CL_PROGRAM_BUILD_LOG, sizeof(log), log, NULL);
-            if(strlen(log) > 0)
-                verbose("  build log: %s", log);
+            // build native program
+            verbose("  build native program");
+            lensed->native = native_program(nkernels, kernels, build_options);
         }
+        else if(!client)
+        {
+            // program binary that is shared by processes on the same node
+            void* binary = NULL;
+            size_t binary_size = 0;
+            
+            // processes using the same device share the program binary of
+            // the first one, which is the process that has the device index
+            // as its node rank
+            if(lcl->index >= 0)
+            {
+                program = NULL;
+                
+                if(rank_node() == lcl->index)
+                {
+                    // build program from source
+                    verbose("  create program");
+                    program = clCreateProgramWithSource(lcl->context, nkernels, kernels, NULL, &err);
+                    if(err != CL_SUCCESS)
+                        error("failed to create program");
+                    
+                    verbose("  build program");
+                    err = clBuildProgram(program, 1, &lcl->device_id, build_options, NULL, NULL);
+                    
+                    // get program binary, which is only shared if built
+                    if(err == CL_SUCCESS && clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size_t), &binary_size, NULL) == CL_SUCCESS && binary_size > 0)
+                    {
+                        binary = malloc(binary_size);
+                        if(!binary)
+                            errori(NULL);
+                        if(clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(unsigned char*), &binary, NULL) != CL_SUCCESS)
+                        {
+                            free(binary);
+                            binary = NULL;
+                        }
+                    }
+                }
+                
+                // send or receive binary
+                rank_share(lcl->index, &binary, &binary_size);
+                
+                // load and build program from binary
+                if(!program && binary)
+                {
+                    verbose("  load program binary");
+                    program = clCreateProgramWithBinary(lcl->context, 1, &lcl->device_id, &binary_size, (const unsigned char**)&binary, NULL, &err);
+                    if(err == CL_SUCCESS)
+                        err = clBuildProgram(program, 1, &lcl->device_id, build_options, NULL, NULL);
+                    if(err != CL_SUCCESS)
+                    {
+                        if(program)
+                            clReleaseProgram(program);
+                        program = NULL;
+                    }
+                }
+                
+                free(binary);
+            }
+            
+            // build program from source if it was not shared
+            if(lcl->index < 0 || !program)
+            {
+                // create program
+                verbose("  create program");
+                program = clCreateProgramWithSource(lcl->context, nkernels, kernels, NULL, &err);
+                if(err != CL_SUCCESS)
+                    error("failed to create program");
+                
+                // and build program
+                verbose("  build program");
+                err = clBuildProgram(program, lcl->ndevices, lcl->device_ids, build_options, NULL, NULL);
+            }
+// build log is reported in the notifications on Apple's implementation
+#ifndef __APPLE__
+            if(LOG_LEVEL <= LOG_VERBOSE)
+            {
+                char log[4096];
+                clGetProgramBuildInfo(program, lcl->device_id, CL_PROGRAM_BUILD_LOG, sizeof(log), log, NULL);
+                if(strlen(log) > 0)
+                    verbose("  build log: %s", log);
+            }
 #endif
-        if(err != CL_SUCCESS)
-            error("failed to build program%s", LOG_LEVEL > LOG_VERBOSE ? " (use --verbose to see build log)" : "");
+            if(err != CL_SUCCESS)
+                error("failed to build program%s", LOG_LEVEL > LOG_VERBOSE ? " (use --verbose to see build log)" : "");
+        }
         
         // free program codes
         for(int i = 0; i < nkernels; ++i)
@@ -775,344 +1370,832 @@ int main(int argc, char* argv[])
         free((char*)build_options);
     }
     
-    // gather device info
+    // pixel coordinate system for kernels
+    {
+        pcs4.s[0] = pcs->rx;
+        pcs4.s[1] = pcs->ry;
+        pcs4.s[2] = pcs->sx;
+        pcs4.s[3] = pcs->sy;
+        
+        // fix coordinate system to account for half-pixel offset of even PSF
+        if(psf)
+        {
+            if(psfw%2 == 0)
+                pcs4.s[0] += 0.5;
+            if(psfh%2 == 0)
+                pcs4.s[1] += 0.5;
+        }
+    }
+    
+    // collect total size of object data, in units of sizeof(cl_float),
+    // without the lenses in tables
+    object_size = 0;
+    for(size_t i = 0; i < inp->nobjs; ++i)
+        if(!inp->objs[i].table)
+            object_size += inp->objs[i].size;
+    
+    // every band has its own copy of the object data
+    object_size *= lensed->nbands;
+    
+    // split the image into bands of rows, one for each OpenCL device, with
+    // a set of bands for each process that the broker serves
+    lensed->nshards = lcl ? lcl->ndevices : 0;
+    lensed->nbatch = (broker && !client) ? rank_node_size() : 1;
+    lensed->shards = NULL;
+    if(lensed->nshards > 0)
     {
-        // get number of work item dimensions for device
-        err = clGetDeviceInfo(lcl->device_id, CL_DEVICE_MAX_WORK_ITEM_DIMENSIONS, sizeof(work_item_dims), &work_item_dims, NULL);
-        if(err != CL_SUCCESS)
-            error("failed to get maximum work item dimensions");
+        // every shard needs at least one row
+        if(lensed->height < lensed->nshards)
+            error("image has fewer rows (%zu) than devices (%zu)", lensed->height, lensed->nshards);
         
-        // allocate space for work item sizes
-        work_item_sizes = malloc(work_item_dims*sizeof(size_t));
-        if(!work_item_sizes)
+        lensed->shards = malloc(lensed->nbatch*lensed->nshards*sizeof(struct shard));
+        if(!lensed->shards)
             errori(NULL);
         
-        // get maximum work group size supported by device
-        err = clGetDeviceInfo(lcl->device_id, CL_DEVICE_MAX_WORK_ITEM_SIZES, work_item_dims*sizeof(size_t), work_item_sizes, NULL);
-        if(err != CL_SUCCESS)
-            error("failed to get maximum work item sizes");
+        // bands of equal height, up to one row
+        for(size_t s = 0; s < lensed->nbatch*lensed->nshards; ++s)
+        {
+            size_t b = s%lensed->nshards;
+            lensed->shards[s].row0 = b*lensed->height/lensed->nshards;
+            lensed->shards[s].rows = (b + 1)*lensed->height/lensed->nshards - lensed->shards[s].row0;
+            lensed->shards[s].device_id = lcl->device_ids[b];
+            lensed->shards[s].rendered = NULL;
+        }
         
-        // get size of local memory
-        err = clGetDeviceInfo(lcl->device_id, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(local_mem_size), &local_mem_size, NULL);
-        if(err != CL_SUCCESS)
-            error("failed to get local memory size");
+        if(lensed->nbatch > 1)
+            verbose("  batch: %zu", lensed->nbatch);
     }
     
-    // allocate device memory for data
+    // whitening kernel for correlated noise in the image, which replaces the
+    // independent pixels of the likelihood
+    noise = NULL;
+    noisew = 0;
+    noiseh = 0;
+    if(inp->opts->noise && (lensed->nshards != 1 || lensed->nbatch != 1))
     {
-        verbose("  create data buffers");
-        
-        image_mem = clCreateBuffer(lcl->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR | CL_MEM_HOST_NO_ACCESS, lensed->size*sizeof(cl_float), lensed->image, NULL);
-        weight_mem = clCreateBuffer(lcl->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR | CL_MEM_HOST_NO_ACCESS, lensed->size*sizeof(cl_float), lensed->weight, NULL);
-        if(psf)
-            psf_mem = clCreateBuffer(lcl->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR | CL_MEM_HOST_NO_ACCESS, psfw*psfh*sizeof(cl_float), psf, &err);
-        if(!image_mem || !weight_mem || err)
-            error("failed to allocate data buffers");
+        warn("correlated noise not available\n"
+             "Whitening the residuals needs a single OpenCL device, without "
+             "broker. The \"noise\" option will be ignored.");
     }
-    
-    // create buffers for quadrature rule
+    else if(inp->opts->noise && lensed->nbands > 1)
     {
-        verbose("  create quadrature buffers");
-        
-        // allocate buffers for quadrature rule
-        qq_mem = clCreateBuffer(lcl->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR | CL_MEM_HOST_NO_ACCESS, nq*sizeof(cl_float2), qq, NULL);
-        ww_mem = clCreateBuffer(lcl->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR | CL_MEM_HOST_NO_ACCESS, nq*sizeof(cl_float2), ww, NULL);
-        if(!qq_mem || !ww_mem)
-            error("failed to allocate quadrature buffers");
+        warn("correlated noise not available\n"
+             "The correlation of the noise is given for a single band. The "
+             "\"noise\" option will be ignored.");
     }
-    
-    // create buffer that contains object data
+    else if(inp->opts->noise && inp->opts->linear)
     {
-        // collect total size of object data, in units of sizeof(cl_float)
-        object_size = 0;
-        for(size_t i = 0; i < inp->nobjs; ++i)
-            object_size += inp->objs[i].size;
-        
-        verbose("  create object buffer");
-        
-        // allocate buffer for object data
-        object_mem = clCreateBuffer(lcl->context, CL_MEM_READ_WRITE, object_size*sizeof(cl_float), NULL, &err);
-        if(err != CL_SUCCESS)
-            error("failed to create object buffer");
+        warn("correlated noise not available\n"
+             "The linear amplitudes are solved with independent pixels. The "
+             "\"noise\" option will be ignored.");
     }
-    
-    // create the buffer that will pass parameter values to objects
+    else if(inp->opts->noise)
     {
-        verbose("  create parameter buffer");
-        
-        // create the memory containing physical parameters on the device
-        lensed->params = clCreateBuffer(lcl->context, CL_MEM_READ_ONLY | CL_MEM_ALLOC_HOST_PTR, lensed->npars*sizeof(cl_float), NULL, &err);
-        if(err != CL_SUCCESS)
-            error("failed to create buffer for parameters");
-        
-        verbose("  create parameter kernel");
+        verbose("  correlated noise");
         
-        // create kernel
-        lensed->set_params = clCreateKernel(program, "set_params", &err);
-        if(err != CL_SUCCESS)
-            error("failed to create kernel for parameters");
+        noise = noise_whitening(inp->opts->noise, &noisew, &noiseh);
         
-        // set kernel arguments
-        err = 0;
-        err |= clSetKernelArg(lensed->set_params, 0, sizeof(cl_ulong), &object_size);
-        err |= clSetKernelArg(lensed->set_params, 1, sizeof(cl_mem), &object_mem);
-        err |= clSetKernelArg(lensed->set_params, 2, object_size*sizeof(cl_uint), NULL);
-        err |= clSetKernelArg(lensed->set_params, 3, sizeof(cl_mem), &lensed->params);
-        if(err != CL_SUCCESS)
-            error("failed to set kernel arguments for parameters");
+        verbose("    whitening kernel: %zu x %zu", noisew, noiseh);
     }
     
-    // render kernel
-    verbose("  render");
+    // set up the shards for the OpenCL devices
+    for(size_t s = 0; s < lensed->nbatch*lensed->nshards; ++s)
     {
-        cl_float4 pcs4;
-        size_t wgs, wgm;
+        struct shard* shard = &lensed->shards[s];
         
-        verbose("    buffer");
+        if(s < lensed->nshards)
+            verbose("  shard %zu: rows %zu to %zu", s, shard->row0, shard->row0 + shard->rows - 1);
         
-        lensed->value_mem = clCreateBuffer(lcl->context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR | CL_MEM_HOST_READ_ONLY, lensed->size*sizeof(cl_float), NULL, NULL);
-        lensed->error_mem = clCreateBuffer(lcl->context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR | CL_MEM_HOST_READ_ONLY, lensed->size*sizeof(cl_float), NULL, NULL);
-        if(!lensed->value_mem || !lensed->error_mem)
-            error("failed to create render buffer");
-        
-        // pixel coordinate system
-        pcs4.s[0] = pcs->rx;
-        pcs4.s[1] = pcs->ry;
-        pcs4.s[2] = pcs->sx;
-        pcs4.s[3] = pcs->sy;
-        
-        // fix coordinate system to account for half-pixel offset of even PSF
-        if(psf)
+        // worker queue
         {
-            if(psfw%2 == 0)
-                pcs4.s[0] += 0.5;
-            if(psfh%2 == 0)
-                pcs4.s[1] += 0.5;
+            shard->queue = clCreateCommandQueue(lcl->context, shard->device_id, queue_properties, &err);
+            if(!shard->queue || err != CL_SUCCESS)
+                error("failed to create command queue");
         }
         
-        verbose("    kernel");
-        
-        // render kernel 
-        lensed->render = clCreateKernel(program, "render", &err);
-        if(err != CL_SUCCESS)
-            error("failed to create render kernel");
+        // gather device info
+        {
+            // get number of work item dimensions for device
+            err = clGetDeviceInfo(shard->device_id, CL_DEVICE_MAX_WORK_ITEM_DIMENSIONS, sizeof(work_item_dims), &work_item_dims, NULL);
+            if(err != CL_SUCCESS)
+                error("failed to get maximum work item dimensions");
+            
+            // allocate space for work item sizes
+            work_item_sizes = malloc(work_item_dims*sizeof(size_t));
+            if(!work_item_sizes)
+                errori(NULL);
+            
+            // get maximum work group size supported by device
+            err = clGetDeviceInfo(shard->device_id, CL_DEVICE_MAX_WORK_ITEM_SIZES, work_item_dims*sizeof(size_t), work_item_sizes, NULL);
+            if(err != CL_SUCCESS)
+                error("failed to get maximum work item sizes");
+            
+            // get size of local memory
+            err = clGetDeviceInfo(shard->device_id, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(local_mem_size), &local_mem_size, NULL);
+            if(err != CL_SUCCESS)
+                error("failed to get local memory size");
+            
+            // get type of device
+            err = clGetDeviceInfo(shard->device_id, CL_DEVICE_TYPE, sizeof(device_type), &device_type, NULL);
+            if(err != CL_SUCCESS)
+                error("failed to get device type");
+            
+            // get number of compute units
+            err = clGetDeviceInfo(shard->device_id, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(compute_units), &compute_units, NULL);
+            if(err != CL_SUCCESS)
+                error("failed to get number of compute units");
+        }
         
-        verbose("    arguments");
+        // allocate device memory for data
+        {
+            verbose("  create data buffers");
+            
+            shard->image_mem = clCreateBuffer(lcl->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR | CL_MEM_HOST_NO_ACCESS, lensed->size*sizeof(cl_float), lensed->image, NULL);
+            shard->weight_mem = clCreateBuffer(lcl->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR | CL_MEM_HOST_NO_ACCESS, lensed->size*sizeof(cl_float), lensed->weight, NULL);
+            if(psf)
+                shard->psf_mem = clCreateBuffer(lcl->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR | CL_MEM_HOST_NO_ACCESS, lensed->nbands*psfw*psfh*sizeof(cl_float), psf, &err);
+            if(noise)
+                shard->noise_mem = clCreateBuffer(lcl->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR | CL_MEM_HOST_NO_ACCESS, noisew*noiseh*sizeof(cl_float), noise, &err);
+            if(!shard->image_mem || !shard->weight_mem || err)
+                error("failed to allocate data buffers");
+        }
         
-        // set kernel arguments
-        err = 0;
-        err |= clSetKernelArg(lensed->render, 0, sizeof(cl_ulong), &object_size);
-        err |= clSetKernelArg(lensed->render, 1, sizeof(cl_mem), &object_mem);
-        err |= clSetKernelArg(lensed->render, 2, object_size*sizeof(cl_uint), NULL);
-        err |= clSetKernelArg(lensed->render, 3, sizeof(cl_float4), &pcs4);
-        err |= clSetKernelArg(lensed->render, 4, sizeof(cl_mem), &qq_mem);
-        err |= clSetKernelArg(lensed->render, 5, sizeof(cl_mem), &ww_mem);
-        err |= clSetKernelArg(lensed->render, 6, sizeof(cl_mem), &lensed->value_mem);
-        err |= clSetKernelArg(lensed->render, 7, sizeof(cl_mem), &lensed->error_mem);
-        if(err != CL_SUCCESS)
-            error("failed to set render kernel arguments");
+        // create buffers for quadrature rule
+        {
+            verbose("  create quadrature buffers");
+            
+            // allocate buffers for quadrature rule
+            shard->qq_mem = clCreateBuffer(lcl->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR | CL_MEM_HOST_NO_ACCESS, nq*sizeof(cl_float2), qq, NULL);
+            shard->ww_mem = clCreateBuffer(lcl->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR | CL_MEM_HOST_NO_ACCESS, nq*sizeof(cl_float2), ww, NULL);
+            if(!shard->qq_mem || !shard->ww_mem)
+                error("failed to allocate quadrature buffers");
+        }
         
-        verbose("    info");
+        // create buffer that contains object data
+        {
+            verbose("  create object buffer");
+            
+            // allocate buffer for object data
+            shard->object_mem = clCreateBuffer(lcl->context, CL_MEM_READ_WRITE, object_size*sizeof(cl_float), NULL, &err);
+            if(err != CL_SUCCESS)
+                error("failed to create object buffer");
+            
+            // allocate buffer for lens tables if there are any
+            shard->lenses_mem = NULL;
+            if(lenses_size > 0)
+            {
+                shard->lenses_mem = clCreateBuffer(lcl->context, CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS, lenses_size*sizeof(cl_float), NULL, &err);
+                if(err != CL_SUCCESS)
+                    error("failed to create buffer for lens tables");
+            }
+        }
         
-        // get work group size for kernel
-        err = clGetKernelWorkGroupInfo(lensed->render, lcl->device_id, CL_KERNEL_WORK_GROUP_SIZE, sizeof(wgs), &wgs, NULL);
-        if(err != CL_SUCCESS)
-            error("failed to get render kernel work group size");
+        // create the buffer that will pass parameter values to objects
+        {
+            // all objects are set unless there are partial updates
+            cl_ulong stage = PARTIAL_ALL;
+            
+            verbose("  create parameter buffer");
+            
+            // create the memory containing physical parameters on the device
+            shard->params = clCreateBuffer(lcl->context, CL_MEM_READ_ONLY | CL_MEM_ALLOC_HOST_PTR, lensed->npars*sizeof(cl_float), NULL, &err);
+            if(err != CL_SUCCESS)
+                error("failed to create buffer for parameters");
+            
+            verbose("  create parameter kernel");
+            
+            // create kernel
+            shard->set_params = clCreateKernel(program, "set_params", &err);
+            if(err != CL_SUCCESS)
+                error("failed to create kernel for parameters");
+            
+            // set kernel arguments
+            err = 0;
+            err |= clSetKernelArg(shard->set_params, 0, sizeof(cl_ulong), &object_size);
+            err |= clSetKernelArg(shard->set_params, 1, sizeof(cl_mem), &shard->object_mem);
+            err |= clSetKernelArg(shard->set_params, 2, (object_size + lenses_item)*sizeof(cl_uint), NULL);
+            err |= clSetKernelArg(shard->set_params, 3, sizeof(cl_mem), &shard->params);
+            err |= clSetKernelArg(shard->set_params, 4, sizeof(cl_mem), &shard->lenses_mem);
+            err |= clSetKernelArg(shard->set_params, 5, sizeof(cl_ulong), &stage);
+            if(err != CL_SUCCESS)
+                error("failed to set kernel arguments for parameters");
+            
+            // multipole trees are built by a single work group after the
+            // parameters are set
+            shard->trees = NULL;
+            for(size_t i = 0; i < inp->nobjs; ++i)
+            {
+                if(inp->objs[i].tree)
+                {
+                    size_t wgs;
+                    
+                    verbose("  create multipole tree kernel");
+                    
+                    shard->trees = clCreateKernel(program, "lens_trees", &err);
+                    if(err != CL_SUCCESS)
+                        error("failed to create multipole tree kernel");
+                    
+                    // work group size is a power of two for the reductions
+                    err = clGetKernelWorkGroupInfo(shard->trees, shard->device_id, CL_KERNEL_WORK_GROUP_SIZE, sizeof(wgs), &wgs, NULL);
+                    if(err != CL_SUCCESS)
+                        error("failed to get multipole tree work group size");
+                    shard->trees_lws[0] = 1;
+                    while(2*shard->trees_lws[0] <= wgs && 2*shard->trees_lws[0] <= 256)
+                        shard->trees_lws[0] *= 2;
+                    
+                    err = 0;
+                    err |= clSetKernelArg(shard->trees, 0, sizeof(cl_mem), &shard->lenses_mem);
+                    err |= clSetKernelArg(shard->trees, 1, shard->trees_lws[0]*lenses_item*sizeof(cl_uint), NULL);
+                    err |= clSetKernelArg(shard->trees, 2, shard->trees_lws[0]*sizeof(cl_float4), NULL);
+                    if(err != CL_SUCCESS)
+                        error("failed to set kernel arguments for multipole trees");
+                    
+                    break;
+                }
+            }
+        }
         
-        // get work group size multiple for kernel if OpenCL version > 1.0
-#ifdef CL_VERSION_1_1
-            err = clGetKernelWorkGroupInfo(lensed->render, lcl->device_id, CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE, sizeof(wgm), &wgm, NULL);
+        // render kernel
+        {
+            size_t wgs, wgm;
+            size_t nlocal, ngroups;
+            int runs, nodes;
+            cl_ulong jend = shard->row0 + shard->rows;
+            
+            verbose("  render");
+            
+            verbose("    buffer");
+            
+            shard->value_mem = clCreateBuffer(lcl->context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR | CL_MEM_HOST_READ_ONLY, lensed->size*sizeof(cl_float), NULL, NULL);
+            shard->error_mem = clCreateBuffer(lcl->context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR | CL_MEM_HOST_READ_ONLY, lensed->size*sizeof(cl_float), NULL, NULL);
+            if(!shard->value_mem || !shard->error_mem)
+                error("failed to create render buffer");
+            
+            verbose("    kernel");
+            
+            // render kernel, which caches rays and light for partial updates
+            shard->render = clCreateKernel(program, lensed->partial ? "render_partial" : "render", &err);
+            if(err != CL_SUCCESS)
+                error("failed to create render kernel");
+            
+            verbose("    info");
+            
+            // get work group size for kernel
+            err = clGetKernelWorkGroupInfo(shard->render, shard->device_id, CL_KERNEL_WORK_GROUP_SIZE, sizeof(wgs), &wgs, NULL);
             if(err != CL_SUCCESS)
-                error("failed to get render kernel work group size multiple");
+                error("failed to get render kernel work group size");
+            
+            // get work group size multiple for kernel if OpenCL version > 1.0
+#ifdef CL_VERSION_1_1
+                err = clGetKernelWorkGroupInfo(shard->render, shard->device_id, CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE, sizeof(wgm), &wgm, NULL);
+                if(err != CL_SUCCESS)
+                    error("failed to get render kernel work group size multiple");
 #else
-            // fixed work group size multiple of 16 for OpenCL 1.0
-            wgm = 16;
+                // fixed work group size multiple of 16 for OpenCL 1.0
+                wgm = 16;
 #endif
-        
-        verbose("    work size");
-        
-        // local work size
-        lensed->render_lws[0] = wgs;
-        
-        // make sure work group size is allowed
-        if(lensed->render_lws[0] > work_item_sizes[0])
-            lensed->render_lws[0] = work_item_sizes[0];
-        
-        // make sure work group size is a multiple of the preferred size
-        lensed->render_lws[0] = (lensed->render_lws[0]/wgm)*wgm;
-        
-        // global work size
-        lensed->render_gws[0] = lensed->size + (lensed->render_lws[0] - lensed->size%lensed->render_lws[0])%lensed->render_lws[0];
-        
-        verbose("      local:  %zu", lensed->render_lws[0]);
-        verbose("      global: %zu", lensed->render_gws[0]);
-    }
-    
-    // convolution kernel if there is a PSF
-    if(psf)
-    {
-        size_t wgs;
-        cl_ulong lm;
-        size_t cache_size;
-        
-        verbose("  convolve");
-        
-        verbose("    buffer");
-        
-        lensed->convolve_mem = clCreateBuffer(lcl->context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR | CL_MEM_HOST_READ_ONLY, lensed->size*sizeof(cl_float), NULL, &err);
-        if(err != CL_SUCCESS)
-            error("failed to create convolve buffer");
-        
-        verbose("    kernel");
-        
-        // convolve kernel 
-        lensed->convolve = clCreateKernel(program, "convolve", &err);
-        if(err != CL_SUCCESS)
-            error("failed to create convolve kernel");
-        
-        verbose("    arguments");
-        
-        // set kernel arguments
-        err = 0;
-        err |= clSetKernelArg(lensed->convolve, 0, sizeof(cl_mem), &lensed->value_mem);
-        err |= clSetKernelArg(lensed->convolve, 1, sizeof(cl_mem), &psf_mem);
-        err |= clSetKernelArg(lensed->convolve, 3, psfw*psfh*sizeof(cl_float), NULL);
-        err |= clSetKernelArg(lensed->convolve, 4, sizeof(cl_mem), &lensed->convolve_mem);
-        if(err != CL_SUCCESS)
-            error("failed to set convolve kernel arguments");
-        
-        verbose("    info");
-        
-        // get work group size for kernel
-        err = clGetKernelWorkGroupInfo(lensed->convolve, lcl->device_id, CL_KERNEL_WORK_GROUP_SIZE, sizeof(wgs), &wgs, NULL);
-        if(err != CL_SUCCESS)
-            error("failed to get convolve kernel work group size");
-        
-        // get local memory size for kernel
-        err = clGetKernelWorkGroupInfo(lensed->convolve, lcl->device_id, CL_KERNEL_LOCAL_MEM_SIZE, sizeof(lm), &lm, NULL);
-        if(err != CL_SUCCESS)
-            error("failed to get convolve kernel local memory size");
-        
-        verbose("    work size");
-        
-        // local work size, start at maximum
-        lensed->convolve_lws[0] = work_item_sizes[0];
-        lensed->convolve_lws[1] = work_item_sizes[1];
-        
-        // reduce local work size until it fits into work group
-        while(lensed->convolve_lws[0]*lensed->convolve_lws[1] > wgs)
-        {
-            if(lensed->convolve_lws[0] > lensed->convolve_lws[1])
-                lensed->convolve_lws[0] /= 2;
+            
+            // make sure work group size is allowed
+            if(wgs > work_item_sizes[0])
+                wgs = work_item_sizes[0];
+            
+            // number of work items per group for one work item per pixel
+            nlocal = (wgs/wgm)*wgm;
+            
+            // number of work groups for one work item per pixel of the shard
+            ngroups = (shard->rows*lensed->width + nlocal - 1)/nlocal;
+            
+            // on CPU devices, each work item computes a run of adjacent pixels,
+            // which leaves the compiler an inner loop to vectorise
+            runs = device_type == CL_DEVICE_TYPE_CPU && !lensed->partial;
+            
+            // small images with large quadrature rules do not keep all compute
+            // units busy with one work item per pixel, so use one work group per
+            // pixel with one work item per node instead
+            nodes = !runs && !lensed->partial && nq >= wgm && ngroups < RENDER_MIN_GROUPS*compute_units;
+            
+            if(nodes)
+            {
+                verbose("    one work group per pixel");
+                
+                // replace render kernel
+                clReleaseKernel(shard->render);
+                shard->render = clCreateKernel(program, "render_nodes", &err);
+                if(err != CL_SUCCESS)
+                    error("failed to create render kernel");
+                
+                // get work group size for kernel
+                err = clGetKernelWorkGroupInfo(shard->render, shard->device_id, CL_KERNEL_WORK_GROUP_SIZE, sizeof(wgs), &wgs, NULL);
+                if(err != CL_SUCCESS)
+                    error("failed to get render kernel work group size");
+                if(wgs > work_item_sizes[0])
+                    wgs = work_item_sizes[0];
+                
+                // power of two that covers the nodes, within work group size
+                shard->render_lws[0] = 1;
+                shard->render_lws[1] = 1;
+                while(shard->render_lws[0] < nq && 2*shard->render_lws[0] <= wgs)
+                    shard->render_lws[0] *= 2;
+                
+                // one work group per pixel
+                shard->render_gws[0] = lensed->width*shard->render_lws[0];
+                shard->render_gws[1] = shard->rows;
+            }
+            else
+            {
+                // number of work items in a row of the image
+                size_t ncols = lensed->width;
+                
+                if(runs)
+                {
+                    verbose("    runs of %d pixels", RENDER_RUN);
+                    
+                    // replace render kernel
+                    clReleaseKernel(shard->render);
+                    shard->render = clCreateKernel(program, "render_run", &err);
+                    if(err != CL_SUCCESS)
+                        error("failed to create render kernel");
+                    
+                    // get work group size for kernel
+                    err = clGetKernelWorkGroupInfo(shard->render, shard->device_id, CL_KERNEL_WORK_GROUP_SIZE, sizeof(wgs), &wgs, NULL);
+                    if(err != CL_SUCCESS)
+                        error("failed to get render kernel work group size");
+                    if(wgs > work_item_sizes[0])
+                        wgs = work_item_sizes[0];
+                    nlocal = (wgs/wgm)*wgm;
+                    
+                    // one work item for each run in a row
+                    ncols = (lensed->width + RENDER_RUN - 1)/RENDER_RUN;
+                }
+                
+                // height of tiles: largest power of two that divides the work
+                // group into a tile at least as wide as high, or one for strips
+                shard->render_lws[1] = 1;
+                if(inp->opts->tiles)
+                {
+                    while(4*shard->render_lws[1]*shard->render_lws[1] <= nlocal
+                          && nlocal%(2*shard->render_lws[1]) == 0
+                          && 2*shard->render_lws[1] <= work_item_sizes[1])
+                        shard->render_lws[1] *= 2;
+                }
+                
+                // width of tiles
+                shard->render_lws[0] = nlocal/shard->render_lws[1];
+                
+                verbose("    %s of %zu x %zu work items", inp->opts->tiles ? "tiles" : "strips", shard->render_lws[0], shard->render_lws[1]);
+                
+                // global work size must be padded to tile size
+                shard->render_gws[0] = ncols + (shard->render_lws[0] - ncols%shard->render_lws[0])%shard->render_lws[0];
+                shard->render_gws[1] = shard->rows + (shard->render_lws[1] - shard->rows%shard->render_lws[1])%shard->render_lws[1];
+            }
+            
+            // rows of the shard start at an offset
+            shard->render_off[0] = 0;
+            shard->render_off[1] = shard->row0;
+            
+            verbose("    arguments");
+            
+            // set kernel arguments
+            err = 0;
+            err |= clSetKernelArg(shard->render, 0, sizeof(cl_ulong), &object_size);
+            err |= clSetKernelArg(shard->render, 1, sizeof(cl_mem), &shard->object_mem);
+            err |= clSetKernelArg(shard->render, 2, object_size*sizeof(cl_uint), NULL);
+            err |= clSetKernelArg(shard->render, 3, sizeof(cl_mem), NULL);
+            err |= clSetKernelArg(shard->render, 4, sizeof(cl_float4), &pcs4);
+            err |= clSetKernelArg(shard->render, 5, sizeof(cl_mem), &shard->qq_mem);
+            err |= clSetKernelArg(shard->render, 6, sizeof(cl_mem), &shard->ww_mem);
+            err |= clSetKernelArg(shard->render, 7, sizeof(cl_mem), &shard->value_mem);
+            err |= clSetKernelArg(shard->render, 8, sizeof(cl_mem), &shard->error_mem);
+            shard->render_end = nodes ? 0 : jend;
+            if(nodes)
+                err |= clSetKernelArg(shard->render, 9, shard->render_lws[0]*sizeof(cl_float2), NULL);
             else
-                lensed->convolve_lws[1] /= 2;
+                err |= clSetKernelArg(shard->render, 9, sizeof(cl_ulong), &jend);
+            if(err != CL_SUCCESS)
+                error("failed to set render kernel arguments");
+            
+            // caches for partial updates
+            shard->partial = NULL;
+            shard->rays_mem = NULL;
+            shard->light_mem = NULL;
+            if(lensed->partial)
+            {
+                cl_ulong stage = PARTIAL_ALL;
+                size_t nrays = compute_rays(inp->nobjs, inp->objs);
+                
+                verbose("    partial updates with %zu rays per node", nrays);
+                
+                shard->partial = malloc(sizeof(struct partial));
+                if(!shard->partial)
+                    errori(NULL);
+                shard->partial->set = malloc(lensed->npars*sizeof(double));
+                shard->partial->rendered = malloc(lensed->npars*sizeof(double));
+                if(!shard->partial->set || !shard->partial->rendered)
+                    errori(NULL);
+                shard->partial->set_valid = 0;
+                shard->partial->rendered_valid = 0;
+                shard->partial->stage = PARTIAL_ALL;
+                
+                // there is always at least one ray, even without sources
+                shard->rays_mem = clCreateBuffer(lcl->context, CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS, (nrays ? nrays : 1)*lensed->size*nq*sizeof(cl_float2), NULL, NULL);
+                shard->light_mem = clCreateBuffer(lcl->context, CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS, lensed->size*sizeof(cl_float2), NULL, NULL);
+                if(!shard->rays_mem || !shard->light_mem)
+                    error("failed to create buffers for partial updates");
+                
+                err = 0;
+                err |= clSetKernelArg(shard->render, 10, sizeof(cl_mem), &shard->rays_mem);
+                err |= clSetKernelArg(shard->render, 11, sizeof(cl_mem), &shard->light_mem);
+                err |= clSetKernelArg(shard->render, 12, sizeof(cl_ulong), &stage);
+                if(err != CL_SUCCESS)
+                    error("failed to set render kernel arguments");
+            }
+            
+            verbose("    work size");
+            verbose("      local:  %zu x %zu", shard->render_lws[0], shard->render_lws[1]);
+            verbose("      global: %zu x %zu", shard->render_gws[0], shard->render_gws[1]);
+            verbose("      offset: %zu x %zu", shard->render_off[0], shard->render_off[1]);
         }
         
-        // size of local memory that stores part of the model
-        cache_size = (psfw/2 + lensed->convolve_lws[0] + psfw/2)*(psfh/2 + lensed->convolve_lws[1] + psfh/2)*sizeof(cl_float);
-        
-        // reduce local work size until cache fits into local memory
-        while(2*cache_size > local_mem_size - lm)
+        // deflection field kernels if enabled
+        if(lensed->field)
         {
-            if(lensed->convolve_lws[0] > lensed->convolve_lws[1])
-                lensed->convolve_lws[0] /= 2;
-            else
-                lensed->convolve_lws[1] /= 2;
+            size_t wgs, wgm;
+            size_t nx, ny;
+            cl_ulong npts;
+            cl_float2* points;
+            cl_float cull;
+            cl_float theta;
+            double y0;
+            size_t rows;
+            
+            verbose("  field");
+            
+            // first row and number of rows of a band, including its margin
+            y0 = pcs4.s[1] - pcs4.s[3]*lensed->margin;
+            rows = lensed->height/lensed->nbands;
+            
+            // bounds of the image, including the extent of the pixels
+            lensed->field->bounds.s[0] = fmin(pcs4.s[0], pcs4.s[0] + pcs4.s[2]*(lensed->width - 1)) - 0.5*fabs(pcs4.s[2]);
+            lensed->field->bounds.s[1] = fmin(y0, y0 + pcs4.s[3]*(rows - 1)) - 0.5*fabs(pcs4.s[3]);
+            lensed->field->bounds.s[2] = fmax(pcs4.s[0], pcs4.s[0] + pcs4.s[2]*(lensed->width - 1)) + 0.5*fabs(pcs4.s[2]);
+            lensed->field->bounds.s[3] = fmax(y0, y0 + pcs4.s[3]*(rows - 1)) + 0.5*fabs(pcs4.s[3]);
+            
+            // grid spacing is measured in pixels
+            lensed->field->scale.s[0] = fabs(pcs4.s[2]);
+            lensed->field->scale.s[1] = fabs(pcs4.s[3]);
+            
+            // field is computed on the queue of its shard
+            lensed->field->queue = shard->queue;
+            
+            verbose("    buffer");
+            
+            // buffer must hold the finest grid
+            field_dims(lensed, FIELD_LEVEL_MAX, &nx, &ny);
+            
+            lensed->field->mem = clCreateBuffer(lcl->context, CL_MEM_READ_WRITE, (FIELD_HEAD + nx*ny)*sizeof(cl_float2), NULL, &err);
+            if(err != CL_SUCCESS)
+                error("failed to create deflection field buffer");
+            
+            // points for validation of the field
+            npts = FIELD_POINTS;
+            points = malloc(npts*sizeof(cl_float2));
+            if(!points)
+                errori(NULL);
+            field_points(lensed, npts, points);
+            
+            lensed->field->points_mem = clCreateBuffer(lcl->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR | CL_MEM_HOST_NO_ACCESS, npts*sizeof(cl_float2), points, NULL);
+            lensed->field->error_mem = clCreateBuffer(lcl->context, CL_MEM_WRITE_ONLY | CL_MEM_ALLOC_HOST_PTR | CL_MEM_HOST_READ_ONLY, npts*sizeof(cl_float), NULL, NULL);
+            if(!lensed->field->points_mem || !lensed->field->error_mem)
+                error("failed to create deflection field validation buffers");
+            
+            // tolerance for culling lenses in tables, and opening angle of
+            // their multipole trees
+            cull = lensed->field->cull;
+            theta = lensed->field->theta;
+            
+            free(points);
+            
+            verbose("    kernel");
+            
+            lensed->field->grid = clCreateKernel(program, "field_grid", &err);
+            if(err != CL_SUCCESS)
+                error("failed to create deflection field kernel");
+            
+            lensed->field->check = clCreateKernel(program, "field_check", &err);
+            if(err != CL_SUCCESS)
+                error("failed to create deflection field check kernel");
+            
+            // check of multipole trees against direct summation
+            for(size_t i = 0; i < inp->nobjs && inp->opts->multipole_check; ++i)
+            {
+                if(inp->objs[i].tree)
+                {
+                    lensed->field->multipole = clCreateKernel(program, "multipole_check", &err);
+                    if(err != CL_SUCCESS)
+                        error("failed to create multipole check kernel");
+                    break;
+                }
+            }
+            
+            verbose("    arguments");
             
-            // make sure that PSF fits into local memory at all
-            if(lensed->convolve_lws[0]*lensed->convolve_lws[1] < 1)
-                error("PSF too large for local memory on device (%zukB)", local_mem_size/1024);
+            // set kernel arguments
+            err = 0;
+            err |= clSetKernelArg(lensed->field->grid, 0, sizeof(cl_ulong), &object_size);
+            err |= clSetKernelArg(lensed->field->grid, 1, sizeof(cl_mem), &shard->object_mem);
+            err |= clSetKernelArg(lensed->field->grid, 2, object_size*sizeof(cl_uint), NULL);
+            err |= clSetKernelArg(lensed->field->grid, 3, sizeof(cl_mem), &lensed->field->mem);
+            err |= clSetKernelArg(lensed->field->grid, 4, sizeof(cl_mem), &shard->lenses_mem);
+            err |= clSetKernelArg(lensed->field->grid, 5, sizeof(cl_float), &cull);
+            err |= clSetKernelArg(lensed->field->grid, 6, sizeof(cl_float), &theta);
+            err |= clSetKernelArg(lensed->field->check, 0, sizeof(cl_ulong), &object_size);
+            err |= clSetKernelArg(lensed->field->check, 1, sizeof(cl_mem), &shard->object_mem);
+            err |= clSetKernelArg(lensed->field->check, 2, object_size*sizeof(cl_uint), NULL);
+            err |= clSetKernelArg(lensed->field->check, 3, sizeof(cl_mem), &lensed->field->mem);
+            err |= clSetKernelArg(lensed->field->check, 4, sizeof(cl_mem), &shard->lenses_mem);
+            err |= clSetKernelArg(lensed->field->check, 5, sizeof(cl_ulong), &npts);
+            err |= clSetKernelArg(lensed->field->check, 6, sizeof(cl_mem), &lensed->field->points_mem);
+            err |= clSetKernelArg(lensed->field->check, 7, sizeof(cl_mem), &lensed->field->error_mem);
+            if(lensed->field->multipole)
+            {
+                err |= clSetKernelArg(lensed->field->multipole, 0, sizeof(cl_mem), &shard->lenses_mem);
+                err |= clSetKernelArg(lensed->field->multipole, 1, sizeof(cl_float), &theta);
+                err |= clSetKernelArg(lensed->field->multipole, 2, sizeof(cl_mem), &lensed->field->points_mem);
+                err |= clSetKernelArg(lensed->field->multipole, 3, sizeof(cl_mem), &lensed->field->error_mem);
+            }
+            if(err != CL_SUCCESS)
+                error("failed to set deflection field kernel arguments");
             
-            cache_size = (psfw/2 + lensed->convolve_lws[0] + psfw/2)*(psfh/2 + lensed->convolve_lws[1] + psfh/2)*sizeof(cl_float);
+            // render kernel interpolates the field
+            err = clSetKernelArg(shard->render, 3, sizeof(cl_mem), &lensed->field->mem);
+            if(err != CL_SUCCESS)
+                error("failed to set render kernel arguments");
+            
+            verbose("    info");
+            
+            // get work group size for kernel
+            err = clGetKernelWorkGroupInfo(lensed->field->grid, shard->device_id, CL_KERNEL_WORK_GROUP_SIZE, sizeof(wgs), &wgs, NULL);
+            if(err != CL_SUCCESS)
+                error("failed to get deflection field kernel work group size");
+            
+            // get work group size multiple for kernel if OpenCL version > 1.0
+#ifdef CL_VERSION_1_1
+                err = clGetKernelWorkGroupInfo(lensed->field->grid, shard->device_id, CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE, sizeof(wgm), &wgm, NULL);
+                if(err != CL_SUCCESS)
+                    error("failed to get deflection field kernel work group size multiple");
+#else
+                // fixed work group size multiple of 16 for OpenCL 1.0
+                wgm = 16;
+#endif
+            
+            verbose("    work size");
+            
+            // local work size
+            lensed->field->grid_lws[0] = wgs;
+            
+            // make sure work group size is allowed
+            if(lensed->field->grid_lws[0] > work_item_sizes[0])
+                lensed->field->grid_lws[0] = work_item_sizes[0];
+            
+            // make sure work group size is a multiple of the preferred size
+            lensed->field->grid_lws[0] = (lensed->field->grid_lws[0]/wgm)*wgm;
+            
+            // check kernel uses the same local work size, and one item per point
+            lensed->field->check_lws[0] = lensed->field->grid_lws[0];
+            lensed->field->check_gws[0] = npts + (lensed->field->check_lws[0] - npts%lensed->field->check_lws[0])%lensed->field->check_lws[0];
+            
+            // start with the coarsest grid, which is refined as necessary
+            field_grid(lensed, FIELD_LEVEL_MIN);
+            
+            field_dims(lensed, FIELD_LEVEL_MIN, &nx, &ny);
+            
+            verbose("      local:  %zu", lensed->field->grid_lws[0]);
+            verbose("      global: %zu", lensed->field->grid_gws[0]);
+            verbose("      grid:   %zu x %zu", nx, ny);
         }
         
-        // global work size must be padded to block size
-        lensed->convolve_gws[0] = lensed->width + (lensed->convolve_lws[0] - lensed->width%lensed->convolve_lws[0])%lensed->convolve_lws[0];
-        lensed->convolve_gws[1] = lensed->height + (lensed->convolve_lws[1] - lensed->height%lensed->convolve_lws[1])%lensed->convolve_lws[1];
-        
-        verbose("      local:  %zu x %zu", lensed->convolve_lws[0], lensed->convolve_lws[1]);
-        verbose("      global: %zu x %zu", lensed->convolve_gws[0], lensed->convolve_gws[1]);
-        
-        verbose("    cache");
-        
-        // set cache size
-        err = clSetKernelArg(lensed->convolve, 2, cache_size, NULL);
-        if(err != CL_SUCCESS)
-            error("failed to set convolve kernel cache");
-    }
-    else
-    {
-        // no kernel: used to determine whether to convolve
-        lensed->convolve = 0;
-    }
-    
-    // loglike kernel
-    verbose("  loglike");
-    {
-        size_t wgs, wgm;
-        
-        verbose("    buffer");
-        
-        lensed->loglike_mem = clCreateBuffer(lcl->context, CL_MEM_WRITE_ONLY | CL_MEM_ALLOC_HOST_PTR | CL_MEM_HOST_READ_ONLY, lensed->size*sizeof(cl_float), NULL, &err);
-        if(err != CL_SUCCESS)
-            error("failed to create loglike buffer");
-        
-        verbose("    kernel");
-        
-        // loglike kernel, take care: the buffer it works on depends on PSF
-        lensed->loglike = clCreateKernel(program, "loglike", &err);
-        if(err != CL_SUCCESS)
-            error("failed to create loglike kernel");
-        
-        verbose("    arguments");
-        
-        // set kernel arguments
-        err = 0;
-        err |= clSetKernelArg(lensed->loglike, 0, sizeof(cl_mem), &image_mem);
-        err |= clSetKernelArg(lensed->loglike, 1, sizeof(cl_mem), &weight_mem);
-        err |= clSetKernelArg(lensed->loglike, 2, sizeof(cl_mem), psf ? &lensed->convolve_mem : &lensed->value_mem);
-        err |= clSetKernelArg(lensed->loglike, 3, sizeof(cl_mem), &lensed->loglike_mem);
-        if(err != CL_SUCCESS)
-            error("failed to set loglike kernel arguments");
-        
-        verbose("    info");
-        
-        // get work group size for kernel
-        err = clGetKernelWorkGroupInfo(lensed->loglike, lcl->device_id, CL_KERNEL_WORK_GROUP_SIZE, sizeof(wgs), &wgs, NULL);
-        if(err != CL_SUCCESS)
-            error("failed to get loglike kernel work group information");
+        // convolution kernel if there is a PSF
+        if(psf)
+        {
+            size_t wgs;
+            cl_ulong lm;
+            size_t cache_size;
+            
+            verbose("  convolve");
+            
+            verbose("    buffer");
+            
+            shard->convolve_mem = clCreateBuffer(lcl->context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR | CL_MEM_HOST_READ_ONLY, lensed->size*sizeof(cl_float), NULL, &err);
+            if(err != CL_SUCCESS)
+                error("failed to create convolve buffer");
+            
+            verbose("    kernel");
+            
+            // convolve kernel 
+            shard->convolve = clCreateKernel(program, "convolve", &err);
+            if(err != CL_SUCCESS)
+                error("failed to create convolve kernel");
+            
+            verbose("    arguments");
+            
+            // set kernel arguments
+            err = 0;
+            err |= clSetKernelArg(shard->convolve, 0, sizeof(cl_mem), &shard->value_mem);
+            err |= clSetKernelArg(shard->convolve, 1, sizeof(cl_mem), &shard->psf_mem);
+            err |= clSetKernelArg(shard->convolve, 3, psfw*psfh*sizeof(cl_float), NULL);
+            err |= clSetKernelArg(shard->convolve, 4, sizeof(cl_mem), &shard->convolve_mem);
+            if(err != CL_SUCCESS)
+                error("failed to set convolve kernel arguments");
+            
+            verbose("    info");
+            
+            // get work group size for kernel
+            err = clGetKernelWorkGroupInfo(shard->convolve, shard->device_id, CL_KERNEL_WORK_GROUP_SIZE, sizeof(wgs), &wgs, NULL);
+            if(err != CL_SUCCESS)
+                error("failed to get convolve kernel work group size");
+            
+            // get local memory size for kernel
+            err = clGetKernelWorkGroupInfo(shard->convolve, shard->device_id, CL_KERNEL_LOCAL_MEM_SIZE, sizeof(lm), &lm, NULL);
+            if(err != CL_SUCCESS)
+                error("failed to get convolve kernel local memory size");
+            
+            verbose("    work size");
+            
+            // local work size, start at maximum
+            shard->convolve_lws[0] = work_item_sizes[0];
+            shard->convolve_lws[1] = work_item_sizes[1];
+            
+            // reduce local work size until it fits into work group
+            while(shard->convolve_lws[0]*shard->convolve_lws[1] > wgs)
+            {
+                if(shard->convolve_lws[0] > shard->convolve_lws[1])
+                    shard->convolve_lws[0] /= 2;
+                else
+                    shard->convolve_lws[1] /= 2;
+            }
+            
+            // size of local memory that stores part of the model
+            cache_size = (psfw/2 + shard->convolve_lws[0] + psfw/2)*(psfh/2 + shard->convolve_lws[1] + psfh/2)*sizeof(cl_float);
+            
+            // reduce local work size until cache fits into local memory
+            while(2*cache_size > local_mem_size - lm)
+            {
+                if(shard->convolve_lws[0] > shard->convolve_lws[1])
+                    shard->convolve_lws[0] /= 2;
+                else
+                    shard->convolve_lws[1] /= 2;
+                
+                // make sure that PSF fits into local memory at all
+                if(shard->convolve_lws[0]*shard->convolve_lws[1] < 1)
+                    error("PSF too large for local memory on device (%zukB)", local_mem_size/1024);
+                
+                cache_size = (psfw/2 + shard->convolve_lws[0] + psfw/2)*(psfh/2 + shard->convolve_lws[1] + psfh/2)*sizeof(cl_float);
+            }
+            
+            // global work size must be padded to block size
+            shard->convolve_gws[0] = lensed->width + (shard->convolve_lws[0] - lensed->width%shard->convolve_lws[0])%shard->convolve_lws[0];
+            shard->convolve_gws[1] = shard->rows + (shard->convolve_lws[1] - shard->rows%shard->convolve_lws[1])%shard->convolve_lws[1];
+            
+            // rows of the shard start at an offset
+            shard->convolve_off[0] = 0;
+            shard->convolve_off[1] = shard->row0;
+            
+            // rows before and after the shard that are covered by the PSF
+            shard->halo = psfh/2;
+            
+            verbose("      local:  %zu x %zu", shard->convolve_lws[0], shard->convolve_lws[1]);
+            verbose("      global: %zu x %zu", shard->convolve_gws[0], shard->convolve_gws[1]);
+            verbose("      offset: %zu x %zu", shard->convolve_off[0], shard->convolve_off[1]);
+            
+            verbose("    cache");
+            
+            // set cache size
+            err = clSetKernelArg(shard->convolve, 2, cache_size, NULL);
+            if(err != CL_SUCCESS)
+                error("failed to set convolve kernel cache");
+        }
+        else
+        {
+            // no kernel: used to determine whether to convolve
+            shard->convolve = 0;
+        }
         
-        // get work group size multiple for kernel if OpenCL version > 1.0
-#ifdef CL_VERSION_1_1
-            err = clGetKernelWorkGroupInfo(lensed->loglike, lcl->device_id, CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE, sizeof(wgm), &wgm, NULL);
+        // loglike kernel
+        {
+            size_t wgs, wgm;
+            
+            verbose("  loglike");
+            
+            verbose("    buffer");
+            
+            shard->loglike_mem = clCreateBuffer(lcl->context, CL_MEM_WRITE_ONLY | CL_MEM_ALLOC_HOST_PTR | CL_MEM_HOST_READ_ONLY, lensed->size*sizeof(cl_float), NULL, &err);
             if(err != CL_SUCCESS)
-                error("failed to get loglike kernel work group size multiple");
+                error("failed to create loglike buffer");
+            
+            verbose("    kernel");
+            
+            // loglike kernel, take care: the buffer it works on depends on PSF,
+            // and correlated noise is whitened by its own kernel
+            shard->loglike = clCreateKernel(program, noise ? "loglike_noise" : "loglike", &err);
+            if(err != CL_SUCCESS)
+                error("failed to create loglike kernel");
+            
+            verbose("    arguments");
+            
+            // set kernel arguments
+            err = 0;
+            err |= clSetKernelArg(shard->loglike, 0, sizeof(cl_mem), &shard->image_mem);
+            err |= clSetKernelArg(shard->loglike, 1, sizeof(cl_mem), &shard->weight_mem);
+            err |= clSetKernelArg(shard->loglike, 2, sizeof(cl_mem), psf ? &shard->convolve_mem : &shard->value_mem);
+            err |= clSetKernelArg(shard->loglike, 3, sizeof(cl_mem), &shard->loglike_mem);
+            if(noise)
+            {
+                cl_ulong nw = noisew;
+                cl_ulong nh = noiseh;
+                err |= clSetKernelArg(shard->loglike, 4, sizeof(cl_mem), &shard->noise_mem);
+                err |= clSetKernelArg(shard->loglike, 5, sizeof(cl_ulong), &nw);
+                err |= clSetKernelArg(shard->loglike, 6, sizeof(cl_ulong), &nh);
+            }
+            if(err != CL_SUCCESS)
+                error("failed to set loglike kernel arguments");
+            
+            verbose("    info");
+            
+            // get work group size for kernel
+            err = clGetKernelWorkGroupInfo(shard->loglike, shard->device_id, CL_KERNEL_WORK_GROUP_SIZE, sizeof(wgs), &wgs, NULL);
+            if(err != CL_SUCCESS)
+                error("failed to get loglike kernel work group information");
+            
+            // get work group size multiple for kernel if OpenCL version > 1.0
+#ifdef CL_VERSION_1_1
+                err = clGetKernelWorkGroupInfo(shard->loglike, shard->device_id, CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE, sizeof(wgm), &wgm, NULL);
+                if(err != CL_SUCCESS)
+                    error("failed to get loglike kernel work group size multiple");
 #else
-            // fixed work group size multiple of 16 for OpenCL 1.0
-            wgm = 16;
+                // fixed work group size multiple of 16 for OpenCL 1.0
+                wgm = 16;
 #endif
+            
+            verbose("    work size");
+            
+            // local work size
+            shard->loglike_lws[0] = wgs;
+            
+            // make sure work group size is allowed
+            if(shard->loglike_lws[0] > work_item_sizes[0])
+                shard->loglike_lws[0] = work_item_sizes[0];
+            
+            // make sure work group size is a multiple of the preferred size
+            shard->loglike_lws[0] = (shard->loglike_lws[0]/wgm)*wgm;
+            
+            // global work size for kernel, covering the pixels of the shard
+            shard->loglike_gws[0] = shard->rows*lensed->width + (shard->loglike_lws[0] - shard->rows*lensed->width%shard->loglike_lws[0])%shard->loglike_lws[0];
+            
+            // pixels of the shard start at an offset
+            shard->loglike_off[0] = shard->row0*lensed->width;
+            
+            verbose("      local:  %zu", shard->loglike_lws[0]);
+            verbose("      global: %zu", shard->loglike_gws[0]);
+            verbose("      offset: %zu", shard->loglike_off[0]);
+        }
         
-        verbose("    work size");
-        
-        // local work size
-        lensed->loglike_lws[0] = wgs;
-        
-        // make sure work group size is allowed
-        if(lensed->loglike_lws[0] > work_item_sizes[0])
-            lensed->loglike_lws[0] = work_item_sizes[0];
-        
-        // make sure work group size is a multiple of the preferred size
-        lensed->loglike_lws[0] = (lensed->loglike_lws[0]/wgm)*wgm;
+        // free device info
+        free(work_item_sizes);
+    }
+    
+    // buffers for native backend, which works on host memory
+    if(native)
+    {
+        verbose("  native buffers");
         
-        // global work size for kernel
-        lensed->loglike_gws[0] = lensed->size + (lensed->loglike_lws[0] - lensed->size%lensed->loglike_lws[0])%lensed->loglike_lws[0];
+        // object data and parameters
+        lensed->native->dsiz = object_size;
+        lensed->native->data = calloc(object_size, sizeof(cl_uint));
+        lensed->native->params = calloc(lensed->npars, sizeof(cl_float));
+        if(!lensed->native->data || !lensed->native->params)
+            errori(NULL);
         
-        verbose("      local:  %zu", lensed->loglike_lws[0]);
-        verbose("      global: %zu", lensed->loglike_gws[0]);
+        // pixel coordinate system and quadrature rule
+        lensed->native->pcs = pcs4;
+        lensed->native->qq = qq;
+        lensed->native->ww = ww;
+        
+        // observed data, weights and PSF
+        lensed->native->image = lensed->image;
+        lensed->native->weight = lensed->weight;
+        lensed->native->psf = psf;
+        
+        // computed images
+        lensed->native->value = malloc(lensed->size*sizeof(cl_float));
+        lensed->native->error = malloc(lensed->size*sizeof(cl_float));
+        lensed->native->convolved = psf ? malloc(lensed->size*sizeof(cl_float)) : NULL;
+        lensed->native->chi2 = malloc(lensed->size*sizeof(cl_float));
+        if(!lensed->native->value || !lensed->native->error || (psf && !lensed->native->convolved) || !lensed->native->chi2)
+            errori(NULL);
     }
     
     // profiling information
-    if(inp->opts->profile)
+    if(queue_properties & CL_QUEUE_PROFILING_ENABLE)
     {
         verbose("  profiler");
         
@@ -1125,6 +2208,8 @@ int main(int argc, char* argv[])
         lensed->profile->map_params        = profile_create("+params");
         lensed->profile->unmap_params      = profile_create("-params");
         lensed->profile->set_params        = profile_create("set_params");
+        lensed->profile->field             = profile_create("field");
+        lensed->profile->screen            = profile_create("screen");
         lensed->profile->render            = profile_create("render");
         lensed->profile->convolve          = profile_create("convolve");
         lensed->profile->loglike           = profile_create("loglike");
@@ -1137,6 +2222,350 @@ int main(int argc, char* argv[])
         lensed->profile = NULL;
     }
     
+    // pixelated source that is solved for, which renders nothing by itself
+    // and cannot be ignored
+    lensed->pixels = NULL;
+    for(size_t i = 0, sources = 0, planes = 1; i < inp->nobjs; ++i)
+    {
+        object* obj = &inp->objs[i];
+        
+        // a lens after a source starts a new plane
+        if(obj->type == OBJ_LENS && sources > 0)
+            planes += 1;
+        if(obj->type == OBJ_SOURCE)
+            sources += 1;
+        
+        if(strcmp(obj->name, "pixels") != 0)
+            continue;
+        
+        if(lensed->pixels)
+            error("%s: more than one pixelated source\n"
+                  "Only a single pixelated source can be solved for. Please "
+                  "remove all other objects of type \"pixels\".", obj->id);
+        
+        if(lensed->nshards != 1 || lensed->nbatch != 1)
+            error("%s: pixelated source not available\n"
+                  "Solving for the pixelated source needs a single OpenCL "
+                  "device, without broker.", obj->id);
+        
+        if(inp->opts->linear)
+            error("%s: pixelated source not available\n"
+                  "The pixelated source cannot be solved for together with "
+                  "linear amplitudes. Please remove the \"linear\" option.",
+                  obj->id);
+        
+        if(noise)
+            error("%s: pixelated source not available\n"
+                  "The pixelated source is solved with independent pixels, "
+                  "not with correlated noise. Please remove the \"noise\" "
+                  "option.", obj->id);
+        
+        if(obj->pars[0].ipp || obj->pars[1].ipp)
+            error("%s: pixelated source with image plane prior\n"
+                  "The position of the grid of a pixelated source cannot "
+                  "have an image plane prior.", obj->id);
+        
+        // the grid is traced through the lenses of the first plane only
+        if(planes > 1)
+            error("%s: pixelated source behind other sources\n"
+                  "The pixelated source must be on the first source plane, "
+                  "before any lens that follows a source.", obj->id);
+        
+        if(lensed->nbands > 1)
+            error("%s: pixelated source not available\n"
+                  "The pixelated source is solved on a single band. Please "
+                  "remove the [bands] section.", obj->id);
+        
+        if(inp->opts->pixels_size < 2 || inp->opts->pixels_reg < 0 || inp->opts->pixels_iter < 1)
+            error("%s: invalid pixelated source options\n"
+                  "The grid needs at least 2 pixels along each side, the "
+                  "regularisation must not be negative, and the solver "
+                  "needs at least one iteration.", obj->id);
+        
+        verbose("  pixelated source");
+        verbose("    grid: %d x %d", inp->opts->pixels_size, inp->opts->pixels_size);
+        verbose("    regularisation: %g", inp->opts->pixels_reg);
+        verbose("    iterations: %d", inp->opts->pixels_iter);
+        
+        lensed->pixels = pixels_create(lensed, lcl->context, program, obj, inp->opts->pixels_size, inp->opts->pixels_reg, inp->opts->pixels_iter, pcs4, object_size, nq);
+    }
+    
+    // linear amplitudes that are marginalised, which were taken out of the
+    // parameter space and cannot be ignored
+    lensed->linear = NULL;
+    if(inp->opts->linear && (lensed->nshards != 1 || lensed->nbatch != 1))
+    {
+        error("linear amplitudes not available\n"
+              "Marginalising the linear amplitudes needs a single OpenCL "
+              "device, without broker. Please remove the \"linear\" "
+              "option.");
+    }
+    else if(inp->opts->linear)
+    {
+        verbose("  linear amplitudes");
+        
+        lensed->linear = linear_create(lensed, lcl->context, program);
+        
+        if(lensed->linear->namps == 0)
+        {
+            warn("no linear amplitudes\n"
+                 "None of the parameters is a magnitude or amplitude with a "
+                 "prior. The \"linear\" option will be ignored.");
+            linear_free(lensed->linear);
+            lensed->linear = NULL;
+        }
+    }
+    
+    // cells of faint pixels that are binned to a signal-to-noise ratio
+    lensed->cells = NULL;
+    if(inp->opts->voronoi && (lensed->linear || lensed->pixels))
+    {
+        warn("Voronoi binning not available\n"
+             "The linear amplitudes or the pixelated source are solved on "
+             "the pixels of the image. The \"voronoi\" option will be "
+             "ignored.");
+    }
+    else if(inp->opts->voronoi && lensed->nbands > 1)
+    {
+        warn("Voronoi binning not available\n"
+             "The cells of binned pixels cannot span several bands. The "
+             "\"voronoi\" option will be ignored.");
+    }
+    else if(inp->opts->voronoi && (lensed->nshards != 1 || lensed->nbatch != 1))
+    {
+        warn("Voronoi binning not available\n"
+             "The cells of binned pixels need a single OpenCL device, "
+             "without broker. The \"voronoi\" option will be ignored.");
+    }
+    else if(inp->opts->voronoi && noise)
+    {
+        warn("Voronoi binning not available\n"
+             "The cells of binned pixels assume independent noise. The "
+             "\"voronoi\" option will be ignored.");
+    }
+    else if(inp->opts->voronoi < 0)
+    {
+        warn("Voronoi binning not available\n"
+             "The target signal-to-noise ratio of the cells must be "
+             "positive. The \"voronoi\" option will be ignored.");
+    }
+    else if(inp->opts->voronoi)
+    {
+        verbose("  Voronoi binning");
+        
+        lensed->cells = voronoi_cells(lensed->width, lensed->height, lensed->image, lensed->weight, inp->opts->voronoi);
+        
+        verbose("    cells: %zu", lensed->cells->ncells);
+        verbose("    computed pixels: %zu of %zu", lensed->cells->nreps, lensed->size);
+        
+        voronoi_create(lensed, lcl->context, program, pcs4, object_size);
+    }
+    
+    // chunks of rows for early termination of the likelihood
+    lensed->threshold = -DBL_MAX;
+    lensed->nchunks = 0;
+    lensed->chunks = NULL;
+    lensed->rendered = NULL;
+    if(inp->opts->early_exit && inp->opts->ins)
+    {
+        warn("early exit not available\n"
+             "Importance nested sampling needs the exact likelihood of "
+             "every point. The \"early-exit\" option will be ignored.");
+    }
+    else if(inp->opts->early_exit && (lensed->nshards != 1 || lensed->nbatch != 1 || lensed->profile))
+    {
+        warn("early exit not available\n"
+             "Early termination of the likelihood needs a single OpenCL "
+             "device, without broker or profiler. The \"early-exit\" "
+             "option will be ignored.");
+    }
+    else if(inp->opts->early_exit && (lensed->linear || lensed->pixels))
+    {
+        warn("early exit not available\n"
+             "The linear amplitudes or the pixelated source are solved on "
+             "the whole image. The \"early-exit\" option will be ignored.");
+    }
+    else if(inp->opts->early_exit && noise)
+    {
+        warn("early exit not available\n"
+             "The whitened residuals of a row depend on the rows around it. "
+             "The \"early-exit\" option will be ignored.");
+    }
+    else if(inp->opts->early_exit && lensed->cells)
+    {
+        warn("early exit not available\n"
+             "Early termination of the likelihood works on rows of pixels, "
+             "not on cells of the Voronoi binning. The \"early-exit\" "
+             "option will be ignored.");
+    }
+    else if(inp->opts->early_exit)
+    {
+        struct shard* shard = lensed->shards;
+        unsigned long long seed;
+        size_t rows;
+        
+        verbose("  early exit");
+        
+        // chunks are not smaller than the work groups of the kernels
+        rows = shard->render_lws[1];
+        if(shard->convolve && shard->convolve_lws[1] > rows)
+            rows = shard->convolve_lws[1];
+        
+        lensed->nchunks = lensed->height/rows;
+        if(lensed->nchunks > LOGLIKE_CHUNKS)
+            lensed->nchunks = LOGLIKE_CHUNKS;
+        
+        // a single chunk does not save anything
+        if(lensed->nchunks < 2)
+            lensed->nchunks = 0;
+        
+        if(lensed->nchunks > 0)
+        {
+            lensed->chunks = malloc(lensed->nchunks*sizeof(struct chunk));
+            lensed->rendered = malloc(lensed->height);
+            if(!lensed->chunks || !lensed->rendered)
+                errori(NULL);
+            
+            // bands of equal height, up to one row
+            for(size_t c = 0; c < lensed->nchunks; ++c)
+            {
+                lensed->chunks[c].row0 = c*lensed->height/lensed->nchunks;
+                lensed->chunks[c].rows = (c + 1)*lensed->height/lensed->nchunks - lensed->chunks[c].row0;
+            }
+            
+            // shuffle chunks with a fixed seed, so that every sample uses
+            // the same order, and neighbouring rows are not computed first
+            seed = 1;
+            for(size_t c = lensed->nchunks - 1; c > 0; --c)
+            {
+                struct chunk tmp;
+                size_t d;
+                
+                seed = seed*6364136223846793005ULL + 1442695040888963407ULL;
+                d = (seed >> 33)%(c + 1);
+                
+                tmp = lensed->chunks[c];
+                lensed->chunks[c] = lensed->chunks[d];
+                lensed->chunks[d] = tmp;
+            }
+        }
+        
+        verbose("    chunks: %zu", lensed->nchunks);
+    }
+    
+    // screening of samples on a binned image
+    lensed->screen = NULL;
+    if(inp->opts->screen && (lensed->nshards != 1 || lensed->nbatch != 1))
+    {
+        warn("screening not available\n"
+             "Screening of samples needs a single OpenCL device, without "
+             "broker. The \"screen\" option will be ignored.");
+    }
+    else if(inp->opts->screen && (lensed->linear || lensed->pixels))
+    {
+        warn("screening not available\n"
+             "The linear amplitudes or the pixelated source are solved on "
+             "the whole image. The \"screen\" option will be ignored.");
+    }
+    else if(inp->opts->screen && lensed->nbands > 1)
+    {
+        warn("screening not available\n"
+             "The blocks of the binned image cannot span several bands. The "
+             "\"screen\" option will be ignored.");
+    }
+    else if(inp->opts->screen && lensed->cells)
+    {
+        warn("screening not available\n"
+             "The binned image of the screening is not a lower bound for "
+             "the cells of the Voronoi binning. The \"screen\" option will "
+             "be ignored.");
+    }
+    else if(inp->opts->screen && noise)
+    {
+        warn("screening not available\n"
+             "The binned image of the screening is not a lower bound for "
+             "the whitened residuals of correlated noise. The \"screen\" "
+             "option will be ignored.");
+    }
+    else if(inp->opts->screen && (inp->opts->screen < 2 || inp->opts->screen > lensed->width || inp->opts->screen > lensed->height))
+    {
+        warn("screening not available\n"
+             "The block size of the screening image must be at least 2 and "
+             "at most the size of the image. The \"screen\" option will be "
+             "ignored.");
+    }
+    else if(inp->opts->screen)
+    {
+        verbose("  screening");
+        
+        // blocks are computed from a single point at their centre, which
+        // is cheap compared to the quadrature rule of the image
+        lensed->screen = binned_create(lensed, lcl->context, program, inp->opts->screen, psf, psfw, psfh, pcs4, object_size);
+        
+        // samples are only skipped if the bound from their screening chi^2
+        // value exceeds the threshold by a margin that noise alone is very
+        // unlikely to reach
+        lensed->screen_margin = SCREEN_SIGMAS*sqrt(2.0*lensed->screen->nblocks);
+        lensed->screen_error = 0;
+        lensed->screen_calib = 0;
+        lensed->screen_count = 0;
+        lensed->screen_skipped = 0;
+        
+        verbose("    margin: %.2f", lensed->screen_margin);
+    }
+    
+    // binned images for the coarse runs of the pyramid
+    lensed->nlevels = 0;
+    lensed->levels = NULL;
+    lensed->level = NULL;
+    if(inp->opts->pyramid && (lensed->nshards != 1 || lensed->nbatch != 1))
+    {
+        warn("pyramid not available\n"
+             "The coarse runs of the pyramid need a single OpenCL device, "
+             "without broker. The \"pyramid\" option will be ignored.");
+    }
+    else if(inp->opts->pyramid && (lensed->linear || lensed->pixels))
+    {
+        warn("pyramid not available\n"
+             "The linear amplitudes or the pixelated source are solved on "
+             "the whole image. The \"pyramid\" option will be ignored.");
+    }
+    else if(inp->opts->pyramid && lensed->nbands > 1)
+    {
+        warn("pyramid not available\n"
+             "The blocks of the binned images cannot span several bands. "
+             "The \"pyramid\" option will be ignored.");
+    }
+    else if(inp->opts->pyramid && (inp->opts->pyramid < 0 || inp->opts->pyramid >= 32 || (1ul << inp->opts->pyramid) > lensed->width || (1ul << inp->opts->pyramid) > lensed->height))
+    {
+        warn("pyramid not available\n"
+             "The blocks of the coarsest level of the pyramid must not be "
+             "larger than the image. The \"pyramid\" option will be "
+             "ignored.");
+    }
+    else if(inp->opts->pyramid)
+    {
+        verbose("  pyramid");
+        
+        lensed->nlevels = inp->opts->pyramid;
+        lensed->levels = malloc(lensed->nlevels*sizeof(struct binned*));
+        if(!lensed->levels)
+            errori(NULL);
+        
+        // blocks of the coarsest level have 2^n pixels along each side, and
+        // every finer level halves them
+        for(size_t l = 0; l < lensed->nlevels; ++l)
+            lensed->levels[l] = binned_create(lensed, lcl->context, program, 1ul << (lensed->nlevels - l), psf, psfw, psfh, pcs4, object_size);
+    }
+    
+    // start broker, which all processes on the node must do together
+    lensed->broker = NULL;
+    if(broker)
+    {
+        verbose("  broker");
+        lensed->broker = broker_create(lensed->npars, loglike_batch, lensed);
+    }
+    
     
     /******************
      * DS9 connection *
@@ -1172,7 +2601,7 @@ int main(int argc, char* argv[])
     info("find posterior");
     
     // write parameter names, labels and ranges to file
-    if(inp->opts->output)
+    if(inp->opts->output && rank_world() == 0)
     {
         FILE* paramfile;
         FILE* rangefile;
@@ -1232,21 +2661,48 @@ int main(int argc, char* argv[])
     // some space
     info("  ");
     
-    // call MultiNest
+    // call MultiNest, once for every level of the pyramid and once for the
+    // image, unless interrupted
+    for(size_t l = 0; l <= lensed->nlevels; ++l)
     {
         // MultiNest options
         int ndim = lensed->ndims;
         int npar = lensed->npars;
         int ncdim = ndim;
+        int nlive = inp->opts->nlive;
+        int resume = inp->opts->resume;
+        int outfile = inp->opts->output;
         double ztol = -1E90;
         char root[100] = {0};
-        int initmpi = 1;
+        int initmpi = rank_mpi() ? 0 : 1;
         double logzero = -DBL_MAX;
         int* wrap;
+        int interrupted = 0;
         
         // efficiency rating can mean different things, depending on ceff
         double efr = inp->opts->ceff ? inp->opts->acc : inp->opts->shf;
         
+        // binned image of a coarse run of the pyramid, or the image
+        lensed->level = l < lensed->nlevels ? lensed->levels[l] : NULL;
+        
+        // coarse runs use fewer live points and do not write output files
+        if(lensed->level)
+        {
+            info("  pyramid level %zu of %zu: blocks of %zu x %zu pixels", l + 1, lensed->nlevels, (size_t)lensed->level->bin, (size_t)lensed->level->bin);
+            
+            if(nlive/2 > ndim)
+                nlive /= 2;
+            resume = 0;
+            outfile = 0;
+        }
+        else if(lensed->nlevels > 0)
+        {
+            info("  full image");
+        }
+        
+        // threshold of live points is only known once this run reports
+        lensed->threshold = -DBL_MAX;
+        
         // copy root element for file output if given
         if(inp->opts->root)
             strncpy(root, inp->opts->root, 99);
@@ -1268,13 +2724,13 @@ int main(int argc, char* argv[])
         // run MultiNest, re-entry point for interrupts
         if(setjmp(jmp) == 0)
             run(inp->opts->ins, inp->opts->mmodal, inp->opts->ceff,
-                inp->opts->nlive, inp->opts->tol, efr, ndim, npar, ncdim,
+                nlive, inp->opts->tol, efr, ndim, npar, ncdim,
                 inp->opts->maxmodes, inp->opts->updint, ztol, root,
-                inp->opts->seed, wrap, inp->opts->feedback, inp->opts->resume,
-                inp->opts->output, initmpi, logzero, inp->opts->maxiter,
+                inp->opts->seed, wrap, inp->opts->feedback, resume,
+                outfile, initmpi, logzero, inp->opts->maxiter,
                 loglike, dumper, lensed);
         else
-            info("\ninterrupted!");
+            interrupted = 1;
         
         // restore signal handling
         signal(SIGINT, SIG_DFL);
@@ -1285,7 +2741,62 @@ int main(int argc, char* argv[])
         
         // free MultiNest data
         free(wrap);
+        
+        if(interrupted)
+        {
+            info("\ninterrupted!");
+            break;
+        }
+        
+        // narrow the uniform priors of the next run to a box around all
+        // posterior samples of this coarse run, padded by the width of the
+        // samples, or by the given number of standard deviations if that is
+        // larger, since the coarse model can be biased
+        if(lensed->level)
+        {
+            info("  ");
+            
+            // only the first process has the samples, and all processes must
+            // narrow the priors in the same way
+            rank_bcast(lensed->lower, lensed->npars);
+            rank_bcast(lensed->upper, lensed->npars);
+            rank_bcast(lensed->sigma, lensed->npars);
+            
+            for(size_t i = 0; i < lensed->npars; ++i)
+            {
+                param* par = lensed->pars[i];
+                double pad = inp->opts->pyramid_sigma*lensed->sigma[i];
+                prior* pri;
+                
+                // derived and wrap-around parameters keep their priors
+                if(par->derived || par->wrap)
+                    continue;
+                
+                if(pad < lensed->upper[i] - lensed->lower[i])
+                    pad = lensed->upper[i] - lensed->lower[i];
+                
+                pri = prior_restrict(par->pri, lensed->lower[i] - pad, lensed->upper[i] + pad);
+                if(pri)
+                {
+                    char buf[100];
+                    
+                    // evidence of the next run is for the narrowed prior
+                    lensed->logvol += log((prior_upper(pri) - prior_lower(pri))/(prior_upper(par->pri) - prior_lower(par->pri)));
+                    
+                    prior_free(par->pri);
+                    par->pri = pri;
+                    
+                    prior_print(par->pri, buf, sizeof(buf));
+                    verbose("    %s: %s", par->id, buf);
+                }
+            }
+        }
     }
+    lensed->level = NULL;
+    
+    // stop broker once all processes on the node are done
+    if(lensed->broker)
+        broker_free(lensed->broker);
     
     // some more space
     info("  ");
@@ -1304,7 +2815,11 @@ int main(int argc, char* argv[])
      ***********/
     
     // compute chi^2/dof
-    chi2_dof = -2*lensed->max_loglike / (lensed->size - masked - lensed->npars);
+    // degrees of freedom are the cells if pixels are binned
+    if(lensed->cells)
+        chi2_dof = -2*lensed->max_loglike / (lensed->cells->ncells - lensed->npars);
+    else
+        chi2_dof = -2*lensed->max_loglike / (lensed->size - masked - lensed->npars);
     
     // summary statistics
     info("summary");
@@ -1335,6 +2850,8 @@ int main(int argc, char* argv[])
             lensed->profile->map_params,
             lensed->profile->unmap_params,
             lensed->profile->set_params,
+            lensed->profile->field,
+            lensed->profile->screen,
             lensed->profile->render,
             lensed->profile->convolve,
             lensed->profile->loglike,
@@ -1343,12 +2860,46 @@ int main(int argc, char* argv[])
         };
         int profc = sizeof(profv)/sizeof(profv[0]);
         
+        // sum profiles of all processes in the job
+        for(int i = 0; i < profc; ++i)
+        {
+            unsigned long long ticks[] = { profv[i]->queue, profv[i]->submit, profv[i]->execute };
+            rank_sum(ticks, 3);
+            profv[i]->queue   = ticks[0];
+            profv[i]->submit  = ticks[1];
+            profv[i]->execute = ticks[2];
+        }
+        
         info("profiler");
         info("  ");
         profile_print(profc, profv);
         info("  ");
     }
     
+    // screening results, which all processes in the job have
+    if(lensed->screen)
+    {
+        unsigned long long counts[] = { lensed->screen_count, lensed->screen_skipped };
+        rank_sum(counts, 2);
+        
+        if(lensed->profile)
+        {
+            info(LOG_BOLD "  screening: " LOG_RESET "%llu of %llu samples skipped (%.1f%%)",
+                 counts[1], counts[0], counts[0] ? 100.0*counts[1]/counts[0] : 0.0);
+            info("  ");
+        }
+        else
+        {
+            verbose("screening: %llu of %llu samples skipped", counts[1], counts[0]);
+        }
+        
+        verbose("screening: largest error of binned model: %.2f", lensed->screen_error);
+    }
+    
+    // largest error of multipole trees against direct summation
+    if(lensed->field && lensed->field->multipole)
+        info("multipole trees: maximum deflection error %g", lensed->field->multipole_error);
+    
     // batch output
     if(LOG_LEVEL == LOG_BATCH)
     {
@@ -1390,6 +2941,8 @@ int main(int argc, char* argv[])
         profile_free(lensed->profile->map_params);
         profile_free(lensed->profile->unmap_params);
         profile_free(lensed->profile->set_params);
+        profile_free(lensed->profile->field);
+        profile_free(lensed->profile->screen);
         profile_free(lensed->profile->render);
         profile_free(lensed->profile->convolve);
         profile_free(lensed->profile->loglike);
@@ -1398,46 +2951,113 @@ int main(int argc, char* argv[])
         free(lensed->profile);
     }
     
-    // free render kernel
-    clReleaseKernel(lensed->render);
-    clReleaseMemObject(lensed->value_mem);
-    clReleaseMemObject(lensed->error_mem);
-    
-    // free convolve kernel
-    if(psf)
+    // free deflection field
+    if(lensed->field)
     {
-        clReleaseKernel(lensed->convolve);
-        clReleaseMemObject(lensed->convolve_mem);
+        clReleaseKernel(lensed->field->grid);
+        clReleaseKernel(lensed->field->check);
+        if(lensed->field->multipole)
+            clReleaseKernel(lensed->field->multipole);
+        clReleaseMemObject(lensed->field->mem);
+        clReleaseMemObject(lensed->field->points_mem);
+        clReleaseMemObject(lensed->field->error_mem);
+        free(lensed->field);
     }
     
-    // free loglike kernel
-    clReleaseKernel(lensed->loglike);
-    clReleaseMemObject(lensed->loglike_mem);
+    // free native program
+    if(native)
+        native_free(lensed->native);
     
-    // free parameter space
-    clReleaseMemObject(lensed->params);
-    clReleaseKernel(lensed->set_params);
+    // free chunks
+    free(lensed->chunks);
+    free(lensed->rendered);
     
-    // free object buffer
-    clReleaseMemObject(object_mem);
+    // free binned images
+    if(lensed->screen)
+        binned_free(lensed->screen);
+    for(size_t l = 0; l < lensed->nlevels; ++l)
+        binned_free(lensed->levels[l]);
+    free(lensed->levels);
     
-    // free quadrature buffers
-    clReleaseMemObject(qq_mem);
-    clReleaseMemObject(ww_mem);
+    // free cells
+    if(lensed->cells)
+        voronoi_free(lensed->cells);
     
-    // free data
-    clReleaseMemObject(image_mem);
-    clReleaseMemObject(weight_mem);
-    if(psf)
-        clReleaseMemObject(psf_mem);
+    // free linear amplitudes
+    if(lensed->linear)
+        linear_free(lensed->linear);
     
-    // free device info
-    free(work_item_sizes);
+    // free pixelated source
+    if(lensed->pixels)
+        pixels_free(lensed->pixels);
     
-    // free worker
-    clReleaseProgram(program);
-    clReleaseCommandQueue(lensed->queue);
-    free_lensed_cl(lcl);
+    // free shards
+    for(size_t s = 0; s < lensed->nbatch*lensed->nshards; ++s)
+    {
+        struct shard* shard = &lensed->shards[s];
+        
+        // free render kernel
+        clReleaseKernel(shard->render);
+        clReleaseMemObject(shard->value_mem);
+        clReleaseMemObject(shard->error_mem);
+        
+        // free caches of partial updates
+        if(shard->partial)
+        {
+            clReleaseMemObject(shard->rays_mem);
+            clReleaseMemObject(shard->light_mem);
+            free(shard->partial->set);
+            free(shard->partial->rendered);
+            free(shard->partial);
+        }
+        
+        // free convolve kernel
+        if(psf)
+        {
+            clReleaseKernel(shard->convolve);
+            clReleaseMemObject(shard->convolve_mem);
+        }
+        
+        // free loglike kernel
+        clReleaseKernel(shard->loglike);
+        clReleaseMemObject(shard->loglike_mem);
+        
+        // free parameter space
+        clReleaseMemObject(shard->params);
+        clReleaseKernel(shard->set_params);
+        if(shard->trees)
+            clReleaseKernel(shard->trees);
+        
+        // free object buffer
+        clReleaseMemObject(shard->object_mem);
+        if(shard->lenses_mem)
+            clReleaseMemObject(shard->lenses_mem);
+        
+        // free quadrature buffers
+        clReleaseMemObject(shard->qq_mem);
+        clReleaseMemObject(shard->ww_mem);
+        
+        // free data
+        clReleaseMemObject(shard->image_mem);
+        clReleaseMemObject(shard->weight_mem);
+        if(psf)
+            clReleaseMemObject(shard->psf_mem);
+        if(noise)
+            clReleaseMemObject(shard->noise_mem);
+        
+        // free worker
+        if(shard->rendered)
+            clReleaseEvent(shard->rendered);
+        clReleaseCommandQueue(shard->queue);
+    }
+    free(lensed->shards);
+    
+    // free OpenCL environment
+    if(lcl)
+    {
+        clReleaseProgram(program);
+        free_lensed_cl(lcl);
+    }
     
     // free quadrature rule
     free(qq);
@@ -1449,16 +3069,20 @@ int main(int argc, char* argv[])
     free(lensed->sigma);
     free(lensed->ml);
     free(lensed->map);
+    free(lensed->lower);
+    free(lensed->upper);
     
     // free parameter space
     free(lensed->pars);
     free(lensed->pmap);
+    free(lensed->partial);
     
     // free data
     free(lensed->image);
     free(pcs);
     free(lensed->weight);
     free(psf);
+    free(noise);
     
     // free input
     free_input(inp);
@@ -1470,5 +3094,8 @@ int main(int argc, char* argv[])
     if(LOG_LEVEL == LOG_QUIET || LOG_LEVEL == LOG_BATCH)
         mute();
     
+    // finalise MPI
+    rank_finalize();
+    
     return EXIT_SUCCESS;
 }
@@ -1,5 +1,278 @@
 #pragma once
 
+// stages of partial updates, as in the kernel: lenses are kept from
+// PARTIAL_SOURCES on, and sources from PARTIAL_FOREGROUNDS on
+enum
+{
+    PARTIAL_ALL = 0,
+    PARTIAL_SOURCES,
+    PARTIAL_FOREGROUNDS
+};
+
+// parameters that the object data and the cached rays and light of a shard
+// were computed for, so that partial updates only recompute objects whose
+// parameters changed
+struct partial
+{
+    // parameters of the object data, and flag for valid object data
+    double* set;
+    int set_valid;
+    
+    // parameters of the cached rays and light, and flag for valid caches
+    double* rendered;
+    int rendered_valid;
+    
+    // stage of the render kernel for the parameters that were last set
+    cl_ulong stage;
+};
+
+// band of image rows that is computed on one OpenCL device
+struct shard
+{
+    // first row and number of rows
+    size_t row0;
+    size_t rows;
+    
+    // device and worker queue
+    cl_device_id device_id;
+    cl_command_queue queue;
+    
+    // replicated data, quadrature rule and object buffers
+    cl_mem image_mem;
+    cl_mem weight_mem;
+    cl_mem psf_mem;
+    cl_mem noise_mem;
+    cl_mem qq_mem;
+    cl_mem ww_mem;
+    cl_mem object_mem;
+    
+    // lenses in tables, or NULL if there are none
+    cl_mem lenses_mem;
+    
+    // parameter kernel
+    cl_kernel set_params;
+    cl_mem params;
+    
+    // multipole tree kernel, or NULL if there are no trees
+    cl_kernel trees;
+    size_t trees_lws[1];
+    
+    // render kernel
+    cl_mem value_mem;
+    cl_mem error_mem;
+    cl_kernel render;
+    size_t render_lws[2];
+    size_t render_gws[2];
+    size_t render_off[2];
+    
+    // end row that bounds the render kernel, or zero if it has no bound
+    cl_ulong render_end;
+    
+    // rays of every quadrature point and light of sources that are cached
+    // for partial updates, or NULL if they are not used
+    struct partial* partial;
+    cl_mem rays_mem;
+    cl_mem light_mem;
+    
+    // rendering is done, for exchange of rows with other shards
+    cl_event rendered;
+    
+    // convolve kernel, and rows around the shard that it reads
+    cl_mem convolve_mem;
+    cl_kernel convolve;
+    size_t convolve_lws[2];
+    size_t convolve_gws[2];
+    size_t convolve_off[2];
+    size_t halo;
+    
+    // loglike kernel
+    cl_mem loglike_mem;
+    cl_kernel loglike;
+    size_t loglike_lws[1];
+    size_t loglike_gws[1];
+    size_t loglike_off[1];
+};
+
+// band of image rows for early termination of the likelihood
+struct chunk
+{
+    size_t row0;
+    size_t rows;
+};
+
+// image binned into square blocks of pixels, with the kernels that compare a
+// model on the blocks with it
+struct binned
+{
+    // number of pixels along the side of a block, and size of binned image
+    cl_ulong bin;
+    cl_ulong width;
+    cl_ulong height;
+    
+    // number of blocks that are not masked
+    size_t nblocks;
+    
+    // binned data, and model and chi^2 values on blocks
+    cl_mem image_mem;
+    cl_mem weight_mem;
+    cl_mem psf_mem;
+    cl_mem model_mem;
+    cl_mem loglike_mem;
+    
+    // kernels with one work item per block
+    cl_kernel render;
+    cl_kernel loglike;
+    size_t gws[2];
+};
+
+// cells of pixels that are binned to a target signal-to-noise ratio, each of
+// which is computed from a representative pixel
+struct cells
+{
+    // number of cells, and number of pixels that are computed
+    size_t ncells;
+    size_t nreps;
+    
+    // representative pixel of every pixel, list of pixels that are computed,
+    // and the unmasked pixels of every cell, starting at the given index
+    cl_uint* rep;
+    cl_uint* reps;
+    cl_uint* start;
+    cl_uint* pixels;
+    
+    // summed data and inverse summed variance of every cell
+    cl_float* image;
+    cl_float* weight;
+    
+    // buffers of the above on the device
+    cl_mem rep_mem;
+    cl_mem reps_mem;
+    cl_mem start_mem;
+    cl_mem pixels_mem;
+    cl_mem image_mem;
+    cl_mem weight_mem;
+    cl_mem loglike_mem;
+    
+    // kernels that compute the representative pixels, copy them to their
+    // cells, and compare the cells with the binned data
+    cl_kernel render;
+    size_t render_lws[1];
+    size_t render_gws[1];
+    cl_kernel fill;
+    size_t fill_gws[1];
+    cl_kernel loglike;
+    size_t loglike_gws[1];
+};
+
+// amplitude that enters the model linearly
+struct amplitude
+{
+    // index of parameter in the list of MultiNest, and flag for magnitudes
+    size_t index;
+    int mag;
+    
+    // parameter value for unit amplitude
+    double unit;
+    
+    // mean and inverse variance of a normal prior on the amplitude, or zero
+    // inverse variance for a flat prior
+    double mean;
+    double prec;
+};
+
+// linear amplitudes that are marginalised analytically, with the models and
+// kernels that solve for them
+struct linear
+{
+    // amplitudes, and parameters for the model of each amplitude
+    size_t namps;
+    struct amplitude* amps;
+    double* params;
+    
+    // models for unit amplitudes and for each amplitude at two, which become
+    // the data and the basis images
+    cl_mem models_mem;
+    cl_kernel basis;
+    size_t basis_gws[1];
+    
+    // weighted products of data and basis images
+    cl_mem gram_mem;
+    cl_kernel gram;
+    size_t gram_gws[2];
+    
+    // best-fit amplitudes, and chi^2 values of their residuals along rows
+    cl_mem fit_mem;
+    cl_mem resid_mem;
+    cl_kernel resid;
+    size_t resid_gws[1];
+};
+
+// source on a regular grid of pixels, which is solved for by regularised
+// least squares with conjugate gradients on the first shard
+struct pixels
+{
+    // number of source pixels along each side, regularisation, number of
+    // solver iterations between checks of convergence, and whether the solver
+    // failed to converge before
+    cl_ulong n;
+    cl_float lambda;
+    size_t niter;
+    int warned;
+    
+    // indices of the centre and half-width of the grid in the parameters
+    size_t ix;
+    size_t iy;
+    size_t ir;
+    
+    // cell and position within the cell of every quadrature node, and the
+    // nodes of every cell, which are listed by counting
+    cl_mem cell_mem;
+    cl_mem frac_mem;
+    cl_mem count_mem;
+    cl_mem start_mem;
+    cl_mem fill_mem;
+    cl_mem nodes_mem;
+    
+    // two images for the lensing and convolution operators
+    cl_mem tmp_mem[2];
+    
+    // vectors of the solver on the source pixels, and its scalar products,
+    // with the initial product of residual and preconditioned residual last
+    cl_mem b_mem;
+    cl_mem dinv_mem;
+    cl_mem x_mem;
+    cl_mem r_mem;
+    cl_mem z_mem;
+    cl_mem p_mem;
+    cl_mem q_mem;
+    cl_mem cg_mem;
+    
+    // kernels that build the lensing operator
+    cl_kernel trace;
+    cl_kernel scan;
+    cl_kernel sort;
+    
+    // kernels of the operators and the solver
+    cl_kernel map;
+    cl_kernel convolve;
+    cl_kernel gather;
+    cl_kernel dot;
+    cl_kernel energy;
+    cl_kernel init;
+    cl_kernel step;
+    cl_kernel direction;
+    cl_kernel residual;
+    cl_kernel add;
+    
+    // work sizes over pixels, nodes, rows and columns, and source pixels, and
+    // the single work group of the reductions
+    size_t image_gws[1];
+    size_t nodes_gws[1];
+    size_t convolve_gws[2];
+    size_t source_gws[1];
+    size_t reduce_lws[1];
+};
+
 struct lensed
 {
     // input data
@@ -9,12 +282,21 @@ struct lensed
     cl_float* image;
     cl_float* weight;
     
+    // number of bands that are stacked in the image, and the rows of margin
+    // above and below each band
+    size_t nbands;
+    size_t margin;
+    
     // parameter space
     size_t npars;
     size_t ndims;
     param** pars;
     size_t* pmap;
     
+    // type of the object of every parameter, in the order of MultiNest, for
+    // partial updates, or NULL if they are not used
+    int* partial;
+    
     // MultiNest tolerance
     double tol;
     
@@ -29,37 +311,91 @@ struct lensed
     double* ml;
     double* map;
     
-    // worker queue
-    cl_command_queue queue;
+    // range of the posterior samples of each parameter
+    double* lower;
+    double* upper;
     
-    // parameter kernel
-    cl_kernel set_params;
-    cl_mem params;
+    // log-volume of the priors of the current run relative to the priors of
+    // the configuration, which the pyramid narrows, and which is added to the
+    // log-evidence
+    double logvol;
     
-    // render kernel
-    cl_mem value_mem;
-    cl_mem error_mem;
-    cl_kernel render;
-    size_t render_lws[1];
-    size_t render_gws[1];
+    // native backend, or NULL for OpenCL
+    struct native* native;
     
-    // convolve kernel
-    cl_mem convolve_mem;
-    cl_kernel convolve;
-    size_t convolve_lws[2];
-    size_t convolve_gws[2];
+    // partitions of the image for OpenCL devices, repeated for each of the
+    // parameters in a batch
+    size_t nshards;
+    size_t nbatch;
+    struct shard* shards;
     
-    // loglike kernel
-    cl_mem loglike_mem;
-    cl_kernel loglike;
-    size_t loglike_lws[1];
-    size_t loglike_gws[1];
+    // broker that evaluates likelihoods for all processes on the node
+    struct broker* broker;
+    
+    // chunks of rows for early termination of the likelihood once it is
+    // below the threshold, and the rows that are rendered for a sample
+    double threshold;
+    size_t nchunks;
+    struct chunk* chunks;
+    char* rendered;
+    
+    // cells of pixels that are binned to a signal-to-noise ratio
+    struct cells* cells;
+    
+    // linear amplitudes that are marginalised
+    struct linear* linear;
+    
+    // pixelated source that is solved for
+    struct pixels* pixels;
+    
+    // screening of samples on a binned image before the full likelihood,
+    // with the noise margin of its chi^2 value, the largest error of the
+    // binned model and the number of samples that it was calibrated on, and
+    // the number of screened and skipped samples
+    struct binned* screen;
+    double screen_margin;
+    double screen_error;
+    unsigned long long screen_calib;
+    unsigned long long screen_count;
+    unsigned long long screen_skipped;
+    
+    // binned images for the coarse runs of the pyramid, from coarsest to
+    // finest, and the binned image of the current run, or NULL for the image
+    size_t nlevels;
+    struct binned** levels;
+    struct binned* level;
+    
+    // interpolated deflection field
+    struct {
+        double tol;
+        double cull;
+        double theta;
+        int level;
+        int warned;
+        unsigned long count;
+        cl_float4 bounds;
+        cl_float2 scale;
+        cl_command_queue queue;
+        cl_mem mem;
+        cl_kernel grid;
+        size_t grid_lws[1];
+        size_t grid_gws[1];
+        cl_mem points_mem;
+        cl_mem error_mem;
+        cl_kernel check;
+        size_t check_lws[1];
+        size_t check_gws[1];
+        cl_kernel multipole;
+        double multipole_error;
+    }* field;
     
     // profiling info
     struct {
         profile* map_params;
         profile* unmap_params;
         profile* set_params;
+        profile* field;
+        profile* screen;
         profile* render;
         profile* convolve;
         profile* loglike;
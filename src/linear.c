@@ -0,0 +1,383 @@
+#include <stdlib.h>
+#include <float.h>
+#include <math.h>
+
+#include "opencl.h"
+#include "input.h"
+#include "prior.h"
+#include "profile.h"
+#include "lensed.h"
+#include "linear.h"
+#include "log.h"
+
+// magnitude that is reported for objects without positive flux
+#define LINEAR_NO_FLUX 99
+
+struct linear* linear_create(const struct lensed* lensed, cl_context context,
+                             cl_program program)
+{
+    struct shard* shard = lensed->shards;
+    struct linear* linear;
+    cl_int err;
+    cl_ulong nvec;
+    double total;
+    size_t npix;
+    
+    linear = malloc(sizeof(struct linear));
+    if(!linear)
+        errori(NULL);
+    
+    // count linear amplitudes
+    linear->namps = 0;
+    for(size_t i = 0; i < lensed->npars; ++i)
+        if(lensed->pars[lensed->pmap[i]]->linear)
+            linear->namps += 1;
+    
+    linear->amps = malloc(linear->namps*sizeof(struct amplitude));
+    linear->params = malloc(lensed->npars*sizeof(double));
+    if(!linear->amps || !linear->params)
+        errori(NULL);
+    
+    // total flux of the data, so that basis images are comparable to it and
+    // do not get lost against the rest of the model
+    total = 0;
+    npix = 0;
+    for(size_t k = 0; k < lensed->size; ++k)
+    {
+        if(lensed->weight[k] > 0)
+        {
+            total += fabs(lensed->image[k]);
+            npix += 1;
+        }
+    }
+    if(!(total > 0))
+    {
+        total = lensed->size;
+        npix = lensed->size;
+    }
+    
+    for(size_t i = 0, a = 0; i < lensed->npars; ++i)
+    {
+        param* par = lensed->pars[lensed->pmap[i]];
+        struct amplitude* amp;
+        double m, s;
+        
+        if(!par->linear)
+            continue;
+        
+        amp = &linear->amps[a++];
+        
+        amp->index = i;
+        amp->mag = (par->type == PAR_MAGNITUDE);
+        
+        // magnitudes have unit amplitude at the total flux of the data, and
+        // all other amplitudes at its mean
+        amp->unit = amp->mag ? -2.5*log10(total) : total/npix;
+        
+        // normal priors carry over to the amplitude, to first order for
+        // magnitudes; all other priors are flat in the amplitude
+        amp->mean = 0;
+        amp->prec = 0;
+        if(prior_normal(par->pri, &m, &s))
+        {
+            if(amp->mag)
+            {
+                amp->mean = pow(10, -0.4*(m - amp->unit));
+                s = 0.4*log(10)*amp->mean*s;
+            }
+            else
+            {
+                amp->mean = m/amp->unit;
+                s = s/amp->unit;
+            }
+            amp->prec = 1/(s*s);
+        }
+        
+        verbose("    %s: %s prior", par->id, amp->prec > 0 ? "normal" : "flat");
+    }
+    
+    // data and one basis image per amplitude
+    nvec = linear->namps + 1;
+    
+    // buffers for models and their products
+    linear->models_mem = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS, nvec*lensed->size*sizeof(cl_float), NULL, NULL);
+    linear->gram_mem = clCreateBuffer(context, CL_MEM_WRITE_ONLY | CL_MEM_ALLOC_HOST_PTR | CL_MEM_HOST_READ_ONLY, nvec*nvec*lensed->height*sizeof(cl_float), NULL, NULL);
+    linear->fit_mem = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_ALLOC_HOST_PTR | CL_MEM_HOST_WRITE_ONLY, nvec*sizeof(cl_float), NULL, NULL);
+    linear->resid_mem = clCreateBuffer(context, CL_MEM_WRITE_ONLY | CL_MEM_ALLOC_HOST_PTR | CL_MEM_HOST_READ_ONLY, lensed->height*sizeof(cl_float), NULL, NULL);
+    if(!linear->models_mem || !linear->gram_mem || !linear->fit_mem || !linear->resid_mem)
+        error("failed to create linear amplitude buffers");
+    
+    // kernels for basis images and products
+    linear->basis = clCreateKernel(program, "linear_basis", &err);
+    if(err != CL_SUCCESS)
+        error("failed to create linear basis kernel");
+    
+    linear->gram = clCreateKernel(program, "linear_gram", &err);
+    if(err != CL_SUCCESS)
+        error("failed to create linear gram kernel");
+    
+    linear->resid = clCreateKernel(program, "linear_resid", &err);
+    if(err != CL_SUCCESS)
+        error("failed to create linear resid kernel");
+    
+    // set kernel arguments, the data is that of the first shard
+    err = 0;
+    err |= clSetKernelArg(linear->basis, 0, sizeof(cl_ulong), &nvec);
+    err |= clSetKernelArg(linear->basis, 1, sizeof(cl_mem), &shard->image_mem);
+    err |= clSetKernelArg(linear->basis, 2, sizeof(cl_mem), &linear->models_mem);
+    err |= clSetKernelArg(linear->gram, 0, sizeof(cl_ulong), &nvec);
+    err |= clSetKernelArg(linear->gram, 1, sizeof(cl_mem), &linear->models_mem);
+    err |= clSetKernelArg(linear->gram, 2, sizeof(cl_mem), &shard->weight_mem);
+    err |= clSetKernelArg(linear->gram, 3, sizeof(cl_mem), &linear->gram_mem);
+    err |= clSetKernelArg(linear->resid, 0, sizeof(cl_ulong), &nvec);
+    err |= clSetKernelArg(linear->resid, 1, sizeof(cl_mem), &linear->models_mem);
+    err |= clSetKernelArg(linear->resid, 2, sizeof(cl_mem), &shard->weight_mem);
+    err |= clSetKernelArg(linear->resid, 3, sizeof(cl_mem), &linear->fit_mem);
+    err |= clSetKernelArg(linear->resid, 4, sizeof(cl_mem), &linear->resid_mem);
+    if(err != CL_SUCCESS)
+        error("failed to set linear amplitude kernel arguments");
+    
+    // one work item per pixel, per pair of vectors and row, and per row
+    linear->basis_gws[0] = lensed->size;
+    linear->gram_gws[0] = nvec*nvec;
+    linear->gram_gws[1] = lensed->height;
+    linear->resid_gws[0] = lensed->height;
+    
+    return linear;
+}
+
+const double* linear_params(const struct lensed* lensed, const double* params,
+                            size_t v)
+{
+    struct linear* linear = lensed->linear;
+    
+    // copy parameters
+    for(size_t i = 0; i < lensed->npars; ++i)
+        linear->params[i] = params[i];
+    
+    // amplitudes at one, except for the amplitude of the vector at two
+    for(size_t a = 0; a < linear->namps; ++a)
+    {
+        const struct amplitude* amp = &linear->amps[a];
+        
+        if(a + 1 != v)
+            linear->params[amp->index] = amp->unit;
+        else if(amp->mag)
+            linear->params[amp->index] = amp->unit - 2.5*log10(2);
+        else
+            linear->params[amp->index] = 2*amp->unit;
+    }
+    
+    return linear->params;
+}
+
+void linear_store(const struct lensed* lensed, size_t v)
+{
+    struct shard* shard = lensed->shards;
+    
+    cl_int err;
+    
+    // size of one model
+    size_t len = lensed->size*sizeof(cl_float);
+    
+    // model is convolved if there is a PSF
+    err = clEnqueueCopyBuffer(shard->queue, shard->convolve ? shard->convolve_mem : shard->value_mem, lensed->linear->models_mem, 0, v*len, len, 0, NULL, NULL);
+    if(err != CL_SUCCESS)
+        error("failed to store model for linear amplitude");
+}
+
+double linear_chi2(const struct lensed* lensed, double* params)
+{
+    struct shard* shard = lensed->shards;
+    struct linear* linear = lensed->linear;
+    
+    size_t n = linear->namps;
+    size_t nvec = n + 1;
+    
+    cl_int err;
+    cl_float* gram;
+    cl_float* fit;
+    cl_float* resid;
+    
+    // products of data and basis images, normal matrix and its right-hand
+    // side
+    double* g;
+    double* m;
+    double* b;
+    
+    // log-determinants of normal matrix and prior
+    double logdet, logpri;
+    
+    double chi2;
+    
+    // turn models into data and basis images
+    err = clEnqueueNDRangeKernel(shard->queue, linear->basis, 1, NULL, linear->basis_gws, NULL, 0, NULL, NULL);
+    if(err != CL_SUCCESS)
+        error("failed to run linear basis kernel");
+    
+    // weighted products along rows
+    err = clEnqueueNDRangeKernel(shard->queue, linear->gram, 2, NULL, linear->gram_gws, NULL, 0, NULL, NULL);
+    if(err != CL_SUCCESS)
+        error("failed to run linear gram kernel");
+    
+    g = calloc(nvec*nvec + n*n + n, sizeof(double));
+    if(!g)
+        errori(NULL);
+    m = g + nvec*nvec;
+    b = m + n*n;
+    
+    // map products from device
+    gram = clEnqueueMapBuffer(shard->queue, linear->gram_mem, CL_TRUE, CL_MAP_READ, 0, nvec*nvec*lensed->height*sizeof(cl_float), 0, NULL, NULL, &err);
+    if(err != CL_SUCCESS)
+        error("failed to map linear gram buffer");
+    
+    // sum rows of upper triangle
+    for(size_t i = 0; i < nvec; ++i)
+        for(size_t j = i; j < nvec; ++j)
+            for(size_t r = 0; r < lensed->height; ++r)
+                g[i*nvec + j] += gram[(i*nvec + j)*lensed->height + r];
+    
+    clEnqueueUnmapMemObject(shard->queue, linear->gram_mem, gram, 0, NULL, NULL);
+    
+    // normal equations, with the data as the first vector
+    for(size_t i = 0; i < n; ++i)
+    {
+        b[i] = g[i + 1];
+        for(size_t j = i; j < n; ++j)
+            m[i*n + j] = m[j*n + i] = g[(i + 1)*nvec + j + 1];
+    }
+    
+    // add normal priors
+    logpri = 0;
+    for(size_t i = 0; i < n; ++i)
+    {
+        const struct amplitude* amp = &linear->amps[i];
+        
+        if(amp->prec > 0)
+        {
+            m[i*n + i] += amp->prec;
+            b[i] += amp->prec*amp->mean;
+            logpri += log(amp->prec);
+        }
+    }
+    
+    // amplitudes without any effect on the image are zero
+    for(size_t i = 0; i < n; ++i)
+    {
+        if(!(m[i*n + i] > 0))
+        {
+            for(size_t j = 0; j < n; ++j)
+                m[i*n + j] = m[j*n + i] = 0;
+            m[i*n + i] = 1;
+            b[i] = 0;
+        }
+    }
+    
+    // Cholesky decomposition of normal matrix, in its lower triangle
+    logdet = 0;
+    for(size_t j = 0; j < n; ++j)
+    {
+        double d = m[j*n + j];
+        for(size_t k = 0; k < j; ++k)
+            d -= m[j*n + k]*m[j*n + k];
+        
+        // amplitudes are degenerate
+        if(!(d > 0))
+        {
+            free(g);
+            return DBL_MAX;
+        }
+        
+        m[j*n + j] = sqrt(d);
+        logdet += log(d);
+        
+        for(size_t i = j + 1; i < n; ++i)
+        {
+            double s = m[i*n + j];
+            for(size_t k = 0; k < j; ++k)
+                s -= m[i*n + k]*m[j*n + k];
+            m[i*n + j] = s/m[j*n + j];
+        }
+    }
+    
+    // forward substitution
+    for(size_t i = 0; i < n; ++i)
+    {
+        for(size_t k = 0; k < i; ++k)
+            b[i] -= m[i*n + k]*b[k];
+        b[i] /= m[i*n + i];
+    }
+    
+    // back substitution, which gives the best-fit amplitudes
+    for(size_t i = n; i-- > 0;)
+    {
+        for(size_t k = i + 1; k < n; ++k)
+            b[i] -= m[k*n + i]*b[k];
+        b[i] /= m[i*n + i];
+    }
+    
+    // the chi^2 value at the best fit is computed from the residuals, since
+    // subtracting the products from the weighted sum of the squared data
+    // loses all precision in single precision for bright data
+    fit = clEnqueueMapBuffer(shard->queue, linear->fit_mem, CL_TRUE, CL_MAP_WRITE, 0, nvec*sizeof(cl_float), 0, NULL, NULL, &err);
+    if(err != CL_SUCCESS)
+        error("failed to map linear fit buffer");
+    for(size_t i = 0; i < n; ++i)
+        fit[i] = b[i];
+    clEnqueueUnmapMemObject(shard->queue, linear->fit_mem, fit, 0, NULL, NULL);
+    
+    err = clEnqueueNDRangeKernel(shard->queue, linear->resid, 1, NULL, linear->resid_gws, NULL, 0, NULL, NULL);
+    if(err != CL_SUCCESS)
+        error("failed to run linear resid kernel");
+    
+    resid = clEnqueueMapBuffer(shard->queue, linear->resid_mem, CL_TRUE, CL_MAP_READ, 0, lensed->height*sizeof(cl_float), 0, NULL, NULL, &err);
+    if(err != CL_SUCCESS)
+        error("failed to map linear resid buffer");
+    
+    chi2 = 0;
+    for(size_t r = 0; r < lensed->height; ++r)
+        chi2 += resid[r];
+    
+    clEnqueueUnmapMemObject(shard->queue, linear->resid_mem, resid, 0, NULL, NULL);
+    
+    // add normal priors at the best fit
+    for(size_t i = 0; i < n; ++i)
+    {
+        const struct amplitude* amp = &linear->amps[i];
+        
+        if(amp->prec > 0)
+            chi2 += amp->prec*(b[i] - amp->mean)*(b[i] - amp->mean);
+    }
+    
+    // report best-fit amplitudes as parameters
+    for(size_t i = 0; i < n; ++i)
+    {
+        const struct amplitude* amp = &linear->amps[i];
+        
+        if(!amp->mag)
+            params[amp->index] = b[i]*amp->unit;
+        else if(b[i] > 0)
+            params[amp->index] = amp->unit - 2.5*log10(b[i]);
+        else
+            params[amp->index] = LINEAR_NO_FLUX;
+    }
+    
+    free(g);
+    
+    // marginal likelihood is the Gaussian integral over the amplitudes
+    return chi2 + logdet - logpri;
+}
+
+void linear_free(struct linear* linear)
+{
+    clReleaseKernel(linear->basis);
+    clReleaseKernel(linear->gram);
+    clReleaseMemObject(linear->models_mem);
+    clReleaseMemObject(linear->gram_mem);
+    clReleaseKernel(linear->resid);
+    clReleaseMemObject(linear->fit_mem);
+    clReleaseMemObject(linear->resid_mem);
+    free(linear->amps);
+    free(linear->params);
+    free(linear);
+}
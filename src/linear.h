@@ -0,0 +1,22 @@
+#pragma once
+
+// collect the linear amplitudes among the parameters, and create the buffers
+// and kernels that solve for them on the first shard
+struct linear* linear_create(const struct lensed* lensed, cl_context context,
+                             cl_program program);
+
+// parameters for the model of the given vector: zero is the model with unit
+// amplitudes, and n is the model where amplitude n is at two
+const double* linear_params(const struct lensed* lensed, const double* params,
+                            size_t v);
+
+// store the model of the given vector, which was rendered on the first shard
+void linear_store(const struct lensed* lensed, size_t v);
+
+// solve for the amplitudes once all models are stored, and return -2 times
+// the log-likelihood marginalised over them; the best-fit amplitudes are
+// written to the parameters
+double linear_chi2(const struct lensed* lensed, double* params);
+
+// free linear amplitudes and their kernels
+void linear_free(struct linear* linear);
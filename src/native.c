@@ -0,0 +1,419 @@
+// provide POSIX standard in strict C99 mode
+#define _XOPEN_SOURCE 700
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <dlfcn.h>
+
+#include "opencl.h"
+#include "input.h"
+#include "kernel.h"
+#include "native.h"
+#include "log.h"
+#include "path.h"
+
+// default compiler and flags for native programs
+static const char NATIVE_CXX[] = "c++";
+static const char NATIVE_CXXFLAGS[] = "-O3 -march=native -fno-math-errno -fopenmp";
+
+// flags that are always needed to build a native program
+static const char NATIVE_BUILD[] = "-std=c++11 -fPIC -shared";
+
+// compatibility header for kernel code
+static const char NATIVE_HEADER[] = "kernel/native.h";
+
+// vector types that are used in vector literals
+static const char* NATIVE_VECTORS[] = {
+    "float2",
+    "float4",
+    "int2",
+    "mat22",
+    NULL
+};
+
+// swizzles that are provided as member functions
+static const char* NATIVE_SWIZZLES[] = {
+    "xy",
+    "zw",
+    "lo",
+    "hi",
+    NULL
+};
+
+// casts of object data to void pointers in address spaces
+static const char* NATIVE_VOIDPTRS[] = {
+    "(local void*)",
+    "(global void*)",
+    "(constant void*)",
+    "(private void*)",
+    NULL
+};
+
+// get compiler or flags from the environment, or use default
+static const char* native_env(const char* name, const char* def)
+{
+    const char* env = getenv(name);
+    return env && *env ? env : def;
+}
+
+// append text to the rewritten code, or only count its length if there is
+// no buffer
+static void native_put(char* out, size_t* len, const char* s, size_t n)
+{
+    if(out)
+        memcpy(out + *len, s, n);
+    *len += n;
+}
+
+// rewrite the constructs of kernel code that are not valid C++ into the
+// buffer, and return the length of the rewritten code; without a buffer, the
+// length is only counted
+static size_t native_rewrite(const char* src, char* out)
+{
+    size_t len = 0;
+    
+    while(*src)
+    {
+        int found = 0;
+        
+        if(*src == '(')
+        {
+            // vector literal `(type)(...)` becomes constructor `type(...)`
+            for(const char** v = NATIVE_VECTORS; !found && *v; ++v)
+            {
+                size_t n = strlen(*v);
+                if(strncmp(src + 1, *v, n) == 0 && src[n+1] == ')')
+                {
+                    const char* p = src + n + 2;
+                    while(isspace(*p))
+                        ++p;
+                    if(*p == '(')
+                    {
+                        native_put(out, &len, *v, n);
+                        src = p;
+                        found = 1;
+                    }
+                }
+            }
+            
+            // cast to void pointer becomes cast to any pointer
+            for(const char** v = NATIVE_VOIDPTRS; !found && *v; ++v)
+            {
+                size_t n = strlen(*v);
+                if(strncmp(src, *v, n) == 0)
+                {
+                    native_put(out, &len, "(anyptr)", strlen("(anyptr)"));
+                    src += n;
+                    found = 1;
+                }
+            }
+        }
+        else if(*src == '.')
+        {
+            // swizzle `.xy` becomes member function call `.xy()`
+            for(const char** v = NATIVE_SWIZZLES; !found && *v; ++v)
+            {
+                size_t n = strlen(*v);
+                if(strncmp(src + 1, *v, n) == 0 && !isalnum(src[n+1]) && src[n+1] != '_')
+                {
+                    native_put(out, &len, ".", 1);
+                    native_put(out, &len, *v, n);
+                    native_put(out, &len, "()", 2);
+                    src += n + 1;
+                    found = 1;
+                }
+            }
+        }
+        
+        // copy everything else
+        if(!found)
+            native_put(out, &len, src++, 1);
+    }
+    
+    return len;
+}
+
+// rewrite kernel code into a new buffer that is large enough for it
+static char* native_source(const char* src)
+{
+    // first pass counts the length of the rewritten code
+    size_t len = native_rewrite(src, NULL);
+    
+    char* buf = malloc(len + 1);
+    if(!buf)
+        errori(NULL);
+    
+    native_rewrite(src, buf);
+    buf[len] = '\0';
+    
+    return buf;
+}
+
+// compile kernel code to shared object and load it
+// remove the files and the temporary directory of a build
+static void native_clean(const char* dir, const char* cpp, const char* so,
+                         const char* log)
+{
+    unlink(cpp);
+    unlink(so);
+    unlink(log);
+    rmdir(dir);
+}
+
+static void* native_build(size_t nkernels, const char* kernels[], const char* options)
+{
+    const char* tmp;
+    char* dir;
+    char* cpp;
+    char* so;
+    char* log;
+    char* cmd;
+    size_t len;
+    FILE* file;
+    int status;
+    void* handle;
+    
+    const char* cxx = native_env("LENSED_CXX", NATIVE_CXX);
+    const char* cxxflags = native_env("LENSED_CXXFLAGS", NATIVE_CXXFLAGS);
+    
+    // temporary directory for build
+    tmp = native_env("TMPDIR", "/tmp");
+    dir = malloc(strlen(tmp) + strlen("/lensed-XXXXXX") + 1);
+    if(!dir)
+        errori(NULL);
+    sprintf(dir, "%s/lensed-XXXXXX", tmp);
+    if(!mkdtemp(dir))
+        error("could not create directory for native program in %s", tmp);
+    
+    // files for build
+    cpp = malloc(strlen(dir) + strlen("/program.cpp") + 1);
+    so = malloc(strlen(dir) + strlen("/program.so") + 1);
+    log = malloc(strlen(dir) + strlen("/build.log") + 1);
+    if(!cpp || !so || !log)
+        errori(NULL);
+    sprintf(cpp, "%s/program.cpp", dir);
+    sprintf(so, "%s/program.so", dir);
+    sprintf(log, "%s/build.log", dir);
+    
+    // write rewritten kernel code
+    file = fopen(cpp, "w");
+    if(!file)
+    {
+        int err = errno;
+        rmdir(dir);
+        errno = err;
+        errori("could not write %s", cpp);
+    }
+    for(size_t i = 0; i < nkernels; ++i)
+    {
+        char* src = native_source(kernels[i]);
+        fputs(src, file);
+        free(src);
+    }
+    fclose(file);
+    
+    // build command, only macro definitions are taken from the options
+    len = strlen(cxx) + strlen(NATIVE_BUILD) + strlen(cxxflags)
+        + strlen(LENSED_PATH) + strlen(NATIVE_HEADER) + strlen(options)
+        + strlen(so) + strlen(cpp) + strlen(log) + 64;
+    cmd = malloc(len);
+    if(!cmd)
+        errori(NULL);
+    len = sprintf(cmd, "%s %s %s -include \"%s%s\"", cxx, NATIVE_BUILD, cxxflags, LENSED_PATH, NATIVE_HEADER);
+    for(const char* o = options; *o;)
+    {
+        size_t n;
+        
+        while(isspace(*o))
+            ++o;
+        n = strcspn(o, " \t\n");
+        if(n > 2 && strncmp(o, "-D", 2) == 0)
+            len += sprintf(cmd + len, " %.*s", (int)n, o);
+        o += n;
+    }
+    sprintf(cmd + len, " -o \"%s\" \"%s\" > \"%s\" 2>&1", so, cpp, log);
+    
+    // compile, and show the compiler output if the build fails or gives
+    // warnings
+    status = system(cmd);
+    if(LOG_LEVEL <= LOG_VERBOSE)
+    {
+        char buf[4096] = {0};
+        
+        file = fopen(log, "r");
+        if(file)
+        {
+            len = fread(buf, 1, sizeof(buf) - 1, file);
+            buf[len] = '\0';
+            fclose(file);
+        }
+        
+        if(status != 0 || *buf)
+        {
+            verbose("build command: %s", cmd);
+            verbose("build log: %s", buf);
+        }
+    }
+    
+    // load program if it was built
+    handle = status == 0 ? dlopen(so, RTLD_NOW | RTLD_LOCAL) : NULL;
+    
+    // the loaded program does not need its files, and a failed build leaves
+    // nothing behind
+    native_clean(dir, cpp, so, log);
+    
+    if(status != 0)
+        error("failed to build native program%s", LOG_LEVEL > LOG_VERBOSE ? " (use --verbose to see build log)" : "");
+    if(!handle)
+        error("failed to load native program: %s", dlerror());
+    
+    free(cmd);
+    free(log);
+    free(so);
+    free(cpp);
+    free(dir);
+    
+    return handle;
+}
+
+// look up function in native program
+static void* native_symbol(void* handle, const char* name)
+{
+    void* sym = dlsym(handle, name);
+    if(!sym)
+        error("native program: missing function %s", name);
+    return sym;
+}
+
+int native_device(const char* device)
+{
+    return device && strcmp(device, NATIVE_DEVICE) == 0;
+}
+
+const char* native_compiler()
+{
+    return native_env("LENSED_CXX", NATIVE_CXX);
+}
+
+void native_object(const char* name, cl_int* type, cl_ulong* size,
+                   cl_ulong* npar, cl_char16** names, cl_int** types,
+                   cl_float2** bounds, cl_float** defvals)
+{
+    size_t nkernels;
+    const char** kernels;
+    const char* options;
+    void* handle;
+    char* kernam;
+    
+    // kernels of object program
+    void (*meta)(cl_int*, cl_ulong*, cl_ulong*);
+    void (*params)(cl_char16*, cl_int*, cl_float2*, cl_float*);
+    void (*work_item)(size_t);
+    
+    // load and build object program without image
+    {
+        // this is to satisfy the preprocessor
+        const char* build_flags[] = { 0 };
+        
+        object_program(name, &nkernels, &kernels);
+        options = kernel_options(0, 0, 0, 0, 0, 0, build_flags);
+        handle = native_build(nkernels, kernels, options);
+        
+        for(size_t i = 0; i < nkernels; ++i)
+            free((void*)kernels[i]);
+        free(kernels);
+        free((char*)options);
+    }
+    
+    // get metadata
+    kernam = kernel_name("meta_", name);
+    *(void**)&meta = native_symbol(handle, kernam);
+    meta(type, size, npar);
+    free(kernam);
+    
+    // arrays for parameter information
+    *names   = malloc(*npar*sizeof(cl_char16));
+    *types   = malloc(*npar*sizeof(cl_int));
+    *bounds  = malloc(*npar*sizeof(cl_float2));
+    *defvals = malloc(*npar*sizeof(cl_float));
+    if(!*names || !*types || !*bounds || !*defvals)
+        errori("object %s", name);
+    
+    // get parameter information, one work item per parameter
+    kernam = kernel_name("params_", name);
+    *(void**)&params = native_symbol(handle, kernam);
+    *(void**)&work_item = native_symbol(handle, "native_work_item");
+    for(size_t i = 0; i < *npar; ++i)
+    {
+        work_item(i);
+        params(*names, *types, *bounds, *defvals);
+    }
+    free(kernam);
+    
+    dlclose(handle);
+}
+
+struct native* native_program(size_t nkernels, const char* kernels[],
+                              const char* options)
+{
+    struct native* native = malloc(sizeof(struct native));
+    if(!native)
+        errori(NULL);
+    
+    // build program
+    native->handle = native_build(nkernels, kernels, options);
+    
+    // get entry points
+    *(void**)&native->set_params = native_symbol(native->handle, "native_set_params");
+    *(void**)&native->render = native_symbol(native->handle, "native_render");
+    *(void**)&native->convolve = native_symbol(native->handle, "native_convolve");
+    *(void**)&native->loglike = native_symbol(native->handle, "native_loglike");
+    
+    // buffers are set up by caller
+    native->dsiz = 0;
+    native->data = NULL;
+    native->params = NULL;
+    native->qq = NULL;
+    native->ww = NULL;
+    native->image = NULL;
+    native->weight = NULL;
+    native->psf = NULL;
+    native->value = NULL;
+    native->error = NULL;
+    native->convolved = NULL;
+    native->chi2 = NULL;
+    
+    return native;
+}
+
+double native_compute(struct native* native)
+{
+    // set parameters
+    native->set_params(native->dsiz, native->data, native->params);
+    
+    // simulate objects
+    native->render(native->dsiz, native->data, native->pcs.s, (const cl_float*)native->qq, (const cl_float*)native->ww, native->value, native->error);
+    
+    // convolve with PSF if given
+    if(native->psf)
+        native->convolve(native->value, native->psf, native->convolved);
+    
+    // compare with observed image
+    return native->loglike(native->image, native->weight, native->psf ? native->convolved : native->value, native->chi2);
+}
+
+void native_free(struct native* native)
+{
+    free(native->data);
+    free(native->params);
+    free(native->value);
+    free(native->error);
+    free(native->convolved);
+    free(native->chi2);
+    dlclose(native->handle);
+    free(native);
+}
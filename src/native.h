@@ -0,0 +1,61 @@
+#pragma once
+
+// name of the device option that selects the native backend
+#define NATIVE_DEVICE "native"
+
+// native program compiled from the kernel code
+struct native
+{
+    // loaded shared object
+    void* handle;
+    
+    // entry points of the program
+    void (*set_params)(size_t, cl_uint*, const cl_float*);
+    void (*render)(size_t, const cl_uint*, const cl_float*, const cl_float*, const cl_float*, cl_float*, cl_float*);
+    void (*convolve)(const cl_float*, const cl_float*, cl_float*);
+    double (*loglike)(const cl_float*, const cl_float*, const cl_float*, cl_float*);
+    
+    // object data
+    size_t dsiz;
+    cl_uint* data;
+    
+    // parameters
+    cl_float* params;
+    
+    // pixel coordinate system and quadrature rule
+    cl_float4 pcs;
+    const cl_float2* qq;
+    const cl_float2* ww;
+    
+    // observed data, weights and PSF
+    const cl_float* image;
+    const cl_float* weight;
+    const cl_float* psf;
+    
+    // computed images
+    cl_float* value;
+    cl_float* error;
+    cl_float* convolved;
+    cl_float* chi2;
+};
+
+// check if device selects the native backend
+int native_device(const char* device);
+
+// compiler command that is used for native programs
+const char* native_compiler();
+
+// get metadata and parameter information of object using native code
+void native_object(const char* name, cl_int* type, cl_ulong* size,
+                   cl_ulong* npar, cl_char16** names, cl_int** types,
+                   cl_float2** bounds, cl_float** defvals);
+
+// build native program from kernel code, using the given build options
+struct native* native_program(size_t nkernels, const char* kernels[],
+                              const char* options);
+
+// compute image for the current parameters and return its chi^2 value
+double native_compute(struct native* native);
+
+// free native program and its buffers
+void native_free(struct native* native);
@@ -13,6 +13,364 @@
 #include "nested.h"
 #include "log.h"
 #include "ds9.h"
+#include "field.h"
+#include "native.h"
+#include "broker.h"
+#include "binned.h"
+#include "voronoi.h"
+#include "linear.h"
+#include "pixels.h"
+
+// samples that are computed both on the binned and the full image before the
+// screening starts, to calibrate the error of the binned model
+#define SCREEN_CALIBRATE 100
+
+// factor of the largest calibrated error of the binned model in the bound
+#define SCREEN_SAFETY 2
+
+// stage of a partial update from the old parameters, or NULL if there are
+// none, to the new parameters: only objects of types whose parameters changed
+// are computed again
+static cl_ulong partial_stage(const struct lensed* lensed, const double* old,
+                              const double* params)
+{
+    cl_ulong stage = PARTIAL_FOREGROUNDS;
+    
+    if(!old)
+        return PARTIAL_ALL;
+    
+    for(size_t i = 0; i < lensed->npars; ++i)
+    {
+        if(params[i] == old[i])
+            continue;
+        if(lensed->partial[i] == OBJ_LENS)
+            return PARTIAL_ALL;
+        if(lensed->partial[i] == OBJ_SOURCE)
+            stage = PARTIAL_SOURCES;
+    }
+    
+    return stage;
+}
+
+// simulate objects on a shard, keeping an event for the exchange of rows
+static void render_shard(struct lensed* lensed, struct shard* shard, cl_event* event)
+{
+    cl_int err;
+    
+    // render with the stage of the partial update, after which the caches
+    // hold the parameters that were last set
+    if(shard->partial)
+    {
+        struct partial* partial = shard->partial;
+        
+        clSetKernelArg(shard->render, 12, sizeof(cl_ulong), &partial->stage);
+        
+        for(size_t i = 0; i < lensed->npars; ++i)
+            partial->rendered[i] = partial->set[i];
+        partial->rendered_valid = 1;
+    }
+    
+    // other shards need to know when rows are ready for convolution
+    if(lensed->nshards > 1 && shard->convolve)
+    {
+        if(shard->rendered)
+            clReleaseEvent(shard->rendered);
+        event = &shard->rendered;
+    }
+    
+    err = clEnqueueNDRangeKernel(shard->queue, shard->render, 2, shard->render_off, shard->render_gws, shard->render_lws, 0, NULL, event);
+    if(err != CL_SUCCESS)
+        error("failed to run render kernel");
+    
+    // start rendering while other shards are set up
+    clFlush(shard->queue);
+}
+
+// copy the rows around a shard that are covered by the PSF from other shards
+// of the same set
+static void exchange_rows(struct lensed* lensed, struct shard* set, struct shard* shard)
+{
+    cl_int err;
+    
+    // rows that are read by the convolution
+    size_t lo = shard->row0 > shard->halo ? shard->row0 - shard->halo : 0;
+    size_t hi = shard->row0 + shard->rows + shard->halo;
+    if(hi > lensed->height)
+        hi = lensed->height;
+    
+    for(size_t t = 0; t < lensed->nshards; ++t)
+    {
+        struct shard* other = &set[t];
+        
+        // rows of other shard that are read
+        size_t r0 = other->row0 > lo ? other->row0 : lo;
+        size_t r1 = other->row0 + other->rows < hi ? other->row0 + other->rows : hi;
+        
+        if(other == shard || r0 >= r1)
+            continue;
+        
+        // copy rows once the other shard has rendered them
+        err = clEnqueueCopyBuffer(shard->queue, other->value_mem, shard->value_mem, r0*lensed->width*sizeof(cl_float), r0*lensed->width*sizeof(cl_float), (r1 - r0)*lensed->width*sizeof(cl_float), 1, &other->rendered, NULL);
+        if(err != CL_SUCCESS)
+            error("failed to exchange rows between shards");
+    }
+}
+
+// set parameters on a shard
+static void set_params(struct lensed* lensed, struct shard* shard, const double* params,
+                       cl_event* map_params_ev, cl_event* unmap_params_ev,
+                       cl_event* set_params_ev, cl_event* field_ev)
+{
+    cl_int err = 0;
+    
+    // objects whose parameters did not change since they were last set are
+    // kept by partial updates
+    cl_ulong stage = PARTIAL_ALL;
+    if(shard->partial)
+    {
+        struct partial* partial = shard->partial;
+        
+        stage = partial_stage(lensed, partial->set_valid ? partial->set : NULL, params);
+        partial->stage = partial_stage(lensed, partial->rendered_valid ? partial->rendered : NULL, params);
+        
+        for(size_t i = 0; i < lensed->npars; ++i)
+            partial->set[i] = params[i];
+        partial->set_valid = 1;
+        
+        // rays are traced again when the deflection field changes
+        if(lensed->field && stage == PARTIAL_ALL)
+            partial->stage = PARTIAL_ALL;
+        
+        err |= clSetKernelArg(shard->set_params, 5, sizeof(cl_ulong), &stage);
+    }
+    
+    // map parameter space on device
+    cl_float* p = clEnqueueMapBuffer(shard->queue, shard->params, CL_TRUE, CL_MAP_WRITE, 0, lensed->npars*sizeof(cl_float), 0, NULL, map_params_ev, &err);
+    
+    // copy parameters to device using map
+    for(size_t i = 0; i < lensed->npars; ++i)
+        p[lensed->pmap[i]] = params[i];
+    
+    // done with parameter space
+    clEnqueueUnmapMemObject(shard->queue, shard->params, p, 0, NULL, unmap_params_ev);
+    
+    // set parameters
+    err |= clEnqueueTask(shard->queue, shard->set_params, 0, NULL, set_params_ev);
+    
+    // build multipole trees, unless the lenses are kept
+    if(shard->trees && stage == PARTIAL_ALL)
+        err |= clEnqueueNDRangeKernel(shard->queue, shard->trees, 1, NULL, shard->trees_lws, shard->trees_lws, 0, NULL, NULL);
+    
+    // check for errors
+    if(err != CL_SUCCESS)
+        error("failed to set parameters");
+    
+    // compute deflection field if enabled, unless the lenses are kept
+    if(lensed->field && stage == PARTIAL_ALL)
+        field_update(lensed, field_ev);
+}
+
+// set parameters and simulate objects on a set of shards
+static void set_shards(struct lensed* lensed, struct shard* set, const double* params,
+                       cl_event* map_params_ev, cl_event* unmap_params_ev,
+                       cl_event* set_params_ev, cl_event* field_ev,
+                       cl_event* render_ev)
+{
+    for(size_t s = 0; s < lensed->nshards; ++s)
+    {
+        set_params(lensed, &set[s], params, map_params_ev, unmap_params_ev, set_params_ev, field_ev);
+        render_shard(lensed, &set[s], render_ev);
+    }
+}
+
+// convolve and compare with observed image on a set of shards
+static void compare_shards(struct lensed* lensed, struct shard* set,
+                           cl_event* convolve_ev, cl_event* loglike_ev)
+{
+    cl_int err;
+    
+    for(size_t s = 0; s < lensed->nshards; ++s)
+    {
+        struct shard* shard = &set[s];
+        
+        // convolve with PSF if given
+        if(shard->convolve)
+        {
+            // get rows covered by the PSF from other shards
+            exchange_rows(lensed, set, shard);
+            
+            err = clEnqueueNDRangeKernel(shard->queue, shard->convolve, 2, shard->convolve_off, shard->convolve_gws, shard->convolve_lws, 0, NULL, convolve_ev);
+            if(err != CL_SUCCESS)
+                error("failed to run convolve kernel");
+        }
+        
+        // compare with observed image
+        err = clEnqueueNDRangeKernel(shard->queue, shard->loglike, 1, shard->loglike_off, shard->loglike_gws, shard->loglike_lws, 0, NULL, loglike_ev);
+        if(err != CL_SUCCESS)
+            error("failed to run loglike kernel");
+        
+        // start working while other shards are set up
+        clFlush(shard->queue);
+    }
+}
+
+// sum chi^2 values of a set of shards
+static double sum_shards(struct lensed* lensed, struct shard* set,
+                         cl_event* map_loglike_mem_ev,
+                         cl_event* unmap_loglike_mem_ev)
+{
+    cl_int err;
+    double chi2 = 0.0;
+    
+    for(size_t s = 0; s < lensed->nshards; ++s)
+    {
+        struct shard* shard = &set[s];
+        
+        // pixels of the shard
+        size_t off = shard->row0*lensed->width;
+        size_t len = shard->rows*lensed->width;
+        
+        // map chi^2 values from device
+        cl_float* loglike = clEnqueueMapBuffer(shard->queue, shard->loglike_mem, CL_TRUE, CL_MAP_READ, off*sizeof(cl_float), len*sizeof(cl_float), 0, NULL, map_loglike_mem_ev, &err);
+        if(err != CL_SUCCESS)
+            error("failed to map loglike buffer");
+        
+        // sum chi^2 value
+        for(size_t i = 0; i < len; ++i)
+            chi2 += loglike[i];
+        
+        // unmap result
+        clEnqueueUnmapMemObject(shard->queue, shard->loglike_mem, loglike, 0, NULL, unmap_loglike_mem_ev);
+    }
+    
+    return chi2;
+}
+
+// simulate objects on a range of rows of a shard
+static void render_rows(struct shard* shard, size_t a, size_t b)
+{
+    cl_int err;
+    
+    size_t off[2] = { 0, a };
+    size_t gws[2] = { shard->render_gws[0], b - a };
+    
+    // padded rows are cut off by the end row, if the kernel has one
+    if(shard->render_end)
+    {
+        cl_ulong end = b;
+        gws[1] += (shard->render_lws[1] - gws[1]%shard->render_lws[1])%shard->render_lws[1];
+        clSetKernelArg(shard->render, 9, sizeof(cl_ulong), &end);
+    }
+    
+    // rows use the caches of partial updates, which are then only valid for
+    // some rows
+    if(shard->partial)
+    {
+        clSetKernelArg(shard->render, 12, sizeof(cl_ulong), &shard->partial->stage);
+        shard->partial->rendered_valid = 0;
+    }
+    
+    err = clEnqueueNDRangeKernel(shard->queue, shard->render, 2, off, gws, shard->render_lws, 0, NULL, NULL);
+    if(err != CL_SUCCESS)
+        error("failed to run render kernel");
+}
+
+// compute chi^2 value in chunks of rows, and stop once the partial sum is
+// above the bound; all terms are positive, so that the partial sum is a lower
+// bound for the chi^2 value
+static double chunked_chi2(struct lensed* lensed, const double* params, int set, double bound)
+{
+    struct shard* shard = lensed->shards;
+    
+    // rows around a chunk that are read by the convolution
+    size_t halo = shard->convolve ? shard->halo : 0;
+    
+    cl_int err;
+    double chi2 = 0;
+    
+    // set parameters, unless they are already set
+    if(!set)
+        set_params(lensed, shard, params, NULL, NULL, NULL, NULL);
+    
+    // no rows are simulated yet
+    memset(lensed->rendered, 0, lensed->height);
+    
+    for(size_t c = 0; c < lensed->nchunks && chi2 <= bound; ++c)
+    {
+        struct chunk* chunk = &lensed->chunks[c];
+        
+        // rows that are needed for chunk
+        size_t lo = chunk->row0 > halo ? chunk->row0 - halo : 0;
+        size_t hi = chunk->row0 + chunk->rows + halo;
+        if(hi > lensed->height)
+            hi = lensed->height;
+        
+        // simulate objects on runs of rows that are missing
+        for(size_t a = lo; a < hi;)
+        {
+            size_t b = a;
+            while(b < hi && !lensed->rendered[b])
+                lensed->rendered[b++] = 1;
+            if(b > a)
+                render_rows(shard, a, b);
+            a = b + 1;
+        }
+        
+        // convolve rows of chunk
+        if(shard->convolve)
+        {
+            size_t off[2] = { 0, chunk->row0 };
+            size_t gws[2] = { shard->convolve_gws[0], chunk->rows };
+            gws[1] += (shard->convolve_lws[1] - gws[1]%shard->convolve_lws[1])%shard->convolve_lws[1];
+            
+            err = clEnqueueNDRangeKernel(shard->queue, shard->convolve, 2, off, gws, shard->convolve_lws, 0, NULL, NULL);
+            if(err != CL_SUCCESS)
+                error("failed to run convolve kernel");
+        }
+        
+        // compare pixels of chunk with observed image
+        {
+            size_t off = chunk->row0*lensed->width;
+            size_t len = chunk->rows*lensed->width;
+            size_t gws = len + (shard->loglike_lws[0] - len%shard->loglike_lws[0])%shard->loglike_lws[0];
+            cl_float* loglike;
+            
+            err = clEnqueueNDRangeKernel(shard->queue, shard->loglike, 1, &off, &gws, shard->loglike_lws, 0, NULL, NULL);
+            if(err != CL_SUCCESS)
+                error("failed to run loglike kernel");
+            
+            // map chi^2 values of chunk from device
+            loglike = clEnqueueMapBuffer(shard->queue, shard->loglike_mem, CL_TRUE, CL_MAP_READ, off*sizeof(cl_float), len*sizeof(cl_float), 0, NULL, NULL, &err);
+            if(err != CL_SUCCESS)
+                error("failed to map loglike buffer");
+            
+            // add chi^2 values of chunk
+            for(size_t i = 0; i < len; ++i)
+                chi2 += loglike[i];
+            
+            clEnqueueUnmapMemObject(shard->queue, shard->loglike_mem, loglike, 0, NULL, NULL);
+        }
+    }
+    
+    // restore bound of render kernel for whole shard
+    if(shard->render_end)
+        clSetKernelArg(shard->render, 9, sizeof(cl_ulong), &shard->render_end);
+    
+    return chi2;
+}
+
+// record the error of the binned model from a sample that was computed on
+// both images: the chi^2 value of the exact binned model is never larger than
+// that of the image, so by the triangle inequality the square root of the
+// binned chi^2 value exceeds that of the image by at most the norm of the
+// error of the binned model
+static void screen_calibrate(struct lensed* lensed, double screen_chi2, double chi2)
+{
+    double e = sqrt(screen_chi2) - sqrt(chi2);
+    if(e > lensed->screen_error)
+        lensed->screen_error = e;
+    lensed->screen_calib += 1;
+}
 
 void loglike(double cube[], int* ndim, int* npar, double* lnew, void* lensed_)
 {
@@ -21,23 +379,18 @@ void loglike(double cube[], int* ndim, int* npar, double* lnew, void* lensed_)
     cl_event* map_params_ev        = NULL;
     cl_event* unmap_params_ev      = NULL;
     cl_event* set_params_ev        = NULL;
+    cl_event* field_ev             = NULL;
     cl_event* render_ev            = NULL;
+    cl_event* fill_ev              = NULL;
     cl_event* convolve_ev          = NULL;
     cl_event* loglike_ev           = NULL;
     cl_event* map_loglike_mem_ev   = NULL;
     cl_event* unmap_loglike_mem_ev = NULL;
     
-    if(lensed->profile)
-    {
-        map_params_ev        = profile_event();
-        unmap_params_ev      = profile_event();
-        set_params_ev        = profile_event();
-        render_ev            = profile_event();
-        convolve_ev          = profile_event();
-        loglike_ev           = profile_event();
-        map_loglike_mem_ev   = profile_event();
-        unmap_loglike_mem_ev = profile_event();
-    }
+    // parameters are set on the first shard by the screening, which then
+    // keeps the chi^2 value of the binned image
+    int set = 0;
+    double screen_chi2 = 0;
     
     // transform from unit cube to physical
     for(size_t i = 0; i < *npar; ++i)
@@ -60,69 +413,205 @@ void loglike(double cube[], int* ndim, int* npar, double* lnew, void* lensed_)
         cube[i] = phys;
     }
     
-    // error flag
-    cl_int err = 0;
+    // broker computes for all processes on the node
+    if(lensed->broker)
+    {
+        *lnew = broker_request(lensed->broker, cube);
+        return;
+    }
     
-    // map parameter space on device
-    cl_float* params = clEnqueueMapBuffer(lensed->queue, lensed->params, CL_TRUE, CL_MAP_WRITE, 0, lensed->npars*sizeof(cl_float), 0, NULL, map_params_ev, &err);
+    // native backend computes on the host
+    if(lensed->native)
+    {
+        // copy parameters
+        for(size_t i = 0; i < lensed->npars; ++i)
+            lensed->native->params[lensed->pmap[i]] = cube[i];
+        
+        // compute image and set log-likelihood
+        *lnew = -0.5*native_compute(lensed->native);
+        
+        return;
+    }
     
-    // copy parameters to device using map
-    for(size_t i = 0; i < lensed->npars; ++i)
-        params[lensed->pmap[i]] = cube[i];
+    // render a model for every linear amplitude, and marginalise them
+    if(lensed->linear)
+    {
+        struct shard* shard = lensed->shards;
+        cl_int err;
+        
+        for(size_t v = 0; v <= lensed->linear->namps; ++v)
+        {
+            set_params(lensed, shard, linear_params(lensed, cube, v), NULL, NULL, NULL, NULL);
+            render_shard(lensed, shard, NULL);
+            
+            // convolve with PSF if given
+            if(shard->convolve)
+            {
+                err = clEnqueueNDRangeKernel(shard->queue, shard->convolve, 2, shard->convolve_off, shard->convolve_gws, shard->convolve_lws, 0, NULL, NULL);
+                if(err != CL_SUCCESS)
+                    error("failed to run convolve kernel");
+            }
+            
+            linear_store(lensed, v);
+        }
+        
+        // best-fit amplitudes are stored as derived parameters
+        *lnew = -0.5*linear_chi2(lensed, cube);
+        
+        return;
+    }
     
-    // done with parameter space
-    clEnqueueUnmapMemObject(lensed->queue, lensed->params, params, 0, NULL, unmap_params_ev);
+    // render the rest of the model, and solve for the pixelated source
+    if(lensed->pixels)
+    {
+        set_params(lensed, lensed->shards, cube, NULL, NULL, NULL, NULL);
+        render_shard(lensed, lensed->shards, NULL);
+        *lnew = -0.5*pixels_chi2(lensed, cube);
+        return;
+    }
     
-    // set parameters
-    err |= clEnqueueTask(lensed->queue, lensed->set_params, 0, NULL, set_params_ev);
+    // coarse runs of the pyramid compare with a binned image
+    if(lensed->level)
+    {
+        set_params(lensed, lensed->shards, cube, NULL, NULL, NULL, NULL);
+        *lnew = -0.5*binned_chi2(lensed, lensed->level, NULL, NULL);
+        return;
+    }
     
-    // check for errors
-    if(err != CL_SUCCESS)
-        error("failed to set parameters");
+    // screen samples on the binned image, and skip those that cannot be
+    // accepted even if the margin is taken off once there is a threshold and
+    // the error of the binned model is calibrated
+    if(lensed->screen)
+    {
+        cl_event* screen_render_ev  = NULL;
+        cl_event* screen_loglike_ev = NULL;
+        
+        if(lensed->profile)
+        {
+            screen_render_ev  = profile_event();
+            screen_loglike_ev = profile_event();
+        }
+        
+        set_params(lensed, lensed->shards, cube, NULL, NULL, NULL, NULL);
+        screen_chi2 = binned_chi2(lensed, lensed->screen, screen_render_ev, screen_loglike_ev);
+        set = 1;
+        
+        if(lensed->profile)
+        {
+            profile_read(lensed->profile->screen, screen_render_ev);
+            profile_read(lensed->profile->screen, screen_loglike_ev);
+        }
+        
+        if(lensed->threshold > -DBL_MAX && lensed->screen_calib >= SCREEN_CALIBRATE)
+        {
+            // lower bound for the chi^2 value of the image
+            double d = sqrt(screen_chi2) - SCREEN_SAFETY*lensed->screen_error;
+            double bound = (d > 0 ? d*d : 0) - lensed->screen_margin;
+            
+            lensed->screen_count += 1;
+            
+            if(bound > -2*lensed->threshold)
+            {
+                lensed->screen_skipped += 1;
+                *lnew = -0.5*bound;
+                return;
+            }
+        }
+    }
     
-    // simulate objects
-    err = clEnqueueNDRangeKernel(lensed->queue, lensed->render, 1, NULL, lensed->render_gws, lensed->render_lws, 0, NULL, render_ev);
-    if(err != CL_SUCCESS)
-        error("failed to run render kernel");
+    // compare cells of binned pixels with the binned data
+    if(lensed->cells)
+    {
+        if(lensed->profile)
+        {
+            set_params_ev = profile_event();
+            field_ev      = profile_event();
+            render_ev     = profile_event();
+            fill_ev       = profile_event();
+            convolve_ev   = profile_event();
+            loglike_ev    = profile_event();
+        }
+        
+        set_params(lensed, lensed->shards, cube, NULL, NULL, set_params_ev, field_ev);
+        *lnew = -0.5*voronoi_chi2(lensed, render_ev, fill_ev, convolve_ev, loglike_ev);
+        
+        if(lensed->profile)
+        {
+            profile_read(lensed->profile->set_params, set_params_ev);
+            if(lensed->field)
+                profile_read(lensed->profile->field, field_ev);
+            profile_read(lensed->profile->render, render_ev);
+            profile_read(lensed->profile->render, fill_ev);
+            if(lensed->shards->convolve)
+                profile_read(lensed->profile->convolve, convolve_ev);
+            if(lensed->cells->ncells > 0)
+                profile_read(lensed->profile->loglike, loglike_ev);
+        }
+        
+        return;
+    }
     
-    // convolve with PSF if given
-    if(lensed->convolve)
+    // compute in chunks once there is a threshold for early termination
+    if(lensed->nchunks > 0 && lensed->threshold > -DBL_MAX)
     {
-        err = clEnqueueNDRangeKernel(lensed->queue, lensed->convolve, 2, NULL, lensed->convolve_gws, lensed->convolve_lws, 0, NULL, convolve_ev);
-        if(err != CL_SUCCESS)
-            error("failed to run convolve kernel");
+        double bound = -2*lensed->threshold;
+        double chi2 = chunked_chi2(lensed, cube, set, bound);
+        
+        // only complete chi^2 values calibrate the screening
+        if(lensed->screen && chi2 <= bound)
+            screen_calibrate(lensed, screen_chi2, chi2);
+        
+        *lnew = -0.5*chi2;
+        return;
     }
     
-    // compare with observed image
-    err = clEnqueueNDRangeKernel(lensed->queue, lensed->loglike, 1, NULL, lensed->loglike_gws, lensed->loglike_lws, 0, NULL, loglike_ev);
-    if(err != CL_SUCCESS)
-        error("failed to run loglike kernel");
+    if(lensed->profile)
+    {
+        if(!set)
+        {
+            map_params_ev    = profile_event();
+            unmap_params_ev  = profile_event();
+            set_params_ev    = profile_event();
+            field_ev         = profile_event();
+        }
+        render_ev            = profile_event();
+        convolve_ev          = profile_event();
+        loglike_ev           = profile_event();
+        map_loglike_mem_ev   = profile_event();
+        unmap_loglike_mem_ev = profile_event();
+    }
     
-    // map chi^2 values from device
-    cl_float* loglike = clEnqueueMapBuffer(lensed->queue, lensed->loglike_mem, CL_TRUE, CL_MAP_READ, 0, lensed->size*sizeof(cl_float), 0, NULL, map_loglike_mem_ev, &err);
-    if(err != CL_SUCCESS)
-        error("failed to map loglike buffer");
+    // set parameters and simulate objects on each shard, or only simulate
+    // objects on the single shard if the screening set its parameters
+    if(set)
+        render_shard(lensed, lensed->shards, render_ev);
+    else
+        set_shards(lensed, lensed->shards, cube, map_params_ev, unmap_params_ev, set_params_ev, field_ev, render_ev);
     
-    // sum chi^2 value
-    double chi2 = 0.0;
-    for(size_t i = 0; i < lensed->size; ++i)
-        chi2 += loglike[i];
+    // convolve and compare with observed image on each shard
+    compare_shards(lensed, lensed->shards, convolve_ev, loglike_ev);
     
-    // unmap result
-    clEnqueueUnmapMemObject(lensed->queue, lensed->loglike_mem, loglike, 0, NULL, unmap_loglike_mem_ev);
+    // set log-likelihood from chi^2 values of all shards
+    *lnew = -0.5*sum_shards(lensed, lensed->shards, map_loglike_mem_ev, unmap_loglike_mem_ev);
     
-    // set log-likelihood
-    *lnew = -0.5*chi2;
+    // calibrate the screening with the chi^2 value of the image
+    if(lensed->screen)
+        screen_calibrate(lensed, screen_chi2, -2*(*lnew));
     
     if(lensed->profile)
     {
-        clFinish(lensed->queue);
+        clFinish(lensed->shards->queue);
         
-        profile_read(lensed->profile->map_params, map_params_ev);
-        profile_read(lensed->profile->unmap_params, unmap_params_ev);
-        profile_read(lensed->profile->set_params, set_params_ev);
+        if(!set)
+        {
+            profile_read(lensed->profile->map_params, map_params_ev);
+            profile_read(lensed->profile->unmap_params, unmap_params_ev);
+            profile_read(lensed->profile->set_params, set_params_ev);
+            if(lensed->field)
+                profile_read(lensed->profile->field, field_ev);
+        }
         profile_read(lensed->profile->render, render_ev);
-        if(lensed->convolve)
+        if(lensed->shards->convolve)
             profile_read(lensed->profile->convolve, convolve_ev);
         profile_read(lensed->profile->loglike, loglike_ev);
         profile_read(lensed->profile->map_loglike_mem, map_loglike_mem_ev);
@@ -130,6 +619,22 @@ void loglike(double cube[], int* ndim, int* npar, double* lnew, void* lensed_)
     }
 }
 
+void loglike_batch(void* lensed_, size_t n, const double* params[], double lnew[])
+{
+    struct lensed* lensed = lensed_;
+    
+    // submit all parameters before waiting for any result, so that the work
+    // of the batch is queued on the devices at once
+    for(size_t k = 0; k < n; ++k)
+        set_shards(lensed, lensed->shards + k*lensed->nshards, params[k], NULL, NULL, NULL, NULL, NULL);
+    
+    for(size_t k = 0; k < n; ++k)
+        compare_shards(lensed, lensed->shards + k*lensed->nshards, NULL, NULL);
+    
+    for(size_t k = 0; k < n; ++k)
+        lnew[k] = -0.5*sum_shards(lensed, lensed->shards + k*lensed->nshards, NULL, NULL);
+}
+
 void dumper(int* nsamples, int* nlive, int* npar, double** physlive,
             double** posterior, double** constraints, double* maxloglike,
             double* logz, double* inslogz, double* logzerr, void* lensed_)
@@ -140,7 +645,6 @@ void dumper(int* nsamples, int* nlive, int* npar, double** physlive,
     struct lensed* lensed = lensed_;
     
     cl_int err;
-    cl_mem image_mem;
     cl_float* value_map;
     cl_float* error_map;
     cl_float* image_map;
@@ -163,57 +667,104 @@ void dumper(int* nsamples, int* nlive, int* npar, double** physlive,
         lensed->sigma[p]    = constraints[0][SIGMA*lensed->npars+i];
         lensed->ml[p]       = constraints[0][ML*lensed->npars+i];
         lensed->map[p]      = constraints[0][MAP*lensed->npars+i];
+        
+        // range of posterior samples, or the mean without samples
+        lensed->lower[p] = lensed->upper[p] = lensed->mean[p];
+        for(int s = 0; s < *nsamples; ++s)
+        {
+            double x = posterior[0][i*(*nsamples) + s];
+            if(x < lensed->lower[p])
+                lensed->lower[p] = x;
+            if(x > lensed->upper[p])
+                lensed->upper[p] = x;
+        }
     }
     
-    // copy summary statistics
-    lensed->logev = *logz;
+    // lowest log-likelihood of live points is the threshold for new points
+    if(lensed->nchunks > 0 || lensed->screen)
+    {
+        double* live = physlive[0] + (*npar)*(*nlive);
+        
+        lensed->threshold = live[0];
+        for(int i = 1; i < *nlive; ++i)
+            if(live[i] < lensed->threshold)
+                lensed->threshold = live[i];
+    }
+    
+    // copy summary statistics, with the evidence for the priors of the
+    // configuration if the pyramid narrowed them
+    lensed->logev = *logz + lensed->logvol;
     lensed->logev_err = *logzerr;
-    lensed->logev_ins = *inslogz;
+    lensed->logev_ins = *inslogz + lensed->logvol;
     lensed->max_loglike = *maxloglike;
     
-    // output results if asked to
-    if(lensed->fits || lensed->ds9)
+    // output results if asked to, but not for coarse runs of the pyramid
+    if((lensed->fits || lensed->ds9) && !lensed->level)
     {
-        // map parameter space on device
-        cl_float* params = clEnqueueMapBuffer(lensed->queue, lensed->params, CL_TRUE, CL_MAP_WRITE, 0, lensed->npars*sizeof(cl_float), 0, NULL, NULL, &err);
-        
-        // copy ML parameters to device using map
-        for(size_t i = 0; i < lensed->npars; ++i)
-            params[lensed->pmap[i]] = constraints[0][ML*lensed->npars+i];
-        
-        // done with parameter space
-        clEnqueueUnmapMemObject(lensed->queue, lensed->params, params, 0, NULL, NULL);
-        
-        // set parameters
-        err |= clEnqueueTask(lensed->queue, lensed->set_params, 0, NULL, NULL);
-        
-        // check for errors
-        if(err != CL_SUCCESS)
-            error("failed to set parameters");
-        
-        // simulate objects
-        err = clEnqueueNDRangeKernel(lensed->queue, lensed->render, 1, NULL, lensed->render_gws, lensed->render_lws, 0, NULL, NULL);
-        if(err != CL_SUCCESS)
-            error("failed to run render kernel");
-        
-        // convolve with PSF if given
-        if(lensed->convolve)
+        if(lensed->native)
         {
-            err = clEnqueueNDRangeKernel(lensed->queue, lensed->convolve, 2, NULL, lensed->convolve_gws, lensed->convolve_lws, 0, NULL, NULL);
-            if(err != CL_SUCCESS)
-                error("failed to run convolve kernel");
+            // copy ML parameters
+            for(size_t i = 0; i < lensed->npars; ++i)
+                lensed->native->params[lensed->pmap[i]] = constraints[0][ML*lensed->npars+i];
+            
+            // compute image
+            native_compute(lensed->native);
+            
+            // output is on the host
+            image_map = lensed->native->psf ? lensed->native->convolved : lensed->native->value;
+            value_map = lensed->native->value;
+            error_map = lensed->native->error;
+            loglike_map = lensed->native->chi2;
+        }
+        else
+        {
+            // the broker must not use the shards meanwhile
+            if(lensed->broker)
+                broker_lock(lensed->broker);
+            
+            // set ML parameters and simulate objects on each shard
+            set_shards(lensed, lensed->shards, constraints[0] + ML*lensed->npars, NULL, NULL, NULL, NULL, NULL);
+            
+            // convolve with PSF if given, and compute chi^2 values, which
+            // are not complete after an early exit of the likelihood; the
+            // pixelated source is solved for and added to the model
+            if(lensed->pixels)
+                pixels_chi2(lensed, constraints[0] + ML*lensed->npars);
+            else
+                compare_shards(lensed, lensed->shards, NULL, NULL);
+            
+            // arrays for output gathered from shards
+            image_map = malloc(lensed->size*sizeof(cl_float));
+            value_map = malloc(lensed->size*sizeof(cl_float));
+            error_map = malloc(lensed->size*sizeof(cl_float));
+            loglike_map = malloc(lensed->size*sizeof(cl_float));
+            if(!image_map || !value_map || !error_map || !loglike_map)
+                errori(NULL);
+            
+            // read rows of each shard from device
+            for(size_t s = 0; s < lensed->nshards; ++s)
+            {
+                struct shard* shard = &lensed->shards[s];
+                
+                // pixels of the shard
+                size_t off = shard->row0*lensed->width;
+                size_t len = shard->rows*lensed->width;
+                
+                // where values are depends on convolution
+                cl_mem image_mem = shard->convolve ? shard->convolve_mem : shard->value_mem;
+                
+                err = 0;
+                err |= clEnqueueReadBuffer(shard->queue, image_mem, CL_FALSE, off*sizeof(cl_float), len*sizeof(cl_float), image_map + off, 0, NULL, NULL);
+                err |= clEnqueueReadBuffer(shard->queue, shard->value_mem, CL_FALSE, off*sizeof(cl_float), len*sizeof(cl_float), value_map + off, 0, NULL, NULL);
+                err |= clEnqueueReadBuffer(shard->queue, shard->error_mem, CL_FALSE, off*sizeof(cl_float), len*sizeof(cl_float), error_map + off, 0, NULL, NULL);
+                err |= clEnqueueReadBuffer(shard->queue, shard->loglike_mem, CL_TRUE, off*sizeof(cl_float), len*sizeof(cl_float), loglike_map + off, 0, NULL, NULL);
+                if(err != CL_SUCCESS)
+                    error("failed to read output buffer");
+            }
+            
+            if(lensed->broker)
+                broker_unlock(lensed->broker);
         }
-        
-        // where values are depends on convolution
-        image_mem = lensed->convolve ? lensed->convolve_mem : lensed->value_mem;
-        
-        // map output from device
-        image_map = clEnqueueMapBuffer(lensed->queue, image_mem, CL_FALSE, CL_MAP_READ, 0, lensed->size*sizeof(cl_float), 0, NULL, NULL, NULL);
-        value_map = clEnqueueMapBuffer(lensed->queue, lensed->value_mem, CL_FALSE, CL_MAP_READ, 0, lensed->size*sizeof(cl_float), 0, NULL, NULL, NULL);
-        error_map = clEnqueueMapBuffer(lensed->queue, lensed->error_mem, CL_TRUE, CL_MAP_READ, 0, lensed->size*sizeof(cl_float), 0, NULL, NULL, NULL);
-        loglike_map = clEnqueueMapBuffer(lensed->queue, lensed->loglike_mem, CL_TRUE, CL_MAP_READ, 0, lensed->size*sizeof(cl_float), 0, NULL, NULL, NULL);
-        if(!image_map || !value_map || !error_map || !loglike_map)
-            error("failed to map output buffer");
         
         // calculate residuals
         residuals = malloc(lensed->size*sizeof(cl_float));
@@ -273,11 +824,14 @@ void dumper(int* nsamples, int* nlive, int* npar, double** physlive,
             free(fits);
         }
         
-        // unmap buffers
-        clEnqueueUnmapMemObject(lensed->queue, image_mem, image_map, 0, NULL, NULL);
-        clEnqueueUnmapMemObject(lensed->queue, lensed->value_mem, value_map, 0, NULL, NULL);
-        clEnqueueUnmapMemObject(lensed->queue, lensed->error_mem, error_map, 0, NULL, NULL);
-        clEnqueueUnmapMemObject(lensed->queue, lensed->loglike_mem, loglike_map, 0, NULL, NULL);
+        // free output gathered from shards
+        if(!lensed->native)
+        {
+            free(image_map);
+            free(value_map);
+            free(error_map);
+            free(loglike_map);
+        }
         
         // free arrays
         free(residuals);
@@ -1,6 +1,7 @@
 #pragma once
 
 void loglike(double cube[], int* ndim, int* npar, double* lnew, void* lensed);
+void loglike_batch(void* lensed, size_t n, const double* params[], double lnew[]);
 void dumper(int* nsamples, int* nlive, int* npar, double** physlive,
             double** posterior, double** constraints, double* maxloglike,
             double* logz, double* inslogz, double* logzerr, void* lensed);
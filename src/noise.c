@@ -0,0 +1,98 @@
+#include <stdlib.h>
+#include <math.h>
+
+#include "opencl.h"
+#include "data.h"
+#include "noise.h"
+#include "log.h"
+
+// lowest noise power that is whitened, relative to the highest, so that
+// frequencies without noise are not amplified without bound
+#define NOISE_POWER_MIN 1E-3
+
+cl_float* noise_whitening(const char* filename, size_t* width, size_t* height)
+{
+    // correlation kernel and its radii
+    cl_float* corr;
+    size_t cw, ch, rx, ry;
+    double c0;
+    
+    // size of the periodic grid for transforms, and the power spectrum
+    size_t n;
+    double* power;
+    double pmax;
+    
+    // whitening kernel
+    cl_float* white;
+    
+    // two pi over the size of the grid
+    double f;
+    
+    read_image(filename, &cw, &ch, &corr);
+    
+    if(cw%2 == 0 || ch%2 == 0)
+        error("noise correlation must have odd size (is %zu x %zu)", cw, ch);
+    
+    rx = cw/2;
+    ry = ch/2;
+    
+    // correlation is relative to the variance of a pixel, which the weights
+    // already account for
+    c0 = corr[ry*cw + rx];
+    if(!(c0 > 0))
+        error("noise correlation must be positive at its centre");
+    
+    // whitening kernel has twice the radius of the correlation, and the grid
+    // is large enough that neither wraps around
+    *width = 4*rx + 1;
+    *height = 4*ry + 1;
+    n = 4*(cw > ch ? cw : ch);
+    f = 8*atan(1)/n;
+    
+    power = malloc(n*n*sizeof(double));
+    white = malloc((*width)*(*height)*sizeof(cl_float));
+    if(!power || !white)
+        errori(NULL);
+    
+    // power spectrum of the symmetric part of the correlation, which is real;
+    // the kernel is small, so the transform is a direct sum
+    pmax = 0;
+    for(size_t v = 0; v < n; ++v)
+    {
+        for(size_t u = 0; u < n; ++u)
+        {
+            double p = 0;
+            for(size_t j = 0; j < ch; ++j)
+                for(size_t i = 0; i < cw; ++i)
+                    p += corr[j*cw + i]*cos(f*((double)u*((double)i - rx) + (double)v*((double)j - ry)));
+            power[v*n + u] = p/c0;
+            if(p/c0 > pmax)
+                pmax = p/c0;
+        }
+    }
+    
+    if(!(pmax > 0))
+        error("noise correlation has no positive power");
+    
+    // whitening filter is the inverse square root of the power spectrum
+    for(size_t k = 0; k < n*n; ++k)
+        power[k] = 1/sqrt(fmax(power[k], NOISE_POWER_MIN*pmax));
+    
+    // whitening kernel from the inverse transform, truncated to its size
+    for(size_t j = 0; j < *height; ++j)
+    {
+        for(size_t i = 0; i < *width; ++i)
+        {
+            double w = 0;
+            for(size_t v = 0; v < n; ++v)
+                for(size_t u = 0; u < n; ++u)
+                    w += power[v*n + u]*cos(f*((double)u*((double)i - 2*rx) + (double)v*((double)j - 2*ry)));
+            white[j*(*width) + i] = w/(n*n);
+        }
+    }
+    
+    free(power);
+    free(corr);
+    
+    return white;
+}
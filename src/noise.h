@@ -0,0 +1,5 @@
+#pragma once
+
+// read the correlation of the pixel noise from a FITS file of odd size, and
+// return the kernel that whitens it, with twice the radius of the correlation
+cl_float* noise_whitening(const char* filename, size_t* width, size_t* height);
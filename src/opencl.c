@@ -125,54 +125,178 @@ lensed_device* get_lensed_devices()
     return list;
 }
 
-lensed_cl* get_lensed_cl(const char* device_str)
+// find device by name, which is not terminated by zero
+static lensed_device* find_device(const char* name, size_t len)
+{
+    // get list of devices
+    lensed_device* device = get_lensed_devices();
+    
+    // check for auto-selection
+    if(len == strlen("auto") && strncmp(name, "auto", len) == 0)
+    {
+        // try to find GPU device
+        for(; device->device_id; ++device)
+            if(device->device_type == CL_DEVICE_TYPE_GPU)
+                break;
+        
+        // if no GPU was found, use first device
+        if(!device->device_id)
+            device = get_lensed_devices();
+    }
+    else
+    {
+        // find particular device
+        for(; device->device_id; ++device)
+            if(strlen(device->name) == len && strncmp(name, device->name, len) == 0)
+                break;
+        
+        // check if device was found
+        if(!device->device_id)
+            error("no such device: %.*s (see `lensed --devices` for a list of devices)", (int)len, name);
+    }
+    
+    return device;
+}
+
+// split device into sub-devices by NUMA node, or return zero if not possible
+static cl_uint split_device(lensed_device* device, cl_device_id** device_ids, cl_uint ndevices)
+{
+#ifdef CL_VERSION_1_2
+    cl_int err;
+    cl_uint nsub;
+    
+    // partition by the NUMA affinity domain
+    cl_device_partition_property properties[] = {
+        CL_DEVICE_PARTITION_BY_AFFINITY_DOMAIN,
+        CL_DEVICE_AFFINITY_DOMAIN_NUMA,
+        0
+    };
+    
+    // get number of sub-devices
+    err = clCreateSubDevices(device->device_id, properties, 0, NULL, &nsub);
+    if(err != CL_SUCCESS || nsub == 0)
+    {
+        warn("cannot split device %s\n"
+             "The device does not support partitioning by NUMA node and "
+             "will be used as a whole.", device->name);
+        return 0;
+    }
+    
+    // make space for sub-devices
+    *device_ids = realloc(*device_ids, (ndevices + nsub)*sizeof(cl_device_id));
+    if(!*device_ids)
+        errori(NULL);
+    
+    // create sub-devices
+    err = clCreateSubDevices(device->device_id, properties, nsub, *device_ids + ndevices, NULL);
+    if(err != CL_SUCCESS)
+        error("failed to split device %s", device->name);
+    
+    return nsub;
+#else
+    warn("cannot split device %s\n"
+         "Partitioning devices by NUMA node requires OpenCL 1.2. The device "
+         "will be used as a whole.", device->name);
+    return 0;
+#endif
+}
+
+lensed_cl* get_lensed_cl(const char* device_str, int numa, int select)
 {
     // OpenCL error code
     cl_int err;
     
+    // list of selected devices
+    size_t nlist;
+    lensed_device** list;
+    
     // result
     lensed_cl* lcl = malloc(sizeof(lensed_cl));
     if(!lcl)
         errori(NULL);
     
-    // get list of devices
-    lensed_device* device = get_lensed_devices();
-    
     // make sure there is a device
-    if(!device->device_id)
+    if(!get_lensed_devices()->device_id)
         error("no devices found");
     
-    // if name was given, look for specific device
+    // number of devices in comma-separated list
+    nlist = 1;
+    for(const char* c = device_str; c && *c; ++c)
+        if(*c == ',')
+            nlist += 1;
+    
+    list = malloc(nlist*sizeof(lensed_device*));
+    if(!list)
+        errori(NULL);
+    
+    // if name was given, look for specific devices, else use first device
     if(device_str)
     {
-        // check for auto-selection
-        if(strcmp(device_str, "auto") == 0)
+        const char* name = device_str;
+        for(size_t i = 0; i < nlist; ++i)
         {
-            // try to find GPU device
-            for(; device->device_id; ++device)
-                if(device->device_type == CL_DEVICE_TYPE_GPU)
-                    break;
-            
-            // if no GPU was found, use first device
-            if(!device->device_id)
-                device = get_lensed_devices();
+            size_t len = strcspn(name, ",");
+            list[i] = find_device(name, len);
+            name += len + 1;
         }
-        else
+    }
+    else
+    {
+        list[0] = get_lensed_devices();
+    }
+    
+    // devices must be distinct and share a platform for the context
+    for(size_t i = 1; i < nlist; ++i)
+    {
+        for(size_t j = 0; j < i; ++j)
+            if(list[j] == list[i])
+                error("device %s selected more than once", list[i]->name);
+        if(list[i]->platform_id != list[0]->platform_id)
+            error("devices %s and %s are on different platforms", list[0]->name, list[i]->name);
+    }
+    
+    // set platform ID of devices
+    lcl->platform_id = list[0]->platform_id;
+    
+    // collect device IDs, splitting devices if asked to
+    lcl->ndevices = 0;
+    lcl->device_ids = NULL;
+    for(size_t i = 0; i < nlist; ++i)
+    {
+        cl_uint nsub = numa ? split_device(list[i], &lcl->device_ids, lcl->ndevices) : 0;
+        
+        // use device as a whole if it was not split
+        if(nsub == 0)
         {
-            // find particular device
-            for(; device->device_id; ++device)
-                if(strcmp(device_str, device->name) == 0)
-                    break;
-            
-            // check if device was found
-            if(!device->device_id)
-                error("no such device: %s (see `lensed --devices` for a list of devices)", device_str);
+            lcl->device_ids = realloc(lcl->device_ids, (lcl->ndevices + 1)*sizeof(cl_device_id));
+            if(!lcl->device_ids)
+                errori(NULL);
+            lcl->device_ids[lcl->ndevices] = list[i]->device_id;
+            nsub = 1;
         }
+        
+        lcl->ndevices += nsub;
+    }
+    
+    // keep only the selected device, releasing all others
+    lcl->index = -1;
+    if(select >= 0)
+    {
+        lcl->index = select % lcl->ndevices;
+#ifdef CL_VERSION_1_2
+        for(cl_uint i = 0; i < lcl->ndevices; ++i)
+            if(i != (cl_uint)lcl->index)
+                clReleaseDevice(lcl->device_ids[i]);
+#endif
+        lcl->device_ids[0] = lcl->device_ids[lcl->index];
+        lcl->ndevices = 1;
     }
     
-    // set platform and device IDs of device
-    lcl->platform_id = device->platform_id;
-    lcl->device_id = device->device_id;
+    // first device is used where a single device is needed
+    lcl->device_id = lcl->device_ids[0];
+    
+    // done with list
+    free(list);
     
     // selected platform
     cl_context_properties properties[] = {
@@ -182,7 +306,7 @@ lensed_cl* get_lensed_cl(const char* device_str)
     };
     
     // create the context
-    lcl->context = clCreateContext(properties, 1, &lcl->device_id, notify, NULL, &err);
+    lcl->context = clCreateContext(properties, lcl->ndevices, lcl->device_ids, notify, NULL, &err);
     if(err != CL_SUCCESS)
         error("failed to create device context");
     
@@ -193,4 +317,10 @@ lensed_cl* get_lensed_cl(const char* device_str)
 void free_lensed_cl(lensed_cl* lcl)
 {
     clReleaseContext(lcl->context);
+#ifdef CL_VERSION_1_2
+    // release sub-devices, which does nothing for root devices
+    for(cl_uint i = 0; i < lcl->ndevices; ++i)
+        clReleaseDevice(lcl->device_ids[i]);
+#endif
+    free(lcl->device_ids);
 }
@@ -32,14 +32,19 @@ typedef struct
 {
     cl_platform_id platform_id;
     cl_device_id device_id;
+    cl_uint ndevices;
+    cl_device_id* device_ids;
+    int index;
     cl_context context;
 } lensed_cl;
 
 // list available OpenCL devices
 lensed_device* get_lensed_devices();
 
-// get Lensed OpenCL environment
-lensed_cl* get_lensed_cl(const char* device_str);
+// get Lensed OpenCL environment for a comma-separated list of devices, which
+// are optionally split into sub-devices by NUMA node; if select is not
+// negative, only the device at that position, wrapped around the list, is used
+lensed_cl* get_lensed_cl(const char* device_str, int numa, int select);
 
 // free Lensed OpenCL environment
 void free_lensed_cl(lensed_cl*);
@@ -0,0 +1,500 @@
+#include <stdlib.h>
+#include <math.h>
+
+#include "opencl.h"
+#include "input.h"
+#include "profile.h"
+#include "lensed.h"
+#include "pixels.h"
+#include "log.h"
+
+// largest work group of the reductions
+#define PIXELS_REDUCE 64
+
+// tolerance of the solver, relative to the initial preconditioned residual
+#define PIXELS_TOL 1E-3
+
+// largest number of times that the iterations of the solver are repeated
+// before it gives up on the tolerance
+#define PIXELS_REPEAT 10
+
+// create a kernel of the pixelated source
+static cl_kernel pixels_kernel(cl_program program, const char* name)
+{
+    cl_int err;
+    cl_kernel kernel = clCreateKernel(program, name, &err);
+    if(err != CL_SUCCESS)
+        error("failed to create %s kernel", name);
+    return kernel;
+}
+
+// find index of parameter in the list of MultiNest
+static size_t pixels_index(const struct lensed* lensed, const param* par)
+{
+    for(size_t i = 0; i < lensed->npars; ++i)
+        if(lensed->pars[lensed->pmap[i]] == par)
+            return i;
+    error("pixelated source parameter %s not found", par->id);
+    return 0;
+}
+
+struct pixels* pixels_create(const struct lensed* lensed, cl_context context,
+                             cl_program program, const object* obj,
+                             cl_ulong n, double lambda, size_t niter,
+                             cl_float4 pcs, cl_ulong dsiz, cl_ulong nq)
+{
+    struct shard* shard = lensed->shards;
+    struct pixels* pixels;
+    cl_int err;
+    cl_ulong nsrc, ncells, adjoint, diagonal, slot;
+    size_t nnodes, wgs;
+    cl_int* zero;
+    
+    pixels = malloc(sizeof(struct pixels));
+    if(!pixels)
+        errori(NULL);
+    
+    pixels->n = n;
+    pixels->lambda = lambda;
+    pixels->niter = niter;
+    pixels->warned = 0;
+    
+    // parameters of the grid
+    pixels->ix = pixels_index(lensed, &obj->pars[0]);
+    pixels->iy = pixels_index(lensed, &obj->pars[1]);
+    pixels->ir = pixels_index(lensed, &obj->pars[2]);
+    
+    // number of source pixels, cells of the grid, and quadrature nodes
+    nsrc = n*n;
+    ncells = (n - 1)*(n - 1);
+    nnodes = lensed->size*nq;
+    
+    verbose("    buffers");
+    
+    // the counts of the cells start at zero, and are reset after every scan
+    zero = calloc(ncells, sizeof(cl_int));
+    if(!zero)
+        errori(NULL);
+    
+    pixels->cell_mem = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS, nnodes*sizeof(cl_int), NULL, NULL);
+    pixels->frac_mem = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS, nnodes*sizeof(cl_float2), NULL, NULL);
+    pixels->count_mem = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR | CL_MEM_HOST_NO_ACCESS, ncells*sizeof(cl_int), zero, NULL);
+    pixels->start_mem = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS, (ncells + 1)*sizeof(cl_int), NULL, NULL);
+    pixels->fill_mem = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS, ncells*sizeof(cl_int), NULL, NULL);
+    pixels->nodes_mem = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS, nnodes*sizeof(cl_int), NULL, NULL);
+    if(!pixels->cell_mem || !pixels->frac_mem || !pixels->count_mem || !pixels->start_mem || !pixels->fill_mem || !pixels->nodes_mem)
+        error("failed to create pixelated source mapping buffers");
+    
+    for(size_t t = 0; t < 2; ++t)
+    {
+        pixels->tmp_mem[t] = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS, lensed->size*sizeof(cl_float), NULL, NULL);
+        if(!pixels->tmp_mem[t])
+            error("failed to create pixelated source image buffers");
+    }
+    
+    pixels->b_mem = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS, nsrc*sizeof(cl_float), NULL, NULL);
+    pixels->dinv_mem = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS, nsrc*sizeof(cl_float), NULL, NULL);
+    pixels->x_mem = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS, nsrc*sizeof(cl_float), NULL, NULL);
+    pixels->r_mem = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS, nsrc*sizeof(cl_float), NULL, NULL);
+    pixels->z_mem = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS, nsrc*sizeof(cl_float), NULL, NULL);
+    pixels->p_mem = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS, nsrc*sizeof(cl_float), NULL, NULL);
+    pixels->q_mem = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS, nsrc*sizeof(cl_float), NULL, NULL);
+    pixels->cg_mem = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR | CL_MEM_HOST_READ_ONLY, 5*sizeof(cl_float), NULL, NULL);
+    if(!pixels->b_mem || !pixels->dinv_mem || !pixels->x_mem || !pixels->r_mem || !pixels->z_mem || !pixels->p_mem || !pixels->q_mem || !pixels->cg_mem)
+        error("failed to create pixelated source solver buffers");
+    
+    free(zero);
+    
+    verbose("    kernels");
+    
+    pixels->trace = pixels_kernel(program, "pixels_trace");
+    pixels->scan = pixels_kernel(program, "pixels_scan");
+    pixels->sort = pixels_kernel(program, "pixels_sort");
+    pixels->map = pixels_kernel(program, "pixels_map");
+    pixels->convolve = pixels_kernel(program, "pixels_convolve");
+    pixels->gather = pixels_kernel(program, "pixels_gather");
+    pixels->dot = pixels_kernel(program, "pixels_dot");
+    pixels->energy = pixels_kernel(program, "pixels_energy");
+    pixels->init = pixels_kernel(program, "pixels_init");
+    pixels->step = pixels_kernel(program, "pixels_step");
+    pixels->direction = pixels_kernel(program, "pixels_direction");
+    pixels->residual = pixels_kernel(program, "pixels_residual");
+    pixels->add = pixels_kernel(program, "pixels_add");
+    
+    verbose("    arguments");
+    
+    // set the arguments that do not change between calls, the pixelated
+    // source is solved on the first shard
+    adjoint = 0;
+    diagonal = 0;
+    slot = 3;
+    err = 0;
+    err |= clSetKernelArg(pixels->trace, 0, sizeof(cl_ulong), &dsiz);
+    err |= clSetKernelArg(pixels->trace, 1, sizeof(cl_mem), &shard->object_mem);
+    err |= clSetKernelArg(pixels->trace, 2, dsiz*sizeof(cl_uint), NULL);
+    err |= clSetKernelArg(pixels->trace, 3, sizeof(cl_mem), lensed->field ? &lensed->field->mem : NULL);
+    err |= clSetKernelArg(pixels->trace, 4, sizeof(cl_float4), &pcs);
+    err |= clSetKernelArg(pixels->trace, 5, sizeof(cl_mem), &shard->qq_mem);
+    err |= clSetKernelArg(pixels->trace, 7, sizeof(cl_ulong), &n);
+    err |= clSetKernelArg(pixels->trace, 8, sizeof(cl_mem), &pixels->cell_mem);
+    err |= clSetKernelArg(pixels->trace, 9, sizeof(cl_mem), &pixels->frac_mem);
+    err |= clSetKernelArg(pixels->trace, 10, sizeof(cl_mem), &pixels->count_mem);
+    err |= clSetKernelArg(pixels->scan, 0, sizeof(cl_ulong), &ncells);
+    err |= clSetKernelArg(pixels->scan, 1, sizeof(cl_mem), &pixels->count_mem);
+    err |= clSetKernelArg(pixels->scan, 2, sizeof(cl_mem), &pixels->start_mem);
+    err |= clSetKernelArg(pixels->scan, 3, sizeof(cl_mem), &pixels->fill_mem);
+    err |= clSetKernelArg(pixels->sort, 0, sizeof(cl_mem), &pixels->cell_mem);
+    err |= clSetKernelArg(pixels->sort, 1, sizeof(cl_mem), &pixels->fill_mem);
+    err |= clSetKernelArg(pixels->sort, 2, sizeof(cl_mem), &pixels->nodes_mem);
+    err |= clSetKernelArg(pixels->map, 0, sizeof(cl_ulong), &n);
+    err |= clSetKernelArg(pixels->map, 1, sizeof(cl_mem), &pixels->cell_mem);
+    err |= clSetKernelArg(pixels->map, 2, sizeof(cl_mem), &pixels->frac_mem);
+    err |= clSetKernelArg(pixels->map, 3, sizeof(cl_mem), &shard->ww_mem);
+    err |= clSetKernelArg(pixels->convolve, 0, sizeof(cl_ulong), &adjoint);
+    err |= clSetKernelArg(pixels->convolve, 2, sizeof(cl_mem), shard->convolve ? &shard->psf_mem : NULL);
+    err |= clSetKernelArg(pixels->convolve, 3, sizeof(cl_mem), &shard->weight_mem);
+    err |= clSetKernelArg(pixels->gather, 0, sizeof(cl_ulong), &n);
+    err |= clSetKernelArg(pixels->gather, 1, sizeof(cl_mem), &pixels->start_mem);
+    err |= clSetKernelArg(pixels->gather, 2, sizeof(cl_mem), &pixels->nodes_mem);
+    err |= clSetKernelArg(pixels->gather, 3, sizeof(cl_mem), &pixels->frac_mem);
+    err |= clSetKernelArg(pixels->gather, 4, sizeof(cl_mem), &shard->ww_mem);
+    err |= clSetKernelArg(pixels->gather, 6, sizeof(cl_mem), &shard->weight_mem);
+    err |= clSetKernelArg(pixels->gather, 7, sizeof(cl_ulong), &diagonal);
+    err |= clSetKernelArg(pixels->dot, 0, sizeof(cl_ulong), &nsrc);
+    err |= clSetKernelArg(pixels->dot, 4, sizeof(cl_mem), &pixels->cg_mem);
+    err |= clSetKernelArg(pixels->energy, 0, sizeof(cl_ulong), &n);
+    err |= clSetKernelArg(pixels->energy, 1, sizeof(cl_mem), &pixels->x_mem);
+    err |= clSetKernelArg(pixels->energy, 3, sizeof(cl_mem), &pixels->cg_mem);
+    err |= clSetKernelArg(pixels->energy, 4, sizeof(cl_ulong), &slot);
+    err |= clSetKernelArg(pixels->init, 0, sizeof(cl_ulong), &nsrc);
+    err |= clSetKernelArg(pixels->init, 1, sizeof(cl_mem), &pixels->b_mem);
+    err |= clSetKernelArg(pixels->init, 2, sizeof(cl_mem), &pixels->dinv_mem);
+    err |= clSetKernelArg(pixels->init, 3, sizeof(cl_mem), &pixels->x_mem);
+    err |= clSetKernelArg(pixels->init, 4, sizeof(cl_mem), &pixels->r_mem);
+    err |= clSetKernelArg(pixels->init, 5, sizeof(cl_mem), &pixels->z_mem);
+    err |= clSetKernelArg(pixels->init, 6, sizeof(cl_mem), &pixels->p_mem);
+    err |= clSetKernelArg(pixels->step, 0, sizeof(cl_ulong), &nsrc);
+    err |= clSetKernelArg(pixels->step, 1, sizeof(cl_mem), &pixels->cg_mem);
+    err |= clSetKernelArg(pixels->step, 4, sizeof(cl_mem), &pixels->p_mem);
+    err |= clSetKernelArg(pixels->step, 5, sizeof(cl_mem), &pixels->q_mem);
+    err |= clSetKernelArg(pixels->step, 6, sizeof(cl_mem), &pixels->dinv_mem);
+    err |= clSetKernelArg(pixels->step, 7, sizeof(cl_mem), &pixels->x_mem);
+    err |= clSetKernelArg(pixels->step, 8, sizeof(cl_mem), &pixels->r_mem);
+    err |= clSetKernelArg(pixels->step, 9, sizeof(cl_mem), &pixels->z_mem);
+    err |= clSetKernelArg(pixels->direction, 0, sizeof(cl_ulong), &nsrc);
+    err |= clSetKernelArg(pixels->direction, 1, sizeof(cl_mem), &pixels->cg_mem);
+    err |= clSetKernelArg(pixels->direction, 4, sizeof(cl_mem), &pixels->z_mem);
+    err |= clSetKernelArg(pixels->direction, 5, sizeof(cl_mem), &pixels->p_mem);
+    err |= clSetKernelArg(pixels->residual, 0, sizeof(cl_mem), &shard->image_mem);
+    err |= clSetKernelArg(pixels->residual, 1, sizeof(cl_mem), shard->convolve ? &shard->convolve_mem : &shard->value_mem);
+    err |= clSetKernelArg(pixels->residual, 2, sizeof(cl_mem), &pixels->tmp_mem[1]);
+    if(err != CL_SUCCESS)
+        error("failed to set pixelated source kernel arguments");
+    
+    // the reductions and the scan run in a single work group with a power of
+    // two items
+    pixels->reduce_lws[0] = PIXELS_REDUCE;
+    err = clGetKernelWorkGroupInfo(pixels->dot, shard->device_id, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &wgs, NULL);
+    if(err != CL_SUCCESS)
+        error("failed to get pixelated source kernel work group size");
+    while(pixels->reduce_lws[0] > wgs)
+        pixels->reduce_lws[0] /= 2;
+    err = clGetKernelWorkGroupInfo(pixels->energy, shard->device_id, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &wgs, NULL);
+    if(err != CL_SUCCESS)
+        error("failed to get pixelated source kernel work group size");
+    while(pixels->reduce_lws[0] > wgs)
+        pixels->reduce_lws[0] /= 2;
+    err = clGetKernelWorkGroupInfo(pixels->scan, shard->device_id, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &wgs, NULL);
+    if(err != CL_SUCCESS)
+        error("failed to get pixelated source kernel work group size");
+    while(pixels->reduce_lws[0] > wgs)
+        pixels->reduce_lws[0] /= 2;
+    
+    err = 0;
+    err |= clSetKernelArg(pixels->dot, 3, pixels->reduce_lws[0]*sizeof(cl_float), NULL);
+    err |= clSetKernelArg(pixels->energy, 2, pixels->reduce_lws[0]*sizeof(cl_float), NULL);
+    err |= clSetKernelArg(pixels->scan, 4, pixels->reduce_lws[0]*sizeof(cl_int), NULL);
+    if(err != CL_SUCCESS)
+        error("failed to set pixelated source kernel arguments");
+    
+    // one work item per pixel, node, and source pixel
+    pixels->image_gws[0] = lensed->size;
+    pixels->nodes_gws[0] = nnodes;
+    pixels->convolve_gws[0] = lensed->width;
+    pixels->convolve_gws[1] = lensed->height;
+    pixels->source_gws[0] = nsrc;
+    
+    return pixels;
+}
+
+// run a kernel of the pixelated source
+static void pixels_run(cl_command_queue queue, cl_kernel kernel, cl_uint dim,
+                       const size_t* gws, const size_t* lws,
+                       const char* name)
+{
+    cl_int err = clEnqueueNDRangeKernel(queue, kernel, dim, NULL, gws, lws, 0, NULL, NULL);
+    if(err != CL_SUCCESS)
+        error("failed to run %s kernel", name);
+}
+
+// map source pixels to the image and convolve, which leaves the result in the
+// second image buffer; if back is set, also apply the transpose of the
+// convolution to the weighted result, which leaves it in the first buffer
+static void pixels_apply(const struct pixels* pixels, cl_command_queue queue,
+                         cl_mem src, int back)
+{
+    cl_ulong adjoint;
+    cl_int err;
+    
+    // interpolate source at nodes
+    err = 0;
+    err |= clSetKernelArg(pixels->map, 4, sizeof(cl_mem), &src);
+    err |= clSetKernelArg(pixels->map, 5, sizeof(cl_mem), &pixels->tmp_mem[0]);
+    if(err != CL_SUCCESS)
+        error("failed to set pixels_map kernel arguments");
+    pixels_run(queue, pixels->map, 1, pixels->image_gws, NULL, "pixels_map");
+    
+    // convolve with PSF, and back
+    for(size_t t = 0; t < (back ? 2 : 1); ++t)
+    {
+        adjoint = t;
+        err = 0;
+        err |= clSetKernelArg(pixels->convolve, 0, sizeof(cl_ulong), &adjoint);
+        err |= clSetKernelArg(pixels->convolve, 1, sizeof(cl_mem), &pixels->tmp_mem[t]);
+        err |= clSetKernelArg(pixels->convolve, 4, sizeof(cl_mem), &pixels->tmp_mem[1 - t]);
+        if(err != CL_SUCCESS)
+            error("failed to set pixels_convolve kernel arguments");
+        pixels_run(queue, pixels->convolve, 2, pixels->convolve_gws, NULL, "pixels_convolve");
+    }
+}
+
+// map the image in the first buffer back to the source, with regularisation
+static void pixels_back(const struct pixels* pixels, cl_command_queue queue,
+                        cl_ulong diagonal, cl_float lambda, cl_mem src,
+                        cl_mem out)
+{
+    cl_int err = 0;
+    err |= clSetKernelArg(pixels->gather, 5, sizeof(cl_mem), &pixels->tmp_mem[0]);
+    err |= clSetKernelArg(pixels->gather, 7, sizeof(cl_ulong), &diagonal);
+    err |= clSetKernelArg(pixels->gather, 8, sizeof(cl_float), &lambda);
+    err |= clSetKernelArg(pixels->gather, 9, sizeof(cl_mem), &src);
+    err |= clSetKernelArg(pixels->gather, 10, sizeof(cl_mem), &out);
+    if(err != CL_SUCCESS)
+        error("failed to set pixels_gather kernel arguments");
+    pixels_run(queue, pixels->gather, 1, pixels->source_gws, NULL, "pixels_gather");
+}
+
+// scalar product of two source vectors into a slot of the solver
+static void pixels_product(const struct pixels* pixels, cl_command_queue queue,
+                           cl_mem a, cl_mem b, cl_ulong slot)
+{
+    cl_int err = 0;
+    err |= clSetKernelArg(pixels->dot, 1, sizeof(cl_mem), &a);
+    err |= clSetKernelArg(pixels->dot, 2, sizeof(cl_mem), &b);
+    err |= clSetKernelArg(pixels->dot, 5, sizeof(cl_ulong), &slot);
+    if(err != CL_SUCCESS)
+        error("failed to set pixels_dot kernel arguments");
+    pixels_run(queue, pixels->dot, 1, pixels->reduce_lws, pixels->reduce_lws, "pixels_dot");
+}
+
+// one iteration of the solver, which alternates the slots of the products
+static void pixels_iterate(const struct pixels* pixels, cl_command_queue queue,
+                           size_t it)
+{
+    cl_ulong rzold = it%2;
+    cl_ulong rznew = (it + 1)%2;
+    cl_ulong slot = 2;
+    cl_int err;
+    
+    // apply operator to search direction
+    pixels_apply(pixels, queue, pixels->p_mem, 1);
+    pixels_back(pixels, queue, 0, pixels->lambda, pixels->p_mem, pixels->q_mem);
+    pixels_product(pixels, queue, pixels->p_mem, pixels->q_mem, slot);
+    
+    // step along search direction
+    err = 0;
+    err |= clSetKernelArg(pixels->step, 2, sizeof(cl_ulong), &rzold);
+    err |= clSetKernelArg(pixels->step, 3, sizeof(cl_ulong), &slot);
+    if(err != CL_SUCCESS)
+        error("failed to set pixels_step kernel arguments");
+    pixels_run(queue, pixels->step, 1, pixels->source_gws, NULL, "pixels_step");
+    
+    // new search direction
+    pixels_product(pixels, queue, pixels->r_mem, pixels->z_mem, rznew);
+    err = 0;
+    err |= clSetKernelArg(pixels->direction, 2, sizeof(cl_ulong), &rzold);
+    err |= clSetKernelArg(pixels->direction, 3, sizeof(cl_ulong), &rznew);
+    if(err != CL_SUCCESS)
+        error("failed to set pixels_direction kernel arguments");
+    pixels_run(queue, pixels->direction, 1, pixels->source_gws, NULL, "pixels_direction");
+}
+
+double pixels_chi2(const struct lensed* lensed, const double* params)
+{
+    struct shard* shard = lensed->shards;
+    struct pixels* pixels = lensed->pixels;
+    cl_command_queue queue = shard->queue;
+    
+    // the model of the rest of the objects
+    cl_mem model = shard->convolve ? shard->convolve_mem : shard->value_mem;
+    
+    cl_int err;
+    cl_float4 grid;
+    cl_ulong adjoint;
+    size_t it, repeat;
+    cl_float* cg;
+    cl_float* loglike;
+    double r, h, energy, chi2;
+    
+    // convolve with PSF if given
+    if(shard->convolve)
+    {
+        err = clEnqueueNDRangeKernel(queue, shard->convolve, 2, shard->convolve_off, shard->convolve_gws, shard->convolve_lws, 0, NULL, NULL);
+        if(err != CL_SUCCESS)
+            error("failed to run convolve kernel");
+    }
+    
+    // grid of source pixels from its parameters
+    r = params[pixels->ir];
+    h = 2*r/(pixels->n - 1);
+    grid.s[0] = params[pixels->ix] - r;
+    grid.s[1] = params[pixels->iy] - r;
+    grid.s[2] = h;
+    grid.s[3] = h;
+    
+    // trace quadrature nodes and list the nodes of every cell of the grid
+    err = clSetKernelArg(pixels->trace, 6, sizeof(cl_float4), &grid);
+    if(err != CL_SUCCESS)
+        error("failed to set pixels_trace kernel arguments");
+    pixels_run(queue, pixels->trace, 1, pixels->image_gws, NULL, "pixels_trace");
+    pixels_run(queue, pixels->scan, 1, pixels->reduce_lws, pixels->reduce_lws, "pixels_scan");
+    pixels_run(queue, pixels->sort, 1, pixels->nodes_gws, NULL, "pixels_sort");
+    
+    // right-hand side from the data that the rest of the model leaves
+    pixels_run(queue, pixels->residual, 1, pixels->image_gws, NULL, "pixels_residual");
+    adjoint = 1;
+    err = 0;
+    err |= clSetKernelArg(pixels->convolve, 0, sizeof(cl_ulong), &adjoint);
+    err |= clSetKernelArg(pixels->convolve, 1, sizeof(cl_mem), &pixels->tmp_mem[1]);
+    err |= clSetKernelArg(pixels->convolve, 4, sizeof(cl_mem), &pixels->tmp_mem[0]);
+    if(err != CL_SUCCESS)
+        error("failed to set pixels_convolve kernel arguments");
+    pixels_run(queue, pixels->convolve, 2, pixels->convolve_gws, NULL, "pixels_convolve");
+    pixels_back(pixels, queue, 0, 0, pixels->x_mem, pixels->b_mem);
+    
+    // inverse diagonal of the operator, without the PSF
+    pixels_back(pixels, queue, 1, pixels->lambda, pixels->b_mem, pixels->dinv_mem);
+    
+    // preconditioned conjugate gradients, which alternate between two slots
+    // for the product of residual and preconditioned residual, and keep the
+    // curvature along the search direction in the third; the initial product
+    // is kept in the last slot for the tolerance
+    pixels_run(queue, pixels->init, 1, pixels->source_gws, NULL, "pixels_init");
+    pixels_product(pixels, queue, pixels->r_mem, pixels->z_mem, 0);
+    pixels_product(pixels, queue, pixels->r_mem, pixels->z_mem, 4);
+    
+    // the iterations run without waiting for the host, and are repeated until
+    // the solver is within tolerance
+    it = 0;
+    for(repeat = 0; repeat < PIXELS_REPEAT; ++repeat)
+    {
+        double rz, rz0;
+        
+        for(size_t end = it + pixels->niter; it < end; ++it)
+            pixels_iterate(pixels, queue, it);
+        
+        cg = clEnqueueMapBuffer(queue, pixels->cg_mem, CL_TRUE, CL_MAP_READ, 0, 5*sizeof(cl_float), 0, NULL, NULL, &err);
+        if(err != CL_SUCCESS)
+            error("failed to map pixelated source solver buffer");
+        rz = cg[it%2];
+        rz0 = cg[4];
+        clEnqueueUnmapMemObject(queue, pixels->cg_mem, cg, 0, NULL, NULL);
+        
+        if(rz <= PIXELS_TOL*PIXELS_TOL*rz0)
+            break;
+    }
+    
+    if(repeat == PIXELS_REPEAT && !pixels->warned)
+    {
+        warn("pixelated source did not converge\n"
+             "The solver did not reach its tolerance within %zu iterations. "
+             "The likelihood of samples then depends on their convergence. "
+             "Consider increasing the \"pixels-iter\" option.", it);
+        pixels->warned = 1;
+    }
+    
+    // add lensed and convolved source to model, and the lensed source to the
+    // unconvolved model for output
+    pixels_apply(pixels, queue, pixels->x_mem, 0);
+    for(size_t t = shard->convolve ? 0 : 1; t < 2; ++t)
+    {
+        cl_mem out = t ? model : shard->value_mem;
+        
+        err = 0;
+        err |= clSetKernelArg(pixels->add, 0, sizeof(cl_mem), &pixels->tmp_mem[t]);
+        err |= clSetKernelArg(pixels->add, 1, sizeof(cl_mem), &out);
+        if(err != CL_SUCCESS)
+            error("failed to set pixels_add kernel arguments");
+        pixels_run(queue, pixels->add, 1, pixels->image_gws, NULL, "pixels_add");
+    }
+    
+    // compare with observed image
+    err = clEnqueueNDRangeKernel(queue, shard->loglike, 1, shard->loglike_off, shard->loglike_gws, shard->loglike_lws, 0, NULL, NULL);
+    if(err != CL_SUCCESS)
+        error("failed to run loglike kernel");
+    
+    // regularisation of the solution
+    pixels_run(queue, pixels->energy, 1, pixels->reduce_lws, pixels->reduce_lws, "pixels_energy");
+    
+    // map chi^2 values from device and sum them
+    loglike = clEnqueueMapBuffer(queue, shard->loglike_mem, CL_TRUE, CL_MAP_READ, 0, lensed->size*sizeof(cl_float), 0, NULL, NULL, &err);
+    if(err != CL_SUCCESS)
+        error("failed to map loglike buffer");
+    chi2 = 0;
+    for(size_t i = 0; i < lensed->size; ++i)
+        chi2 += loglike[i];
+    clEnqueueUnmapMemObject(queue, shard->loglike_mem, loglike, 0, NULL, NULL);
+    
+    // map regularisation from device
+    cg = clEnqueueMapBuffer(queue, pixels->cg_mem, CL_TRUE, CL_MAP_READ, 3*sizeof(cl_float), sizeof(cl_float), 0, NULL, NULL, &err);
+    if(err != CL_SUCCESS)
+        error("failed to map pixelated source solver buffer");
+    energy = cg[0];
+    clEnqueueUnmapMemObject(queue, pixels->cg_mem, cg, 0, NULL, NULL);
+    
+    return chi2 + pixels->lambda*energy;
+}
+
+void pixels_free(struct pixels* pixels)
+{
+    clReleaseKernel(pixels->trace);
+    clReleaseKernel(pixels->scan);
+    clReleaseKernel(pixels->sort);
+    clReleaseKernel(pixels->map);
+    clReleaseKernel(pixels->convolve);
+    clReleaseKernel(pixels->gather);
+    clReleaseKernel(pixels->dot);
+    clReleaseKernel(pixels->energy);
+    clReleaseKernel(pixels->init);
+    clReleaseKernel(pixels->step);
+    clReleaseKernel(pixels->direction);
+    clReleaseKernel(pixels->residual);
+    clReleaseKernel(pixels->add);
+    clReleaseMemObject(pixels->cell_mem);
+    clReleaseMemObject(pixels->frac_mem);
+    clReleaseMemObject(pixels->count_mem);
+    clReleaseMemObject(pixels->start_mem);
+    clReleaseMemObject(pixels->fill_mem);
+    clReleaseMemObject(pixels->nodes_mem);
+    clReleaseMemObject(pixels->tmp_mem[0]);
+    clReleaseMemObject(pixels->tmp_mem[1]);
+    clReleaseMemObject(pixels->b_mem);
+    clReleaseMemObject(pixels->dinv_mem);
+    clReleaseMemObject(pixels->x_mem);
+    clReleaseMemObject(pixels->r_mem);
+    clReleaseMemObject(pixels->z_mem);
+    clReleaseMemObject(pixels->p_mem);
+    clReleaseMemObject(pixels->q_mem);
+    clReleaseMemObject(pixels->cg_mem);
+    free(pixels);
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+// create the buffers and kernels that solve for the pixelated source on the
+// first shard
+struct pixels* pixels_create(const struct lensed* lensed, cl_context context,
+                             cl_program program, const object* obj,
+                             cl_ulong n, double lambda, size_t niter,
+                             cl_float4 pcs, cl_ulong dsiz, cl_ulong nq);
+
+// solve for the pixelated source once the rest of the model is rendered on
+// the first shard, add it to the model, and return -2 times the regularised
+// log-likelihood
+double pixels_chi2(const struct lensed* lensed, const double* params);
+
+// free pixelated source and its kernels
+void pixels_free(struct pixels* pixels);
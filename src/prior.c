@@ -183,6 +183,52 @@ prior* prior_default(double value)
     return pri;
 }
 
+prior* prior_restrict(const prior* pri, double lower, double upper)
+{
+    prior* res;
+    
+    // only uniform priors keep their shape within a range
+    if(pri->apply != prior_apply_unif)
+        return NULL;
+    
+    // range is within the original prior
+    if(lower < prior_lower(pri))
+        lower = prior_lower(pri);
+    if(upper > prior_upper(pri))
+        upper = prior_upper(pri);
+    if(!(lower < upper))
+        return NULL;
+    
+    // create prior
+    res = malloc(sizeof(prior));
+    if(!res)
+        errori(NULL);
+    
+    // set up prior functions
+    res->free       = prior_free_unif;
+    res->print      = prior_print_unif;
+    res->apply      = prior_apply_unif;
+    res->lower      = prior_lower_unif;
+    res->upper      = prior_upper_unif;
+    res->pseudo     = 0;
+    
+    // make prior data
+    res->data       = prior_make_unif(lower, upper);
+    
+    // prior is ready
+    return res;
+}
+
+int prior_normal(const prior* pri, double* mean, double* sigma)
+{
+    if(pri->apply != prior_apply_norm)
+        return 0;
+    
+    prior_moments_norm(pri->data, mean, sigma);
+    
+    return 1;
+}
+
 void prior_free(prior* pri)
 {
     if(pri)
@@ -12,6 +12,14 @@ void prior_free(prior* pri);
 // output prior to string
 void prior_print(const prior* pri, char* buf, size_t n);
 
+// restrict prior to a range, which is only possible if the prior keeps its
+// shape within the range; returns NULL otherwise
+prior* prior_restrict(const prior* pri, double lower, double upper);
+
+// get mean and standard deviation of a normal prior; returns 0 if the prior
+// is not normal
+int prior_normal(const prior* pri, double* mean, double* sigma);
+
 // apply prior to unit variate
 double prior_apply(const prior* pri, double u);
 
@@ -74,6 +74,14 @@ void prior_print_norm(const void* data, char* buf, size_t n)
     strcat(buf, ")");
 }
 
+void prior_moments_norm(const void* data, double* m, double* s)
+{
+    const struct norm* norm = data;
+    
+    *m = norm->m;
+    *s = norm->s;
+}
+
 double prior_apply_norm(const void* data, double u)
 {
     const struct norm* norm = data;
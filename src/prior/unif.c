@@ -11,10 +11,22 @@ struct uniform
     double b;
 };
 
-void* prior_read_unif(size_t nargs, const char* argv[])
+void* prior_make_unif(double a, double b)
 {
     struct uniform* unif;
     
+    unif = malloc(sizeof(struct uniform));
+    if(!unif)
+        errori(NULL);
+    
+    unif->a = a;
+    unif->b = b;
+    
+    return unif;
+}
+
+void* prior_read_unif(size_t nargs, const char* argv[])
+{
     int err;
     double a, b;
     
@@ -28,14 +40,7 @@ void* prior_read_unif(size_t nargs, const char* argv[])
     if(err)
         return NULL;
     
-    unif = malloc(sizeof(struct uniform));
-    if(!unif)
-        errori(NULL);
-    
-    unif->a = a;
-    unif->b = b;
-    
-    return unif;
+    return prior_make_unif(a, b);
 }
 
 void prior_free_unif(void* data)
@@ -1,5 +1,6 @@
 #pragma once
 
+void*   prior_make_unif(double a, double b);
 void*   prior_read_unif(size_t nargs, const char* args[]);
 void    prior_free_unif(void* data);
 void    prior_print_unif(const void* data, char* buf, size_t n);
@@ -0,0 +1,253 @@
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "rank.h"
+
+#ifdef LENSED_MPI
+
+#include <mpi.h>
+
+#include "log.h"
+
+// MPI state of this process
+static int initialised = 0;
+static int world_rank = 0;
+static int world_size = 1;
+static int node_rank = 0;
+static int node_size = 1;
+static MPI_Comm node_comm;
+
+// window of memory shared on node
+#if MPI_VERSION >= 3
+static MPI_Win shared_win;
+#endif
+
+void rank_init(int* argc, char*** argv)
+{
+    int flag;
+    int provided;
+    
+    // do nothing if MPI is already running
+    MPI_Initialized(&flag);
+    if(flag)
+        return;
+    
+    // only the main thread calls MPI, but the broker runs in a thread
+    if(MPI_Init_thread(argc, argv, MPI_THREAD_FUNNELED, &provided) != MPI_SUCCESS)
+        error("failed to initialise MPI");
+    
+    initialised = 1;
+    
+    // rank in job
+    MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &world_size);
+    
+    // communicator for processes that share a node
+#if MPI_VERSION >= 3
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, world_rank, MPI_INFO_NULL, &node_comm);
+#else
+    {
+        char name[MPI_MAX_PROCESSOR_NAME];
+        int len;
+        unsigned hash = 5381;
+        
+        // hash of the processor name identifies the node
+        MPI_Get_processor_name(name, &len);
+        for(int i = 0; i < len; ++i)
+            hash = hash*33 + (unsigned char)name[i];
+        
+        MPI_Comm_split(MPI_COMM_WORLD, hash & INT_MAX, world_rank, &node_comm);
+    }
+#endif
+    
+    // rank on node
+    MPI_Comm_rank(node_comm, &node_rank);
+    MPI_Comm_size(node_comm, &node_size);
+}
+
+void rank_finalize()
+{
+    if(!initialised)
+        return;
+    
+    MPI_Comm_free(&node_comm);
+    MPI_Finalize();
+    
+    initialised = 0;
+}
+
+int rank_mpi()
+{
+    return initialised;
+}
+
+int rank_world()
+{
+    return world_rank;
+}
+
+int rank_world_size()
+{
+    return world_size;
+}
+
+int rank_node()
+{
+    return node_rank;
+}
+
+int rank_node_size()
+{
+    return node_size;
+}
+
+void rank_sum(unsigned long long* values, size_t n)
+{
+    if(!initialised || world_size < 2)
+        return;
+    
+    if(world_rank == 0)
+        MPI_Reduce(MPI_IN_PLACE, values, n, MPI_UNSIGNED_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    else
+        MPI_Reduce(values, NULL, n, MPI_UNSIGNED_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+}
+
+void rank_bcast(double* values, size_t n)
+{
+    if(!initialised || world_size < 2)
+        return;
+    
+    MPI_Bcast(values, n, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+}
+
+void rank_share(int group, void** data, size_t* size)
+{
+    MPI_Comm comm;
+    int rank;
+    unsigned long long len;
+    
+    if(!initialised || node_size < 2)
+        return;
+    
+    // communicator for processes in group, first process is the root
+    MPI_Comm_split(node_comm, group, node_rank, &comm);
+    MPI_Comm_rank(comm, &rank);
+    
+    // broadcast size of data, nothing is shared if it is too large
+    len = (rank == 0 && *data && *size <= INT_MAX) ? *size : 0;
+    MPI_Bcast(&len, 1, MPI_UNSIGNED_LONG_LONG, 0, comm);
+    
+    // receive data on all other processes
+    if(rank != 0)
+    {
+        *data = NULL;
+        *size = len;
+        if(len > 0)
+        {
+            *data = malloc(len);
+            if(!*data)
+                errori(NULL);
+        }
+    }
+    
+    // broadcast data
+    if(len > 0)
+        MPI_Bcast(*data, len, MPI_BYTE, 0, comm);
+    
+    MPI_Comm_free(&comm);
+}
+
+void* rank_shared(size_t size)
+{
+#if MPI_VERSION >= 3
+    void* ptr;
+    MPI_Aint len;
+    int disp;
+    
+    if(!initialised)
+        return NULL;
+    
+    // only the first process allocates memory
+    MPI_Win_allocate_shared(node_rank == 0 ? size : 0, 1, MPI_INFO_NULL, node_comm, &ptr, &shared_win);
+    
+    // get memory of first process
+    MPI_Win_shared_query(shared_win, 0, &len, &disp, &ptr);
+    
+    // clear memory before it is used by any process
+    if(node_rank == 0)
+        memset(ptr, 0, size);
+    MPI_Barrier(node_comm);
+    
+    return ptr;
+#else
+    error("shared memory requires MPI 3");
+    return NULL;
+#endif
+}
+
+void rank_shared_free(void* ptr)
+{
+#if MPI_VERSION >= 3
+    if(ptr)
+        MPI_Win_free(&shared_win);
+#endif
+}
+
+#else
+
+void rank_init(int* argc, char*** argv)
+{
+}
+
+void rank_finalize()
+{
+}
+
+int rank_mpi()
+{
+    return 0;
+}
+
+int rank_world()
+{
+    return 0;
+}
+
+int rank_world_size()
+{
+    return 1;
+}
+
+int rank_node()
+{
+    return 0;
+}
+
+int rank_node_size()
+{
+    return 1;
+}
+
+void rank_sum(unsigned long long* values, size_t n)
+{
+}
+
+void rank_bcast(double* values, size_t n)
+{
+}
+
+void rank_share(int group, void** data, size_t* size)
+{
+}
+
+void* rank_shared(size_t size)
+{
+    return NULL;
+}
+
+void rank_shared_free(void* ptr)
+{
+}
+
+#endif
@@ -0,0 +1,35 @@
+#pragma once
+
+// initialise MPI if built with support for it, before MultiNest is called
+void rank_init(int* argc, char*** argv);
+
+// finalise MPI if it was initialised
+void rank_finalize();
+
+// check if MPI was initialised by Lensed
+int rank_mpi();
+
+// rank of this process and number of processes in the job
+int rank_world();
+int rank_world_size();
+
+// rank of this process and number of processes on the node
+int rank_node();
+int rank_node_size();
+
+// sum counters of all processes into the counters of the first process
+void rank_sum(unsigned long long* values, size_t n);
+
+// broadcast values of the first process to all processes in the job
+void rank_bcast(double* values, size_t n);
+
+// share data of the first process in group with all processes on the node
+// that are in the same group; the received data must be freed
+void rank_share(int group, void** data, size_t* size);
+
+// allocate zeroed memory that is shared by all processes on the node, which is
+// owned by the first process; returns NULL without MPI
+void* rank_shared(size_t size);
+
+// free shared memory, which all processes on the node must call
+void rank_shared_free(void* ptr);
@@ -0,0 +1,568 @@
+#include <stdlib.h>
+#include <float.h>
+#include <math.h>
+
+#include "opencl.h"
+#include "input.h"
+#include "profile.h"
+#include "lensed.h"
+#include "voronoi.h"
+#include "log.h"
+
+// maximum number of pixels in a cell
+#define VORONOI_MAX_PIXELS 64
+
+// size of the buckets for the search of the nearest cell, in pixels
+#define VORONOI_BUCKET 8
+
+// number of buckets around a pixel that are searched in each direction
+#define VORONOI_REACH 2
+
+// pixel is not in a cell
+#define VORONOI_NONE ((size_t)-1)
+
+// type of pixels
+enum { VORONOI_MASKED, VORONOI_BRIGHT, VORONOI_FAINT };
+
+// compare floats for sorting
+static int compare_float(const void* a, const void* b)
+{
+    float x = *(const float*)a;
+    float y = *(const float*)b;
+    return (x > y) - (x < y);
+}
+
+// median of unmasked pixels, as an estimate of the background
+static double background(size_t size, const cl_float* image, const cl_float* weight)
+{
+    float* values;
+    size_t n;
+    double med;
+    
+    values = malloc(size*sizeof(float));
+    if(!values)
+        errori(NULL);
+    
+    n = 0;
+    for(size_t k = 0; k < size; ++k)
+        if(weight[k] > 0)
+            values[n++] = image[k];
+    
+    if(n > 0)
+    {
+        qsort(values, n, sizeof(float), compare_float);
+        med = values[n/2];
+    }
+    else
+    {
+        med = 0;
+    }
+    
+    free(values);
+    
+    return med;
+}
+
+struct cells* voronoi_cells(size_t width, size_t height, const cl_float* image,
+                            const cl_float* weight, double target)
+{
+    size_t size = width*height;
+    struct cells* cells;
+    
+    double bg;
+    char* type;
+    size_t* cell;
+    size_t* remap;
+    size_t* count;
+    size_t members[VORONOI_MAX_PIXELS];
+    double* cx;
+    double* cy;
+    size_t nc, nf, nb;
+    
+    // buckets of cells
+    size_t bw, bh;
+    size_t* head;
+    size_t* next;
+    
+    // signal is measured above the background
+    bg = background(size, image, weight);
+    
+    // classify pixels by their signal-to-noise ratio
+    type = malloc(size);
+    cell = malloc(size*sizeof(size_t));
+    if(!type || !cell)
+        errori(NULL);
+    nb = 0;
+    for(size_t k = 0; k < size; ++k)
+    {
+        if(!(weight[k] > 0))
+            type[k] = VORONOI_MASKED;
+        else if((image[k] - bg)*sqrt(weight[k]) >= target)
+            type[k] = VORONOI_BRIGHT;
+        else
+            type[k] = VORONOI_FAINT;
+        
+        if(type[k] == VORONOI_BRIGHT)
+            nb += 1;
+        
+        cell[k] = VORONOI_NONE;
+    }
+    
+    // bin accretion: grow cells of faint pixels from seeds in row order,
+    // adding the neighbouring faint pixel that is closest to the centroid of
+    // the cell until the cell reaches the target or its maximum size
+    nc = 0;
+    for(size_t seed = 0; seed < size; ++seed)
+    {
+        double sum, var, sx, sy;
+        size_t n;
+        
+        if(type[seed] != VORONOI_FAINT || cell[seed] != VORONOI_NONE)
+            continue;
+        
+        n = 0;
+        members[n++] = seed;
+        cell[seed] = nc;
+        sum = image[seed] - bg;
+        var = 1/weight[seed];
+        sx = seed%width;
+        sy = seed/width;
+        
+        while(sum/sqrt(var) < target && n < VORONOI_MAX_PIXELS)
+        {
+            size_t best = VORONOI_NONE;
+            double dbest = DBL_MAX;
+            
+            for(size_t m = 0; m < n; ++m)
+            {
+                size_t i = members[m]%width;
+                size_t j = members[m]/width;
+                size_t nbrs[4];
+                int nn = 0;
+                
+                if(i > 0)
+                    nbrs[nn++] = members[m] - 1;
+                if(i + 1 < width)
+                    nbrs[nn++] = members[m] + 1;
+                if(j > 0)
+                    nbrs[nn++] = members[m] - width;
+                if(j + 1 < height)
+                    nbrs[nn++] = members[m] + width;
+                
+                for(int t = 0; t < nn; ++t)
+                {
+                    size_t k = nbrs[t];
+                    double dx, dy;
+                    
+                    if(type[k] != VORONOI_FAINT || cell[k] != VORONOI_NONE)
+                        continue;
+                    
+                    dx = (double)(k%width) - sx/n;
+                    dy = (double)(k/width) - sy/n;
+                    if(dx*dx + dy*dy < dbest)
+                    {
+                        best = k;
+                        dbest = dx*dx + dy*dy;
+                    }
+                }
+            }
+            
+            // cell is enclosed
+            if(best == VORONOI_NONE)
+                break;
+            
+            members[n++] = best;
+            cell[best] = nc;
+            sum += image[best] - bg;
+            var += 1/weight[best];
+            sx += best%width;
+            sy += best/width;
+        }
+        
+        nc += 1;
+    }
+    
+    // centroids of cells
+    cx = calloc(nc, sizeof(double));
+    cy = calloc(nc, sizeof(double));
+    count = calloc(nc, sizeof(size_t));
+    if(nc && (!cx || !cy || !count))
+        errori(NULL);
+    for(size_t k = 0; k < size; ++k)
+    {
+        if(cell[k] != VORONOI_NONE)
+        {
+            cx[cell[k]] += k%width;
+            cy[cell[k]] += k/width;
+            count[cell[k]] += 1;
+        }
+    }
+    for(size_t c = 0; c < nc; ++c)
+    {
+        cx[c] /= count[c];
+        cy[c] /= count[c];
+    }
+    
+    // sort cells into buckets by their centroids
+    bw = (width + VORONOI_BUCKET - 1)/VORONOI_BUCKET;
+    bh = (height + VORONOI_BUCKET - 1)/VORONOI_BUCKET;
+    head = malloc(bw*bh*sizeof(size_t));
+    next = malloc((nc ? nc : 1)*sizeof(size_t));
+    if(!head || !next)
+        errori(NULL);
+    for(size_t b = 0; b < bw*bh; ++b)
+        head[b] = VORONOI_NONE;
+    for(size_t c = 0; c < nc; ++c)
+    {
+        size_t b = (size_t)(cy[c]/VORONOI_BUCKET)*bw + (size_t)(cx[c]/VORONOI_BUCKET);
+        next[c] = head[b];
+        head[b] = c;
+    }
+    
+    // Voronoi tessellation: assign each faint pixel to the cell with the
+    // nearest centroid, which makes the cells compact
+    remap = malloc(size*sizeof(size_t));
+    if(!remap)
+        errori(NULL);
+    for(size_t k = 0; k < size; ++k)
+    {
+        size_t i = k%width, j = k/width;
+        size_t bi = i/VORONOI_BUCKET, bj = j/VORONOI_BUCKET;
+        size_t best = cell[k];
+        double dbest;
+        
+        remap[k] = best;
+        if(best == VORONOI_NONE)
+            continue;
+        
+        dbest = (i - cx[best])*(i - cx[best]) + (j - cy[best])*(j - cy[best]);
+        
+        for(size_t v = bj > VORONOI_REACH ? bj - VORONOI_REACH : 0; v < bh && v <= bj + VORONOI_REACH; ++v)
+        {
+            for(size_t u = bi > VORONOI_REACH ? bi - VORONOI_REACH : 0; u < bw && u <= bi + VORONOI_REACH; ++u)
+            {
+                for(size_t c = head[v*bw + u]; c != VORONOI_NONE; c = next[c])
+                {
+                    double d = (i - cx[c])*(i - cx[c]) + (j - cy[c])*(j - cy[c]);
+                    if(d < dbest)
+                    {
+                        best = c;
+                        dbest = d;
+                    }
+                }
+            }
+        }
+        
+        remap[k] = best;
+    }
+    free(head);
+    free(next);
+    
+    // number the cells that kept pixels, followed by one cell for every
+    // bright pixel
+    for(size_t c = 0; c < nc; ++c)
+        count[c] = 0;
+    for(size_t k = 0; k < size; ++k)
+        if(remap[k] != VORONOI_NONE)
+            count[remap[k]] += 1;
+    nf = 0;
+    for(size_t c = 0; c < nc; ++c)
+        count[c] = count[c] ? nf++ : VORONOI_NONE;
+    for(size_t k = 0; k < size; ++k)
+    {
+        if(remap[k] != VORONOI_NONE)
+            cell[k] = count[remap[k]];
+        else if(type[k] == VORONOI_BRIGHT)
+            cell[k] = nf++;
+        else
+            cell[k] = VORONOI_NONE;
+    }
+    free(remap);
+    free(count);
+    
+    // create cells
+    cells = malloc(sizeof(struct cells));
+    if(!cells)
+        errori(NULL);
+    
+    cells->ncells = nf;
+    cells->rep = malloc(size*sizeof(cl_uint));
+    cells->start = calloc(nf + 1, sizeof(cl_uint));
+    cells->image = calloc(nf ? nf : 1, sizeof(cl_float));
+    cells->weight = calloc(nf ? nf : 1, sizeof(cl_float));
+    if(!cells->rep || !cells->start || !cells->image || !cells->weight)
+        errori(NULL);
+    
+    // pixels of cells, starting at the running count of pixels
+    for(size_t k = 0; k < size; ++k)
+        if(cell[k] != VORONOI_NONE)
+            cells->start[cell[k] + 1] += 1;
+    for(size_t c = 0; c < nf; ++c)
+        cells->start[c + 1] += cells->start[c];
+    cells->pixels = malloc((cells->start[nf] ? cells->start[nf] : 1)*sizeof(cl_uint));
+    if(!cells->pixels)
+        errori(NULL);
+    {
+        cl_uint* pos = malloc((nf ? nf : 1)*sizeof(cl_uint));
+        if(!pos)
+            errori(NULL);
+        for(size_t c = 0; c < nf; ++c)
+            pos[c] = cells->start[c];
+        for(size_t k = 0; k < size; ++k)
+            if(cell[k] != VORONOI_NONE)
+                cells->pixels[pos[cell[k]]++] = k;
+        free(pos);
+    }
+    
+    // summed data and inverse summed variance of cells, and the pixel that
+    // is closest to the centroid of the cell represents it
+    for(size_t c = 0; c < nf; ++c)
+    {
+        double sum = 0, var = 0, sx = 0, sy = 0;
+        size_t n = cells->start[c + 1] - cells->start[c];
+        size_t rep = cells->pixels[cells->start[c]];
+        double drep = DBL_MAX;
+        
+        for(size_t p = cells->start[c]; p < cells->start[c + 1]; ++p)
+        {
+            size_t k = cells->pixels[p];
+            sum += image[k];
+            var += 1/weight[k];
+            sx += k%width;
+            sy += k/width;
+        }
+        
+        for(size_t p = cells->start[c]; p < cells->start[c + 1]; ++p)
+        {
+            size_t k = cells->pixels[p];
+            double dx = (double)(k%width) - sx/n;
+            double dy = (double)(k/width) - sy/n;
+            if(dx*dx + dy*dy < drep)
+            {
+                rep = k;
+                drep = dx*dx + dy*dy;
+            }
+        }
+        
+        cells->image[c] = sum;
+        cells->weight[c] = 1/var;
+        
+        for(size_t p = cells->start[c]; p < cells->start[c + 1]; ++p)
+            cells->rep[cells->pixels[p]] = rep;
+    }
+    
+    // masked pixels are computed themselves, as the PSF spreads them
+    for(size_t k = 0; k < size; ++k)
+        if(cell[k] == VORONOI_NONE)
+            cells->rep[k] = k;
+    
+    // list of pixels that are computed
+    cells->nreps = 0;
+    for(size_t k = 0; k < size; ++k)
+        if(cells->rep[k] == k)
+            cells->nreps += 1;
+    cells->reps = malloc(cells->nreps*sizeof(cl_uint));
+    if(!cells->reps)
+        errori(NULL);
+    cells->nreps = 0;
+    for(size_t k = 0; k < size; ++k)
+        if(cells->rep[k] == k)
+            cells->reps[cells->nreps++] = k;
+    
+    // no device objects yet
+    cells->rep_mem = NULL;
+    cells->reps_mem = NULL;
+    cells->start_mem = NULL;
+    cells->pixels_mem = NULL;
+    cells->image_mem = NULL;
+    cells->weight_mem = NULL;
+    cells->loglike_mem = NULL;
+    cells->render = NULL;
+    cells->fill = NULL;
+    cells->loglike = NULL;
+    
+    free(type);
+    free(cell);
+    free(cx);
+    free(cy);
+    
+    return cells;
+}
+
+void voronoi_create(struct lensed* lensed, cl_context context,
+                    cl_program program, cl_float4 pcs, cl_ulong dsiz)
+{
+    struct cells* cells = lensed->cells;
+    struct shard* shard = lensed->shards;
+    
+    cl_int err;
+    cl_ulong ncells = cells->ncells;
+    cl_ulong nreps = cells->nreps;
+    size_t npix = cells->start[cells->ncells];
+    size_t wgs;
+    
+    verbose("    buffers");
+    
+    cells->rep_mem = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR | CL_MEM_HOST_NO_ACCESS, lensed->size*sizeof(cl_uint), cells->rep, NULL);
+    cells->reps_mem = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR | CL_MEM_HOST_NO_ACCESS, nreps*sizeof(cl_uint), cells->reps, NULL);
+    cells->start_mem = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR | CL_MEM_HOST_NO_ACCESS, (ncells + 1)*sizeof(cl_uint), cells->start, NULL);
+    cells->pixels_mem = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR | CL_MEM_HOST_NO_ACCESS, (npix ? npix : 1)*sizeof(cl_uint), cells->pixels, NULL);
+    cells->image_mem = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR | CL_MEM_HOST_NO_ACCESS, (ncells ? ncells : 1)*sizeof(cl_float), cells->image, NULL);
+    cells->weight_mem = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR | CL_MEM_HOST_NO_ACCESS, (ncells ? ncells : 1)*sizeof(cl_float), cells->weight, NULL);
+    cells->loglike_mem = clCreateBuffer(context, CL_MEM_WRITE_ONLY | CL_MEM_ALLOC_HOST_PTR | CL_MEM_HOST_READ_ONLY, (ncells ? ncells : 1)*sizeof(cl_float), NULL, NULL);
+    if(!cells->rep_mem || !cells->reps_mem || !cells->start_mem || !cells->pixels_mem || !cells->image_mem || !cells->weight_mem || !cells->loglike_mem)
+        error("failed to create cell buffers");
+    
+    verbose("    kernels");
+    
+    cells->render = clCreateKernel(program, "render_cells", &err);
+    if(err != CL_SUCCESS)
+        error("failed to create cell render kernel");
+    
+    cells->fill = clCreateKernel(program, "fill_cells", &err);
+    if(err != CL_SUCCESS)
+        error("failed to create cell fill kernel");
+    
+    cells->loglike = clCreateKernel(program, "loglike_cells", &err);
+    if(err != CL_SUCCESS)
+        error("failed to create cell loglike kernel");
+    
+    verbose("    arguments");
+    
+    // set kernel arguments, the cells are computed on the first shard
+    err = 0;
+    err |= clSetKernelArg(cells->render, 0, sizeof(cl_ulong), &dsiz);
+    err |= clSetKernelArg(cells->render, 1, sizeof(cl_mem), &shard->object_mem);
+    err |= clSetKernelArg(cells->render, 2, dsiz*sizeof(cl_uint), NULL);
+    err |= clSetKernelArg(cells->render, 3, sizeof(cl_mem), lensed->field ? &lensed->field->mem : NULL);
+    err |= clSetKernelArg(cells->render, 4, sizeof(cl_float4), &pcs);
+    err |= clSetKernelArg(cells->render, 5, sizeof(cl_mem), &shard->qq_mem);
+    err |= clSetKernelArg(cells->render, 6, sizeof(cl_mem), &shard->ww_mem);
+    err |= clSetKernelArg(cells->render, 7, sizeof(cl_ulong), &nreps);
+    err |= clSetKernelArg(cells->render, 8, sizeof(cl_mem), &cells->reps_mem);
+    err |= clSetKernelArg(cells->render, 9, sizeof(cl_mem), &shard->value_mem);
+    err |= clSetKernelArg(cells->fill, 0, sizeof(cl_mem), &cells->rep_mem);
+    err |= clSetKernelArg(cells->fill, 1, sizeof(cl_mem), &shard->value_mem);
+    err |= clSetKernelArg(cells->loglike, 0, sizeof(cl_ulong), &ncells);
+    err |= clSetKernelArg(cells->loglike, 1, sizeof(cl_mem), &cells->start_mem);
+    err |= clSetKernelArg(cells->loglike, 2, sizeof(cl_mem), &cells->pixels_mem);
+    err |= clSetKernelArg(cells->loglike, 3, sizeof(cl_mem), &cells->image_mem);
+    err |= clSetKernelArg(cells->loglike, 4, sizeof(cl_mem), &cells->weight_mem);
+    err |= clSetKernelArg(cells->loglike, 5, sizeof(cl_mem), shard->convolve ? &shard->convolve_mem : &shard->value_mem);
+    err |= clSetKernelArg(cells->loglike, 6, sizeof(cl_mem), &cells->loglike_mem);
+    if(err != CL_SUCCESS)
+        error("failed to set cell kernel arguments");
+    
+    // host arrays are on the device now
+    free(cells->rep);
+    free(cells->reps);
+    free(cells->start);
+    free(cells->pixels);
+    free(cells->image);
+    free(cells->weight);
+    cells->rep = NULL;
+    cells->reps = NULL;
+    cells->start = NULL;
+    cells->pixels = NULL;
+    cells->image = NULL;
+    cells->weight = NULL;
+    
+    verbose("    work size");
+    
+    // render kernel uses work groups of the size of the render kernel, as
+    // far as the device allows
+    err = clGetKernelWorkGroupInfo(cells->render, shard->device_id, CL_KERNEL_WORK_GROUP_SIZE, sizeof(wgs), &wgs, NULL);
+    if(err != CL_SUCCESS)
+        error("failed to get cell render kernel work group size");
+    cells->render_lws[0] = shard->render_lws[0]*shard->render_lws[1];
+    if(cells->render_lws[0] > wgs)
+        cells->render_lws[0] = wgs;
+    cells->render_gws[0] = nreps + (cells->render_lws[0] - nreps%cells->render_lws[0])%cells->render_lws[0];
+    
+    // the other kernels are simple, and the implementation chooses the work
+    // groups
+    cells->fill_gws[0] = lensed->size;
+    cells->loglike_gws[0] = ncells;
+    
+    verbose("      local:  %zu", cells->render_lws[0]);
+    verbose("      global: %zu", cells->render_gws[0]);
+}
+
+double voronoi_chi2(const struct lensed* lensed, cl_event* render_ev,
+                    cl_event* fill_ev, cl_event* convolve_ev,
+                    cl_event* loglike_ev)
+{
+    const struct cells* cells = lensed->cells;
+    struct shard* shard = lensed->shards;
+    
+    cl_int err;
+    cl_float* loglike;
+    double chi2 = 0;
+    
+    // compute representative pixels
+    err = clEnqueueNDRangeKernel(shard->queue, cells->render, 1, NULL, cells->render_gws, cells->render_lws, 0, NULL, render_ev);
+    if(err != CL_SUCCESS)
+        error("failed to run cell render kernel");
+    
+    // copy them to the pixels of their cells
+    err = clEnqueueNDRangeKernel(shard->queue, cells->fill, 1, NULL, cells->fill_gws, NULL, 0, NULL, fill_ev);
+    if(err != CL_SUCCESS)
+        error("failed to run cell fill kernel");
+    
+    // convolve with PSF if given
+    if(shard->convolve)
+    {
+        err = clEnqueueNDRangeKernel(shard->queue, shard->convolve, 2, shard->convolve_off, shard->convolve_gws, shard->convolve_lws, 0, NULL, convolve_ev);
+        if(err != CL_SUCCESS)
+            error("failed to run convolve kernel");
+    }
+    
+    // compare cells with binned data
+    if(cells->ncells > 0)
+    {
+        err = clEnqueueNDRangeKernel(shard->queue, cells->loglike, 1, NULL, cells->loglike_gws, NULL, 0, NULL, loglike_ev);
+        if(err != CL_SUCCESS)
+            error("failed to run cell loglike kernel");
+        
+        // map chi^2 values from device
+        loglike = clEnqueueMapBuffer(shard->queue, cells->loglike_mem, CL_TRUE, CL_MAP_READ, 0, cells->ncells*sizeof(cl_float), 0, NULL, NULL, &err);
+        if(err != CL_SUCCESS)
+            error("failed to map cell loglike buffer");
+        
+        // sum chi^2 values
+        for(size_t c = 0; c < cells->ncells; ++c)
+            chi2 += loglike[c];
+        
+        clEnqueueUnmapMemObject(shard->queue, cells->loglike_mem, loglike, 0, NULL, NULL);
+    }
+    
+    return chi2;
+}
+
+void voronoi_free(struct cells* cells)
+{
+    // host arrays, if not yet on the device
+    free(cells->rep);
+    free(cells->reps);
+    free(cells->start);
+    free(cells->pixels);
+    free(cells->image);
+    free(cells->weight);
+    
+    // device objects, if created
+    if(cells->render)
+    {
+        clReleaseKernel(cells->render);
+        clReleaseKernel(cells->fill);
+        clReleaseKernel(cells->loglike);
+        clReleaseMemObject(cells->rep_mem);
+        clReleaseMemObject(cells->reps_mem);
+        clReleaseMemObject(cells->start_mem);
+        clReleaseMemObject(cells->pixels_mem);
+        clReleaseMemObject(cells->image_mem);
+        clReleaseMemObject(cells->weight_mem);
+        clReleaseMemObject(cells->loglike_mem);
+    }
+    
+    free(cells);
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+// bin the pixels whose signal-to-noise ratio is below the target into cells,
+// by bin accretion followed by a Voronoi tessellation of the cell centroids;
+// all other pixels are cells of their own
+struct cells* voronoi_cells(size_t width, size_t height, const cl_float* image,
+                            const cl_float* weight, double target);
+
+// create the buffers and kernels of the cells on the first shard
+void voronoi_create(struct lensed* lensed, cl_context context,
+                    cl_program program, cl_float4 pcs, cl_ulong dsiz);
+
+// compute the chi^2 value of the cells for the parameters of the first shard,
+// which must be set
+double voronoi_chi2(const struct lensed* lensed, cl_event* render_ev,
+                    cl_event* fill_ev, cl_event* convolve_ev,
+                    cl_event* loglike_ev);
+
+// free cells
+void voronoi_free(struct cells* cells);